@@ -388,10 +388,266 @@ static Mutex s_paramMutex(true,"ChannelParams");
 // Mutex used to protect channel data
 Mutex Channel::s_chanDataMutex(false,"ChannelData");
 
+// Channel timer wheel resolution in microseconds
+#define WHEEL_TICK 10000
+// Bits used by the first level of the wheel and by each upper level
+#define WHEEL_BITS0 8
+#define WHEEL_BITSN 6
+#define WHEEL_SLOTS0 (1 << WHEEL_BITS0)
+#define WHEEL_SLOTSN (1 << WHEEL_BITSN)
+#define WHEEL_LEVELS 3
+// Maximum number of ticks an entry can be scheduled ahead (about 7.7 days)
+#define WHEEL_SPAN ((u_int64_t)1 << (WHEEL_BITS0 + WHEEL_LEVELS * WHEEL_BITSN))
+
+namespace TelEngine {
+
+// Hierarchical timing wheel holding the channels waiting for their timers
+class ChannelTimers : public Mutex
+{
+public:
+    ChannelTimers();
+    void arm(Channel* chan, u_int64_t when);
+    void disarm(Channel* chan);
+    void expire(Channel* chan, Message& msg, const Time& now);
+    void run();
+private:
+    void add(Channel* chan);
+    void unlink(Channel* chan);
+    void rebase(u_int64_t tick);
+    bool cascade(int level, unsigned int index);
+    void advance(u_int64_t tick, ObjList& expired);
+    Channel* m_level0[WHEEL_SLOTS0];
+    Channel* m_levels[WHEEL_LEVELS][WHEEL_SLOTSN];
+    u_int64_t m_tick;
+    unsigned int m_count;
+    Semaphore m_wake;
+    bool m_thread;
+};
+
+// Thread that advances the channel timer wheel
+class ChannelTimersThread : public Thread
+{
+public:
+    inline ChannelTimersThread()
+	: Thread("Channel Timers")
+	{ }
+    virtual void run();
+};
+
+};
+
+static ChannelTimers s_timers;
+
+ChannelTimers::ChannelTimers()
+    : Mutex(false,"ChannelTimers"),
+      m_tick(0), m_count(0), m_wake(1,"ChannelTimers",0), m_thread(false)
+{
+    ::memset(m_level0,0,sizeof(m_level0));
+    ::memset(m_levels,0,sizeof(m_levels));
+}
+
+// Insert a channel in the slot matching its expiration tick
+void ChannelTimers::add(Channel* chan)
+{
+    u_int64_t tick = chan->m_timerWhen / WHEEL_TICK + 1;
+    if (tick < m_tick)
+	tick = m_tick;
+    u_int64_t delta = tick - m_tick;
+    if (delta >= WHEEL_SPAN) {
+	tick = m_tick + WHEEL_SPAN - 1;
+	delta = WHEEL_SPAN - 1;
+    }
+    Channel** slot = 0;
+    if (delta < WHEEL_SLOTS0)
+	slot = &m_level0[tick & (WHEEL_SLOTS0 - 1)];
+    else {
+	int level = 0;
+	while (delta >= ((u_int64_t)1 << (WHEEL_BITS0 + (level + 1) * WHEEL_BITSN)))
+	    level++;
+	slot = &m_levels[level][(tick >> (WHEEL_BITS0 + level * WHEEL_BITSN)) & (WHEEL_SLOTSN - 1)];
+    }
+    chan->m_timerPrev = slot;
+    chan->m_timerNext = *slot;
+    if (*slot)
+	(*slot)->m_timerPrev = &chan->m_timerNext;
+    *slot = chan;
+}
+
+// Remove a channel from the slot holding it
+void ChannelTimers::unlink(Channel* chan)
+{
+    *chan->m_timerPrev = chan->m_timerNext;
+    if (chan->m_timerNext)
+	chan->m_timerNext->m_timerPrev = chan->m_timerPrev;
+    chan->m_timerNext = 0;
+    chan->m_timerPrev = 0;
+}
+
+void ChannelTimers::arm(Channel* chan, u_int64_t when)
+{
+    if (!when)
+	return;
+    Lock mylock(this);
+    if (chan->m_timerWhen) {
+	if (chan->m_timerWhen <= when)
+	    return;
+	unlink(chan);
+    }
+    else {
+	// an empty wheel simply restarts from current time
+	if (!m_count)
+	    m_tick = Time::now() / WHEEL_TICK;
+	m_count++;
+    }
+    chan->m_timerWhen = when;
+    add(chan);
+    if (!m_thread) {
+	ChannelTimersThread* th = new ChannelTimersThread;
+	m_thread = th->startup();
+	if (!m_thread)
+	    Debug(DebugGoOn,"Failed to start channel timers thread!");
+    }
+    else if (m_count == 1)
+	m_wake.unlock();
+}
+
+void ChannelTimers::disarm(Channel* chan)
+{
+    Lock mylock(this);
+    if (!chan->m_timerWhen)
+	return;
+    unlink(chan);
+    chan->m_timerWhen = 0;
+    m_count--;
+}
+
+// Move the wheel to a far away tick and insert again all the channels
+void ChannelTimers::rebase(u_int64_t tick)
+{
+    Debug(DebugNote,"Channel timers jumping " FMT64 " ticks with %u channels",
+	(int64_t)(tick - m_tick),m_count);
+    Channel* list = 0;
+    for (int l = -1; l < WHEEL_LEVELS; l++) {
+	Channel** slots = (l < 0) ? m_level0 : m_levels[l];
+	unsigned int n = (l < 0) ? WHEEL_SLOTS0 : WHEEL_SLOTSN;
+	for (unsigned int i = 0; i < n; i++) {
+	    while (Channel* c = slots[i]) {
+		slots[i] = c->m_timerNext;
+		c->m_timerNext = list;
+		list = c;
+	    }
+	}
+    }
+    m_tick = tick;
+    while (list) {
+	Channel* next = list->m_timerNext;
+	add(list);
+	list = next;
+    }
+}
+
+// Move the entries of an upper level slot to lower levels
+// Return true if the next upper level needs to cascade too
+bool ChannelTimers::cascade(int level, unsigned int index)
+{
+    Channel* c = m_levels[level][index];
+    m_levels[level][index] = 0;
+    while (c) {
+	Channel* next = c->m_timerNext;
+	add(c);
+	c = next;
+    }
+    return !index;
+}
+
+// Advance the wheel up to a tick, collect referenced expired channels
+void ChannelTimers::advance(u_int64_t tick, ObjList& expired)
+{
+    ObjList* last = &expired;
+    while (m_tick <= tick) {
+	unsigned int index = (unsigned int)(m_tick & (WHEEL_SLOTS0 - 1));
+	if (!index) {
+	    for (int l = 0; l < WHEEL_LEVELS; l++) {
+		unsigned int idx = (unsigned int)((m_tick >> (WHEEL_BITS0 + l * WHEEL_BITSN)) & (WHEEL_SLOTSN - 1));
+		if (!cascade(l,idx))
+		    break;
+	    }
+	}
+	Channel* c = m_level0[index];
+	m_level0[index] = 0;
+	m_tick++;
+	while (c) {
+	    Channel* next = c->m_timerNext;
+	    c->m_timerNext = 0;
+	    c->m_timerPrev = 0;
+	    c->m_timerWhen = 0;
+	    m_count--;
+	    // a channel that is being destroyed will disarm itself
+	    if (c->ref())
+		last = last->append(c);
+	    c = next;
+	}
+    }
+}
+
+// Check the timers of an expired channel and arm again the pending ones
+void ChannelTimers::expire(Channel* chan, Message& msg, const Time& now)
+{
+    Driver* drv = chan->driver();
+    if (drv && !drv->m_doExpire) {
+	// expiration disabled in driver, retry later
+	arm(chan,now + 1000000);
+	return;
+    }
+    chan->checkTimers(msg,now);
+    arm(chan,chan->m_timeout);
+    arm(chan,chan->m_maxcall);
+    arm(chan,chan->m_maxPDD);
+}
+
+void ChannelTimers::run()
+{
+    while (!Thread::check(false)) {
+	lock();
+	bool idle = !m_count;
+	unlock();
+	if (idle) {
+	    // timed semaphore waits may be busy loops on some platforms
+	    if (Semaphore::efficientTimedLock())
+		m_wake.lock(500000);
+	    else
+		Thread::idle();
+	    continue;
+	}
+	Thread::usleep(WHEEL_TICK);
+	ObjList expired;
+	Time now;
+	lock();
+	u_int64_t tick = now.usec() / WHEEL_TICK;
+	// system clock changed or we were stalled for too long
+	if ((tick + WHEEL_SLOTS0 < m_tick) || (tick >= m_tick + WHEEL_SLOTS0 * WHEEL_SLOTSN))
+	    rebase(tick);
+	advance(tick,expired);
+	unlock();
+	if (!expired.skipNull())
+	    continue;
+	Message msg("engine.timer",0,true);
+	msg.addParam("time",String(now.sec()));
+	for (ObjList* l = expired.skipNull(); l; l = l->skipNext())
+	    expire(static_cast<Channel*>(l->get()),msg,now);
+    }
+}
+
+void ChannelTimersThread::run()
+{
+    s_timers.run();
+}
+
 Channel::Channel(Driver* driver, const char* id, bool outgoing)
     : CallEndpoint(id),
       m_parameters(""), m_chanParams(0), m_driver(driver), m_outgoing(outgoing),
-      m_timeout(0), m_maxcall(0), m_maxPDD(0), m_dtmfTime(0),
+      m_timeout(0), m_maxcall(0), m_maxPDD(0),
+      m_timerWhen(0), m_timerNext(0), m_timerPrev(0), m_dtmfTime(0),
       m_toutAns(0), m_dtmfSeq(0), m_answered(false)
 {
     init();
@@ -400,7 +656,8 @@ Channel::Channel(Driver* driver, const char* id, bool outgoing)
 Channel::Channel(Driver& driver, const char* id, bool outgoing)
     : CallEndpoint(id),
       m_parameters(""), m_chanParams(0), m_driver(&driver), m_outgoing(outgoing),
-      m_timeout(0), m_maxcall(0), m_maxPDD(0), m_dtmfTime(0),
+      m_timeout(0), m_maxcall(0), m_maxPDD(0),
+      m_timerWhen(0), m_timerNext(0), m_timerPrev(0), m_dtmfTime(0),
       m_toutAns(0), m_dtmfSeq(0), m_answered(false)
 {
     init();
@@ -455,6 +712,8 @@ void Channel::cleanup()
     m_timeout = 0;
     m_maxcall = 0;
     m_maxPDD = 0;
+    if (m_timerWhen)
+	s_timers.disarm(this);
     status("deleted");
     m_targetid.clear();
     dropChan();
@@ -487,6 +746,7 @@ void Channel::initChan()
     m_driver->m_total++;
     m_driver->m_chanCount++;
     m_driver->channels().append(this);
+    m_driver->m_chanIndex.append(this)->setDelete(false);
     m_driver->changed();
 }
 
@@ -497,7 +757,11 @@ void Channel::dropChan()
     m_driver->lock();
     if (!m_driver)
 	TraceDebug(traceId(),DebugFail,"Driver lost in dropChan! [%p]",this);
-    if (m_driver->channels().remove(this,false)) {
+    bool listed = (0 != m_driver->channels().remove(this,false));
+    // the channels list may have been cleared, always try the index
+    if (!m_driver->m_chanIndex.remove(this,id().hash(),false) && listed)
+	m_driver->m_chanIndex.remove(this,false);
+    if (listed) {
 	if (m_driver->m_chanCount > 0)
 	    m_driver->m_chanCount--;
 	m_driver->changed();
@@ -564,7 +828,12 @@ void Channel::dispatched(const Message& msg, bool handled)
 void Channel::setId(const char* newId)
 {
     debugName(0);
+    Lock lck(m_driver);
     CallEndpoint::setId(newId);
+    // keep the driver's channel index up to date
+    if (m_driver)
+	m_driver->m_chanIndex.resync(this);
+    lck.drop();
     debugName(id());
 }
 
@@ -870,6 +1139,11 @@ void Channel::statusParams(String& str)
     }
 }
 
+void Channel::armTimer(u_int64_t when)
+{
+    s_timers.arm(this,when);
+}
+
 void Channel::checkTimers(Message& msg, const Time& tmr)
 {
     if (timeout() && (timeout() < tmr))
@@ -1373,7 +1647,7 @@ bool Module::filterDebug(const String& item) const
 
 Driver::Driver(const char* name, const char* type)
     : Module(name,type),
-      m_init(false), m_varchan(true),
+      m_init(false), m_varchan(true), m_chanIndex(1024),
       m_routing(0), m_routed(0), m_total(0),
       m_nextid(0), m_timeout(0),
       m_maxroute(0), m_maxchans(0), m_chanCount(0),
@@ -1426,8 +1700,7 @@ bool Driver::isBusy() const
 
 Channel* Driver::find(const String& id) const
 {
-    const ObjList* pos = m_chans.find(id);
-    return pos ? static_cast<Channel*>(pos->get()) : 0;
+    return static_cast<Channel*>(m_chanIndex[id]);
 }
 
 bool Driver::received(Message &msg, int id)
@@ -1438,26 +1711,7 @@ bool Driver::received(Message &msg, int id)
     String dest;
     switch (id) {
 	case Timer:
-	    if (m_doExpire && lock(950000)) {
-		if (m_doExpire) {
-		    m_doExpire = false;
-		    // check each channel for timeouts
-		    ListIterator iter(m_chans);
-		    Time t;
-		    for (;;) {
-			RefPointer<Channel> c = static_cast<Channel*>(iter.get());
-			unlock();
-			if (!c)
-			    break;
-			c->checkTimers(msg,t);
-			c = 0;
-			lock();
-		    }
-		    m_doExpire = true;
-		}
-		else
-		    unlock();
-	    }
+	    // channel timeouts are handled by the timer wheel
 	    return Module::received(msg,id);
 	case Status:
 	    // check if it's a channel status request
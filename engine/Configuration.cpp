@@ -143,8 +143,9 @@ void ConfigurationPrivate::processInclude(NamedList* sect, ObjList& stack, bool
 		if (!error) {
 		    XDebug(DebugAll,"Config '%s' including section '%s' in '%s'",
 			m_cfg.safe(),incSect->safe(),sect->safe());
-		    for (ObjList* p = incSect->paramList()->skipNull(); p; p = p->skipNext()) {
-			NamedString* ns = static_cast<NamedString*>(p->get());
+		    const NamedList& incList = *incSect;
+		    for (const ObjList* p = incList.paramList()->skipNull(); p; p = p->skipNext()) {
+			const NamedString* ns = static_cast<const NamedString*>(p->get());
 			o->insert(new NamedString(ns->name(),*ns));
 			// Update current element (replaced by insert)
 			o = o->next();
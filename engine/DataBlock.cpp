@@ -18,6 +18,7 @@
  */
 
 #include "yateclass.h"
+#include "simd.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -32,8 +33,9 @@ extern "C" {
 #include "u2a.h"
 #include "u2s.h"
 
-static unsigned char s2a[65536];
-static unsigned char s2u[65536];
+// padded so batch lookups can read a full dword at any index
+static unsigned char s2a[65536 + 4];
+static unsigned char s2u[65536 + 4];
 }
 
 class InitG711
@@ -73,6 +75,227 @@ public:
 
 static InitG711 s_initG711;
 
+// Batch converters, n is the number of samples
+typedef void (*G711DecodeFunc)(unsigned short* d, const unsigned char* s, unsigned int n);
+typedef void (*G711EncodeFunc)(unsigned char* d, const unsigned short* s, unsigned int n,
+    const unsigned char* table);
+
+// Convert through a 256 entry table, unrolled to help the pipeline
+static void decodeTable(unsigned short* d, const unsigned char* s, unsigned int n,
+    const unsigned short* table)
+{
+    for (; n >= 4; n -= 4, s += 4, d += 4) {
+	d[0] = table[s[0]];
+	d[1] = table[s[1]];
+	d[2] = table[s[2]];
+	d[3] = table[s[3]];
+    }
+    while (n--)
+	*d++ = table[*s++];
+}
+
+static void decodeAlawScalar(unsigned short* d, const unsigned char* s, unsigned int n)
+{
+    decodeTable(d,s,n,a2s);
+}
+
+static void decodeMulawScalar(unsigned short* d, const unsigned char* s, unsigned int n)
+{
+    decodeTable(d,s,n,u2s);
+}
+
+// Convert through the 64k entry slin table
+static void encodeScalar(unsigned char* d, const unsigned short* s, unsigned int n,
+    const unsigned char* table)
+{
+    for (; n >= 4; n -= 4, s += 4, d += 4) {
+	d[0] = table[s[0]];
+	d[1] = table[s[1]];
+	d[2] = table[s[2]];
+	d[3] = table[s[3]];
+    }
+    while (n--)
+	*d++ = table[*s++];
+}
+
+#ifdef YSIMD_X86
+// Shift each 16 bit lane left by the 3 bit amount in the matching lane
+__attribute__((target("sse2")))
+static inline __m128i shiftLanesSSE2(__m128i v, __m128i amount)
+{
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i two = _mm_set1_epi16(2);
+    const __m128i four = _mm_set1_epi16(4);
+    __m128i m = _mm_cmpeq_epi16(_mm_and_si128(amount,one),one);
+    v = _mm_or_si128(_mm_and_si128(m,_mm_slli_epi16(v,1)),_mm_andnot_si128(m,v));
+    m = _mm_cmpeq_epi16(_mm_and_si128(amount,two),two);
+    v = _mm_or_si128(_mm_and_si128(m,_mm_slli_epi16(v,2)),_mm_andnot_si128(m,v));
+    m = _mm_cmpeq_epi16(_mm_and_si128(amount,four),four);
+    return _mm_or_si128(_mm_and_si128(m,_mm_slli_epi16(v,4)),_mm_andnot_si128(m,v));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i shiftLanesAVX2(__m256i v, __m256i amount)
+{
+    const __m256i one = _mm256_set1_epi16(1);
+    const __m256i two = _mm256_set1_epi16(2);
+    const __m256i four = _mm256_set1_epi16(4);
+    __m256i m = _mm256_cmpeq_epi16(_mm256_and_si256(amount,one),one);
+    v = _mm256_blendv_epi8(v,_mm256_slli_epi16(v,1),m);
+    m = _mm256_cmpeq_epi16(_mm256_and_si256(amount,two),two);
+    v = _mm256_blendv_epi8(v,_mm256_slli_epi16(v,2),m);
+    m = _mm256_cmpeq_epi16(_mm256_and_si256(amount,four),four);
+    return _mm256_blendv_epi8(v,_mm256_slli_epi16(v,4),m);
+}
+
+// Decode 8 mu-law bytes already widened to 16 bit lanes (ITU-T G.711)
+__attribute__((target("sse2")))
+static inline __m128i mulawSSE2(__m128i x)
+{
+    const __m128i bias = _mm_set1_epi16(0x84);
+    x = _mm_xor_si128(x,_mm_set1_epi16(0xff));
+    __m128i e = _mm_and_si128(_mm_srli_epi16(x,4),_mm_set1_epi16(7));
+    __m128i t = _mm_add_epi16(_mm_slli_epi16(_mm_and_si128(x,_mm_set1_epi16(0x0f)),3),bias);
+    t = shiftLanesSSE2(t,e);
+    __m128i neg = _mm_cmpeq_epi16(_mm_and_si128(x,_mm_set1_epi16(0x80)),_mm_set1_epi16(0x80));
+    return _mm_or_si128(_mm_and_si128(neg,_mm_sub_epi16(bias,t)),
+	_mm_andnot_si128(neg,_mm_sub_epi16(t,bias)));
+}
+
+// Decode 8 A-law bytes already widened to 16 bit lanes (ITU-T G.711)
+__attribute__((target("sse2")))
+static inline __m128i alawSSE2(__m128i x)
+{
+    x = _mm_xor_si128(x,_mm_set1_epi16(0x55));
+    __m128i e = _mm_and_si128(_mm_srli_epi16(x,4),_mm_set1_epi16(7));
+    __m128i t = _mm_add_epi16(_mm_slli_epi16(_mm_and_si128(x,_mm_set1_epi16(0x0f)),4),_mm_set1_epi16(8));
+    // segments above 0 get the implicit leading bit and shift by segment - 1
+    t = _mm_add_epi16(t,_mm_andnot_si128(_mm_cmpeq_epi16(e,_mm_setzero_si128()),_mm_set1_epi16(0x100)));
+    e = _mm_subs_epu16(e,_mm_set1_epi16(1));
+    t = shiftLanesSSE2(t,e);
+    __m128i pos = _mm_cmpeq_epi16(_mm_and_si128(x,_mm_set1_epi16(0x80)),_mm_set1_epi16(0x80));
+    return _mm_or_si128(_mm_and_si128(pos,t),
+	_mm_andnot_si128(pos,_mm_sub_epi16(_mm_setzero_si128(),t)));
+}
+
+__attribute__((target("sse2")))
+static void decodeAlawSSE2(unsigned short* d, const unsigned char* s, unsigned int n)
+{
+    for (; n >= 8; n -= 8, s += 8, d += 8) {
+	__m128i x = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)s),_mm_setzero_si128());
+	_mm_storeu_si128((__m128i*)d,alawSSE2(x));
+    }
+    decodeTable(d,s,n,a2s);
+}
+
+__attribute__((target("sse2")))
+static void decodeMulawSSE2(unsigned short* d, const unsigned char* s, unsigned int n)
+{
+    for (; n >= 8; n -= 8, s += 8, d += 8) {
+	__m128i x = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)s),_mm_setzero_si128());
+	_mm_storeu_si128((__m128i*)d,mulawSSE2(x));
+    }
+    decodeTable(d,s,n,u2s);
+}
+
+// Same as the SSE2 versions on 16 lanes
+__attribute__((target("avx2")))
+static inline __m256i mulawAVX2(__m256i x)
+{
+    const __m256i bias = _mm256_set1_epi16(0x84);
+    x = _mm256_xor_si256(x,_mm256_set1_epi16(0xff));
+    __m256i e = _mm256_and_si256(_mm256_srli_epi16(x,4),_mm256_set1_epi16(7));
+    __m256i t = _mm256_add_epi16(_mm256_slli_epi16(_mm256_and_si256(x,_mm256_set1_epi16(0x0f)),3),bias);
+    t = shiftLanesAVX2(t,e);
+    __m256i neg = _mm256_cmpeq_epi16(_mm256_and_si256(x,_mm256_set1_epi16(0x80)),_mm256_set1_epi16(0x80));
+    return _mm256_or_si256(_mm256_and_si256(neg,_mm256_sub_epi16(bias,t)),
+	_mm256_andnot_si256(neg,_mm256_sub_epi16(t,bias)));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i alawAVX2(__m256i x)
+{
+    x = _mm256_xor_si256(x,_mm256_set1_epi16(0x55));
+    __m256i e = _mm256_and_si256(_mm256_srli_epi16(x,4),_mm256_set1_epi16(7));
+    __m256i t = _mm256_add_epi16(_mm256_slli_epi16(_mm256_and_si256(x,_mm256_set1_epi16(0x0f)),4),_mm256_set1_epi16(8));
+    t = _mm256_add_epi16(t,_mm256_andnot_si256(_mm256_cmpeq_epi16(e,_mm256_setzero_si256()),_mm256_set1_epi16(0x100)));
+    e = _mm256_subs_epu16(e,_mm256_set1_epi16(1));
+    t = shiftLanesAVX2(t,e);
+    __m256i pos = _mm256_cmpeq_epi16(_mm256_and_si256(x,_mm256_set1_epi16(0x80)),_mm256_set1_epi16(0x80));
+    return _mm256_or_si256(_mm256_and_si256(pos,t),
+	_mm256_andnot_si256(pos,_mm256_sub_epi16(_mm256_setzero_si256(),t)));
+}
+
+__attribute__((target("avx2")))
+static void decodeAlawAVX2(unsigned short* d, const unsigned char* s, unsigned int n)
+{
+    for (; n >= 16; n -= 16, s += 16, d += 16) {
+	__m256i x = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)s));
+	_mm256_storeu_si256((__m256i*)d,alawAVX2(x));
+    }
+    decodeTable(d,s,n,a2s);
+}
+
+__attribute__((target("avx2")))
+static void decodeMulawAVX2(unsigned short* d, const unsigned char* s, unsigned int n)
+{
+    for (; n >= 16; n -= 16, s += 16, d += 16) {
+	__m256i x = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)s));
+	_mm256_storeu_si256((__m256i*)d,mulawAVX2(x));
+    }
+    decodeTable(d,s,n,u2s);
+}
+
+// Look up 8 samples at once in the 64k table, it is padded for the dword reads
+__attribute__((target("avx2")))
+static void encodeAVX2(unsigned char* d, const unsigned short* s, unsigned int n,
+    const unsigned char* table)
+{
+    const __m256i mask = _mm256_set1_epi32(0xff);
+    for (; n >= 16; n -= 16, s += 16, d += 16) {
+	__m256i lo = _mm256_i32gather_epi32((const int*)table,
+	    _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)s)),1);
+	__m256i hi = _mm256_i32gather_epi32((const int*)table,
+	    _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(s + 8))),1);
+	// keep the looked up byte of each dword and pack to 16 bytes in order
+	__m256i w = _mm256_packus_epi32(_mm256_and_si256(lo,mask),_mm256_and_si256(hi,mask));
+	w = _mm256_permute4x64_epi64(w,0xd8);
+	__m128i b = _mm_packus_epi16(_mm256_castsi256_si128(w),_mm256_extracti128_si256(w,1));
+	_mm_storeu_si128((__m128i*)d,b);
+    }
+    encodeScalar(d,s,n,table);
+}
+#endif
+
+class G711Batch
+{
+public:
+    G711Batch()
+	: alaw(decodeAlawScalar), mulaw(decodeMulawScalar), encode(encodeScalar)
+    {
+#ifdef YSIMD_X86
+	switch (simdLevel()) {
+	    case SimdAVX2:
+		alaw = decodeAlawAVX2;
+		mulaw = decodeMulawAVX2;
+		encode = encodeAVX2;
+		break;
+	    case SimdSSE2:
+		alaw = decodeAlawSSE2;
+		mulaw = decodeMulawSSE2;
+		break;
+	    default:
+		break;
+	}
+#endif
+    }
+    G711DecodeFunc alaw;
+    G711DecodeFunc mulaw;
+    G711EncodeFunc encode;
+};
+
+static G711Batch s_g711;
+
 }; // anonymous namespace
 
 static const DataBlock s_empty;
@@ -353,27 +576,38 @@ bool DataBlock::convert(const DataBlock& src, const String& sFormat,
 	clear();
 	return true;
     }
-    resize(len * dl);
+    // reuse the existing buffer if large enough, it is called for every packet
+    if (m_data && (len * dl <= m_allocated))
+	m_length = len * dl;
+    else
+	assign(0,len * dl);
+    if (!m_data)
+	return false;
     if ((sl == 1) && (dl == 1)) {
 	unsigned char *s = (unsigned char *) src.data();
 	unsigned char *d = (unsigned char *) data();
 	unsigned char *c = (unsigned char *) ctable;
+	for (; len >= 4; len -= 4, s += 4, d += 4) {
+	    d[0] = c[s[0]];
+	    d[1] = c[s[1]];
+	    d[2] = c[s[2]];
+	    d[3] = c[s[3]];
+	}
 	while (len--)
 	    *d++ = c[*s++];
     }
     else if ((sl == 1) && (dl == 2)) {
 	unsigned char *s = (unsigned char *) src.data();
 	unsigned short *d = (unsigned short *) data();
-	unsigned short *c = (unsigned short *) ctable;
-	while (len--)
-	    *d++ = c[*s++];
+	if (ctable == a2s)
+	    s_g711.alaw(d,s,len);
+	else
+	    s_g711.mulaw(d,s,len);
     }
     else if ((sl == 2) && (dl == 1)) {
 	unsigned short *s = (unsigned short *) src.data();
 	unsigned char *d = (unsigned char *) data();
-	unsigned char *c = (unsigned char *) ctable;
-	while (len--)
-	    *d++ = c[*s++];
+	s_g711.encode(d,s,len,(const unsigned char*)ctable);
     }
     return true;
 }
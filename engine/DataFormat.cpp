@@ -18,9 +18,11 @@
  */
 
 #include "yatephone.h"
+#include "simd.h"
 
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
 
 namespace TelEngine {
 
@@ -46,8 +48,24 @@ static const FormatInfo s_formats[] = {
     FormatInfo("g729", 10, 10000),
     FormatInfo("plain", 0, 0, "text", 0),
     FormatInfo("raw", 0, 0, "data", 0),
+    FormatInfo("slin/11025", 882, 40000, "audio", 11025, 1, true),
+    FormatInfo("slin/22050", 882, 20000, "audio", 22050, 1, true),
+    FormatInfo("slin/44100", 882, 10000, "audio", 44100, 1, true),
+    FormatInfo("slin/48000", 960, 10000, "audio", 48000, 1, true),
 };
 
+// Mono slin formats handled by the polyphase resampler
+static const FormatInfo* s_polyFormats[] = {
+    s_formats+0,
+    s_formats+20,
+    s_formats+3,
+    s_formats+21,
+    s_formats+6,
+    s_formats+22,
+    s_formats+23,
+};
+#define POLY_FORMATS (sizeof(s_polyFormats)/sizeof(FormatInfo*))
+
 // FIXME: put proper conversion costs everywhere below
 
 static TranslatorCaps s_simpleCaps[] = {
@@ -136,6 +154,69 @@ private:
     RefPointer<ThreadedSource> m_source;
 };
 
+// Length of a pacing timer wheel slot in microseconds
+#define PUMP_TICK 1000
+// Number of slots in the pacing timer wheel, must be a power of 2
+#define PUMP_SLOTS 256
+// Maximum number of shared pacing threads
+#define PUMP_MAX 64
+// How late a paced source may get before it is resynchronized
+#define PUMP_MAX_LATE 200000
+
+// A paced source with its schedule
+class MediaPumpEntry : public GenObject
+{
+public:
+    inline MediaPumpEntry(ThreadedSource* source, unsigned int interval, u_int64_t when)
+	: m_source(source), m_interval(interval), m_when(when)
+	{ }
+    RefPointer<ThreadedSource> m_source;
+    unsigned int m_interval;
+    u_int64_t m_when;
+};
+
+// Shared thread serving many paced sources from a timer wheel
+// It sleeps on a semaphore while it has no source to serve
+class MediaPump : public Thread
+{
+public:
+    MediaPump(unsigned int index);
+    virtual ~MediaPump();
+    virtual void run();
+    virtual void cleanup();
+    inline unsigned int count() const
+	{ return m_count; }
+    bool add(ThreadedSource* source, unsigned int interval);
+    static MediaPump* get();
+    static void stopAll();
+private:
+    void schedule(MediaPumpEntry* entry);
+    void finish(MediaPumpEntry* entry);
+    void flush();
+    Mutex m_mutex;
+    Semaphore m_wake;
+    ObjList m_slots[PUMP_SLOTS];
+    u_int64_t m_tick;
+    unsigned int m_count;
+    unsigned int m_index;
+};
+
+// Stops the pacing threads when the engine halts
+class MediaPumpHalt : public MessageHandler
+{
+public:
+    inline MediaPumpHalt()
+	: MessageHandler("engine.halt",150,"engine")
+	{ }
+    virtual bool received(Message& msg)
+	{ MediaPump::stopAll(); return false; }
+};
+
+static MediaPump* s_pumps[PUMP_MAX];
+static Mutex s_pumpMutex(false,"MediaPump");
+// 0 before the halt handler is installed, -1 after, 1 once pumps are stopped
+static int s_pumpHalt = 0;
+
 // slin/alaw/mulaw converter
 class SimpleTranslator : public DataTranslator
 {
@@ -246,6 +327,271 @@ public:
 	}
 };
 
+// Taps per phase of the polyphase filter when not downsampling
+#define POLY_TAPS_BASE 32
+// Upper limit of taps per phase for high downsampling ratios
+#define POLY_TAPS_MAX 192
+// Kaiser window shape parameter, about 60dB stopband attenuation
+#define POLY_KAISER_BETA 6.0
+// Fixed point shift of the filter coefficients
+#define POLY_COEF_SHIFT 14
+
+// Dot product of samples and coefficients, taps is a multiple of 16
+typedef int (*PolyDotFunc)(const int16_t* coef, const int16_t* data, unsigned int taps);
+
+static int polyDotScalar(const int16_t* coef, const int16_t* data, unsigned int taps)
+{
+    int acc = 0;
+    for (unsigned int i = 0; i < taps; i++)
+	acc += (int)coef[i] * data[i];
+    return acc;
+}
+
+#ifdef YSIMD_X86
+__attribute__((target("sse2")))
+static int polyDotSSE2(const int16_t* coef, const int16_t* data, unsigned int taps)
+{
+    __m128i acc = _mm_setzero_si128();
+    for (unsigned int i = 0; i < taps; i += 8)
+	acc = _mm_add_epi32(acc,_mm_madd_epi16(_mm_loadu_si128((const __m128i*)(coef + i)),
+	    _mm_loadu_si128((const __m128i*)(data + i))));
+    acc = _mm_add_epi32(acc,_mm_shuffle_epi32(acc,0x4e));
+    acc = _mm_add_epi32(acc,_mm_shuffle_epi32(acc,0xb1));
+    return _mm_cvtsi128_si32(acc);
+}
+
+__attribute__((target("avx2")))
+static int polyDotAVX2(const int16_t* coef, const int16_t* data, unsigned int taps)
+{
+    __m256i acc = _mm256_setzero_si256();
+    for (unsigned int i = 0; i < taps; i += 16)
+	acc = _mm256_add_epi32(acc,_mm256_madd_epi16(_mm256_loadu_si256((const __m256i*)(coef + i)),
+	    _mm256_loadu_si256((const __m256i*)(data + i))));
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc),_mm256_extracti128_si256(acc,1));
+    sum = _mm_add_epi32(sum,_mm_shuffle_epi32(sum,0x4e));
+    sum = _mm_add_epi32(sum,_mm_shuffle_epi32(sum,0xb1));
+    return _mm_cvtsi128_si32(sum);
+}
+#endif
+
+// Pick the best dot product the CPU supports
+static PolyDotFunc polyDotSelect()
+{
+#ifdef YSIMD_X86
+    switch (simdLevel()) {
+	case SimdAVX2:
+	    return polyDotAVX2;
+	case SimdSSE2:
+	    return polyDotSSE2;
+	default:
+	    break;
+    }
+#endif
+    return polyDotScalar;
+}
+
+static PolyDotFunc s_polyDot = polyDotSelect();
+
+// Zero order modified Bessel function of the first kind
+static double besselI0(double x)
+{
+    double sum = 1;
+    double term = 1;
+    x = x * x / 4;
+    for (int k = 1; k < 50; k++) {
+	term *= x / ((double)k * k);
+	sum += term;
+	if (term < sum * 1e-12)
+	    break;
+    }
+    return sum;
+}
+
+// Polyphase filter bank for one rate pair, shared by all translators
+class PolyFilterBank : public GenObject
+{
+public:
+    PolyFilterBank(int sRate, int dRate);
+    ~PolyFilterBank()
+	{ delete[] m_coef; }
+    static PolyFilterBank* get(int sRate, int dRate);
+    inline int srcRate() const
+	{ return m_sRate; }
+    inline int destRate() const
+	{ return m_dRate; }
+    // Upsampling factor, also the number of phases
+    inline unsigned int up() const
+	{ return m_up; }
+    inline unsigned int down() const
+	{ return m_down; }
+    inline unsigned int taps() const
+	{ return m_taps; }
+    // Coefficients of a phase in reverse order, ready for a dot product
+    inline const int16_t* phase(unsigned int p) const
+	{ return m_coef + p * m_taps; }
+private:
+    int m_sRate;
+    int m_dRate;
+    unsigned int m_up;
+    unsigned int m_down;
+    unsigned int m_taps;
+    int16_t* m_coef;
+};
+
+static ObjList s_polyBanks;
+static Mutex s_polyMutex(false,"PolyResampler");
+
+PolyFilterBank::PolyFilterBank(int sRate, int dRate)
+    : m_sRate(sRate), m_dRate(dRate), m_up(dRate), m_down(sRate),
+      m_taps(POLY_TAPS_BASE), m_coef(0)
+{
+    unsigned int a = m_up, b = m_down;
+    while (b) {
+	unsigned int t = a % b;
+	a = b;
+	b = t;
+    }
+    m_up /= a;
+    m_down /= a;
+    if (m_down > m_up) {
+	// longer filter for the narrower band when downsampling
+	m_taps = (unsigned int)ceil((double)POLY_TAPS_BASE * m_down / m_up);
+	m_taps = (m_taps + 15) & ~15;
+	if (m_taps > POLY_TAPS_MAX)
+	    m_taps = POLY_TAPS_MAX;
+    }
+    unsigned int len = m_up * m_taps;
+    m_coef = new int16_t[len];
+    // cutoff relative to the upsampled rate, 90% of the lower Nyquist band
+    double fc = 0.45 / ((m_down > m_up) ? m_down : m_up);
+    double center = (len - 1) / 2.0;
+    double norm = besselI0(POLY_KAISER_BETA);
+    double* proto = new double[len];
+    for (unsigned int i = 0; i < len; i++) {
+	double t = i - center;
+	double x = 2 * fc * t;
+	double sinc = (fabs(x) < 1e-9) ? 1.0 : sin(M_PI * x) / (M_PI * x);
+	double w = t / center;
+	w = 1 - w * w;
+	w = besselI0(POLY_KAISER_BETA * sqrt(w > 0 ? w : 0)) / norm;
+	proto[i] = sinc * w;
+    }
+    for (unsigned int p = 0; p < m_up; p++) {
+	// normalize each phase for unity gain at DC
+	double sum = 0;
+	for (unsigned int j = 0; j < m_taps; j++)
+	    sum += proto[p + j * m_up];
+	if (fabs(sum) < 1e-9)
+	    sum = 1;
+	int16_t* c = m_coef + p * m_taps;
+	for (unsigned int j = 0; j < m_taps; j++)
+	    c[m_taps - 1 - j] = (int16_t)floor(proto[p + j * m_up] / sum * (1 << POLY_COEF_SHIFT) + 0.5);
+    }
+    delete[] proto;
+    DDebug(DebugAll,"Created polyphase filter bank %d -> %d ratio %u/%u with %u taps [%p]",
+	sRate,dRate,m_up,m_down,m_taps,this);
+}
+
+// Find or build the filter bank of a rate pair, they are never released
+PolyFilterBank* PolyFilterBank::get(int sRate, int dRate)
+{
+    Lock lock(s_polyMutex);
+    for (ObjList* l = s_polyBanks.skipNull(); l; l = l->skipNext()) {
+	PolyFilterBank* b = static_cast<PolyFilterBank*>(l->get());
+	if (b->srcRate() == sRate && b->destRate() == dRate)
+	    return b;
+    }
+    PolyFilterBank* b = new PolyFilterBank(sRate,dRate);
+    s_polyBanks.append(b);
+    return b;
+}
+
+// slin mono polyphase FIR resampler for arbitrary rate ratios
+class PolyResampTranslator : public DataTranslator
+{
+public:
+    PolyResampTranslator(const DataFormat& sFormat, const DataFormat& dFormat)
+	: DataTranslator(sFormat,dFormat),
+	  m_bank(PolyFilterBank::get(sFormat.sampleRate(),dFormat.sampleRate())),
+	  m_pos(m_bank->taps() - 1), m_phase(0), m_tsFrac(0)
+	{ }
+    virtual unsigned long Consume(const DataBlock& data, unsigned long tStamp, unsigned long flags);
+private:
+    PolyFilterBank* m_bank;
+    // position of the next output in the input buffer and its filter phase
+    unsigned int m_pos;
+    unsigned int m_phase;
+    unsigned int m_tsFrac;
+    // filter history followed by new input
+    DataBlock m_input;
+    DataBlock m_output;
+};
+
+unsigned long PolyResampTranslator::Consume(const DataBlock& data, unsigned long tStamp, unsigned long flags)
+{
+    unsigned int n = data.length();
+    if (!n || (n & 1) || !ref())
+	return 0;
+    unsigned long len = 0;
+    n /= 2;
+    DataSource* src = getTransSource();
+    if (src) {
+	unsigned int taps = m_bank->taps();
+	unsigned int hist = taps - 1;
+	unsigned int up = m_bank->up();
+	unsigned int down = m_bank->down();
+	// buffers only grow, history is kept at the start of input
+	if (m_input.length() < (hist + n) * sizeof(int16_t)) {
+	    DataBlock tmp(0,(hist + n) * sizeof(int16_t));
+	    if (m_input.length())
+		::memcpy(tmp.data(),m_input.data(),hist * sizeof(int16_t));
+	    m_input.assign(tmp.data(),tmp.length(),false);
+	    tmp.clear(false);
+	}
+	unsigned int maxOut = (unsigned int)(((u_int64_t)n * up) / down) + 2;
+	if (m_output.length() < maxOut * sizeof(int16_t))
+	    m_output.assign(0,maxOut * sizeof(int16_t));
+	int16_t* in = (int16_t*)m_input.data();
+	int16_t* out = (int16_t*)m_output.data();
+	::memcpy(in + hist,data.data(),n * sizeof(int16_t));
+	unsigned int total = hist + n;
+	unsigned int count = 0;
+	while (m_pos < total) {
+	    int v = s_polyDot(m_bank->phase(m_phase),in + m_pos - hist,taps);
+	    v = (v + (1 << (POLY_COEF_SHIFT - 1))) >> POLY_COEF_SHIFT;
+	    // saturate symmetrically the filter output
+	    if (v > 32767)
+		v = 32767;
+	    else if (v < -32767)
+		v = -32767;
+	    out[count++] = v;
+	    m_phase += down;
+	    m_pos += m_phase / up;
+	    m_phase %= up;
+	}
+	m_pos -= n;
+	::memmove(in,in + n,hist * sizeof(int16_t));
+	long delta = tStamp - m_timestamp;
+	if (delta > 0) {
+	    u_int64_t scaled = (u_int64_t)delta * up + m_tsFrac;
+	    delta = (long)(scaled / down);
+	    m_tsFrac = (unsigned int)(scaled % down);
+	}
+	else
+	    delta = 0;
+	if (src->timeStamp() != invalidStamp())
+	    delta += src->timeStamp();
+	if (count) {
+	    // wrap the output without copying it
+	    DataBlock oblock(out,count * sizeof(int16_t),false);
+	    len = src->Forward(oblock,delta,flags);
+	    oblock.clear(false);
+	}
+    }
+    deref();
+    return len;
+}
+
 // slin simple mono-stereo converter
 class StereoTranslator : public DataTranslator
 {
@@ -324,6 +670,18 @@ public:
 	{ return s_resampCaps; }
 };
 
+class PolyResampFactory : public TranslatorFactory
+{
+public:
+    PolyResampFactory();
+    virtual DataTranslator* create(const DataFormat& sFormat, const DataFormat& dFormat)
+	{ return converts(sFormat,dFormat) ? new PolyResampTranslator(sFormat,dFormat) : 0; }
+    virtual const TranslatorCaps* getCapabilities() const
+	{ return m_caps; }
+private:
+    TranslatorCaps m_caps[POLY_FORMATS * (POLY_FORMATS - 1) + 1];
+};
+
 class StereoFactory : public TranslatorFactory
 {
 public:
@@ -335,6 +693,26 @@ public:
 	{ return s_stereoCaps; }
 };
 
+// Build capabilities for all rate pairs, cheaper than the basic resampler
+PolyResampFactory::PolyResampFactory()
+    : TranslatorFactory("polyphase")
+{
+    unsigned int n = 0;
+    for (unsigned int i = 0; i < POLY_FORMATS; i++) {
+	for (unsigned int j = 0; j < POLY_FORMATS; j++) {
+	    if (i == j)
+		continue;
+	    m_caps[n].src = s_polyFormats[i];
+	    m_caps[n].dest = s_polyFormats[j];
+	    m_caps[n].cost = 1;
+	    n++;
+	}
+    }
+    m_caps[n].src = 0;
+    m_caps[n].dest = 0;
+    m_caps[n].cost = 0;
+}
+
 class ChainedFactory : public TranslatorFactory
 {
 public:
@@ -362,10 +740,66 @@ private:
     const TranslatorCaps* m_capabilities;
 };
 
+// Immutable copy of the consumers of a DataSource, holds a reference to each
+// Also counts the threads forwarding through it, guarded by the snapshot lock
+class DataConsumerSet : public RefObject
+{
+public:
+    DataConsumerSet(const ObjList& consumers);
+    inline unsigned int count() const
+	{ return m_count; }
+    inline DataConsumer* at(unsigned int idx) const
+	{ return m_list[idx]; }
+    inline unsigned int busy() const
+	{ return m_busy; }
+    inline void enter()
+	{ m_busy++; }
+    inline void leave()
+	{ m_busy--; }
+protected:
+    virtual void destroyed();
+private:
+    unsigned int m_count;
+    unsigned int m_busy;
+    DataConsumer** m_list;
+};
+
+// Snapshot forwarded through by a thread, chained for nested Forward calls
+struct ForwardFrame
+{
+    const DataConsumerSet* set;
+    ForwardFrame* prev;
+};
+
 };
 
 using namespace TelEngine;
 
+// The snapshot lock is held only to swap or reference the consumers snapshot
+#ifdef ATOMIC_OPS
+#ifdef _WINDOWS
+#define SNAP_TRYLOCK(var) (InterlockedCompareExchange((LONG*)&(var),1,0) == 0)
+#define SNAP_UNLOCK(var) InterlockedExchange((LONG*)&(var),0)
+#else
+#define SNAP_TRYLOCK(var) __sync_bool_compare_and_swap(&(var),0,1)
+#define SNAP_UNLOCK(var) __sync_lock_release(&(var))
+#endif
+#define SNAP_LOCK(var) while (!SNAP_TRYLOCK(var)) Thread::yield()
+#else
+static Mutex s_snapMutex(false,"DataSource::Snapshot");
+#define SNAP_LOCK(var) s_snapMutex.lock()
+#define SNAP_UNLOCK(var) s_snapMutex.unlock()
+#endif
+
+#ifdef _WINDOWS
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+// Snapshots the current thread is forwarding through, it must not wait for itself
+static THREAD_LOCAL ForwardFrame* s_forwarding = 0;
+
 
 int FormatInfo::guessSamples(int len) const
 {
@@ -471,16 +905,23 @@ void* DataConsumer::getObject(const String& name) const
 
 unsigned long DataConsumer::Consume(const DataBlock& data, unsigned long tStamp, unsigned long flags, DataSource* source)
 {
+    // sources attach and synchronize while another one may be forwarding
+    s_consSrcMutex.lock();
     if (source == m_override)
 	tStamp += m_overrideTsDelta;
-    else if (m_override || (source != m_source))
+    else if (m_override || (source != m_source)) {
+	s_consSrcMutex.unlock();
 	return 0;
+    }
     else
 	tStamp += m_regularTsDelta;
+    s_consSrcMutex.unlock();
     u_int64_t tsTime = Time::now();
     unsigned long len = Consume(data,tStamp,flags);
+    s_consSrcMutex.lock();
     m_timestamp = tStamp;
     m_lastTsTime = tsTime;
+    s_consSrcMutex.unlock();
     return len;
 }
 
@@ -488,6 +929,7 @@ bool DataConsumer::synchronize(DataSource* source)
 {
     if (!source)
 	return false;
+    Lock lck(s_consSrcMutex);
     bool override = false;
     if (source == m_override)
 	override = true;
@@ -521,6 +963,31 @@ bool DataConsumer::synchronize(DataSource* source)
 }
 
 
+DataConsumerSet::DataConsumerSet(const ObjList& consumers)
+    : m_count(0), m_busy(0), m_list(0)
+{
+    unsigned int n = consumers.count();
+    if (!n)
+	return;
+    m_list = new DataConsumer*[n];
+    for (ObjList* l = consumers.skipNull(); l && (m_count < n); l = l->skipNext()) {
+	DataConsumer* c = static_cast<DataConsumer*>(l->get());
+	if (c->ref())
+	    m_list[m_count++] = c;
+    }
+}
+
+void DataConsumerSet::destroyed()
+{
+    for (unsigned int i = 0; i < m_count; i++)
+	m_list[i]->deref();
+    delete[] m_list;
+    m_list = 0;
+    m_count = 0;
+    RefObject::destroyed();
+}
+
+
 bool DataSource::valid() const
 {
     Lock mylock(const_cast<DataSource*>(this));
@@ -540,11 +1007,64 @@ bool DataSource::control(NamedList& params)
     return m_translator && m_translator->control(params);
 }
 
+// Publish a new snapshot of the consumers, source must be locked
+// The old snapshot is retired until no Forward uses it anymore
+void DataSource::publish()
+{
+    DataConsumerSet* set = m_consumers.skipNull() ? new DataConsumerSet(m_consumers) : 0;
+    SNAP_LOCK(m_snapLock);
+    DataConsumerSet* old = m_snapshot;
+    m_snapshot = set;
+    SNAP_UNLOCK(m_snapLock);
+    if (old)
+	m_retired.append(old);
+    retire();
+}
+
+// Release retired snapshots that other threads no longer forward through
+// Source must be locked, return true if some are still in use
+bool DataSource::retire()
+{
+    bool busy = false;
+    for (ObjList* l = m_retired.skipNull(); l; ) {
+	DataConsumerSet* set = static_cast<DataConsumerSet*>(l->get());
+	unsigned int own = 0;
+	for (const ForwardFrame* f = s_forwarding; f; f = f->prev)
+	    if (f->set == set)
+		own++;
+	SNAP_LOCK(m_snapLock);
+	unsigned int n = set->busy();
+	SNAP_UNLOCK(m_snapLock);
+	if (n > own) {
+	    busy = true;
+	    l = l->skipNext();
+	}
+	else {
+	    l->remove();
+	    l = l->skipNull();
+	}
+    }
+    return busy;
+}
+
+// Wait until detached consumers are no longer used by a Forward in another thread
+// Must be called with the source unlocked
+void DataSource::drain()
+{
+    for (;;) {
+	lock();
+	bool busy = retire();
+	unlock();
+	if (!busy)
+	    break;
+	Thread::yield();
+    }
+}
+
 unsigned long DataSource::Forward(const DataBlock& data, unsigned long tStamp, unsigned long flags)
 {
-    Lock mylock(this,100000);
-    // we DON'T refcount here, we rely on the mutex to keep us safe
-    if (!(mylock.locked() && alive())) {
+    // the caller holds a reference to us, consumers are kept by the snapshot
+    if (!alive()) {
 	DDebug(DebugInfo,"Forwarding on a dead DataSource! [%p]",this);
 	return 0;
     }
@@ -553,39 +1073,58 @@ unsigned long DataSource::Forward(const DataBlock& data, unsigned long tStamp, u
     const FormatInfo* f = m_format.getInfo();
     unsigned long nSamp = f ? f->guessSamples(data.length()) : 0;
 
+    // take the stamps and a counted reference to the consumers snapshot together
+    SNAP_LOCK(m_snapLock);
+    unsigned long lastStamp = m_timestamp;
+    unsigned long nextStamp = m_nextStamp;
+    DataConsumerSet* set = m_snapshot;
+    if (set && set->ref())
+	set->enter();
+    else
+	set = 0;
+    SNAP_UNLOCK(m_snapLock);
+
     // if no timestamp provided - try to use next expected
     if (tStamp == invalidStamp())
-	tStamp = m_nextStamp;
+	tStamp = nextStamp;
     // still no timestamp known - wild guess based on this packet size
     if (tStamp == invalidStamp()) {
 	DDebug(DebugNote,"Unknown timestamp - assuming %lu + %lu [%p]",
-	    m_timestamp,nSamp,this);
-	tStamp = m_timestamp + nSamp;
+	    lastStamp,nSamp,this);
+	tStamp = lastStamp + nSamp;
     }
+    ForwardFrame frame = { set, s_forwarding };
+    s_forwarding = &frame;
     unsigned long len = invalidStamp();
     bool empty = true;
-    ObjList* l = m_consumers.skipNull();
-    while (l) {
-	DataConsumer* c = static_cast<DataConsumer *>(l->get());
+    unsigned int n = set ? set->count() : 0;
+    for (unsigned int i = 0; i < n; i++) {
+	DataConsumer* c = set->at(i);
 	unsigned long ll = c->Consume(data,tStamp,flags,this);
 	if (ll || c->valid()) {
 	    // get the minimum data amount forwarded to all consumers
 	    if (len > ll)
 		len = ll;
-	    l = l->skipNext();
 	    empty = false;
 	}
-	else {
+	else if (lock(0)) {
+	    // never wait here, a busy source will retry on next packet
 	    DDebug(DebugInfo,"Consumer %p becomes invalid [%p]",c,this);
-	    detachInternal(c);
-	    // do not advance in list, we just removed the current element
-	    l = l->skipNull();
+	    if (detachInternal(c))
+		publish();
+	    unlock();
 	}
     }
+    s_forwarding = frame.prev;
     if (empty)
 	len = 0;
+    SNAP_LOCK(m_snapLock);
+    if (set)
+	set->leave();
     m_timestamp = tStamp;
     m_nextStamp = nSamp ? (tStamp + nSamp) : invalidStamp();
+    SNAP_UNLOCK(m_snapLock);
+    TelEngine::destruct(set);
     return len;
 }
 
@@ -621,6 +1160,7 @@ bool DataSource::attach(DataConsumer* consumer, bool override)
     }
     consumer->synchronize(this);
     m_consumers.append(consumer);
+    publish();
     return true;
 }
 
@@ -633,10 +1173,15 @@ bool DataSource::detach(DataConsumer* consumer)
 	return false;
     }
     DDebug(DebugAll,"DataSource [%p] detaching consumer [%p]",this,consumer);
-    // lock the source to prevent races with the Forward method
+    // lock the source to serialize changes, Forward uses the snapshot
     lock();
     bool ok = detachInternal(consumer);
+    if (ok)
+	publish();
     unlock();
+    // the consumer may still be in use by a Forward that took an old snapshot
+    if (ok)
+	drain();
     deref();
     return ok;
 }
@@ -669,11 +1214,13 @@ void DataSource::destroyed()
 
 void DataSource::clear()
 {
-    // keep the source locked to prevent races with the Forward method
+    // keep the source locked while detaching and publishing the snapshot
     lock();
     while (detachInternal(static_cast<DataConsumer*>(m_consumers.get())))
 	;
+    publish();
     unlock();
+    drain();
 }
 
 void DataSource::synchronize(unsigned long tStamp)
@@ -683,8 +1230,10 @@ void DataSource::synchronize(unsigned long tStamp)
 	DDebug(DebugInfo,"Synchronizing on a dead DataSource! [%p]",this);
 	return;
     }
+    SNAP_LOCK(m_snapLock);
     m_timestamp = tStamp;
     m_nextStamp = invalidStamp();
+    SNAP_UNLOCK(m_snapLock);
     ObjList *l = m_consumers.skipNull();
     for (; l; l=l->skipNext()) {
 	DataConsumer *c = static_cast<DataConsumer *>(l->get());
@@ -1080,12 +1629,16 @@ void ThreadedSource::destroyed()
 {
     if (m_thread)
 	Debug(DebugFail,"ThreadedSource destroyed holding thread %p [%p]",m_thread,this);
+    if (m_pump)
+	Debug(DebugFail,"ThreadedSource destroyed while paced by %p [%p]",m_pump,this);
     DataSource::destroyed();
 }
 
 bool ThreadedSource::start(const char* name, Thread::Priority prio)
 {
     Lock mylock(this);
+    if (m_pump)
+	return false;
     if (!m_thread) {
 	ThreadedSourcePrivate* thread = new ThreadedSourcePrivate(this,name,prio);
 	if (thread->startup()) {
@@ -1098,9 +1651,43 @@ bool ThreadedSource::start(const char* name, Thread::Priority prio)
     return m_thread->running();
 }
 
+// A paced source has runFrame() called from a shared pacing thread once per
+//  interval, a frame that blocks delays all sources served by that thread
+bool ThreadedSource::startPaced(unsigned int interval, bool runConsumers)
+{
+    if (!interval)
+	return false;
+    Lock mylock(this);
+    if (m_thread)
+	return false;
+    if (m_pump)
+	return m_paced;
+    MediaPump* pump = MediaPump::get();
+    if (!pump)
+	return false;
+    m_pump = pump;
+    m_paced = true;
+    m_runConsumers = runConsumers;
+    mylock.drop();
+    if (pump->add(this,interval))
+	return true;
+    lock();
+    m_pump = 0;
+    m_paced = false;
+    unlock();
+    return false;
+}
+
+bool ThreadedSource::runFrame()
+{
+    return false;
+}
+
 void ThreadedSource::stop()
 {
     Lock mylock(this);
+    // the pacing thread drops the source on its next frame
+    m_paced = false;
     ThreadedSourcePrivate* tmp = m_thread;
     m_thread = 0;
     if (!tmp || tmp->running())
@@ -1125,7 +1712,7 @@ Thread* ThreadedSource::thread() const
 bool ThreadedSource::running() const
 {
     Lock mylock(const_cast<ThreadedSource*>(this));
-    return m_thread && m_thread->running();
+    return m_paced || (m_thread && m_thread->running());
 }
 
 bool ThreadedSource::looping(bool runConsumers) const
@@ -1137,6 +1724,210 @@ bool ThreadedSource::looping(bool runConsumers) const
 	m_thread->isCurrent() && !Engine::exiting();
 }
 
+// Check if a paced source should produce another frame
+bool ThreadedSource::pacing() const
+{
+    Lock mylock(const_cast<ThreadedSource*>(this));
+    if ((refcount() <= 1) && !(m_runConsumers && alive() && m_consumers.count()))
+	return false;
+    return m_paced && !Engine::exiting();
+}
+
+MediaPump::MediaPump(unsigned int index)
+    : Thread("Media Pump",Thread::High),
+      m_mutex(false,"MediaPump"), m_wake(1,"MediaPump",0),
+      m_tick(Time::now() / PUMP_TICK), m_count(0), m_index(index)
+{
+    DDebug(DebugAll,"MediaPump %u created [%p]",index,this);
+}
+
+MediaPump::~MediaPump()
+{
+    DDebug(DebugAll,"MediaPump %u destroyed [%p]",m_index,this);
+    s_pumpMutex.lock();
+    if (s_pumps[m_index] == this)
+	s_pumps[m_index] = 0;
+    s_pumpMutex.unlock();
+}
+
+// Pick the least loaded pacing thread, start new ones up to the configured count
+MediaPump* MediaPump::get()
+{
+    int n = Engine::config().getIntValue(YSTRING("telephony"),"pacers",2,1,PUMP_MAX);
+    Lock lock(s_pumpMutex);
+    if (s_pumpHalt > 0 || Engine::exiting())
+	return 0;
+    MediaPump* pump = 0;
+    for (int i = 0; i < n; i++) {
+	if (!s_pumps[i]) {
+	    MediaPump* p = new MediaPump(i);
+	    if (!p->startup()) {
+		delete p;
+		continue;
+	    }
+	    s_pumps[i] = p;
+	}
+	if (!pump || (s_pumps[i]->count() < pump->count()))
+	    pump = s_pumps[i];
+    }
+    return pump;
+}
+
+bool MediaPump::add(ThreadedSource* source, unsigned int interval)
+{
+    MediaPumpEntry* e = new MediaPumpEntry(source,interval,Time::now() + interval);
+    if (!e->m_source) {
+	TelEngine::destruct(e);
+	return false;
+    }
+    Lock lock(m_mutex);
+    if (!m_count++) {
+	// the wheel was idle, restart it from current time and wake the thread
+	m_tick = Time::now() / PUMP_TICK;
+	m_wake.unlock();
+    }
+    schedule(e);
+    return true;
+}
+
+// Stop the pacing threads and wait for them to finish
+void MediaPump::stopAll()
+{
+    Lock lock(s_pumpMutex);
+    s_pumpHalt = 1;
+    unsigned int n = 0;
+    for (unsigned int i = 0; i < PUMP_MAX; i++) {
+	if (s_pumps[i]) {
+	    s_pumps[i]->cancel();
+	    s_pumps[i]->m_wake.unlock();
+	    n++;
+	}
+    }
+    lock.drop();
+    if (!n)
+	return;
+    DDebug(DebugAll,"Stopping %u media pumps",n);
+    // a pump clears its slot when destroyed after its thread ends
+    for (unsigned int loops = 1; n; loops++) {
+	Thread::idle();
+	lock.acquire(s_pumpMutex);
+	n = 0;
+	for (unsigned int i = 0; i < PUMP_MAX; i++) {
+	    if (s_pumps[i])
+		n++;
+	}
+	lock.drop();
+	if (n && !(loops % 500))
+	    Debug(DebugWarn,"Still waiting for %u media pumps to stop",n);
+    }
+}
+
+// Place the entry in the slot of its due time, mutex must be locked
+void MediaPump::schedule(MediaPumpEntry* entry)
+{
+    u_int64_t tick = entry->m_when / PUMP_TICK;
+    if (tick < m_tick)
+	tick = m_tick;
+    m_slots[tick & (PUMP_SLOTS - 1)].append(entry);
+}
+
+// Stop serving a source, called without the mutex locked
+void MediaPump::finish(MediaPumpEntry* entry)
+{
+    ThreadedSource* source = entry->m_source;
+    if (source) {
+	source->lock();
+	source->m_pump = 0;
+	source->m_paced = false;
+	source->unlock();
+	source->cleanup();
+    }
+    m_mutex.lock();
+    m_count--;
+    m_mutex.unlock();
+    TelEngine::destruct(entry);
+}
+
+void MediaPump::flush()
+{
+    for (unsigned int i = 0; i < PUMP_SLOTS; i++) {
+	for (;;) {
+	    m_mutex.lock();
+	    MediaPumpEntry* e = static_cast<MediaPumpEntry*>(m_slots[i].remove(false));
+	    m_mutex.unlock();
+	    if (!e)
+		break;
+	    finish(e);
+	}
+    }
+}
+
+void MediaPump::run()
+{
+    // the first pump to run installs the handler stopping them all,
+    //  callers of get() may hold locks so it can't be done there
+    s_pumpMutex.lock();
+    bool install = !s_pumpHalt;
+    if (install)
+	s_pumpHalt = -1;
+    s_pumpMutex.unlock();
+    if (install)
+	Engine::install(new MediaPumpHalt);
+    while (!Thread::check(false)) {
+	m_mutex.lock();
+	if (!m_count) {
+	    // nothing to pace, add() or stopAll() wakes us up
+	    m_mutex.unlock();
+	    m_wake.lock();
+	    continue;
+	}
+	u_int64_t now = Time::now();
+	u_int64_t next = m_tick * PUMP_TICK;
+	if (next > now) {
+	    m_mutex.unlock();
+	    Thread::usleep((unsigned long)(next - now));
+	    continue;
+	}
+	// collect the sources due in this slot, run them without the mutex
+	ObjList due;
+	ObjList* add = &due;
+	ObjList* l = m_slots[m_tick & (PUMP_SLOTS - 1)].skipNull();
+	while (l) {
+	    MediaPumpEntry* e = static_cast<MediaPumpEntry*>(l->get());
+	    if ((e->m_when / PUMP_TICK) <= m_tick) {
+		add = add->append(static_cast<MediaPumpEntry*>(l->remove(false)));
+		l = l->skipNull();
+	    }
+	    else
+		l = l->skipNext();
+	}
+	m_tick++;
+	m_mutex.unlock();
+	while (MediaPumpEntry* e = static_cast<MediaPumpEntry*>(due.remove(false))) {
+	    if (e->m_source->pacing() && e->m_source->runFrame()) {
+		e->m_when += e->m_interval;
+		now = Time::now();
+		if (e->m_when + PUMP_MAX_LATE < now) {
+		    Debug(DebugMild,"MediaPump %u resynchronizing late source %p",
+			m_index,(ThreadedSource*)e->m_source);
+		    e->m_when = now + e->m_interval;
+		}
+		m_mutex.lock();
+		schedule(e);
+		m_mutex.unlock();
+	    }
+	    else
+		finish(e);
+	}
+    }
+    flush();
+}
+
+void MediaPump::cleanup()
+{
+    flush();
+}
+
 
 DataTranslator::DataTranslator(const char* sFormat, const char* dFormat)
     : DataConsumer(sFormat)
@@ -1202,9 +1993,153 @@ Mutex DataTranslator::s_mutex(true,"DataTranslator");
 ObjList DataTranslator::s_factories;
 unsigned int DataTranslator::s_maxChain = 3;
 static ObjList s_compose;
+// Snapshot of the conversions offered by all installed factories.
+// It is rebuilt when factories change and read without the global mutex
+class TranslatorTable
+{
+public:
+    struct Record {
+	const FormatInfo* src;
+	const FormatInfo* dest;
+	TranslatorFactory* factory;
+	int cost;
+	unsigned int length;
+	int nextPair;
+	int nextSrc;
+	int nextDest;
+    };
+    TranslatorTable(const ObjList& factories);
+    ~TranslatorTable();
+    // Records are chained in the order factories were installed
+    inline const Record* findPair(const FormatInfo* src, const FormatInfo* dest) const
+	{ return pair(m_pairHead[hashPair(src,dest)],src,dest); }
+    inline const Record* nextPair(const Record* r) const
+	{ return pair(r->nextPair,r->src,r->dest); }
+    inline const Record* findSrc(const FormatInfo* src) const
+	{ return bySrc(m_srcHead[hash(src)],src); }
+    inline const Record* nextSrc(const Record* r) const
+	{ return bySrc(r->nextSrc,r->src); }
+    inline const Record* findDest(const FormatInfo* dest) const
+	{ return byDest(m_destHead[hash(dest)],dest); }
+    inline const Record* nextDest(const Record* r) const
+	{ return byDest(r->nextDest,r->dest); }
+    inline bool canConvert(const FormatInfo* fmt1, const FormatInfo* fmt2) const
+	{ return (fmt1 == fmt2) || (findPair(fmt1,fmt2) && findPair(fmt2,fmt1)); }
+private:
+    inline unsigned int hash(const FormatInfo* fmt) const
+	{ return ((unsigned int)(((uintptr_t)fmt) >> 3) * 2654435761U) & m_mask; }
+    inline unsigned int hashPair(const FormatInfo* src, const FormatInfo* dest) const
+	{ return (hash(src) * 31 + hash(dest)) & m_mask; }
+    inline const Record* pair(int idx, const FormatInfo* src, const FormatInfo* dest) const
+	{
+	    for (; idx >= 0; idx = m_records[idx].nextPair)
+		if (m_records[idx].src == src && m_records[idx].dest == dest)
+		    return m_records + idx;
+	    return 0;
+	}
+    inline const Record* bySrc(int idx, const FormatInfo* src) const
+	{
+	    for (; idx >= 0; idx = m_records[idx].nextSrc)
+		if (m_records[idx].src == src)
+		    return m_records + idx;
+	    return 0;
+	}
+    inline const Record* byDest(int idx, const FormatInfo* dest) const
+	{
+	    for (; idx >= 0; idx = m_records[idx].nextDest)
+		if (m_records[idx].dest == dest)
+		    return m_records + idx;
+	    return 0;
+	}
+    Record* m_records;
+    unsigned int m_mask;
+    int* m_pairHead;
+    int* m_srcHead;
+    int* m_destHead;
+};
+
+TranslatorTable::TranslatorTable(const ObjList& factories)
+    : m_records(0), m_mask(0), m_pairHead(0), m_srcHead(0), m_destHead(0)
+{
+    unsigned int count = 0;
+    const ObjList* l;
+    for (l = factories.skipNull(); l; l = l->skipNext()) {
+	const TranslatorCaps* caps = static_cast<TranslatorFactory*>(l->get())->getCapabilities();
+	for (; caps && caps->src && caps->dest; caps++)
+	    count++;
+    }
+    unsigned int size = 16;
+    while (size < 2 * count)
+	size <<= 1;
+    m_mask = size - 1;
+    m_records = new Record[count ? count : 1];
+    m_pairHead = new int[size];
+    m_srcHead = new int[size];
+    m_destHead = new int[size];
+    int* pairTail = new int[size];
+    int* srcTail = new int[size];
+    int* destTail = new int[size];
+    for (unsigned int i = 0; i < size; i++)
+	m_pairHead[i] = m_srcHead[i] = m_destHead[i] = pairTail[i] = srcTail[i] = destTail[i] = -1;
+    int n = 0;
+    for (l = factories.skipNull(); l; l = l->skipNext()) {
+	TranslatorFactory* f = static_cast<TranslatorFactory*>(l->get());
+	const TranslatorCaps* caps = f->getCapabilities();
+	for (; caps && caps->src && caps->dest; caps++, n++) {
+	    Record& r = m_records[n];
+	    r.src = caps->src;
+	    r.dest = caps->dest;
+	    r.factory = f;
+	    r.cost = caps->cost;
+	    r.length = f->length();
+	    r.nextPair = r.nextSrc = r.nextDest = -1;
+	    // append at tail of each chain to keep the installation order
+	    unsigned int h = hashPair(r.src,r.dest);
+	    if (pairTail[h] >= 0)
+		m_records[pairTail[h]].nextPair = n;
+	    else
+		m_pairHead[h] = n;
+	    pairTail[h] = n;
+	    h = hash(r.src);
+	    if (srcTail[h] >= 0)
+		m_records[srcTail[h]].nextSrc = n;
+	    else
+		m_srcHead[h] = n;
+	    srcTail[h] = n;
+	    h = hash(r.dest);
+	    if (destTail[h] >= 0)
+		m_records[destTail[h]].nextDest = n;
+	    else
+		m_destHead[h] = n;
+	    destTail[h] = n;
+	}
+    }
+    delete[] pairTail;
+    delete[] srcTail;
+    delete[] destTail;
+    XDebug(DebugAll,"Built translator table with %u conversions [%p]",count,this);
+}
+
+TranslatorTable::~TranslatorTable()
+{
+    delete[] m_records;
+    delete[] m_pairHead;
+    delete[] m_srcHead;
+    delete[] m_destHead;
+}
+
+// The table is replaced under write lock so lookups and factory use
+//  under read lock never see a removed factory
+static TranslatorTable* s_table = 0;
+static bool s_tableDirty = true;
+static unsigned int s_uninstalling = 0;
+static RWLock s_tableLock("DataTranslatorTable");
+
 static SimpleFactory s_sFactory(s_simpleCaps,"g711");
 static SimpleFactory s_sFactory16k(s_simpleCaps16k,"g711wb");
 static SimpleFactory s_sFactory32k(s_simpleCaps32k,"g711uwb");
+// polyphase resampler must come first so it wins over the basic one
+static PolyResampFactory s_pFactory;
 // FIXME
 static ResampFactory s_rFactory;
 static StereoFactory s_stereoFactory;
@@ -1227,6 +2162,7 @@ void DataTranslator::install(TranslatorFactory* factory)
 	return;
     s_factories.append(factory)->setDelete(false);
     s_compose.append(factory)->setDelete(false);
+    s_tableDirty = true;
 }
 
 void DataTranslator::compose()
@@ -1328,13 +2264,47 @@ void DataTranslator::uninstall(TranslatorFactory* factory)
     if (!factory)
 	return;
     s_mutex.lock();
+    // wait for lookups still using the factory, chained factories
+    //  removed below get here again while we hold the write lock
+    bool outer = !s_uninstalling++;
+    if (outer)
+	s_tableLock.writeLock();
     s_compose.remove(factory,false);
     s_factories.remove(factory,false);
     // notify chained factories about the removal
     ListIterator iter(s_factories);
     while (TranslatorFactory* f = static_cast<TranslatorFactory*>(iter.get()))
 	f->removed(factory);
+    TranslatorTable* old = 0;
+    if (outer) {
+	old = s_table;
+	s_table = new TranslatorTable(s_factories);
+	s_tableDirty = (0 != s_compose.skipNull());
+	s_tableLock.unlock();
+    }
+    s_uninstalling--;
     s_mutex.unlock();
+    delete old;
+}
+
+// Compose pending factories and publish a new table if anything changed
+// Never call it while holding the table lock
+void DataTranslator::update()
+{
+    if (!s_tableDirty)
+	return;
+    Lock lock(s_mutex);
+    compose();
+    if (!s_tableDirty)
+	return;
+    TranslatorTable* table = new TranslatorTable(s_factories);
+    s_tableLock.writeLock();
+    TranslatorTable* old = s_table;
+    s_table = table;
+    s_tableDirty = false;
+    s_tableLock.unlock();
+    lock.drop();
+    delete old;
 }
 
 ObjList* DataTranslator::srcFormats(const DataFormat& dFormat, int maxCost, unsigned int maxLen, ObjList* lst)
@@ -1342,27 +2312,21 @@ ObjList* DataTranslator::srcFormats(const DataFormat& dFormat, int maxCost, unsi
     const FormatInfo* fi = dFormat.getInfo();
     if (!fi)
 	return lst;
-    s_mutex.lock();
-    compose();
-    ObjList* l = s_factories.skipNull();
-    for (; l; l=l->skipNext()) {
-	TranslatorFactory* f = static_cast<TranslatorFactory*>(l->get());
-	if (maxLen && (f->length() > maxLen))
+    update();
+    RLock lock(s_tableLock);
+    if (!s_table)
+	return lst;
+    for (const TranslatorTable::Record* r = s_table->findDest(fi); r; r = s_table->nextDest(r)) {
+	if (maxLen && (r->length > maxLen))
 	    continue;
-	const TranslatorCaps* caps = f->getCapabilities();
-	for (; caps && caps->src && caps->dest; caps++) {
-	    if (caps->dest == fi) {
-		if ((maxCost >= 0) && (caps->cost > maxCost))
-		    continue;
-		if (!lst)
-		    lst = new ObjList;
-		else if (lst->find(caps->src->name))
-		    continue;
-		lst->append(new String(caps->src->name));
-	    }
-	}
+	if ((maxCost >= 0) && (r->cost > maxCost))
+	    continue;
+	if (!lst)
+	    lst = new ObjList;
+	else if (lst->find(r->src->name))
+	    continue;
+	lst->append(new String(r->src->name));
     }
-    s_mutex.unlock();
     return lst;
 }
 
@@ -1371,32 +2335,27 @@ ObjList* DataTranslator::destFormats(const DataFormat& sFormat, int maxCost, uns
     const FormatInfo* fi = sFormat.getInfo();
     if (!fi)
 	return lst;
-    s_mutex.lock();
-    compose();
-    ObjList* l = s_factories.skipNull();
-    for (; l; l=l->skipNext()) {
-	TranslatorFactory* f = static_cast<TranslatorFactory*>(l->get());
-	if (maxLen && (f->length() > maxLen))
+    update();
+    RLock lock(s_tableLock);
+    if (!s_table)
+	return lst;
+    for (const TranslatorTable::Record* r = s_table->findSrc(fi); r; r = s_table->nextSrc(r)) {
+	if (maxLen && (r->length > maxLen))
 	    continue;
-	const TranslatorCaps* caps = f->getCapabilities();
-	for (; caps && caps->src && caps->dest; caps++) {
-	    if (caps->src == fi) {
-		if ((maxCost >= 0) && (caps->cost > maxCost))
-		    continue;
-		if (!lst)
-		    lst = new ObjList;
-		else if (lst->find(caps->dest->name))
-		    continue;
-		lst->append(new String(caps->dest->name));
-	    }
-	}
+	if ((maxCost >= 0) && (r->cost > maxCost))
+	    continue;
+	if (!lst)
+	    lst = new ObjList;
+	else if (lst->find(r->dest->name))
+	    continue;
+	lst->append(new String(r->dest->name));
     }
-    s_mutex.unlock();
     return lst;
 }
 
 // helper function to avoid duplicating large amounts of code
-static void mergeOne(ObjList*& lst, const ObjList* formats, const DataFormat& fmt, const FormatInfo* fi, bool sameRate, bool sameChans)
+static void mergeOne(ObjList*& lst, const TranslatorTable* table, const ObjList* formats,
+    const DataFormat& fmt, const FormatInfo* fi, bool sameRate, bool sameChans)
 {
     if (!fi)
 	return;
@@ -1412,7 +2371,7 @@ static void mergeOne(ObjList*& lst, const ObjList* formats, const DataFormat& fm
 	return;
     if (sameChans && (fo->numChannels != fi->numChannels))
 	return;
-    if (DataTranslator::canConvert(fmt,fmti)) {
+    if (table->canConvert(fo,fi)) {
 	if (!lst)
 	    lst = new ObjList;
 	lst->append(new String(fmti));
@@ -1424,8 +2383,10 @@ ObjList* DataTranslator::allFormats(const ObjList* formats, bool existing, bool
     if (!formats)
 	return 0;
     ObjList* lst = 0;
-    s_mutex.lock();
-    compose();
+    update();
+    RLock lock(s_tableLock);
+    if (!s_table)
+	return 0;
     const ObjList* fmts;
     if (existing) {
 	// put existing formats first
@@ -1452,12 +2413,11 @@ ObjList* DataTranslator::allFormats(const ObjList* formats, bool existing, bool
 
 	// search in the static list first
 	for (unsigned int i = 0; i < (sizeof(s_formats)/sizeof(FormatInfo)); i++)
-	    mergeOne(lst,formats,fmto,s_formats+i,sameRate,sameChans);
+	    mergeOne(lst,s_table,formats,fmto,s_formats+i,sameRate,sameChans);
 	// then try the installed formats
 	for (flist* l = s_flist; l; l = l->next)
-	    mergeOne(lst,formats,fmto,l->info,sameRate,sameChans);
+	    mergeOne(lst,s_table,formats,fmto,l->info,sameRate,sameChans);
     }
-    s_mutex.unlock();
     return lst;
 }
 
@@ -1479,9 +2439,9 @@ bool DataTranslator::canConvert(const DataFormat& fmt1, const DataFormat& fmt2)
     const FormatInfo* fi2 = fmt2.getInfo();
     if (!(fi1 && fi2))
 	return false;
-    Lock lock(s_mutex);
-    compose();
-    return canConvert(fi1,fi2);
+    update();
+    RLock lock(s_tableLock);
+    return s_table && s_table->canConvert(fi1,fi2);
 }
 
 bool DataTranslator::canConvert(const FormatInfo* fmt1, const FormatInfo* fmt2)
@@ -1512,20 +2472,14 @@ int DataTranslator::cost(const DataFormat& sFormat, const DataFormat& dFormat)
     const FormatInfo* dest = dFormat.getInfo();
     if (!(src && dest))
 	return c;
-    s_mutex.lock();
-    compose();
-    ObjList* l = s_factories.skipNull();
-    for (; l; l=l->skipNext()) {
-	TranslatorFactory* f = static_cast<TranslatorFactory*>(l->get());
-	const TranslatorCaps* caps = f->getCapabilities();
-	for (; caps && caps->src && caps->dest; caps++) {
-	    if ((c == -1) || (c > caps->cost)) {
-		if ((caps->src == src) && (caps->dest == dest))
-		    c = caps->cost;
-	    }
-	}
+    update();
+    RLock lock(s_tableLock);
+    if (!s_table)
+	return c;
+    for (const TranslatorTable::Record* r = s_table->findPair(src,dest); r; r = s_table->nextPair(r)) {
+	if ((c == -1) || (c > r->cost))
+	    c = r->cost;
     }
-    s_mutex.unlock();
     return c;
 }
 
@@ -1540,21 +2494,45 @@ DataTranslator* DataTranslator::create(const DataFormat& sFormat, const DataForm
     bool counting = getObjCounting();
     NamedCounter* saved = Thread::getCurrentObjCounter(counting);
 
-    s_mutex.lock();
-    compose();
-    ObjList *l = s_factories.skipNull();
-    for (; l; l=l->skipNext()) {
-	TranslatorFactory* f = static_cast<TranslatorFactory*>(l->get());
-	if (counting)
-	    Thread::setCurrentObjCounter(f->objectsCounter());
-	trans = f->create(sFormat,dFormat);
-	if (trans) {
-	    Debug(DebugAll,"Created DataTranslator %p for '%s' -> '%s' by factory %p (len=%u)",
-		trans,sFormat.c_str(),dFormat.c_str(),f,f->length());
-	    break;
+    const FormatInfo* src = sFormat.getInfo();
+    const FormatInfo* dest = dFormat.getInfo();
+    update();
+    s_tableLock.readLock();
+    const TranslatorTable::Record* r = (s_table && src && dest) ? s_table->findPair(src,dest) : 0;
+    if (r) {
+	// only factories advertising the conversion are asked, in installation order
+	for (; r; r = s_table->nextPair(r)) {
+	    TranslatorFactory* f = r->factory;
+	    if (counting)
+		Thread::setCurrentObjCounter(f->objectsCounter());
+	    trans = f->create(sFormat,dFormat);
+	    if (trans) {
+		Debug(DebugAll,"Created DataTranslator %p for '%s' -> '%s' by factory %p (len=%u)",
+		    trans,sFormat.c_str(),dFormat.c_str(),f,f->length());
+		break;
+	    }
 	}
+	s_tableLock.unlock();
+    }
+    else {
+	s_tableLock.unlock();
+	// not in the table, give all factories a chance as they may
+	//  accept formats they don't advertise
+	s_mutex.lock();
+	ObjList *l = s_factories.skipNull();
+	for (; l; l=l->skipNext()) {
+	    TranslatorFactory* f = static_cast<TranslatorFactory*>(l->get());
+	    if (counting)
+		Thread::setCurrentObjCounter(f->objectsCounter());
+	    trans = f->create(sFormat,dFormat);
+	    if (trans) {
+		Debug(DebugAll,"Created DataTranslator %p for '%s' -> '%s' by factory %p (len=%u)",
+		    trans,sFormat.c_str(),dFormat.c_str(),f,f->length());
+		break;
+	    }
+	}
+	s_mutex.unlock();
     }
-    s_mutex.unlock();
     if (counting)
 	Thread::setCurrentObjCounter(saved);
 
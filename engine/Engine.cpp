@@ -90,13 +90,25 @@ namespace TelEngine {
 class EnginePrivate : public Thread
 {
 public:
-    EnginePrivate()
-	: Thread("Engine Worker")
-	{ count++; }
-    ~EnginePrivate()
-	{ count--; }
+    EnginePrivate();
+    ~EnginePrivate();
     virtual void run();
+    bool pushLocal(Message* msg);
+    static EnginePrivate* current();
+    static unsigned int status(String* details);
     static int count;
+private:
+    void runStealing();
+    Message* popLocal(long maxwait = -1);
+    Message* steal();
+    void pinCpu();
+    ObjList m_queue;
+    ObjList* m_append;
+    Mutex m_queueMutex;
+    volatile unsigned int m_depth;
+    u_int64_t m_steals;
+    int m_index;
+    int m_cpu;
 };
 
 class EngineCommand : public MessageHandler
@@ -159,6 +171,15 @@ using namespace TelEngine;
 #define WORKER_SLEEP 500000
 #endif
 
+// Maximum number of engine workers, in sync with maxworkers range
+#define MAX_WORKERS 1000
+
+#ifdef _WINDOWS
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
 // Supervisor control constants
 
 // Minimum configurable size of child's sanity pool
@@ -315,6 +336,13 @@ static EngineSharedPrivate s_vars;
 static Mutex s_hooksMutex(true,"HooksList");
 static ObjList s_hooks;
 static Semaphore* s_semWorkers = 0;
+static bool s_stealing = false;
+static bool s_pinWorkers = true;
+static RWLock s_workersLock("EngineWorkers");
+static EnginePrivate* s_workers[MAX_WORKERS];
+static int s_workersUsed = 0;
+// Work stealing worker running in the current thread
+static THREAD_LOCAL EnginePrivate* s_currentWorker = 0;
 static NamedCounter* s_counter = 0;
 static NamedCounter* s_workCnt = 0;
 
@@ -544,6 +572,18 @@ bool EngineStatusHandler::received(Message &msg)
 		objects(msg.retValue(),details);
 	    return true;
 	}
+	if (sel == YSTRING("workers")) {
+	    String str;
+	    unsigned int steals = EnginePrivate::status(details ? &str : 0);
+	    msg.retValue()
+		<< "name=workers,type=system,format=Depth|Steals|Cpu;"
+		<< "mode=" << (s_stealing ? "stealing" : "shared")
+		<< ",count=" << EnginePrivate::count << ",steals=" << steals;
+	    if (details && str)
+		msg.retValue() << ';' << str;
+	    msg.retValue() << "\r\n";
+	    return true;
+	}
 	if (sel.startSkip("dispatcher")) {
 	    bool byMsg = sel.startSkip("handlers");
 	    if ((byMsg || sel.startSkip("handlers-trackname")) && sel) {
@@ -592,6 +632,9 @@ bool EngineStatusHandler::received(Message &msg)
 #endif
     msg.retValue() << ",threads=" << Thread::count();
     msg.retValue() << ",workers=" << EnginePrivate::count;
+    msg.retValue() << ",workersmode=" << (s_stealing ? "stealing" : "shared");
+    if (s_stealing)
+	msg.retValue() << ",steals=" << EnginePrivate::status(0);
     msg.retValue() << ",mutexes=" << Mutex::count();
     int locks = Mutex::locks();
     if (locks >= 0)
@@ -1015,9 +1058,51 @@ bool EngineHelp::received(Message &msg)
 }
 
 
+EnginePrivate::EnginePrivate()
+    : Thread("Engine Worker"),
+      m_append(&m_queue), m_queueMutex(false,"EngineWorkerQueue"),
+      m_depth(0), m_steals(0), m_index(-1), m_cpu(-1)
+{
+    count++;
+    if (!s_stealing)
+	return;
+    WLock lck(s_workersLock);
+    for (int i = 0; i < MAX_WORKERS; i++) {
+	if (s_workers[i])
+	    continue;
+	s_workers[i] = this;
+	m_index = i;
+	if (s_workersUsed <= i)
+	    s_workersUsed = i + 1;
+	break;
+    }
+}
+
+EnginePrivate::~EnginePrivate()
+{
+    if (m_index >= 0) {
+	if (s_currentWorker == this)
+	    s_currentWorker = 0;
+	WLock lck(s_workersLock);
+	s_workers[m_index] = 0;
+	while (s_workersUsed && !s_workers[s_workersUsed - 1])
+	    s_workersUsed--;
+	lck.drop();
+	// hand over messages we did not get to process
+	Message* msg;
+	while ((msg = popLocal()))
+	    Engine::self()->m_dispatcher.pushQueued(msg);
+    }
+    count--;
+}
+
 void EnginePrivate::run()
 {
     setCurrentObjCounter(s_workCnt);
+    if (m_index >= 0) {
+	runStealing();
+	return;
+    }
     for (;;) {
 	s_makeworker = false;
 	Semaphore* s = s_semWorkers;
@@ -1034,6 +1119,137 @@ void EnginePrivate::run()
     }
 }
 
+// Worker loop of the work stealing pool
+// Process own messages first, then the shared queue, then steal from others
+void EnginePrivate::runStealing()
+{
+    s_currentWorker = this;
+    pinCpu();
+    MessageDispatcher& disp = Engine::self()->m_dispatcher;
+    for (;;) {
+	s_makeworker = false;
+	Semaphore* s = s_semWorkers;
+	if (s && disp.hasMessages())
+	    s->unlock();
+	for (;;) {
+	    Message* msg = popLocal();
+	    if (!msg) {
+		if (disp.dequeueOne())
+		    continue;
+		msg = steal();
+		if (!msg)
+		    break;
+	    }
+	    disp.dispatchQueued(msg);
+	}
+	s = s_semWorkers;
+	if (s) {
+	    s->lock(WORKER_SLEEP);
+	    Thread::yield(true);
+	}
+	else
+	    Thread::idle(true);
+    }
+}
+
+bool EnginePrivate::pushLocal(Message* msg)
+{
+    if (!Engine::self()->m_dispatcher.markQueued(msg))
+	return false;
+    Lock lck(m_queueMutex);
+    m_append = m_append->append(msg);
+    m_depth++;
+    return true;
+}
+
+Message* EnginePrivate::popLocal(long maxwait)
+{
+    if (!m_depth)
+	return 0;
+    Lock lck(m_queueMutex,maxwait);
+    if (!lck.locked())
+	return 0;
+    if (m_queue.next() == m_append)
+	m_append = &m_queue;
+    Message* msg = static_cast<Message*>(m_queue.remove(false));
+    if (msg)
+	m_depth--;
+    return msg;
+}
+
+Message* EnginePrivate::steal()
+{
+    RLock lck(s_workersLock);
+    int n = s_workersUsed;
+    for (int i = 1; i < n; i++) {
+	EnginePrivate* w = s_workers[(m_index + i) % n];
+	if (!(w && w->m_depth))
+	    continue;
+	// don't wait for a busy victim, try the next one
+	Message* msg = w->popLocal(0);
+	if (msg) {
+	    m_steals++;
+	    return msg;
+	}
+    }
+    return 0;
+}
+
+// Pin worker to one of the CPUs allowed for the engine, round robin by index
+void EnginePrivate::pinCpu()
+{
+    if (!s_pinWorkers)
+	return;
+    DataBlock mask;
+    if (Thread::getCurrentAffinity(mask) || !mask.length())
+	return;
+    const uint8_t* bits = (const uint8_t*)mask.data();
+    unsigned int cpus = 0;
+    for (unsigned int i = 0; i < mask.length() * 8; i++)
+	if (bits[i >> 3] & (1 << (i & 7)))
+	    cpus++;
+    if (cpus < 2)
+	return;
+    unsigned int want = m_index % cpus;
+    for (unsigned int i = 0; i < mask.length() * 8; i++) {
+	if (!(bits[i >> 3] & (1 << (i & 7))) || want--)
+	    continue;
+	DataBlock cpu(0,mask.length());
+	*cpu.data(i >> 3) = 1 << (i & 7);
+	int err = Thread::setCurrentAffinity(cpu);
+	if (err)
+	    Debug(DebugMild,"Failed to pin engine worker %d to CPU %u, error=%s(%d)",
+		m_index,i,strerror(err),err);
+	else
+	    m_cpu = i;
+	break;
+    }
+}
+
+EnginePrivate* EnginePrivate::current()
+{
+    return s_currentWorker;
+}
+
+// Fill work stealing workers status, return total steals
+unsigned int EnginePrivate::status(String* details)
+{
+    unsigned int steals = 0;
+    RLock lck(s_workersLock);
+    for (int i = 0; i < s_workersUsed; i++) {
+	EnginePrivate* w = s_workers[i];
+	if (!w)
+	    continue;
+	steals += (unsigned int)w->m_steals;
+	if (!details)
+	    continue;
+	String tmp;
+	tmp << i << "=" << w->m_depth << "|" << w->m_steals << "|" << w->m_cpu;
+	details->append(tmp,",");
+    }
+    return steals;
+}
+
 
 static bool logFileOpen()
 {
@@ -1669,8 +1885,10 @@ int Engine::engineInit()
     if (modPath)
 	s_modpath = modPath;
     s_minworkers = s_cfg.getIntValue("general","minworkers",s_minworkers,1,500);
-    s_maxworkers = s_cfg.getIntValue("general","maxworkers",s_maxworkers,s_minworkers,1000);
+    s_maxworkers = s_cfg.getIntValue("general","maxworkers",s_maxworkers,s_minworkers,MAX_WORKERS);
     s_addworkers = s_cfg.getIntValue("general","addworkers",s_addworkers,1,10);
+    s_stealing = (YSTRING("stealing") == s_cfg.getValue("general","workers_mode"));
+    s_pinWorkers = s_cfg.getBoolValue("general","workers_pin",true);
     s_maxmsgrate = s_cfg.getIntValue("general","maxmsgrate",s_maxmsgrate,0,50000);
     s_maxmsgage = s_cfg.getIntValue("general","maxmsgage",s_maxmsgage,0,5000);
     s_maxqueued = s_cfg.getIntValue("general","maxqueued",s_maxqueued,0,10000);
@@ -1713,6 +1931,7 @@ int Engine::engineInit()
     s_params.addParam("minworkers",String(s_minworkers));
     s_params.addParam("maxworkers",String(s_maxworkers));
     s_params.addParam("addworkers",String(s_addworkers));
+    s_params.addParam("workers_mode",s_stealing ? "stealing" : "shared");
     s_params.addParam("maxmsgrate",String(s_maxmsgrate));
     s_params.addParam("maxmsgage",String(s_maxmsgage));
     s_params.addParam("maxqueued",String(s_maxqueued));
@@ -1876,7 +2095,7 @@ int Engine::run()
 	    s_init = false;
 	    s_cfg.load();
 	    s_params.setParam("maxworkers",String((s_maxworkers
-		= s_cfg.getIntValue("general","maxworkers",s_maxworkers,s_minworkers,1000))));
+		= s_cfg.getIntValue("general","maxworkers",s_maxworkers,s_minworkers,MAX_WORKERS))));
 	    s_params.setParam("addworkers",String((s_addworkers
 		= s_cfg.getIntValue("general","addworkers",s_addworkers,1,10))));
 	    s_params.setParam("maxmsgrate",String((s_maxmsgrate
@@ -1898,7 +2117,8 @@ int Engine::run()
 	if (s_debug) {
 	    // one-time sending of debug setup messages
 	    s_debug = false;
-	    for (ObjList* o = s_debugInit.paramList()->skipNull(); o; o = o->skipNext()) {
+	    const NamedList& dbg = s_debugInit;
+	    for (const ObjList* o = dbg.paramList()->skipNull(); o; o = o->skipNext()) {
 		const NamedString* str = static_cast<NamedString*>(o->get());
 		if (!(str->name() && *str))
 		    continue;
@@ -1920,8 +2140,10 @@ int Engine::run()
 	}
 
 	// Create worker thread if we didn't hear about any of them in a while
+	// The work stealing pool grows only if messages are also piling up
 	int build = s_maxworkers - EnginePrivate::count;
-	if (s_makeworker && (build > 0)) {
+	if (s_makeworker && (build > 0) &&
+		!(s_stealing && EnginePrivate::count && !m_dispatcher.hasMessages())) {
 	    if (EnginePrivate::count) {
 		if (build > s_addworkers)
 		    build = s_addworkers;
@@ -2424,7 +2646,11 @@ bool Engine::enqueue(Message* msg, bool skipHooks)
 	    return true;
 	}
     }
-    if (s_self && s_self->m_dispatcher.enqueue(msg)) {
+    if (!s_self)
+	return false;
+    // in work stealing mode a worker keeps the messages it generates
+    EnginePrivate* w = s_stealing ? EnginePrivate::current() : 0;
+    if (w ? w->pushLocal(msg) : s_self->m_dispatcher.enqueue(msg)) {
 	Semaphore*s = s_semWorkers;
 	if (s)
 	    s->unlock();
@@ -2433,6 +2659,27 @@ bool Engine::enqueue(Message* msg, bool skipHooks)
     return false;
 }
 
+bool Engine::resume(Message* msg, bool handled)
+{
+    if (!(msg && s_self))
+	return false;
+    switch (s_self->m_dispatcher.resumeDeferred(msg,handled)) {
+	case 1:
+	    return true;
+	case 2:
+	    break;
+	default:
+	    Debug(DebugFail,"Resuming message %p '%s' that was not suspended",msg,msg->c_str());
+	    return false;
+    }
+    if (enqueue(msg,true))
+	return true;
+    // nobody else owns the message now, finish it here instead of leaking it
+    Debug(DebugWarn,"Failed to queue resumed message %p '%s', dispatching it now",
+	msg,msg->c_str());
+    return s_self->m_dispatcher.dispatchResumed(msg);
+}
+
 bool Engine::dispatch(Message* msg)
 {
     return (msg && s_self) ? s_self->m_dispatcher.dispatch(*msg) : false;
@@ -35,10 +35,214 @@ private:
     RefPointer<MessageQueue> m_queue;
 };
 
+// Size of the lock-free engine message ring, must be a power of 2
+#define MSG_RING_SIZE 16384
+
+#ifdef ATOMIC_OPS
+#ifdef _WINDOWS
+#define MSG_CAS(var,oldVal,newVal) \
+    (InterlockedCompareExchange((LONG*)&(var),(LONG)(newVal),(LONG)(oldVal)) == (LONG)(oldVal))
+#define MSG_INC64(var) ((u_int64_t)InterlockedIncrement64((LONGLONG*)&(var)))
+#define MSG_BARRIER() MemoryBarrier()
+#else
+#define MSG_CAS(var,oldVal,newVal) __sync_bool_compare_and_swap(&(var),oldVal,newVal)
+#define MSG_INC64(var) __sync_add_and_fetch(&(var),1)
+#define MSG_BARRIER() __sync_synchronize()
+#endif
+#endif
+
+// States of a message whose dispatching may be suspended by a handler
+#define MSG_DEFER_NONE    0
+// dispatched from the queue, handlers may call defer()
+#define MSG_DEFER_ALLOWED 1
+// defer() was called, handler did not return yet
+#define MSG_DEFER_PENDING 2
+// handler returned, dispatching is suspended
+#define MSG_DEFER_PARKED  3
+// resumed before the handler returned, continue in place
+#define MSG_DEFER_EARLY   4
+// resumed and queued for dispatching
+#define MSG_DEFER_RESUME  5
+
+#ifndef ATOMIC_OPS
+static Mutex s_deferMutex(false,"MessageDefer");
+#endif
+
+static inline bool deferSwap(volatile int& state, int oldVal, int newVal)
+{
+#ifdef ATOMIC_OPS
+    return MSG_CAS(state,oldVal,newVal);
+#else
+    Lock lck(s_deferMutex);
+    if (state != oldVal)
+	return false;
+    state = newVal;
+    return true;
+#endif
+}
+
+namespace TelEngine {
+
+// Bounded multiple producer, multiple consumer ring of messages
+// Each cell carries a sequence number telling if it can be written or read
+class MessageRing
+{
+public:
+    MessageRing(unsigned int size);
+    ~MessageRing();
+    bool push(Message* msg);
+    Message* pop();
+private:
+    struct Cell {
+	volatile unsigned int seq;
+	Message* msg;
+    };
+    Cell* m_cells;
+    unsigned int m_mask;
+    volatile unsigned int m_pushPos;
+    volatile unsigned int m_popPos;
+#ifndef ATOMIC_OPS
+    Mutex m_mutex;
+#endif
+};
+
+};
+
+MessageRing::MessageRing(unsigned int size)
+    : m_cells(new Cell[size]), m_mask(size - 1), m_pushPos(0), m_popPos(0)
+#ifndef ATOMIC_OPS
+      , m_mutex(false,"MessageRing")
+#endif
+{
+    for (unsigned int i = 0; i < size; i++) {
+	m_cells[i].seq = i;
+	m_cells[i].msg = 0;
+    }
+}
+
+MessageRing::~MessageRing()
+{
+    Message* msg;
+    while ((msg = pop()))
+	msg->destruct();
+    delete[] m_cells;
+}
+
+bool MessageRing::push(Message* msg)
+{
+#ifdef ATOMIC_OPS
+    Cell* cell;
+    unsigned int pos = m_pushPos;
+    for (;;) {
+	cell = m_cells + (pos & m_mask);
+	unsigned int seq = cell->seq;
+	MSG_BARRIER();
+	int dif = (int)(seq - pos);
+	if (!dif) {
+	    if (MSG_CAS(m_pushPos,pos,pos + 1))
+		break;
+	}
+	else if (dif < 0)
+	    return false;
+	pos = m_pushPos;
+    }
+    cell->msg = msg;
+    MSG_BARRIER();
+    cell->seq = pos + 1;
+#else
+    Lock lck(m_mutex);
+    Cell* cell = m_cells + (m_pushPos & m_mask);
+    if (cell->seq != m_pushPos)
+	return false;
+    cell->msg = msg;
+    cell->seq = ++m_pushPos;
+#endif
+    return true;
+}
+
+Message* MessageRing::pop()
+{
+#ifdef ATOMIC_OPS
+    Cell* cell;
+    unsigned int pos = m_popPos;
+    for (;;) {
+	cell = m_cells + (pos & m_mask);
+	unsigned int seq = cell->seq;
+	MSG_BARRIER();
+	int dif = (int)(seq - (pos + 1));
+	if (!dif) {
+	    if (MSG_CAS(m_popPos,pos,pos + 1))
+		break;
+	}
+	else if (dif < 0)
+	    return 0;
+	pos = m_popPos;
+    }
+    Message* msg = cell->msg;
+    cell->msg = 0;
+    MSG_BARRIER();
+    cell->seq = pos + m_mask + 1;
+#else
+    Lock lck(m_mutex);
+    Cell* cell = m_cells + (m_popPos & m_mask);
+    if (cell->seq != m_popPos + 1)
+	return 0;
+    Message* msg = cell->msg;
+    cell->msg = 0;
+    cell->seq = m_popPos + m_mask + 1;
+    m_popPos++;
+#endif
+    return msg;
+}
+
+// Priority ordered list of the handlers installed for one message name
+class MessageHandlerList : public String
+{
+public:
+    inline MessageHandlerList(const String& name)
+	: String(name)
+	{}
+    ObjList m_list;
+};
+
+// Check if a handler is placed after a priority and handler address
+static inline bool handlerAfter(const MessageHandler* h, unsigned int prio, const MessageHandler* ref)
+{
+    return (h->priority() > prio) || ((h->priority() == prio) && (h > ref));
+}
+
+// Insert a handler in a priority ordered list
+static ObjList* insertHandler(ObjList& list, MessageHandler* handler, bool autoDelete)
+{
+    unsigned int p = handler->priority();
+    ObjList* l = &list;
+    for (; l; l = l->next()) {
+	MessageHandler* h = static_cast<MessageHandler*>(l->get());
+	// at the same priority we sort them in pointer address order
+	if (h && handlerAfter(h,p,handler))
+	    break;
+    }
+    l = l ? l->insert(handler) : list.append(handler);
+    l->setDelete(autoDelete);
+    return l;
+}
+
+// Find first handler in an ordered list placed after a priority and handler address
+static ObjList* skipHandlers(ObjList* list, unsigned int prio, const MessageHandler* ref)
+{
+    for (ObjList* l = list ? list->skipNull() : 0; l; l = l->skipNext())
+	if (handlerAfter(static_cast<MessageHandler*>(l->get()),prio,ref))
+	    return l;
+    return 0;
+}
+
+
 Message::Message(const char* name, const char* retval, bool broadcast)
     : NamedList(name),
       m_return(retval), m_timeEnqueue((uint64_t)0), m_timeDispatch((uint64_t)0),
-      m_data(0), m_notify(false), m_broadcast(broadcast)
+      m_data(0), m_notify(false), m_broadcast(broadcast), m_queued(0),
+      m_defer(MSG_DEFER_NONE), m_deferRetv(false), m_deferHandled(false),
+      m_deferPrio(0), m_deferAfter(0)
 {
     XDebug(DebugAll,"Message::Message(\"%s\",\"%s\",%s) [%p]",
 	name,retval,String::boolText(broadcast),this);
@@ -49,7 +253,9 @@ Message::Message(const Message& original)
       m_return(original.retValue()), m_time(original.msgTime()),
       m_timeEnqueue(original.m_timeEnqueue), m_timeDispatch(original.m_timeDispatch),
       m_data(0),
-      m_notify(false), m_broadcast(original.broadcast())
+      m_notify(false), m_broadcast(original.broadcast()), m_queued(0),
+      m_defer(MSG_DEFER_NONE), m_deferRetv(false), m_deferHandled(false),
+      m_deferPrio(0), m_deferAfter(0)
 {
     XDebug(DebugAll,"Message::Message(&%p) [%p]",&original,this);
 }
@@ -59,7 +265,9 @@ Message::Message(const Message& original, bool broadcast)
       m_return(original.retValue()), m_time(original.msgTime()),
       m_timeEnqueue(original.m_timeEnqueue), m_timeDispatch(original.m_timeDispatch),
       m_data(0),
-      m_notify(false), m_broadcast(broadcast)
+      m_notify(false), m_broadcast(broadcast), m_queued(0),
+      m_defer(MSG_DEFER_NONE), m_deferRetv(false), m_deferHandled(false),
+      m_deferPrio(0), m_deferAfter(0)
 {
     XDebug(DebugAll,"Message::Message(&%p,%s) [%p]",
 	&original,String::boolText(broadcast),this);
@@ -100,6 +308,16 @@ void Message::dispatched(bool accepted)
 	hook->dispatched(*this,accepted);
 }
 
+bool Message::defer()
+{
+    return deferSwap(m_defer,MSG_DEFER_ALLOWED,MSG_DEFER_PENDING);
+}
+
+bool Message::deferrable() const
+{
+    return (m_defer == MSG_DEFER_ALLOWED);
+}
+
 void Message::resetMsg(Time tm)
 {
     m_return.clear();
@@ -318,10 +536,11 @@ bool MessageRelay::receivedInternal(Message& msg)
 
 
 MessageDispatcher::MessageDispatcher(const char* trackParam)
-    : m_handlersLock("DispatcherHandlers"), m_messagesLock("DispatcherMsgs"), 
+    : m_handlersByName(251), m_ring(new MessageRing(MSG_RING_SIZE)),
+      m_handlersLock("DispatcherHandlers"), m_messagesLock("DispatcherMsgs"), 
       m_hooksLock("DispatcherHooks"),
       m_msgAppend(&m_messages), m_hookAppend(&m_hooks),
-      m_trackParam(trackParam), m_changes(0), m_warnTime(0),
+      m_trackParam(trackParam), m_changes(0), m_overflow(0), m_warnTime(0),
       m_enqueueCount(0), m_dequeueCount(0), m_dispatchCount(0),
       m_queuedMax(0), m_msgAvgAge(0),
       m_traceTime(false), m_traceHandlerTime(false),
@@ -334,11 +553,15 @@ MessageDispatcher::~MessageDispatcher()
 {
     XDebug(DebugInfo,"MessageDispatcher::~MessageDispatcher() [%p]",this);
     clear();
+    delete m_ring;
 }
 
 void MessageDispatcher::clear()
 {
     WLock lck(m_handlersLock);
+    m_changes++;
+    m_handlersByName.clear();
+    m_handlersAny.clear();
     m_handlers.clear();
     lck.acquire(m_hooksLock);
     m_hookAppend = &m_hooks;
@@ -351,32 +574,22 @@ bool MessageDispatcher::install(MessageHandler* handler)
     if (!handler)
 	return false;
     WLock lck(m_handlersLock);
-    ObjList *l = m_handlers.find(handler);
-    if (l)
+    if (m_handlers.find(handler))
 	return false;
-    unsigned p = handler->priority();
-    int pos = 0;
-    for (l=&m_handlers; l; l=l->next(),pos++) {
-	MessageHandler *h = static_cast<MessageHandler *>(l->get());
-	if (!h)
-	    continue;
-	if (h->priority() < p)
-	    continue;
-	if (h->priority() > p)
-	    break;
-	// at the same priority we sort them in pointer address order
-	if (h > handler)
-	    break;
-    }
     m_changes++;
-    if (l) {
-	XDebug(DebugAll,"Inserting handler [%p] on place #%d",handler,pos);
-	l->insert(handler);
-    }
+    insertHandler(m_handlers,handler,true);
+    if (handler->null())
+	insertHandler(m_handlersAny,handler,false);
     else {
-	XDebug(DebugAll,"Appending handler [%p] on place #%d",handler,pos);
-	m_handlers.append(handler);
+	MessageHandlerList* hl = static_cast<MessageHandlerList*>(m_handlersByName[*handler]);
+	if (!hl) {
+	    hl = new MessageHandlerList(*handler);
+	    m_handlersByName.append(hl);
+	}
+	insertHandler(hl->m_list,handler,false);
     }
+    XDebug(DebugAll,"Installed handler [%p] '%s' priority %u",
+	handler,handler->c_str(),handler->priority());
     handler->m_dispatcher = this;
     if (handler->null())
 	Debug(DebugInfo,"Registered broadcast message handler %p",handler);
@@ -390,6 +603,16 @@ bool MessageDispatcher::uninstall(MessageHandler* handler)
     handler = static_cast<MessageHandler *>(m_handlers.remove(handler,false));
     if (handler) {
 	m_changes++;
+	if (handler->null())
+	    m_handlersAny.remove(handler,false);
+	else {
+	    MessageHandlerList* hl = static_cast<MessageHandlerList*>(m_handlersByName[*handler]);
+	    if (hl) {
+		hl->m_list.remove(handler,false);
+		if (!hl->m_list.skipNull())
+		    m_handlersByName.remove(hl);
+	    }
+	}
 	if (handler->m_unsafe > 0) {
 	    DDebug(DebugNote,"Waiting for unsafe MessageHandler %p '%s'",
 		handler,handler->c_str());
@@ -408,6 +631,15 @@ bool MessageDispatcher::uninstall(MessageHandler* handler)
 }
 
 bool MessageDispatcher::dispatch(Message& msg)
+{
+    bool parked = false;
+    return dispatchInternal(msg,parked);
+}
+
+// Dispatch a message, resume it if it was suspended by a handler
+// Sets parked to true if a handler suspended the message, in this case the
+//  message belongs to whoever will resume it and must not be touched anymore
+bool MessageDispatcher::dispatchInternal(Message& msg, bool& parked)
 {
 #ifdef XDEBUG
     Debugger debug("MessageDispatcher::dispatch","(%p) (\"%s\")",&msg,msg.c_str());
@@ -428,97 +660,133 @@ bool MessageDispatcher::dispatch(Message& msg)
     String hTrackName;
     unsigned int hTrackPos = 0;
     bool hTrackTime = m_traceHandlerTime;
-    ObjList *l = &m_handlers;
     RLock lck(m_handlersLock);
-    m_dispatchCount++;
-    for (; l; l=l->next()) {
-	MessageHandler *h = static_cast<MessageHandler*>(l->get());
-	if (h && (h->null() || *h == msg)) {
-	    if (h->filter() && !h->filter()->matchListParam(msg))
-		continue;
-	    if (counting)
-		Thread::setCurrentObjCounter(h->objectsCounter());
-
-	    unsigned int c = m_changes;
-	    unsigned int p = h->priority();
-	    if (trackParam() && h->trackName()) {
-		NamedString* tracked = msg.getParam(trackParam());
-		if (tracked)
-		    tracked->append(h->trackName(),",");
-		else
-		    msg.addParam(trackParam(),h->trackName());
-		if (hTrackTime) {
-		    hTrackName = h->trackName();
-		    hTrackPos = tracked ? tracked->length() : hTrackName.length();
-		}
+    // merge the handlers of this message name with the catch-all ones
+    MessageHandlerList* hl = static_cast<MessageHandlerList*>(m_handlersByName[msg]);
+    ObjList* ln = 0;
+    ObjList* la = 0;
+    if (msg.m_deferAfter) {
+	// continue after the handler that suspended the message
+	retv = msg.m_deferRetv;
+	if (!retv || msg.broadcast()) {
+	    ln = skipHandlers(hl ? &hl->m_list : 0,msg.m_deferPrio,msg.m_deferAfter);
+	    la = skipHandlers(&m_handlersAny,msg.m_deferPrio,msg.m_deferAfter);
+	}
+	msg.m_deferAfter = 0;
+    }
+    else {
+	m_dispatchCount++;
+	ln = hl ? hl->m_list.skipNull() : 0;
+	la = m_handlersAny.skipNull();
+    }
+    while (ln || la) {
+	MessageHandler* h = 0;
+	if (ln && la) {
+	    MessageHandler* hn = static_cast<MessageHandler*>(ln->get());
+	    MessageHandler* ha = static_cast<MessageHandler*>(la->get());
+	    if (handlerAfter(hn,ha->priority(),ha)) {
+		h = ha;
+		la = la->skipNext();
 	    }
-	    // mark handler as unsafe to destroy / uninstall
-	    h->m_unsafe++;
-	    lck.drop();
-
-	    u_int64_t tm = (m_warnTime || hTrackTime) ? Time::now() : 0;
-
-	    retv = h->receivedInternal(msg) || retv;
-
-	    if (tm) {
-		tm = Time::now() - tm;
-		if (m_warnTime && tm > m_warnTime) {
-		    lck.acquire(m_handlersLock);
-		    const char* name = (c == m_changes) ? h->trackName().c_str() : 0;
-		    Debug(DebugInfo,"Message '%s' [%p] passed through %p%s%s%s in " FMT64U " usec",
-			msg.c_str(),&msg,h,
-			(name ? " '" : ""),(name ? name : ""),(name ? "'" : ""),tm);
-		}
-		if (hTrackTime && hTrackName) {
-		    NamedString* tracked = msg.getParam(trackParam());
-		    unsigned int start = hTrackPos - hTrackName.length();
-		    if (tracked && start < tracked->length()) {
-			if (0 == ::strncmp(tracked->c_str() + start,hTrackName.c_str(),hTrackName.length())) {
-			    String buf;
-			    buf.printf("#%u.%03u",(unsigned int)(tm / 1000),
-				(unsigned int)(tm % 1000));
-			    char c = (*tracked)[hTrackPos];
-			    if (!c)
-				*tracked << buf;
-			    else if (',' == c) // Message re-dispatched. New handler name added
-				tracked->insert(hTrackPos,buf,buf.length());
-			}
-		    }
-		}
+	    else {
+		h = hn;
+		ln = ln->skipNext();
 	    }
+	}
+	else if (ln) {
+	    h = static_cast<MessageHandler*>(ln->get());
+	    ln = ln->skipNext();
+	}
+	else {
+	    h = static_cast<MessageHandler*>(la->get());
+	    la = la->skipNext();
+	}
+	if (h->filter() && !h->filter()->matchListParam(msg))
+	    continue;
+	if (counting)
+	    Thread::setCurrentObjCounter(h->objectsCounter());
+
+	unsigned int c = m_changes;
+	unsigned int p = h->priority();
+	if (trackParam() && h->trackName()) {
+	    NamedString* tracked = msg.getParam(trackParam());
+	    if (tracked)
+		tracked->append(h->trackName(),",");
+	    else
+		msg.addParam(trackParam(),h->trackName());
+	    if (hTrackTime) {
+		hTrackName = h->trackName();
+		hTrackPos = tracked ? tracked->length() : hTrackName.length();
+	    }
+	}
+	// mark handler as unsafe to destroy / uninstall
+	h->m_unsafe++;
+	lck.drop();
+
+	u_int64_t tm = (m_warnTime || hTrackTime) ? Time::now() : 0;
+
+	retv = h->receivedInternal(msg) || retv;
+
+	if (msg.m_defer == MSG_DEFER_PENDING) {
+	    // the handler suspended the message, remember where we are
+	    // once parked the message belongs to the resuming thread, skip timing
+	    msg.m_deferRetv = retv;
+	    msg.m_deferPrio = p;
+	    msg.m_deferAfter = h;
+	    if (deferSwap(msg.m_defer,MSG_DEFER_PENDING,MSG_DEFER_PARKED)) {
+		if (counting)
+		    Thread::setCurrentObjCounter(saved);
+		parked = true;
+		return false;
+	    }
+	    // already resumed from another thread, just go on
+	    msg.m_deferAfter = 0;
+	    msg.m_defer = MSG_DEFER_ALLOWED;
+	    retv = retv || msg.m_deferHandled;
+	}
 
-	    if (retv && !msg.broadcast())
-		break;
-	    lck.acquire(m_handlersLock);
-	    if (c == m_changes)
-		continue;
-	    // the handler list has changed - find again
-	    NDebug(DebugAll,"Rescanning handler list for '%s' [%p] at priority %u",
-		msg.c_str(),&msg,p);
-	    ObjList* l2 = &m_handlers;
-	    for (l = l2; l; l=l->next()) {
-		MessageHandler *mh = static_cast<MessageHandler*>(l->get());
-		if (!mh)
-		    continue;
-		if (mh == h)
-		    // exact match - silently continue where we left
-		    break;
-
-		// gone past last handler priority - exit with last handler
-		if ((mh->priority() > p) || ((mh->priority() == p) && (mh > h))) {
-		    Debug(DebugAll,"Handler list for '%s' [%p] changed, skipping from %p (%u) to %p (%u)",
-			msg.c_str(),&msg,h,p,mh,mh->priority());
-		    // l will advance in the outer for loop so use previous
-		    l = l2;
-		    break;
+	if (tm) {
+	    tm = Time::now() - tm;
+	    if (m_warnTime && tm > m_warnTime) {
+		lck.acquire(m_handlersLock);
+		const char* name = (c == m_changes) ? h->trackName().c_str() : 0;
+		Debug(DebugInfo,"Message '%s' [%p] passed through %p%s%s%s in " FMT64U " usec",
+		    msg.c_str(),&msg,h,
+		    (name ? " '" : ""),(name ? name : ""),(name ? "'" : ""),tm);
+	    }
+	    if (hTrackTime && hTrackName) {
+		NamedString* tracked = msg.getParam(trackParam());
+		unsigned int start = hTrackPos - hTrackName.length();
+		if (tracked && start < tracked->length()) {
+		    if (0 == ::strncmp(tracked->c_str() + start,hTrackName.c_str(),hTrackName.length())) {
+			String buf;
+			buf.printf("#%u.%03u",(unsigned int)(tm / 1000),
+			    (unsigned int)(tm % 1000));
+			char c = (*tracked)[hTrackPos];
+			if (!c)
+			    *tracked << buf;
+			else if (',' == c) // Message re-dispatched. New handler name added
+			    tracked->insert(hTrackPos,buf,buf.length());
+		    }
 		}
-		l2 = l;
 	    }
-	    if (!l)
-		break;
 	}
+
+	if (retv && !msg.broadcast())
+	    break;
+	lck.acquire(m_handlersLock);
+	// a handler may have renamed the message (e.g. chan.masquerade)
+	if (c == m_changes && (hl ? (*hl == msg) : !m_handlersByName[msg]))
+	    continue;
+	// the handler list has changed - find again
+	NDebug(DebugAll,"Rescanning handler list for '%s' [%p] at priority %u",
+	    msg.c_str(),&msg,p);
+	hl = static_cast<MessageHandlerList*>(m_handlersByName[msg]);
+	ln = skipHandlers(hl ? &hl->m_list : 0,p,h);
+	la = skipHandlers(&m_handlersAny,p,h);
     }
     lck.drop();
+    msg.m_defer = MSG_DEFER_NONE;
     if (counting)
 	Thread::setCurrentObjCounter(msg.getObjCounter());
     msg.dispatched(retv);
@@ -542,6 +810,7 @@ bool MessageDispatcher::dispatch(Message& msg)
     }
 
     lck.acquire(m_hooksLock);
+    ObjList* l = 0;
     if (m_hookHole && !m_hookCount) {
 	// compact the list, remove the holes
 	for (l = &m_hooks; l; l = l->next()) {
@@ -575,35 +844,127 @@ bool MessageDispatcher::dispatch(Message& msg)
     return retv;
 }
 
-bool MessageDispatcher::enqueue(Message* msg)
+bool MessageDispatcher::markQueued(Message* msg)
 {
+    if (!msg)
+	return false;
+    // the queued flag replaces searching the whole queue for duplicates
+#ifdef ATOMIC_OPS
+    if (!MSG_CAS(msg->m_queued,0,1))
+	return false;
+#else
     WLock lck(m_messagesLock);
-    if (!msg || m_messages.find(msg))
+    if (msg->m_queued)
 	return false;
+    msg->m_queued = 1;
+    lck.drop();
+#endif
     if (m_traceTime)
 	msg->m_timeEnqueue = Time::now();
-    m_msgAppend = m_msgAppend->append(msg);
-    u_int64_t count = (++m_enqueueCount) - m_dequeueCount;
+    // count before the message is pushed so a consumer can never dequeue it first
+#ifdef ATOMIC_OPS
+    u_int64_t enq = MSG_INC64(m_enqueueCount);
+    u_int64_t deq = m_dequeueCount;
+#else
+    lck.acquire(m_messagesLock);
+    u_int64_t enq = ++m_enqueueCount;
+    u_int64_t deq = m_dequeueCount;
+    lck.drop();
+#endif
+    // other producers may have been counted and dequeued meanwhile
+    u_int64_t count = (enq > deq) ? enq - deq : 0;
+    // high watermark is advisory, a lost race only delays its update
     if (m_queuedMax < count)
 	m_queuedMax = count;
     return true;
 }
 
-bool MessageDispatcher::dequeueOne()
+void MessageDispatcher::dispatchQueued(Message* msg)
 {
+    msg->m_queued = 0;
+#ifdef ATOMIC_OPS
+    MSG_INC64(m_dequeueCount);
+#else
     WLock lck(m_messagesLock);
-    if (m_messages.next() == m_msgAppend)
-	m_msgAppend = &m_messages;
-    Message* msg = static_cast<Message *>(m_messages.remove(false));
-    if (!msg)
-	return false;
     m_dequeueCount++;
-    uint64_t age = Time::now() - msg->msgTime();
-    if (age < 60000000)
-	m_msgAvgAge = (3 * m_msgAvgAge + age) >> 2;
     lck.drop();
-    dispatch(*msg);
-    msg->destruct();
+#endif
+    if (msg->m_defer != MSG_DEFER_RESUME) {
+	uint64_t age = Time::now() - msg->msgTime();
+	if (age < 60000000)
+	    m_msgAvgAge = (3 * m_msgAvgAge + age) >> 2;
+    }
+    dispatchOwned(msg);
+}
+
+// Continue resuming a message in the calling thread if it could not be queued
+bool MessageDispatcher::dispatchResumed(Message* msg)
+{
+    // a message already queued will be dispatched from the queue
+    if (msg->m_queued)
+	return true;
+    if (msg->m_defer != MSG_DEFER_RESUME)
+	return false;
+    dispatchOwned(msg);
+    return true;
+}
+
+// Dispatch a message owned by the dispatcher, destroy it unless parked again
+void MessageDispatcher::dispatchOwned(Message* msg)
+{
+    if (msg->m_defer == MSG_DEFER_RESUME)
+	msg->m_deferRetv = msg->m_deferRetv || msg->m_deferHandled;
+    msg->m_defer = MSG_DEFER_ALLOWED;
+    bool parked = false;
+    dispatchInternal(*msg,parked);
+    if (!parked)
+	msg->destruct();
+}
+
+// Returns 0 if message is not suspended, 1 if it will continue in the thread
+//  that suspended it or 2 if it must be queued again
+int MessageDispatcher::resumeDeferred(Message* msg, bool handled)
+{
+    msg->m_deferHandled = handled;
+    if (deferSwap(msg->m_defer,MSG_DEFER_PENDING,MSG_DEFER_EARLY))
+	return 1;
+    if (deferSwap(msg->m_defer,MSG_DEFER_PARKED,MSG_DEFER_RESUME))
+	return 2;
+    return 0;
+}
+
+void MessageDispatcher::pushQueued(Message* msg)
+{
+    // once the ring filled up keep queueing to the overflow list until it drains
+    if (m_overflow || !m_ring->push(msg)) {
+	WLock lck(m_messagesLock);
+	m_msgAppend = m_msgAppend->append(msg);
+	m_overflow++;
+    }
+}
+
+bool MessageDispatcher::enqueue(Message* msg)
+{
+    if (!markQueued(msg))
+	return false;
+    pushQueued(msg);
+    return true;
+}
+
+bool MessageDispatcher::dequeueOne()
+{
+    Message* msg = m_ring->pop();
+    if (!msg && m_overflow) {
+	WLock lck(m_messagesLock);
+	if (m_messages.next() == m_msgAppend)
+	    m_msgAppend = &m_messages;
+	msg = static_cast<Message *>(m_messages.remove(false));
+	if (msg)
+	    m_overflow--;
+    }
+    if (!msg)
+	return false;
+    dispatchQueued(msg);
     return true;
 }
 
@@ -616,7 +977,10 @@ void MessageDispatcher::dequeue()
 unsigned int MessageDispatcher::messageCount()
 {
     RLock lck(m_messagesLock);
-    return (unsigned int)(m_enqueueCount - m_dequeueCount);
+    // read dequeued first, it never gets ahead of what was enqueued
+    u_int64_t deq = m_dequeueCount;
+    u_int64_t enq = m_enqueueCount;
+    return (enq > deq) ? (unsigned int)(enq - deq) : 0;
 }
 
 unsigned int MessageDispatcher::handlerCount()
@@ -634,8 +998,8 @@ unsigned int MessageDispatcher::postHookCount()
 void MessageDispatcher::getStats(u_int64_t& enqueued, u_int64_t& dequeued, u_int64_t& dispatched, u_int64_t& queueMax)
 {
     RLock lck(m_messagesLock);
-    enqueued = m_enqueueCount;
     dequeued = m_dequeueCount;
+    enqueued = m_enqueueCount;
     queueMax = m_queuedMax;
     lck.acquire(m_handlersLock);
     dispatched = m_dispatchCount;
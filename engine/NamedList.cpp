@@ -19,10 +19,123 @@
 
 #include "yateclass.h"
 #include "yatexml.h"
+#include <string.h>
+
+// Minimum number of parameters walked by a lookup before building an index
+#define NAMEDLIST_INDEX_MIN 32
+
+namespace TelEngine {
+
+// Open addressing hash table mapping names to the first list node holding it
+// It also counts the parameters of the list to detect changes made directly
+//  to the list through a pointer obtained earlier from paramList()
+class NamedListIndex
+{
+public:
+    NamedListIndex(const ObjList& params, unsigned int count);
+    inline ~NamedListIndex()
+	{ delete[] m_slots; }
+    inline unsigned int count() const
+	{ return m_count; }
+    inline void counted(int delta)
+	{ m_count += delta; }
+    const ObjList* find(const String& name) const;
+    bool add(const ObjList* node);
+    bool remove(const ObjList* node);
+    void moved(const ObjList* from, const ObjList* to);
+private:
+    static inline const String& name(const ObjList* node)
+	{ return static_cast<const NamedString*>(node->get())->name(); }
+    const ObjList** m_slots;
+    unsigned int m_mask;
+    unsigned int m_used;
+    unsigned int m_count;
+};
+
+};
 
 using namespace TelEngine;
 
 static const NamedList s_empty("");
+static u_int64_t s_shapes = 0;
+#ifndef ATOMIC_OPS
+static Mutex s_shapeMutex(false,"NamedListShape");
+#endif
+
+NamedListIndex::NamedListIndex(const ObjList& params, unsigned int count)
+    : m_slots(0), m_mask(63), m_used(0), m_count(count)
+{
+    while (m_mask < 4 * count)
+	m_mask = (m_mask << 1) | 1;
+    m_slots = new const ObjList*[m_mask + 1];
+    ::memset(m_slots,0,(m_mask + 1) * sizeof(const ObjList*));
+    for (const ObjList* o = params.skipNull(); o; o = o->skipNext())
+	add(o);
+}
+
+const ObjList* NamedListIndex::find(const String& name) const
+{
+    unsigned int h = name.hash();
+    for (unsigned int i = h & m_mask; m_slots[i]; i = (i + 1) & m_mask) {
+	const String& n = NamedListIndex::name(m_slots[i]);
+	if (n.hash() == h && n == name)
+	    return m_slots[i];
+    }
+    return 0;
+}
+
+// Add a parameter node unless its name is already indexed
+// Return false if the table is too full and must be rebuilt
+bool NamedListIndex::add(const ObjList* node)
+{
+    if (2 * (m_used + 1) > m_mask)
+	return false;
+    const String& n = name(node);
+    unsigned int h = n.hash();
+    unsigned int i = h & m_mask;
+    for (; m_slots[i]; i = (i + 1) & m_mask) {
+	const String& other = name(m_slots[i]);
+	if (other.hash() == h && other == n)
+	    return true;
+    }
+    m_slots[i] = node;
+    m_used++;
+    return true;
+}
+
+// Remove the slot of a parameter node, shift back the rest of its cluster
+// Return false if the node was not indexed
+bool NamedListIndex::remove(const ObjList* node)
+{
+    unsigned int i = name(node).hash() & m_mask;
+    for (; m_slots[i] != node; i = (i + 1) & m_mask) {
+	if (!m_slots[i])
+	    return false;
+    }
+    m_slots[i] = 0;
+    m_used--;
+    for (unsigned int j = (i + 1) & m_mask; m_slots[j]; j = (j + 1) & m_mask) {
+	unsigned int k = name(m_slots[j]).hash() & m_mask;
+	// leave in place entries whose home slot lies cyclically in (i,j]
+	if ((i < j) ? (i < k && k <= j) : (i < k || k <= j))
+	    continue;
+	m_slots[i] = m_slots[j];
+	m_slots[j] = 0;
+	i = j;
+    }
+    return true;
+}
+
+// Update the slot of a parameter that moved from a list node to another
+void NamedListIndex::moved(const ObjList* from, const ObjList* to)
+{
+    for (unsigned int i = name(to).hash() & m_mask; m_slots[i]; i = (i + 1) & m_mask) {
+	if (m_slots[i] == from) {
+	    m_slots[i] = to;
+	    return;
+	}
+    }
+}
 
 const NamedList& NamedList::empty()
 {
@@ -30,22 +143,27 @@ const NamedList& NamedList::empty()
 }
 
 NamedList::NamedList(const char* name)
-    : String(name)
+    : String(name), m_index(0), m_shape(0)
 {
 }
 
 NamedList::NamedList(const NamedList& original)
-    : String(original)
+    : String(original), m_index(0), m_shape(0)
 {
     copyParams(false,original);
 }
 
 NamedList::NamedList(const char* name, const NamedList& original, const String& prefix)
-    : String(name)
+    : String(name), m_index(0), m_shape(0)
 {
     copySubParams(original,prefix);
 }
 
+NamedList::~NamedList()
+{
+    resetIndex();
+}
+
 NamedList& NamedList::operator=(const NamedList& value)
 {
     String::operator=(value);
@@ -60,20 +178,70 @@ void* NamedList::getObject(const String& name) const
     return String::getObject(name);
 }
 
+void NamedList::dropIndex()
+{
+    NamedListIndex* idx = m_index;
+    m_index = 0;
+    delete idx;
+}
+
+// Keep the index in sync with a parameter node appended to list
+void NamedList::indexParam(const ObjList* node)
+{
+    m_shape = 0;
+    if (!m_index)
+	return;
+    m_index->counted(1);
+    if (!m_index->add(node))
+	dropIndex();
+}
+
+// Hand out a structure stamp not used by any other list
+// Stamps are 64 bit so they never wrap and a freed list can't match later
+u_int64_t NamedList::shape() const
+{
+    while (!m_shape) {
+#ifdef ATOMIC_OPS
+#ifdef _WINDOWS
+	m_shape = (u_int64_t)InterlockedIncrement64((LONGLONG*)&s_shapes);
+#else
+	m_shape = __sync_add_and_fetch(&s_shapes,1);
+#endif
+#else
+	Lock lck(s_shapeMutex);
+	m_shape = ++s_shapes;
+#endif
+    }
+    return m_shape;
+}
+
 NamedList& NamedList::addParam(NamedString* param)
 {
     XDebug(DebugInfo,"NamedList::addParam(%p) [\"%s\",\"%s\"]",
         param,(param ? param->name().c_str() : ""),TelEngine::c_safe(param));
-    if (param)
-	m_params.append(param);
+    if (param) {
+	indexParam(m_params.append(param));
+    }
     return *this;
 }
 
+const ObjList* NamedList::addParamNode(NamedString* param, const ObjList* node)
+{
+    XDebug(DebugInfo,"NamedList::addParamNode(%p,%p) [\"%s\",\"%s\"]",
+        param,node,(param ? param->name().c_str() : ""),TelEngine::c_safe(param));
+    if (!param)
+	return 0;
+    ObjList* o = (node ? const_cast<ObjList*>(node) : &m_params)->append(param);
+    indexParam(o);
+    return o;
+}
+
 NamedList& NamedList::addParam(const char* name, const char* value, bool emptyOK)
 {
     XDebug(DebugInfo,"NamedList::addParam(\"%s\",\"%s\",%s)",name,value,String::boolText(emptyOK));
-    if (emptyOK || !TelEngine::null(value))
-	m_params.append(new NamedString(name, value));
+    if (emptyOK || !TelEngine::null(value)) {
+	indexParam(m_params.append(new NamedString(name, value)));
+    }
     return *this;
 }
 
@@ -82,42 +250,21 @@ NamedList& NamedList::setParam(NamedString* param)
     XDebug(DebugAll,"NamedList::setParam(%p) [%p]",param,this);
     if (!param)
 	return *this;
-    ObjList* o = m_params.skipNull();
-    while (o) {
-        NamedString* s = static_cast<NamedString*>(o->get());
-        if (s->name() == param->name()) {
-	    o->set(param);
-	    return *this;
-	}
-	ObjList* next = o->skipNext();
-	if (next)
-	    o = next;
-	else
-	    break;
-    }
+    // the node is ours, it keeps its place in list and index
+    ObjList* o = const_cast<ObjList*>(getParamNode(param->name()));
     if (o)
-	o->append(param);
+	o->set(param);
     else
-	m_params.append(param);
+	addParam(param);
     return *this;   
 }
 
-static inline NamedString* nlSetParamCreate(NamedList& list, const String& name, ObjList*& append)
+// Find parameter to set, create a new one if not found
+static inline NamedString* nlSetParamCreate(NamedList& list, const String& name, bool& append)
 {
-    append = list.paramList()->skipNull();
-    while (append) {
-        NamedString* ns = static_cast<NamedString*>(append->get());
-        if (ns->name() == name) {
-	    append = 0;
-	    return ns;
-	}
-	ObjList* next = append->skipNext();
-	if (!next)
-	    return new NamedString(name);
-	append = next;
-    }
-    append = list.paramList();
-    return new NamedString(name);
+    NamedString* ns = list.getParam(name);
+    append = !ns;
+    return ns ? ns : new NamedString(name);
 }
 
 NamedList& NamedList::setParam(const String& name, unsigned int flags, const TokenDict* tokens,
@@ -125,12 +272,12 @@ NamedList& NamedList::setParam(const String& name, unsigned int flags, const Tok
 {
     XDebug(DebugAll,"NamedList::setParam(%s) flags=%u tokens=%p unkFlag=%u [%p]",
 	name.safe(),flags,tokens,unknownflag,this);
-    ObjList* append = 0;
+    bool append = false;
     NamedString* ns = nlSetParamCreate(*this,name,append);
     *static_cast<String*>(ns) = "";
     ns->decodeFlags(flags,tokens,unknownflag);
     if (append)
-	append->append(ns);
+	addParam(ns);
     return *this;   
 }
 
@@ -139,33 +286,33 @@ NamedList& NamedList::setParam(const String& name, uint64_t flags, const TokenDi
 {
     XDebug(DebugAll,"NamedList::setParam(%s) flags64=" FMT64U " tokens=%p unkFlag=%u [%p]",
 	name.safe(),flags,tokens,unknownflag,this);
-    ObjList* append = 0;
+    bool append = false;
     NamedString* ns = nlSetParamCreate(*this,name,append);
     *static_cast<String*>(ns) = "";
     ns->decodeFlags(flags,tokens,unknownflag);
     if (append)
-	append->append(ns);
+	addParam(ns);
     return *this;   
 }
 
 NamedList& NamedList::setParamHex(const String& name, const void* buf, unsigned int len, char sep)
 {
     XDebug(DebugAll,"NamedList::setParamHex(%s,%p,%u,%c) [%p]",name.safe(),buf,len,sep,this);
-    ObjList* append = 0;
+    bool append = false;
     NamedString* ns = nlSetParamCreate(*this,name,append);
     ns->hexify((void*)buf,len,sep);
     if (append)
-	append->append(ns);
+	addParam(ns);
     return *this;   
 }
 
 template <class Obj> NamedList& nlSetParamValue(NamedList& list, const String& name, Obj& value)
 {
-    ObjList* append = 0;
+    bool append = false;
     NamedString* ns = nlSetParamCreate(list,name,append);
     *static_cast<String*>(ns) = value;
     if (append)
-	append->append(ns);
+	list.addParam(ns);
     return list;
 }
 
@@ -216,8 +363,11 @@ NamedList& NamedList::clearParam(const String& name, char childSep, const String
     while (p) {
         NamedString *s = static_cast<NamedString *>(p->get());
         if (s && ((s->name() == name) || s->name().startsWith(tmp))
-	    && (!value || value->matches(*s)))
+	    && (!value || value->matches(*s))) {
+	    // a parameter with same name may follow, let the index rebuild
+	    resetIndex();
             p->remove();
+	}
 	else
 	    p = p->next();
     }
@@ -230,12 +380,45 @@ NamedList& NamedList::clearParam(NamedString* param, bool delParam)
     if (!param)
 	return *this;
     ObjList* o = m_params.find(param);
-    if (o)
+    if (o) {
+	resetIndex();
 	o->remove(delParam);
+    }
     XDebug(DebugInfo,"NamedList::clearParam(%p) found=%p",param,o);
     return *this;
 }
 
+// Remove the parameter held by a known node without dropping the index
+NamedString* NamedList::clearParamNode(const ObjList* node, bool delParam)
+{
+    ObjList* o = const_cast<ObjList*>(node);
+    NamedString* ns = o ? static_cast<NamedString*>(o->get()) : 0;
+    if (!ns)
+	return 0;
+    XDebug(DebugInfo,"NamedList::clearParamNode(%p) '%s'",node,ns->name().c_str());
+    m_shape = 0;
+    const ObjList* next = o->next();
+    if (m_index)
+	m_index->counted(-1);
+    if (m_index && m_index->remove(o)) {
+	// a parameter with same name may follow, it becomes the indexed one
+	for (const ObjList* l = o->skipNext(); l; l = l->skipNext()) {
+	    if (static_cast<const NamedString*>(l->get())->name() == ns->name()) {
+		if (!m_index->add(l))
+		    dropIndex();
+		break;
+	    }
+	}
+    }
+    o->remove(false);
+    if (m_index && next && o->get())
+	m_index->moved(next,o);
+    if (!delParam)
+	return ns;
+    TelEngine::destruct(ns);
+    return 0;
+}
+
 NamedList& NamedList::copyParam(const NamedList& original, const String& name, char childSep)
 {
     XDebug(DebugInfo,"NamedList::copyParam(%p,\"%s\",'%.1s')",
@@ -251,8 +434,10 @@ NamedList& NamedList::copyParam(const NamedList& original, const String& name, c
     ObjList* dest = &m_params;
     for (const ObjList* l = original.m_params.skipNull(); l; l = l->skipNext()) {
 	const NamedString* s = static_cast<const NamedString*>(l->get());
-        if ((s->name() == name) || s->name().startsWith(tmp))
+        if ((s->name() == name) || s->name().startsWith(tmp)) {
 	    dest = dest->append(new NamedString(s->name(),*s));
+	    indexParam(dest);
+	}
     }
     return *this;
 }
@@ -284,8 +469,10 @@ NamedList& NamedList::copyParams(bool replace, const NamedList& original, bool c
 	    ns = nlCopyParam(*p);
 	if (!ns)
 	    ns = new NamedString(p->name(),*p);
-	if (append)
+	if (append) {
 	    append = append->append(ns);
+	    indexParam(append);
+	}
 	else
 	    setParam(ns);
     }
@@ -335,8 +522,10 @@ NamedList& NamedList::copySubParams(const NamedList& original, const String& pre
 		const char* name = s->name().c_str() + offs;
 		if (!*name)
 		    continue;
-		if (!replace)
+		if (!replace) {
 		    dest = dest->append(new NamedString(name,*s));
+		    indexParam(dest);
+		}
 		else if (offs)
 		    setParam(name,*s);
 		else
@@ -397,16 +586,54 @@ int NamedList::getIndex(const String& name) const
     return -1;
 }
 
-NamedString* NamedList::getParam(const String& name) const
-{
-    XDebug(DebugInfo,"NamedList::getParam(\"%s\")",name.c_str());
+const ObjList* NamedList::getParamNode(const String& name) const
+{
+    XDebug(DebugInfo,"NamedList::getParamNode(\"%s\")",name.c_str());
+    NamedListIndex* idx = m_index;
+    if (idx) {
+	const ObjList* p = idx->find(name);
+	// hits are checked by name, trust a miss only if no parameter was
+	//  added or removed behind the index, scan the list otherwise
+	if (p || idx->count() == m_params.count())
+	    return p;
+	DDebug(DebugMild,"NamedList '%s' changed while indexed [%p]",c_str(),this);
+	for (p = m_params.skipNull(); p; p = p->skipNext()) {
+	    if (static_cast<const NamedString*>(p->get())->name() == name)
+		break;
+	}
+	return p;
+    }
+    unsigned int n = 0;
     const ObjList *p = m_params.skipNull();
-    for (; p; p=p->skipNext()) {
+    for (; p; p=p->skipNext(), n++) {
         NamedString *s = static_cast<NamedString *>(p->get());
         if (s->name() == name)
-            return s;
+            break;
     }
-    return 0;
+    if (n >= NAMEDLIST_INDEX_MIN) {
+	// long walk, build an index for next lookups
+	idx = new NamedListIndex(m_params,m_params.count());
+#ifdef ATOMIC_OPS
+#ifdef _WINDOWS
+	bool ok = !InterlockedCompareExchangePointer((PVOID*)&m_index,idx,0);
+#else
+	bool ok = __sync_bool_compare_and_swap(&m_index,(NamedListIndex*)0,idx);
+#endif
+#else
+	bool ok = !m_index;
+	if (ok)
+	    m_index = idx;
+#endif
+	if (!ok)
+	    delete idx;
+    }
+    return p;
+}
+
+NamedString* NamedList::getParam(const String& name) const
+{
+    const ObjList* p = getParamNode(name);
+    return p ? static_cast<NamedString*>(p->get()) : 0;
 }
 
 NamedString* NamedList::getParam(unsigned int index) const
@@ -73,6 +73,9 @@
 #define MAX_SOCKLEN 1024
 #define MAX_RESWAIT 5000000
 
+// Maximum number of datagrams transferred in one batch system call
+#define MAX_BATCH 64
+
 using namespace TelEngine;
 
 static Mutex s_mutex(false,"SocketAddr");
@@ -2052,6 +2055,104 @@ int Socket::recvFrom(void* buffer, int length, SocketAddr& addr, int flags)
     return res;
 }
 
+int Socket::recvFromBatch(void** buffers, int* lengths, int count, SocketAddr* addrs, int flags)
+{
+    if (!(buffers && lengths) || (count <= 0))
+	return 0;
+#ifdef HAVE_MMSG
+    if (count > MAX_BATCH)
+	count = MAX_BATCH;
+    struct mmsghdr msgs[MAX_BATCH];
+    struct iovec iov[MAX_BATCH];
+    struct sockaddr_storage names[MAX_BATCH];
+    for (int i = 0; i < count; i++) {
+	iov[i].iov_base = buffers[i];
+	iov[i].iov_len = buffers[i] ? lengths[i] : 0;
+	::memset(&msgs[i],0,sizeof(msgs[i]));
+	msgs[i].msg_hdr.msg_iov = &iov[i];
+	msgs[i].msg_hdr.msg_iovlen = 1;
+	if (addrs) {
+	    msgs[i].msg_hdr.msg_name = &names[i];
+	    msgs[i].msg_hdr.msg_namelen = sizeof(names[i]);
+	}
+    }
+    int res = ::recvmmsg(m_handle,msgs,count,flags,0);
+    if (!checkError(res,true))
+	return res;
+    // drop datagrams consumed by filters, keep the others packed at start
+    int n = 0;
+    for (int i = 0; i < res; i++) {
+	int len = msgs[i].msg_len;
+	const struct sockaddr* addr = addrs ? (const struct sockaddr*)&names[i] : 0;
+	socklen_t alen = addrs ? msgs[i].msg_hdr.msg_namelen : 0;
+	if (applyFilters(buffers[i],len,flags,addr,alen))
+	    continue;
+	if (n != i) {
+	    // swap buffers so the caller still owns all of them
+	    void* tmp = buffers[n];
+	    buffers[n] = buffers[i];
+	    buffers[i] = tmp;
+	    lengths[i] = lengths[n];
+	}
+	lengths[n] = len;
+	if (addrs)
+	    addrs[n].assign(addr,alen);
+	n++;
+    }
+    if (res && !n) {
+	m_error = EAGAIN;
+	return socketError();
+    }
+    return n;
+#else
+    int n = 0;
+    while (n < count) {
+	int res = addrs ? recvFrom(buffers[n],lengths[n],addrs[n],flags) :
+	    recvFrom(buffers[n],lengths[n],0,0,flags);
+	if (res == socketError())
+	    return n ? n : res;
+	lengths[n++] = res;
+    }
+    return n;
+#endif
+}
+
+int Socket::sendToBatch(const void* const* buffers, const int* lengths, int count,
+    const SocketAddr& addr, int flags)
+{
+    if (!(buffers && lengths) || (count <= 0))
+	return 0;
+#ifdef HAVE_MMSG
+    if (count > MAX_BATCH)
+	count = MAX_BATCH;
+    struct mmsghdr msgs[MAX_BATCH];
+    struct iovec iov[MAX_BATCH];
+    for (int i = 0; i < count; i++) {
+	iov[i].iov_base = const_cast<void*>(buffers[i]);
+	iov[i].iov_len = buffers[i] ? lengths[i] : 0;
+	::memset(&msgs[i],0,sizeof(msgs[i]));
+	msgs[i].msg_hdr.msg_iov = &iov[i];
+	msgs[i].msg_hdr.msg_iovlen = 1;
+	msgs[i].msg_hdr.msg_name = const_cast<struct sockaddr*>(addr.address());
+	msgs[i].msg_hdr.msg_namelen = addr.length();
+    }
+    int res = ::sendmmsg(m_handle,msgs,count,flags);
+    if (!checkError(res,true))
+	return res;
+    for (int i = 0; i < res; i++)
+	applyFilters(buffers[i],msgs[i].msg_len,flags,addr.address(),addr.length(),false);
+    return res;
+#else
+    int n = 0;
+    for (; n < count; n++) {
+	int res = sendTo(buffers[n],lengths[n],addr,flags);
+	if (res == socketError())
+	    return n ? n : res;
+    }
+    return n;
+#endif
+}
+
 int Socket::recv(void* buffer, int length, int flags)
 {
     if (!buffer)
@@ -2500,7 +2500,7 @@ static inline String dumpIndent(const String& buf)
 
 void MatchingItemDump::init(const NamedList& params)
 {
-    for (ObjList* o = params.paramList()->skipNull(); o; o = o->skipNext()) {
+    for (const ObjList* o = params.paramList()->skipNull(); o; o = o->skipNext()) {
 	NamedString* ns = static_cast<NamedString*>(o->get());
 	if (ns->name() == YSTRING("flags"))
 	    m_flags = ns->encodeFlags(s_miDumpFlags);
@@ -289,6 +289,28 @@ const unsigned char* SHA1::rawDigest()
     return m_bin;
 }
 
+// Finish a HMAC on stack copies of the pad digests
+bool SHA1::hmacPads(unsigned char* out, const SHA1& ipad, const SHA1& opad,
+    const void* buf, unsigned int len, const void* extra, unsigned int extraLen)
+{
+    if (!(out && ipad.m_private && opad.m_private) || ipad.m_hex || opad.m_hex)
+	return false;
+    if ((len && !buf) || (extraLen && !extra))
+	return false;
+    sha1_ctx ctx;
+    ::memcpy(&ctx,ipad.m_private,sizeof(ctx));
+    if (len)
+	sha1_update(&ctx,(const u_int8_t*)buf,len);
+    if (extraLen)
+	sha1_update(&ctx,(const u_int8_t*)extra,extraLen);
+    u_int8_t inner[SHA1_DIGEST_SIZE];
+    sha1_final(&ctx,inner);
+    ::memcpy(&ctx,opad.m_private,sizeof(ctx));
+    sha1_update(&ctx,inner,sizeof(inner));
+    sha1_final(&ctx,out);
+    return true;
+}
+
 // NIST FIPS 186-2 change notice 1 PRF with 160 bit SHA1 function G(t,c)
 bool SHA1::fips186prf(DataBlock& out, const DataBlock& seed, unsigned int len)
 {
@@ -0,0 +1,58 @@
+/**
+ * simd.h
+ * This file is part of the YATE Project http://YATE.null.ro
+ *
+ * Internal helper for picking vectorized code at runtime.
+ * Not installed, used by the engine and by modules built in tree
+ *
+ * Yet Another Telephony Engine - a fully featured software PBX and IVR
+ * Copyright (C) 2004-2023 Null Team
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef __YATE_SIMD_H
+#define __YATE_SIMD_H
+
+// Compilers that can build per function x86 vector code and check the CPU
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && ((__GNUC__ > 4) || defined(__clang__))
+#define YSIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace TelEngine {
+
+// Vector instruction sets, in increasing order of preference
+enum SimdLevel {
+    SimdScalar = 0,
+    SimdSSE2,
+    SimdAVX2
+};
+
+// Find the best vector instruction set supported by the running CPU
+static inline SimdLevel simdLevel()
+{
+#ifdef YSIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+	return SimdAVX2;
+    if (__builtin_cpu_supports("sse2"))
+	return SimdSSE2;
+#endif
+    return SimdScalar;
+}
+
+}; // namespace TelEngine
+
+#endif /* __YATE_SIMD_H */
+
+/* vi: set ts=8 sw=4 sts=4 noet: */
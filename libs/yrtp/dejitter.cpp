@@ -19,42 +19,72 @@
  */
 
 #include <yatertp.h>
+#include <string.h>
+
+// Payload space preallocated for each slot, larger packets get their own buffer
+#define SLOT_DATA 512
+// Shortest packet interval the slots are sized for, in microseconds
+#define SLOT_INTERVAL 10000
+#define MIN_SLOTS 8
+#define MAX_SLOTS 128
 
 using namespace TelEngine;
 
-namespace { // anonymous
+namespace TelEngine {
 
-class RTPDelayedData : public DataBlock
+// One packet slot of the dejitter ring, copied around when reordering
+class RTPDelayedData
 {
 public:
-    inline RTPDelayedData(u_int64_t when, bool mark, int payload,
-	unsigned int tstamp, const void* data, int len)
-	: DataBlock(const_cast<void*>(data),len), m_scheduled(when),
-	  m_marker(mark), m_payload(payload), m_timestamp(tstamp)
+    inline RTPDelayedData()
+	: m_scheduled(0), m_marker(false), m_payload(0), m_timestamp(0),
+	  m_data(0), m_len(0), m_size(0), m_owned(false)
 	{ }
-    inline u_int64_t scheduled() const
-	{ return m_scheduled; }
-    inline bool marker() const
-	{ return m_marker; }
-    int payload() const
-	{ return m_payload; }
-    inline unsigned int timestamp() const
-	{ return m_timestamp; }
-private:
+    void set(u_int64_t when, bool mark, int payload, unsigned int tstamp,
+	const void* data, int len);
     u_int64_t m_scheduled;
     bool m_marker;
     int m_payload;
     unsigned int m_timestamp;
+    unsigned char* m_data;
+    int m_len;
+    int m_size;
+    bool m_owned;
 };
 
-}; // anonymous namespace
+}
+
+void RTPDelayedData::set(u_int64_t when, bool mark, int payload, unsigned int tstamp,
+    const void* data, int len)
+{
+    m_scheduled = when;
+    m_marker = mark;
+    m_payload = payload;
+    m_timestamp = tstamp;
+    if (len < 0)
+	len = 0;
+    if (len > m_size) {
+	// only happens until the largest packet size was seen once
+	if (m_owned)
+	    delete[] m_data;
+	m_size = (len + SLOT_DATA - 1) & ~(SLOT_DATA - 1);
+	m_data = new unsigned char[m_size];
+	m_owned = true;
+    }
+    if (len)
+	::memcpy(m_data,data,len);
+    m_len = len;
+}
 
 
 RTPDejitter::RTPDejitter(RTPReceiver* receiver, unsigned int mindelay, unsigned int maxdelay,
     DebugEnabler* dbg, const char* traceId)
     : RTPProcessor(dbg,traceId),
+      m_slots(0), m_slab(0), m_size(0), m_head(0), m_count(0),
       m_receiver(receiver), m_minDelay(mindelay), m_maxDelay(maxdelay),
-      m_headStamp(0), m_tailStamp(0), m_headTime(0), m_sampRate(125000), m_fastRate(10)
+      m_headStamp(0), m_headTime(0), m_sampRate(125000), m_fastRate(10),
+      m_lastStamp(0), m_lastTime(0), m_jitter(0),
+      m_late(0), m_dropped(0), m_reordered(0)
 {
     if (m_maxDelay > 1000000)
 	m_maxDelay = 1000000;
@@ -64,23 +94,82 @@ RTPDejitter::RTPDejitter(RTPReceiver* receiver, unsigned int mindelay, unsigned
 	m_minDelay = 5000;
     if (m_minDelay > m_maxDelay - 30000)
 	m_minDelay = m_maxDelay - 30000;
+    m_delay = m_minDelay;
+    // enough slots to hold the maximum delay of short packets
+    m_size = m_maxDelay / SLOT_INTERVAL + 4;
+    if (m_size < MIN_SLOTS)
+	m_size = MIN_SLOTS;
+    else if (m_size > MAX_SLOTS)
+	m_size = MAX_SLOTS;
+    m_slots = new RTPDelayedData[m_size];
+    m_slab = new unsigned char[m_size * SLOT_DATA];
+    for (unsigned int i = 0; i < m_size; i++) {
+	m_slots[i].m_data = m_slab + i * SLOT_DATA;
+	m_slots[i].m_size = SLOT_DATA;
+    }
 }
 
 RTPDejitter::~RTPDejitter()
 {
-    DDebug(dbg(),DebugInfo,"Dejitter destroyed with %u packets [%p]",m_packets.count(),this);
+    DDebug(dbg(),DebugInfo,"Dejitter destroyed with %u packets, late=%u dropped=%u reordered=%u [%p]",
+	m_count,m_late,m_dropped,m_reordered,this);
+    for (unsigned int i = 0; i < m_size; i++)
+	if (m_slots[i].m_owned)
+	    delete[] m_slots[i].m_data;
+    delete[] m_slots;
+    delete[] m_slab;
 }
 
 void RTPDejitter::clear()
 {
-    m_packets.clear();
-    m_headStamp = m_tailStamp = 0;
+    m_head = m_count = 0;
+    m_headStamp = 0;
+    m_lastTime = 0;
+}
+
+void RTPDejitter::getStats(String& stats) const
+{
+    stats.append("JI=",",") << ((jitter() + 500) / 1000);
+    stats << ",X-JL=" << m_late;
+    stats << ",X-JD=" << m_dropped;
+    stats << ",X-JR=" << m_reordered;
+    stats << ",X-JB=" << ((m_delay + 500) / 1000);
+}
+
+// Update the jitter estimate (RFC 3550 A.8) and the playout delay
+void RTPDejitter::adapt(unsigned int timestamp, u_int64_t now)
+{
+    int dTs = timestamp - m_lastStamp;
+    if (m_lastTime && (dTs > 0)) {
+	int64_t d = (int64_t)(now - m_lastTime) - (int64_t)(dTs * m_sampRate / 1000);
+	if (d < 0)
+	    d = -d;
+	// jitter is kept scaled by 16
+	m_jitter += d - (int64_t)((m_jitter + 8) >> 4);
+	// aim for 3 times the jitter, grow at once but shrink gently
+	u_int64_t target = 3 * (m_jitter >> 4);
+	if (target < m_minDelay)
+	    target = m_minDelay;
+	else if (target > m_maxDelay - 30000)
+	    target = m_maxDelay - 30000;
+	if (target > m_delay)
+	    m_delay = (unsigned int)target;
+	else if (target < m_delay)
+	    m_delay -= (unsigned int)((m_delay - target + 63) >> 6);
+    }
+    if (!m_lastTime || (dTs > 0)) {
+	m_lastStamp = timestamp;
+	m_lastTime = now;
+    }
 }
 
 bool RTPDejitter::rtpRecv(bool marker, int payload, unsigned int timestamp, const void* data, int len)
 {
+    u_int64_t now = Time::now();
     u_int64_t when = 0;
     bool insert = false;
+    adapt(timestamp,now);
+    unsigned int tailStamp = m_count ? m_slots[(m_head + m_count - 1) % m_size].m_timestamp : 0;
 
     if (m_headStamp) {
 	// at least one packet got out of the queue
@@ -90,9 +179,9 @@ bool RTPDejitter::rtpRecv(bool marker, int payload, unsigned int timestamp, cons
 	else if (dTs < 0) {
 	    DDebug(dbg(),DebugNote,"Dejitter dropping TS %u, last delivered was %u [%p]",
 		timestamp,m_headStamp,this);
+	    m_late++;
 	    return false;
 	}
-	u_int64_t now = Time::now();
 	int64_t rate = 1000 * (now - m_headTime) / dTs;
 	if (rate > 0) {
 	    if (m_sampRate) {
@@ -113,77 +202,100 @@ bool RTPDejitter::rtpRecv(bool marker, int payload, unsigned int timestamp, cons
 	else
 	    rate = m_sampRate;
 	if (rate > 0)
-	    when = m_headTime + (dTs * rate / 1000) + m_minDelay;
+	    when = m_headTime + (dTs * rate / 1000) + m_delay;
 	else
-	    when = now + m_minDelay;
-	if (m_tailStamp) {
-	    if (timestamp == m_tailStamp)
+	    when = now + m_delay;
+	if (m_count) {
+	    if (timestamp == tailStamp)
 		return true;
-	    if (((int)(timestamp - m_tailStamp)) < 0)
+	    if (((int)(timestamp - tailStamp)) < 0)
 		insert = true;
 	    else if (when > now + m_maxDelay) {
 		DDebug(dbg(),DebugNote,"Packet with TS %u falls after max buffer [%p]",timestamp,this);
+		m_dropped++;
 		return false;
 	    }
 	}
     }
     else {
-	if (m_tailStamp && ((int)(timestamp - m_tailStamp)) < 0) {
+	if (m_count && ((int)(timestamp - tailStamp)) < 0) {
 	    // until we get some statistics don't attempt to reorder packets
-	    DDebug(dbg(),DebugNote,"Dejitter got TS %u while last queued was %u [%p]",timestamp,m_tailStamp,this);
+	    DDebug(dbg(),DebugNote,"Dejitter got TS %u while last queued was %u [%p]",timestamp,tailStamp,this);
+	    m_late++;
 	    return false;
 	}
 	// we got no packets out yet so use a fixed interval
-	when = Time::now() + m_minDelay;
+	when = now + m_delay;
     }
 
+    if (m_count >= m_size) {
+	DDebug(dbg(),DebugNote,"Dejitter full, dropping TS %u [%p]",timestamp,this);
+	m_dropped++;
+	return false;
+    }
+    // find the position keeping the ring sorted by timestamp, usually the tail
+    unsigned int pos = m_count;
     if (insert) {
-	for (ObjList* l = m_packets.skipNull(); l; l = l->skipNext()) {
-	    RTPDelayedData* pkt = static_cast<RTPDelayedData*>(l->get());
-	    if (pkt->timestamp() == timestamp)
-		return true;
-	    if (pkt->timestamp() > timestamp && pkt->scheduled() > when) {
-		l->insert(new RTPDelayedData(when,marker,payload,timestamp,data,len));
+	while (pos) {
+	    const RTPDelayedData& prev = m_slots[(m_head + pos - 1) % m_size];
+	    int dTs = timestamp - prev.m_timestamp;
+	    if (dTs == 0)
 		return true;
-	    }
+	    if (dTs > 0)
+		break;
+	    pos--;
 	}
+	// never schedule before a packet already in the queue
+	const RTPDelayedData& next = m_slots[(m_head + pos) % m_size];
+	if (next.m_scheduled < when)
+	    when = next.m_scheduled;
+	m_reordered++;
+	// move the free slot into place, the payload buffers move along
+	RTPDelayedData tmp = m_slots[(m_head + m_count) % m_size];
+	for (unsigned int i = m_count; i > pos; i--)
+	    m_slots[(m_head + i) % m_size] = m_slots[(m_head + i - 1) % m_size];
+	m_slots[(m_head + pos) % m_size] = tmp;
     }
-    m_tailStamp = timestamp;
-    m_packets.append(new RTPDelayedData(when,marker,payload,timestamp,data,len));
+    m_slots[(m_head + pos) % m_size].set(when,marker,payload,timestamp,data,len);
+    m_count++;
     return true;
 }
 
 void RTPDejitter::timerTick(const Time& when)
 {
-    RTPDelayedData* packet = static_cast<RTPDelayedData*>(m_packets.get());
-    if (!packet) {
-	m_tailStamp = 0;
+    if (!m_count) {
 	if (m_headStamp && (m_headTime + m_maxDelay < when))
 	    m_headStamp = 0;
 	return;
     }
-    if (packet->scheduled() > when)
+    RTPDelayedData* packet = m_slots + m_head;
+    if (packet->m_scheduled > when)
 	return;
-    m_packets.remove(packet,false);
+    m_head = (m_head + 1) % m_size;
+    m_count--;
     // remember the last delivered
-    m_headStamp = packet->timestamp();
-    m_headTime = packet->scheduled();
+    m_headStamp = packet->m_timestamp;
+    m_headTime = packet->m_scheduled;
+    // the slot is not reused before the receiver returns, we are on the group's thread
     if (m_receiver)
-	m_receiver->rtpRecv(packet->marker(),packet->payload(),
-	    packet->timestamp(),packet->data(),packet->length());
-    TelEngine::destruct(packet);
+	m_receiver->rtpRecv(packet->m_marker,packet->m_payload,
+	    packet->m_timestamp,packet->m_data,packet->m_len);
     unsigned int count = 0;
-    while ((packet = static_cast<RTPDelayedData*>(m_packets.get()))) {
-	long int delayed = (long int)(when - packet->scheduled());
+    while (m_count) {
+	packet = m_slots + m_head;
+	long int delayed = (long int)(when - packet->m_scheduled);
 	if (delayed <= 0 || delayed <= (long)m_minDelay)
 	    break;
 	// we are too delayed - probably rtpRecv() took too long to complete...
-	m_packets.remove(packet,true);
+	m_head = (m_head + 1) % m_size;
+	m_count--;
 	count++;
     }
-    if (count)
+    if (count) {
+	m_dropped += count;
 	TraceDebug(m_traceId,dbg(),(count > 1) ? DebugMild : DebugNote,
 	    "Dropped %u delayed packet%s from buffer [%p]",count,((count > 1) ? "s" : ""),this);
+    }
 }
 
 /* vi: set ts=8 sw=4 sts=4 noet: */
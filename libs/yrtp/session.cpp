@@ -481,6 +481,12 @@ void RTPReceiver::stats(NamedList& stat) const
     stat.setParam("synclost",String(m_syncLost));
     stat.setParam("wrongssrc",String(m_wrongSSRC));
     stat.setParam("seqslost",String(m_seqLost));
+    if (m_dejitter) {
+	stat.setParam("latepkts",String(m_dejitter->late()));
+	stat.setParam("droppedpkts",String(m_dejitter->dropped()));
+	stat.setParam("reorderedpkts",String(m_dejitter->reordered()));
+	stat.setParam("jitter",String(m_dejitter->jitter() / 1000));
+    }
 }
 
 
@@ -994,6 +1000,8 @@ void RTPSession::getStats(String& stats) const
 	stats.append("PR=",",") << m_recv->ioPackets();
 	stats << ",OR=" << m_recv->ioOctets();
 	stats << ",PL=" << m_recv->ioPacketsLost();
+	if (m_recv->m_dejitter)
+	    m_recv->m_dejitter->getStats(stats);
     }
 }
 
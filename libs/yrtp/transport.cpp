@@ -21,11 +21,145 @@
 #include <yatertp.h>
 #include <string.h>
 
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#endif
+
 #define BUF_SIZE 1500
 
+// Maximum number of socket events handled in one loop by a group
+#define POLL_EVENTS 64
+
+// Number of packets read or sent in one system call by a transport
+#define RECV_BATCH 8
+#define SEND_BATCH 8
+
+// Size of the shared port demultiplexing tables
+#define MUX_HASH 256
+// Maximum number of sockets bound to a shared port
+#define MUX_SOCKETS 16
+
 using namespace TelEngine;
 
 static unsigned long s_sleep = 5;
+static bool s_eventPoll = false;
+static bool s_batchSend = false;
+
+namespace TelEngine {
+
+// Buffers used by a transport to receive and send packets in batches
+class RTPBatch
+{
+public:
+    inline RTPBatch()
+	: m_txData(0), m_txCount(0)
+	{ }
+    inline ~RTPBatch()
+	{ delete[] m_txData; }
+    // Queue a packet for sending, return false if the queue is full
+    bool queue(const void* data, int len);
+    SocketAddr m_rxAddr[RECV_BATCH];
+    char* m_txData;
+    const void* m_txBuf[SEND_BATCH];
+    int m_txLen[SEND_BATCH];
+    int m_txCount;
+};
+
+class RTPMuxPort;
+
+// A socket pair bound to a shared port, read by its own group
+class RTPMuxSocket : public RTPProcessor
+{
+public:
+    inline RTPMuxSocket(RTPMuxPort* port)
+	: m_port(port)
+	{ }
+    bool init(const SocketAddr& addr, bool reuse);
+    Socket m_rtp;
+    Socket m_rtcp;
+protected:
+    virtual void timerTick(const Time& when);
+    virtual void readable(bool rtcp, const Time& when);
+    virtual void watchSockets(RTPGroup* grp, bool add);
+private:
+    void receive(Socket& sock, bool rtcp);
+    RTPMuxPort* m_port;
+    SocketAddr m_rxAddr[RECV_BATCH];
+};
+
+// A transport attached to a shared port
+class RTPMuxEntry : public RefObject, public Mutex
+{
+public:
+    inline RTPMuxEntry(RTPTransport* trans, RTPMuxPort* port, RTPMuxSocket* sock, bool rtcp)
+	: Mutex(false,"RTPMuxEntry"),
+	  m_trans(trans), m_port(port), m_sock(sock), m_rtcp(rtcp),
+	  m_ssrc(0), m_hasSsrc(false), m_auto(false), m_bucket(0), m_linked(false)
+	{ }
+    // owner transport, protected by the entry's mutex
+    RTPTransport* m_trans;
+    RTPMuxPort* m_port;
+    RTPMuxSocket* m_sock;
+    bool m_rtcp;
+    // demultiplexing keys, protected by the port's mutex
+    SocketAddr m_remote;
+    SocketAddr m_remoteRTCP;
+    SocketAddr m_pref;
+    u_int32_t m_ssrc;
+    bool m_hasSsrc;
+    bool m_auto;
+    unsigned int m_bucket;
+    bool m_linked;
+};
+
+// Local address shared by many transports, demultiplexes packets to them
+class RTPMuxPort : public GenObject, public Mutex
+{
+public:
+    RTPMuxPort(const SocketAddr& addr);
+    RTPMuxEntry* attach(RTPTransport* trans, bool rtcp);
+    void detach(RTPMuxEntry* entry);
+    void update(RTPMuxEntry* entry, const RTPTransport* trans, const u_int32_t* ssrc = 0);
+    void received(const char* buf, int len, SocketAddr& from, bool rtcp);
+    static RTPMuxPort* get(const SocketAddr& addr, unsigned int sockets);
+    SocketAddr m_addr;
+private:
+    bool init(unsigned int sockets);
+    RTPMuxEntry* find(const SocketAddr& from, u_int32_t ssrc, bool hasSsrc, bool rtcp);
+    void link(RTPMuxEntry* entry);
+    void unlink(RTPMuxEntry* entry);
+    RTPMuxSocket* m_sockets[MUX_SOCKETS];
+    unsigned int m_count;
+    unsigned int m_next;
+    ObjList m_byAddr[MUX_HASH];
+    ObjList m_bySsrc[MUX_HASH];
+    ObjList m_learning;
+};
+
+}
+
+// Shared ports are kept open until the process exits
+static ObjList s_muxPorts;
+static Mutex s_muxMutex(false,"RTPMuxPorts");
+
+bool RTPBatch::queue(const void* data, int len)
+{
+    if (m_txCount >= SEND_BATCH)
+	return false;
+    if (!m_txData)
+	m_txData = new char[SEND_BATCH * BUF_SIZE];
+    if (len > BUF_SIZE)
+	len = BUF_SIZE;
+    char* buf = m_txData + m_txCount * BUF_SIZE;
+    ::memcpy(buf,data,len);
+    m_txBuf[m_txCount] = buf;
+    m_txLen[m_txCount] = len;
+    m_txCount++;
+    return true;
+}
 
 // Set IPv6 sin6_scope_id for remote addresses from local address
 // recvFrom() will set the sin6_scope_id of the remote socket address
@@ -42,10 +176,334 @@ static inline void setScopeId(const SocketAddr& local, SocketAddr& sa1,
 	sa3->scopeId(val);
 }
 
+// Hash the host part of an address, ports don't matter so RTP and RTCP
+//  packets from the same remote end up in the same bucket
+static unsigned int hostHash(const SocketAddr& addr)
+{
+    const struct sockaddr* sa = addr.address();
+    if (!sa)
+	return 0;
+    switch (addr.family()) {
+	case SocketAddr::IPv4:
+	    return ntohl(((const struct sockaddr_in*)sa)->sin_addr.s_addr);
+#ifdef AF_INET6
+	case SocketAddr::IPv6:
+	    {
+		const u_int8_t* p = ((const struct sockaddr_in6*)sa)->sin6_addr.s6_addr;
+		unsigned int h = 0;
+		for (int i = 0; i < 16; i++)
+		    h = (h << 5) + h + p[i];
+		return h;
+	    }
+#endif
+	default:
+	    return 0;
+    }
+}
+
+// Read a big endian 32 bit value
+static inline u_int32_t getU32(const char* buf)
+{
+    const unsigned char* p = (const unsigned char*)buf;
+    return ((u_int32_t)p[0] << 24) | ((u_int32_t)p[1] << 16) | ((u_int32_t)p[2] << 8) | p[3];
+}
+
+// Create and bind one socket of a shared port
+static bool bindShared(Socket& sock, const SocketAddr& addr, bool reuse)
+{
+    if (!sock.create(addr.family(),SOCK_DGRAM))
+	return false;
+#ifdef SO_REUSEPORT
+    if (reuse) {
+	int on = 1;
+	sock.setOption(SOL_SOCKET,SO_REUSEPORT,&on,sizeof(on));
+    }
+#endif
+    if (sock.bind(addr)) {
+	sock.setBlocking(false);
+	// the socket carries the traffic of many transports
+	int len = 262144;
+	sock.setOption(SOL_SOCKET,SO_RCVBUF,&len,sizeof(len));
+	return true;
+    }
+    sock.terminate();
+    return false;
+}
+
+
+bool RTPMuxSocket::init(const SocketAddr& addr, bool reuse)
+{
+    SocketAddr a(addr);
+    if (bindShared(m_rtp,a,reuse)) {
+	a.port(addr.port() + 1);
+	if (bindShared(m_rtcp,a,reuse)) {
+	    group(new RTPGroup);
+	    watchSockets(group(),true);
+	    return true;
+	}
+	m_rtp.terminate();
+    }
+    return false;
+}
+
+void RTPMuxSocket::timerTick(const Time& when)
+{
+    if (!(group() && group()->eventPolling())) {
+	receive(m_rtp,false);
+	receive(m_rtcp,true);
+    }
+    m_rtp.timerTick(when);
+    m_rtcp.timerTick(when);
+}
+
+void RTPMuxSocket::readable(bool rtcp, const Time& when)
+{
+    receive(rtcp ? m_rtcp : m_rtp,rtcp);
+}
+
+void RTPMuxSocket::watchSockets(RTPGroup* grp, bool add)
+{
+    if (!(grp && grp->eventPolling()))
+	return;
+    if (m_rtp.valid())
+	grp->watch(this,m_rtp,false,add);
+    if (m_rtcp.valid())
+	grp->watch(this,m_rtcp,true,add);
+}
+
+// Read all available packets and hand them to the port for demultiplexing
+void RTPMuxSocket::receive(Socket& sock, bool rtcp)
+{
+    if (!sock.valid())
+	return;
+    char data[RECV_BATCH][BUF_SIZE];
+    void* bufs[RECV_BATCH];
+    int lens[RECV_BATCH];
+    for (;;) {
+	for (int i = 0; i < RECV_BATCH; i++) {
+	    bufs[i] = data[i];
+	    lens[i] = BUF_SIZE;
+	}
+	int n = sock.recvFromBatch(bufs,lens,RECV_BATCH,m_rxAddr);
+	for (int i = 0; i < n; i++)
+	    if (lens[i] > 0)
+		m_port->received((const char*)bufs[i],lens[i],m_rxAddr[i],rtcp);
+	if (n < RECV_BATCH)
+	    break;
+    }
+}
+
+
+RTPMuxPort::RTPMuxPort(const SocketAddr& addr)
+    : Mutex(false,"RTPMuxPort"),
+      m_addr(addr), m_count(0), m_next(0)
+{
+    DDebug(DebugInfo,"RTPMuxPort::RTPMuxPort(%s) [%p]",addr.addr().c_str(),this);
+}
+
+// Find or open a shared port
+RTPMuxPort* RTPMuxPort::get(const SocketAddr& addr, unsigned int sockets)
+{
+    Lock lock(s_muxMutex);
+    for (ObjList* l = s_muxPorts.skipNull(); l; l = l->skipNext()) {
+	RTPMuxPort* p = static_cast<RTPMuxPort*>(l->get());
+	if (p->m_addr == addr)
+	    return p;
+    }
+    RTPMuxPort* p = new RTPMuxPort(addr);
+    if (!p->init(sockets)) {
+	Debug(DebugWarn,"Failed to open shared RTP port %s",addr.addr().c_str());
+	delete p;
+	return 0;
+    }
+    Debug(DebugInfo,"Opened shared RTP port %s with %u socket(s)",
+	addr.addr().c_str(),p->m_count);
+    s_muxPorts.append(p)->setDelete(false);
+    return p;
+}
+
+bool RTPMuxPort::init(unsigned int sockets)
+{
+#ifdef SO_REUSEPORT
+    if (sockets > MUX_SOCKETS)
+	sockets = MUX_SOCKETS;
+#else
+    sockets = 1;
+#endif
+    if (!sockets)
+	sockets = 1;
+    while (m_count < sockets) {
+	RTPMuxSocket* sock = new RTPMuxSocket(this);
+	if (!sock->init(m_addr,sockets > 1)) {
+	    delete sock;
+	    break;
+	}
+	m_sockets[m_count++] = sock;
+    }
+    return m_count > 0;
+}
+
+RTPMuxEntry* RTPMuxPort::attach(RTPTransport* trans, bool rtcp)
+{
+    // spread the transmitted packets over the sockets
+    lock();
+    RTPMuxSocket* sock = m_sockets[m_next++ % m_count];
+    unlock();
+    RTPMuxEntry* entry = new RTPMuxEntry(trans,this,sock,rtcp);
+    update(entry,trans);
+    return entry;
+}
+
+void RTPMuxPort::detach(RTPMuxEntry* entry)
+{
+    lock();
+    unlink(entry);
+    unlock();
+    // wait for a packet being delivered to finish
+    entry->lock();
+    entry->m_trans = 0;
+    entry->unlock();
+    TelEngine::destruct(entry);
+}
+
+// Copy the demultiplexing keys from the transport, optionally set the learned SSRC
+void RTPMuxPort::update(RTPMuxEntry* entry, const RTPTransport* trans, const u_int32_t* ssrc)
+{
+    Lock lock(this);
+    unlink(entry);
+    entry->m_remote = trans->m_remoteAddr;
+    entry->m_remoteRTCP = trans->m_remoteRTCP;
+    entry->m_pref = trans->m_remotePref;
+    entry->m_auto = trans->m_autoRemote;
+    if (ssrc) {
+	entry->m_ssrc = *ssrc;
+	entry->m_hasSsrc = true;
+    }
+    link(entry);
+}
+
+void RTPMuxPort::link(RTPMuxEntry* entry)
+{
+    if (entry->m_remote.valid()) {
+	entry->m_bucket = hostHash(entry->m_remote) % MUX_HASH;
+	m_byAddr[entry->m_bucket].append(entry)->setDelete(false);
+    }
+    if (entry->m_hasSsrc)
+	m_bySsrc[entry->m_ssrc % MUX_HASH].append(entry)->setDelete(false);
+    if (entry->m_auto || entry->m_pref.valid())
+	m_learning.append(entry)->setDelete(false);
+    entry->m_linked = true;
+}
+
+void RTPMuxPort::unlink(RTPMuxEntry* entry)
+{
+    if (!entry->m_linked)
+	return;
+    if (entry->m_remote.valid())
+	m_byAddr[entry->m_bucket].remove(entry,false);
+    if (entry->m_hasSsrc)
+	m_bySsrc[entry->m_ssrc % MUX_HASH].remove(entry,false);
+    if (entry->m_auto || entry->m_pref.valid())
+	m_learning.remove(entry,false);
+    entry->m_linked = false;
+}
+
+// Find the transport a packet belongs to: by remote address and SSRC,
+//  by SSRC alone if the remote moved, by address to the oldest transport
+//  that didn't learn the SSRC yet or to the single transport still waiting
+//  to learn its remote address
+RTPMuxEntry* RTPMuxPort::find(const SocketAddr& from, u_int32_t ssrc, bool hasSsrc, bool rtcp)
+{
+    RTPMuxEntry* fresh = 0;
+    RTPMuxEntry* any = 0;
+    unsigned int matches = 0;
+    ObjList* l = m_byAddr[hostHash(from) % MUX_HASH].skipNull();
+    for (; l; l = l->skipNext()) {
+	RTPMuxEntry* e = static_cast<RTPMuxEntry*>(l->get());
+	if ((from != e->m_remote) && (from != e->m_remoteRTCP))
+	    continue;
+	// several transports may talk to the same remote port
+	if (e->m_hasSsrc) {
+	    if (hasSsrc && (e->m_ssrc == ssrc))
+		return e;
+	}
+	else if (!fresh)
+	    fresh = e;
+	if (!matches++)
+	    any = e;
+    }
+    if (hasSsrc) {
+	for (l = m_bySsrc[ssrc % MUX_HASH].skipNull(); l; l = l->skipNext()) {
+	    RTPMuxEntry* e = static_cast<RTPMuxEntry*>(l->get());
+	    if (e->m_ssrc == ssrc)
+		return e;
+	}
+    }
+    // a single transport with this remote gets the packets even if the SSRC changed
+    if (matches == 1)
+	return any;
+    if (rtcp)
+	return 0;
+    if (fresh)
+	return fresh;
+    RTPMuxEntry* found = 0;
+    for (l = m_learning.skipNull(); l; l = l->skipNext()) {
+	RTPMuxEntry* e = static_cast<RTPMuxEntry*>(l->get());
+	if (from == e->m_pref)
+	    return e;
+	if (!e->m_auto)
+	    continue;
+	// we can't tell which transport should learn the address
+	if (found)
+	    return 0;
+	found = e;
+    }
+    return found;
+}
+
+void RTPMuxPort::received(const char* buf, int len, SocketAddr& from, bool rtcp)
+{
+    if (len < 8)
+	return;
+    // RTCP multiplexed on the RTP port has packet types 192 to 223 (RFC 5761)
+    if (!rtcp) {
+	unsigned char pt = (unsigned char)buf[1];
+	rtcp = (pt >= 192) && (pt <= 223);
+    }
+    int ofs = rtcp ? 4 : 8;
+    bool hasSsrc = (len >= ofs + 4);
+    u_int32_t ssrc = hasSsrc ? getU32(buf + ofs) : 0;
+    lock();
+    RefPointer<RTPMuxEntry> entry = find(from,ssrc,hasSsrc,rtcp);
+    unlock();
+    if (!entry) {
+	XDebug(DebugAll,"Shared port %s dropped %s packet from %s SSRC=%u [%p]",
+	    m_addr.addr().c_str(),(rtcp ? "RTCP" : "RTP"),from.addr().c_str(),ssrc,this);
+	return;
+    }
+    Lock lck(entry);
+    RTPTransport* trans = entry->m_trans;
+    if (!trans)
+	return;
+    // the transport expects to be called from its group's thread
+    Lock glck(trans->group());
+    if (rtcp) {
+	trans->rtcpPacket(buf,len);
+	return;
+    }
+    trans->rtpPacket(buf,len,from);
+    if (!(hasSsrc && (from == trans->m_remoteAddr)))
+	return;
+    // remember the SSRC so we can follow the remote if its address changes
+    if (!entry->m_hasSsrc || (entry->m_ssrc != ssrc) || (entry->m_auto != trans->m_autoRemote)
+	|| (entry->m_pref != trans->m_remotePref))
+	update(entry,trans,&ssrc);
+}
+
 
 RTPGroup::RTPGroup(int msec, Priority prio, const String& affinity)
     : Mutex(true,"RTPGroup"),
-      Thread("RTP Group",prio), m_listChanged(false)
+      Thread("RTP Group",prio), m_listChanged(false), m_poll(-1), m_batchSend(s_batchSend)
 {
     DDebug(DebugInfo,"RTPGroup::RTPGroup() [%p]",this);
     if (msec < 1)
@@ -53,6 +511,14 @@ RTPGroup::RTPGroup(int msec, Priority prio, const String& affinity)
     if (msec > 50)
 	msec = 50;
     m_sleep = msec;
+#ifdef HAVE_EPOLL
+    if (s_eventPoll) {
+	m_poll = ::epoll_create1(EPOLL_CLOEXEC);
+	if (m_poll < 0)
+	    Debug(DebugWarn,"Failed to create epoll descriptor, error=%s(%d) [%p]",
+		::strerror(errno),errno,this);
+    }
+#endif
     if (affinity) {
 	int err = setAffinity(affinity);
 	if (err)
@@ -64,6 +530,10 @@ RTPGroup::RTPGroup(int msec, Priority prio, const String& affinity)
 RTPGroup::~RTPGroup()
 {
     DDebug(DebugInfo,"RTPGroup::~RTPGroup() [%p]",this);
+#ifdef HAVE_EPOLL
+    if (m_poll >= 0)
+	::close(m_poll);
+#endif
 }
 
 void RTPGroup::cleanup()
@@ -88,6 +558,11 @@ void RTPGroup::cleanup()
 void RTPGroup::run()
 {
     DDebug(DebugInfo,"RTPGroup::run() [%p]",this);
+    if (eventPolling()) {
+	runEvents();
+	DDebug(DebugInfo,"RTPGroup::run() ran out of processors [%p]",this);
+	return;
+    }
     bool ok = true;
     while (ok) {
 	unsigned long msec = m_sleep;
@@ -115,12 +590,62 @@ void RTPGroup::run()
     DDebug(DebugInfo,"RTPGroup::run() ran out of processors [%p]",this);
 }
 
+// Read only the sockets that have data, run the timers at fixed intervals
+void RTPGroup::runEvents()
+{
+#ifdef HAVE_EPOLL
+    struct epoll_event events[POLL_EVENTS];
+    u_int64_t tick = Time::now();
+    bool ok = true;
+    while (ok) {
+	unsigned long msec = m_sleep;
+	if (msec < s_sleep)
+	    msec = s_sleep;
+	u_int64_t now = Time::now();
+	int wait = (tick > now) ? (int)((tick - now + 999) / 1000) : 0;
+	int n = ::epoll_wait(m_poll,events,POLL_EVENTS,wait);
+	Thread::check();
+	lock();
+	Time t;
+	for (int i = 0; i < n; i++) {
+	    uintptr_t data = (uintptr_t)events[i].data.ptr;
+	    RTPProcessor* p = reinterpret_cast<RTPProcessor*>(data & ~(uintptr_t)1);
+	    // the processor may have left since the events were collected
+	    if (m_processors.find(p))
+		p->readable((data & 1) != 0,t);
+	}
+	if (t.usec() < tick) {
+	    ok = (0 != m_processors.skipNull());
+	    unlock();
+	    continue;
+	}
+	tick += msec * 1000;
+	if (tick <= t.usec())
+	    tick = t.usec() + msec * 1000;
+	ObjList* l = &m_processors;
+	m_listChanged = false;
+	for (ok = false;l;l = l->next()) {
+	    RTPProcessor* p = static_cast<RTPProcessor*>(l->get());
+	    if (p) {
+		ok = true;
+		p->timerTick(t);
+		if (m_listChanged)
+		    break;
+	    }
+	}
+	unlock();
+    }
+#endif
+}
+
 void RTPGroup::join(RTPProcessor* proc)
 {
     DDebug(DebugAll,"RTPGroup::join(%p) [%p]",proc,this);
     lock();
     m_listChanged = true;
     m_processors.append(proc)->setDelete(false);
+    if (eventPolling())
+	proc->watchSockets(this,true);
     startup();
     unlock();
 }
@@ -130,10 +655,48 @@ void RTPGroup::part(RTPProcessor* proc)
     DDebug(DebugAll,"RTPGroup::part(%p) [%p]",proc,this);
     lock();
     m_listChanged = true;
-    m_processors.remove(proc,false);
+    if (m_processors.remove(proc,false) && eventPolling())
+	proc->watchSockets(this,false);
     unlock();
 }
 
+bool RTPGroup::watch(RTPProcessor* proc, Socket& sock, bool rtcp, bool add)
+{
+#ifdef HAVE_EPOLL
+    if (m_poll < 0 || !proc || !sock.valid())
+	return false;
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = reinterpret_cast<void*>((uintptr_t)proc | (rtcp ? 1 : 0));
+    if (!::epoll_ctl(m_poll,add ? EPOLL_CTL_ADD : EPOLL_CTL_DEL,sock.handle(),&ev))
+	return true;
+    if (add && (errno == EEXIST))
+	return !::epoll_ctl(m_poll,EPOLL_CTL_MOD,sock.handle(),&ev);
+    Debug(DebugMild,"RTPGroup failed to %s socket %d, error=%s(%d) [%p]",
+	add ? "watch" : "unwatch",sock.handle(),::strerror(errno),errno,this);
+#endif
+    return false;
+}
+
+void RTPGroup::setEventPolling(bool on)
+{
+    s_eventPoll = on && canEventPoll();
+}
+
+void RTPGroup::setBatchSend(bool on)
+{
+    s_batchSend = on;
+}
+
+bool RTPGroup::canEventPoll()
+{
+#ifdef HAVE_EPOLL
+    return true;
+#else
+    return false;
+#endif
+}
+
 void RTPGroup::setMinSleep(int msec)
 {
     if (msec < 1)
@@ -181,11 +744,19 @@ void RTPProcessor::getStats(String& stats) const
 {
 }
 
+void RTPProcessor::readable(bool rtcp, const Time& when)
+{
+}
+
+void RTPProcessor::watchSockets(RTPGroup* grp, bool add)
+{
+}
+
 
 RTPTransport::RTPTransport(RTPTransport::Type type, DebugEnabler* dbg, const char* traceId)
     : RTPProcessor(dbg,traceId),
       m_type(type), m_processor(0), m_monitor(0), m_autoRemote(false),
-      m_warnSendErrorRtp(true), m_warnSendErrorRtcp(true)
+      m_warnSendErrorRtp(true), m_warnSendErrorRtcp(true), m_batch(0), m_shared(0)
 {
     DDebug(this->dbg(),DebugAll,"RTPTransport::RTPTransport(%d) [%p]",type,this);
 }
@@ -196,13 +767,17 @@ RTPTransport::~RTPTransport()
     RTPGroup* g = group();
     if (g)
 	TraceDebug(m_traceId,dbg(),DebugCrit,"RTPTransport destroyed while in RTPGroup %p [%p]",g,this);
+    unshare();
     group(0);
     setProcessor();
     setMonitor();
+    delete m_batch;
 }
 
 void RTPTransport::destruct()
 {
+    // stop receiving from the shared port before leaving the group
+    unshare();
     group(0);
     setProcessor();
     setMonitor();
@@ -212,67 +787,130 @@ void RTPTransport::destruct()
 void RTPTransport::timerTick(const Time& when)
 {
     XDebug(dbg(),DebugAll,"RTPTransport::timerTick() group=%p [%p]",group(),this);
+    // sockets are read when data arrives if the group watches them
+    bool read = !(group() && group()->eventPolling());
     if (m_rtpSock.valid()) {
-	char buf[BUF_SIZE];
-	int len;
-	while ((len = m_rtpSock.recvFrom(buf,sizeof(buf),m_rxAddrRTP)) > 0) {
-	    XDebug(dbg(),DebugAll,"RTP/UDPTL from '%s:%d' length %d [%p]",
-		m_rxAddrRTP.host().c_str(),m_rxAddrRTP.port(),len,this);
-	    switch (m_type) {
-		case RTP:
-		    if (len < 12)
-			continue;
-		    if (((unsigned char)buf[0] & 0xc0) != 0x80)
-			continue;
-		    break;
-		case UDPTL:
-		    if (len < 6)
-			continue;
-		    break;
-		default:
-		    break;
-	    }
-	    if (!m_remoteAddr.valid())
-		continue;
-	    // looks like it's RTP or UDPTL, at least by length and version
-	    bool preferred = false;
-	    if ((m_autoRemote || (preferred = (m_rxAddrRTP == m_remotePref))) && (m_rxAddrRTP != m_remoteAddr)) {
-		TraceDebug(m_traceId,dbg(),DebugInfo,"Auto changing RTP address from %s:%d to%s %s:%d",
-		    m_remoteAddr.host().c_str(),m_remoteAddr.port(),
-		    (preferred ? " preferred" : ""),
-		    m_rxAddrRTP.host().c_str(),m_rxAddrRTP.port());
-		// if we received from the preferred address don't auto change any more
-		if (preferred)
-		    m_remotePref.clear();
-		remoteAddr(m_rxAddrRTP);
-	    }
-	    m_autoRemote = false;
-	    if (m_rxAddrRTP == m_remoteAddr) {
-		if (m_processor)
-		    m_processor->rtpData(buf,len);
-		if (m_monitor)
-		    m_monitor->rtpData(buf,len);
-	    }
-	    else if (m_processor)
-		m_processor->incWrongSrc();
-	}
+	if (read)
+	    receiveRtp();
+	flushRtp();
 	m_rtpSock.timerTick(when);
     }
     if (m_rtcpSock.valid()) {
-	char buf[BUF_SIZE];
-	int len;
-	while (((len = m_rtcpSock.recvFrom(buf,sizeof(buf),m_rxAddrRTCP)) >= 8) && (m_rxAddrRTCP == m_remoteRTCP)) {
-	    XDebug(dbg(),DebugAll,"RTCP from '%s:%d' length %d [%p]",
-		m_rxAddrRTCP.host().c_str(),m_rxAddrRTCP.port(),len,this);
-	    if (m_processor)
-		m_processor->rtcpData(buf,len);
-	    if (m_monitor)
-		m_monitor->rtcpData(buf,len);
-	}
+	if (read)
+	    receiveRtcp();
 	m_rtcpSock.timerTick(when);
     }
 }
 
+void RTPTransport::readable(bool rtcp, const Time& when)
+{
+    if (rtcp)
+	receiveRtcp();
+    else
+	receiveRtp();
+}
+
+void RTPTransport::watchSockets(RTPGroup* grp, bool add)
+{
+    if (!(grp && grp->eventPolling()))
+	return;
+    if (m_rtpSock.valid())
+	grp->watch(this,m_rtpSock,false,add);
+    if (m_rtcpSock.valid())
+	grp->watch(this,m_rtcpSock,true,add);
+}
+
+// Read all available RTP or UDPTL packets, several in each system call
+void RTPTransport::receiveRtp()
+{
+    if (!m_rtpSock.valid())
+	return;
+    if (!m_batch)
+	m_batch = new RTPBatch;
+    char data[RECV_BATCH][BUF_SIZE];
+    void* bufs[RECV_BATCH];
+    int lens[RECV_BATCH];
+    for (;;) {
+	for (int i = 0; i < RECV_BATCH; i++) {
+	    bufs[i] = data[i];
+	    lens[i] = BUF_SIZE;
+	}
+	int n = m_rtpSock.recvFromBatch(bufs,lens,RECV_BATCH,m_batch->m_rxAddr);
+	for (int i = 0; i < n; i++)
+	    if (lens[i] > 0)
+		rtpPacket((const char*)bufs[i],lens[i],m_batch->m_rxAddr[i]);
+	if (n < RECV_BATCH)
+	    break;
+    }
+}
+
+// Check and forward one received RTP or UDPTL packet
+void RTPTransport::rtpPacket(const char* buf, int len, SocketAddr& from)
+{
+    XDebug(dbg(),DebugAll,"RTP/UDPTL from '%s:%d' length %d [%p]",
+	from.host().c_str(),from.port(),len,this);
+    switch (m_type) {
+	case RTP:
+	    if (len < 12)
+		return;
+	    if (((unsigned char)buf[0] & 0xc0) != 0x80)
+		return;
+	    break;
+	case UDPTL:
+	    if (len < 6)
+		return;
+	    break;
+	default:
+	    break;
+    }
+    if (!m_remoteAddr.valid())
+	return;
+    // looks like it's RTP or UDPTL, at least by length and version
+    bool preferred = false;
+    if ((m_autoRemote || (preferred = (from == m_remotePref))) && (from != m_remoteAddr)) {
+	TraceDebug(m_traceId,dbg(),DebugInfo,"Auto changing RTP address from %s:%d to%s %s:%d",
+	    m_remoteAddr.host().c_str(),m_remoteAddr.port(),
+	    (preferred ? " preferred" : ""),
+	    from.host().c_str(),from.port());
+	// if we received from the preferred address don't auto change any more
+	if (preferred)
+	    m_remotePref.clear();
+	remoteAddr(from);
+    }
+    m_autoRemote = false;
+    if (from == m_remoteAddr) {
+	if (m_processor)
+	    m_processor->rtpData(buf,len);
+	if (m_monitor)
+	    m_monitor->rtpData(buf,len);
+    }
+    else if (m_processor)
+	m_processor->incWrongSrc();
+}
+
+// Read all available RTCP packets
+void RTPTransport::receiveRtcp()
+{
+    if (!m_rtcpSock.valid())
+	return;
+    char buf[BUF_SIZE];
+    int len;
+    while (((len = m_rtcpSock.recvFrom(buf,sizeof(buf),m_rxAddrRTCP)) >= 8) && (m_rxAddrRTCP == m_remoteRTCP)) {
+	XDebug(dbg(),DebugAll,"RTCP from '%s:%d' length %d [%p]",
+	    m_rxAddrRTCP.host().c_str(),m_rxAddrRTCP.port(),len,this);
+	rtcpPacket(buf,len);
+    }
+}
+
+// Forward one received RTCP packet
+void RTPTransport::rtcpPacket(const char* buf, int len)
+{
+    if (m_processor)
+	m_processor->rtcpData(buf,len);
+    if (m_monitor)
+	m_monitor->rtcpData(buf,len);
+}
+
 // Send data to remote party
 // Put a debug message on failure
 // Return true if all bytes were sent
@@ -292,20 +930,47 @@ bool RTPTransport::sendData(Socket& sock, const SocketAddr& to, const void* data
 	return false;
     }
     int wr = sock.sendTo(data,len,to);
-    if (wr == Socket::socketError() && flag && !sock.canRetry()) {
-	flag = false;
-	// Retrieve the error before calling getSockName() to avoid reset
-	String s;
-	int e = sock.error();
-	Thread::errorString(s,e);
-	SocketAddr local;
-	sock.getSockName(local);
-	TraceDebug(m_traceId,dbg(),DebugNote,"%s send failed (local=%s remote=%s): %d %s",
-	    what,local.addr().c_str(),to.addr().c_str(),e,s.c_str());
-    }
+    if (wr == Socket::socketError())
+	sendFailed(sock,to,what,flag);
     return wr == len;
 }
 
+// Put a debug message on first send failure that can't be retried
+void RTPTransport::sendFailed(Socket& sock, const SocketAddr& to, const char* what, bool& flag)
+{
+    if (!flag || sock.canRetry())
+	return;
+    flag = false;
+    // Retrieve the error before calling getSockName() to avoid reset
+    String s;
+    int e = sock.error();
+    Thread::errorString(s,e);
+    SocketAddr local;
+    sock.getSockName(local);
+    TraceDebug(m_traceId,dbg(),DebugNote,"%s send failed (local=%s remote=%s): %d %s",
+	what,local.addr().c_str(),to.addr().c_str(),e,s.c_str());
+}
+
+// Send all queued RTP packets in as few system calls as possible
+void RTPTransport::flushRtp()
+{
+    if (!(m_batch && m_batch->m_txCount))
+	return;
+    Lock lock(group());
+    int sent = 0;
+    while (sent < m_batch->m_txCount) {
+	int n = m_rtpSock.sendToBatch(m_batch->m_txBuf + sent,m_batch->m_txLen + sent,
+	    m_batch->m_txCount - sent,m_remoteAddr);
+	if (n <= 0) {
+	    if (n == Socket::socketError())
+		sendFailed(m_rtpSock,m_remoteAddr,"RTP",m_warnSendErrorRtp);
+	    break;
+	}
+	sent += n;
+    }
+    m_batch->m_txCount = 0;
+}
+
 void RTPTransport::rtpData(const void* data, int len)
 {
     if (!data)
@@ -322,14 +987,36 @@ void RTPTransport::rtpData(const void* data, int len)
 	default:
 	    break;
     }
-    sendData(m_rtpSock,m_remoteAddr,data,len,"RTP",m_warnSendErrorRtp);
+    RTPGroup* g = group();
+    if (g && g->batchSend() && m_rtpSock.valid() && m_remoteAddr.valid()) {
+	// queue the packet, it will be sent at the next group tick
+	Lock lock(g);
+	if (!m_batch)
+	    m_batch = new RTPBatch;
+	if (m_batch->queue(data,len))
+	    return;
+	flushRtp();
+	if (m_batch->queue(data,len))
+	    return;
+    }
+    sendData(*rtpSock(),m_remoteAddr,data,len,"RTP",m_warnSendErrorRtp);
 }
 
 void RTPTransport::rtcpData(const void* data, int len)
 {
     if ((len < 8) || !data)
 	return;
-    sendData(m_rtcpSock,m_remoteRTCP,data,len,"RTCP",m_warnSendErrorRtcp);
+    sendData(*rtcpSock(),m_remoteRTCP,data,len,"RTCP",m_warnSendErrorRtcp);
+}
+
+Socket* RTPTransport::rtpSock()
+{
+    return m_shared ? &m_shared->m_sock->m_rtp : &m_rtpSock;
+}
+
+Socket* RTPTransport::rtcpSock()
+{
+    return (m_shared && m_shared->m_rtcp) ? &m_shared->m_sock->m_rtcp : &m_rtcpSock;
 }
 
 void RTPTransport::setProcessor(RTPProcessor* processor)
@@ -352,7 +1039,7 @@ void RTPTransport::setMonitor(RTPProcessor* monitor)
 bool RTPTransport::localAddr(SocketAddr& addr, bool rtcp)
 {
     // check if sockets are already created and bound
-    if (m_rtpSock.valid())
+    if (m_rtpSock.valid() || m_shared)
 	return false;
     int p = addr.port();
     // for RTCP make sure we don't have a port or it's an even one
@@ -367,6 +1054,7 @@ bool RTPTransport::localAddr(SocketAddr& addr, bool rtcp)
 	    m_rtpSock.getSockName(addr);
 	    m_localAddr = addr;
 	    setScopeId(m_localAddr,m_remoteAddr,m_remotePref);
+	    watchSockets(group(),true);
 	    return true;
 	}
 	if (!p) {
@@ -380,6 +1068,7 @@ bool RTPTransport::localAddr(SocketAddr& addr, bool rtcp)
 		    m_rtpSock.setBlocking(false);
 		    m_localAddr = addr;
 		    setScopeId(m_localAddr,m_remoteAddr,m_remoteRTCP,&m_remotePref);
+		    watchSockets(group(),true);
 		    return true;
 		}
 		DDebug(dbg(),DebugMild,"RTP Socket failed with code %d",m_rtpSock.error());
@@ -394,6 +1083,7 @@ bool RTPTransport::localAddr(SocketAddr& addr, bool rtcp)
 	    addr.port(p);
 	    m_localAddr = addr;
 	    setScopeId(m_localAddr,m_remoteAddr,m_remoteRTCP,&m_remotePref);
+	    watchSockets(group(),true);
 	    return true;
 	}
 #ifdef DEBUG
@@ -410,6 +1100,36 @@ bool RTPTransport::localAddr(SocketAddr& addr, bool rtcp)
     return false;
 }
 
+bool RTPTransport::sharedAddr(SocketAddr& addr, bool rtcp, unsigned int sockets)
+{
+    if (m_rtpSock.valid() || m_shared || (m_type != RTP))
+	return false;
+    // RTCP uses the next port so the shared one must be even
+    int p = addr.port();
+    if (!p || (p & 1))
+	return false;
+    RTPMuxPort* port = RTPMuxPort::get(addr,sockets);
+    if (!port)
+	return false;
+    Lock lock(group());
+    m_warnSendErrorRtp = true;
+    m_warnSendErrorRtcp = true;
+    m_localAddr = port->m_addr;
+    setScopeId(m_localAddr,m_remoteAddr,m_remoteRTCP,&m_remotePref);
+    m_shared = port->attach(this,rtcp);
+    return true;
+}
+
+// Detach from the shared port, no more packets are delivered after it returns
+void RTPTransport::unshare()
+{
+    if (!m_shared)
+	return;
+    RTPMuxEntry* entry = m_shared;
+    m_shared = 0;
+    entry->m_port->detach(entry);
+}
+
 bool RTPTransport::remoteAddr(SocketAddr& addr, bool sniff)
 {
     Lock lock(group());
@@ -427,6 +1147,8 @@ bool RTPTransport::remoteAddr(SocketAddr& addr, bool sniff)
 	if (sniff)
 	    m_remotePref = addr;
 	setScopeId(m_localAddr,m_remoteAddr,m_remoteRTCP,sniff ? &m_remotePref : 0);
+	if (m_shared)
+	    m_shared->m_port->update(m_shared,this);
 	return true;
     }
     return false;
@@ -450,11 +1172,13 @@ bool RTPTransport::setBuffer(int bufLen)
 
 bool RTPTransport::drillHole()
 {
-    if (m_rtpSock.valid() && m_remoteAddr.valid()) {
+    Socket* rtp = rtpSock();
+    if (rtp->valid() && m_remoteAddr.valid()) {
 	static const char buf[4] = { 0, 0, 0, 0 };
-	if (m_rtpSock.sendTo(buf,sizeof(buf),m_remoteAddr) == sizeof(buf)) {
-	    if (m_rtcpSock.valid() && m_remoteRTCP.valid())
-		m_rtcpSock.sendTo(buf,sizeof(buf),m_remoteRTCP);
+	if (rtp->sendTo(buf,sizeof(buf),m_remoteAddr) == sizeof(buf)) {
+	    Socket* rtcp = rtcpSock();
+	    if (rtcp->valid() && m_remoteRTCP.valid())
+		rtcp->sendTo(buf,sizeof(buf),m_remoteRTCP);
 	    return true;
 	}
     }
@@ -50,6 +50,9 @@ class RTPSession;
 class RTPSender;
 class RTPReceiver;
 class RTPSecure;
+class RTPBatch;
+class RTPMuxEntry;
+class RTPDelayedData;
 
 /**
  * Object holding RTP debug
@@ -182,6 +185,21 @@ protected:
      */
     virtual void timerTick(const Time& when) = 0;
 
+    /**
+     * Method called by an event polling group when a watched socket has data
+     * @param rtcp True if the RTCP socket is readable, false for the RTP one
+     * @param when Time to use as base in all computing
+     */
+    virtual void readable(bool rtcp, const Time& when);
+
+    /**
+     * Method called when joining or leaving an event polling group so the
+     *  processor can start or stop watching its sockets
+     * @param grp Pointer to the event polling group
+     * @param add True if joining the group, false if leaving it
+     */
+    virtual void watchSockets(RTPGroup* grp, bool add);
+
     unsigned int m_wrongSrc;
 
 private:
@@ -239,10 +257,56 @@ public:
      */
     void part(RTPProcessor* proc);
 
+    /**
+     * Set the system global socket polling mode of groups created afterwards
+     * @param on True to wait for socket events, false to read all sockets at every tick
+     */
+    static void setEventPolling(bool on);
+
+    /**
+     * Check if event polling is supported on this platform
+     * @return True if groups can wait for socket events
+     */
+    static bool canEventPoll();
+
+    /**
+     * Set the system global batched sending mode of groups created afterwards
+     * @param on True to queue outgoing RTP packets and send them at each tick
+     */
+    static void setBatchSend(bool on);
+
+    /**
+     * Check if transports in this group queue outgoing packets and send them in batches
+     * @return True if packets are sent in batches at each tick
+     */
+    inline bool batchSend() const
+	{ return m_batchSend; }
+
+    /**
+     * Check if this group waits for socket events instead of reading all sockets
+     * @return True if sockets are watched for incoming data
+     */
+    inline bool eventPolling() const
+	{ return m_poll >= 0; }
+
+    /**
+     * Start or stop watching a socket for incoming data.
+     * The processor's readable() method is called when data arrives
+     * @param proc Pointer to the processor owning the socket
+     * @param sock Socket to watch
+     * @param rtcp True if this is the RTCP socket of the processor
+     * @param add True to start watching the socket, false to stop
+     * @return True if the operation succeeded
+     */
+    bool watch(RTPProcessor* proc, Socket& sock, bool rtcp, bool add = true);
+
 private:
+    void runEvents();
     ObjList m_processors;
     bool m_listChanged;
     unsigned long m_sleep;
+    int m_poll;
+    bool m_batchSend;
 };
 
 /**
@@ -251,6 +315,7 @@ private:
  */
 class YRTP_API RTPTransport : public RTPProcessor
 {
+    friend class RTPMuxPort;
 public:
     /**
      * Activation status of the transport
@@ -330,6 +395,24 @@ public:
      */
     bool remoteAddr(SocketAddr& addr, bool sniff = false);
 
+    /**
+     * Attach the RTP transport to a local port shared with other transports.
+     * Incoming packets are demultiplexed by remote address and SSRC
+     * @param addr Local address and even port number shared by the transports
+     * @param rtcp Enable RTCP transport
+     * @param sockets Number of sockets bound to the port using SO_REUSEPORT,
+     *  used only when the shared port is first opened
+     * @return True if the transport was attached, false if a failure occured
+     */
+    bool sharedAddr(SocketAddr& addr, bool rtcp = true, unsigned int sockets = 1);
+
+    /**
+     * Check if the transport uses a shared local port
+     * @return True if packets are received through a shared port
+     */
+    inline bool shared() const
+	{ return m_shared != 0; }
+
     /**
      * Set the size of the operating system's buffers for the RTP and RTCP sockets
      * @param bufLen Requested length of the buffer
@@ -343,21 +426,19 @@ public:
      * @return True if operation was successfull, false if an error occured
      */
     inline bool setTOS(int tos)
-	{ return m_rtpSock.setTOS(tos); }
+	{ return rtpSock()->setTOS(tos); }
 
     /**
      * Get the RTP socket used by this transport
-     * @return Pointer to the RTP socket
+     * @return Pointer to the RTP socket, may be shared with other transports
      */
-    inline Socket* rtpSock()
-	{ return &m_rtpSock; }
+    Socket* rtpSock();
 
     /**
      * Get the RTCP socket used by this transport
-     * @return Pointer to the RTCP socket
+     * @return Pointer to the RTCP socket, may be shared with other transports
      */
-    inline Socket* rtcpSock()
-	{ return &m_rtcpSock; }
+    Socket* rtcpSock();
 
     /**
      * Drill a hole in a firewall or NAT for the RTP and RTCP sockets
@@ -372,6 +453,20 @@ protected:
      */
     virtual void timerTick(const Time& when);
 
+    /**
+     * Method called by an event polling group to read data out of a socket
+     * @param rtcp True if the RTCP socket is readable, false for the RTP one
+     * @param when Time to use as base in all computing
+     */
+    virtual void readable(bool rtcp, const Time& when);
+
+    /**
+     * Start or stop watching the sockets in an event polling group
+     * @param grp Pointer to the event polling group
+     * @param add True if joining the group, false if leaving it
+     */
+    virtual void watchSockets(RTPGroup* grp, bool add);
+
     /**
      * This method is called to send a RTP packet
      * @param data Pointer to raw RTP data
@@ -389,6 +484,13 @@ protected:
 private:
     bool sendData(Socket& sock, const SocketAddr& to, const void* data, int len,
 	const char* what, bool& flag);
+    void sendFailed(Socket& sock, const SocketAddr& to, const char* what, bool& flag);
+    void receiveRtp();
+    void receiveRtcp();
+    void rtpPacket(const char* buf, int len, SocketAddr& from);
+    void rtcpPacket(const char* buf, int len);
+    void flushRtp();
+    void unshare();
     Type m_type;
     RTPProcessor* m_processor;
     RTPProcessor* m_monitor;
@@ -398,17 +500,20 @@ private:
     SocketAddr m_remoteAddr;
     SocketAddr m_remoteRTCP;
     SocketAddr m_remotePref;
-    SocketAddr m_rxAddrRTP;
     SocketAddr m_rxAddrRTCP;
     bool m_autoRemote;
     bool m_warnSendErrorRtp;
     bool m_warnSendErrorRtcp;
+    RTPBatch* m_batch;
+    RTPMuxEntry* m_shared;
 };
 
 /**
  * A dejitter buffer that can be inserted in the receive data path to
  *  absorb variations in packet arrival time. Incoming packets are stored
- *  and forwarded at fixed intervals.
+ *  in a preallocated ring of slots and forwarded at fixed intervals.
+ * The playout delay adapts between the minimum and maximum delay
+ *  following the measured interarrival jitter.
  * @short Dejitter buffer for incoming data packets
  */
 class YRTP_API RTPDejitter : public RTPProcessor
@@ -447,6 +552,49 @@ public:
      */
     void clear();
 
+    /**
+     * Retrieve MGCP P: style comma separated dejitter parameters
+     * JI (jitter in msec) and the X-JL (late), X-JD (dropped),
+     *  X-JR (reordered) and X-JB (current delay in msec) extensions
+     * @param stats String to append parameters to
+     */
+    virtual void getStats(String& stats) const;
+
+    /**
+     * Get the number of packets that arrived after a later one was played
+     * @return Number of late packets
+     */
+    inline u_int32_t late() const
+	{ return m_late; }
+
+    /**
+     * Get the number of packets dropped for not fitting in the buffer
+     * @return Number of dropped packets
+     */
+    inline u_int32_t dropped() const
+	{ return m_dropped; }
+
+    /**
+     * Get the number of packets that were inserted out of order
+     * @return Number of reordered packets
+     */
+    inline u_int32_t reordered() const
+	{ return m_reordered; }
+
+    /**
+     * Get the current playout delay
+     * @return Delay applied to incoming packets in microseconds
+     */
+    inline unsigned int delay() const
+	{ return m_delay; }
+
+    /**
+     * Get the measured interarrival jitter
+     * @return Smoothed jitter in microseconds
+     */
+    inline unsigned int jitter() const
+	{ return (unsigned int)(m_jitter >> 4); }
+
 protected:
     /**
      * Method called periodically to keep the data flowing
@@ -455,15 +603,26 @@ protected:
     virtual void timerTick(const Time& when);
 
 private:
-    ObjList m_packets;
+    void adapt(unsigned int timestamp, u_int64_t now);
+    RTPDelayedData* m_slots;
+    unsigned char* m_slab;
+    unsigned int m_size;
+    unsigned int m_head;
+    unsigned int m_count;
     RTPReceiver* m_receiver;
     unsigned int m_minDelay;
     unsigned int m_maxDelay;
+    unsigned int m_delay;
     unsigned int m_headStamp;
-    unsigned int m_tailStamp;
     u_int64_t m_headTime;
     u_int64_t m_sampRate;
     unsigned char m_fastRate;
+    unsigned int m_lastStamp;
+    u_int64_t m_lastTime;
+    u_int64_t m_jitter;
+    u_int32_t m_late;
+    u_int32_t m_dropped;
+    u_int32_t m_reordered;
 };
 
 /**
@@ -1347,6 +1506,16 @@ public:
     inline bool localAddr(SocketAddr& addr, bool rtcp = true)
 	{ Lock lck(this); return m_transport && m_transport->localAddr(addr,rtcp); }
 
+    /**
+     * Attach the RTP transport of this session to a shared local port
+     * @param addr Local address and even port number shared by the transports
+     * @param rtcp Enable RTCP in this session
+     * @param sockets Number of sockets bound to the port if it's not already open
+     * @return True if the transport was attached, false if a failure occured
+     */
+    inline bool sharedAddr(SocketAddr& addr, bool rtcp = true, unsigned int sockets = 1)
+	{ Lock lck(this); return m_transport && m_transport->sharedAddr(addr,rtcp,sockets); }
+
     /**
      * Get the stored security provider or of the sender
      * @return A pointer to the RTPSecure or NULL
@@ -30,6 +30,7 @@ namespace { // anonymous
 class ParseNested;
 class JsRunner;
 class JsCodeStats;
+class JsFieldRef;
 
 class JsContext : public JsObject, public ScriptMutex
 {
@@ -51,7 +52,7 @@ public:
     virtual bool runFunction(ObjList& stack, const ExpOperation& oper, GenObject* context);
     virtual bool runField(ObjList& stack, const ExpOperation& oper, GenObject* context);
     virtual bool runAssign(ObjList& stack, const ExpOperation& oper, GenObject* context);
-    GenObject* resolve(ObjList& stack, String& name, GenObject* context);
+    GenObject* resolve(ObjList& stack, String& name, GenObject* context, const JsFieldRef* ref = 0);
     bool runStringFunction(GenObject* obj, const String& name, ObjList& stack, const ExpOperation& oper, GenObject* context);
     bool runStringField(GenObject* obj, const String& name, ObjList& stack, const ExpOperation& oper, GenObject* context);
     void objCreated(GenObject* obj)
@@ -63,7 +64,8 @@ public:
     void trackObjs(unsigned int track = 0);
     ObjList* countAllocations();
 private:
-    GenObject* resolveTop(ObjList& stack, const String& name, GenObject* context);
+    GenObject* resolveTop(ObjList& stack, const String& name, GenObject* context,
+	const JsFieldName* field = 0);
     HashList* m_trackObjs;
     Mutex m_trackObjsMtx;
 };
@@ -136,6 +138,49 @@ struct JsEntry
     unsigned int index;
 };
 
+// Dotted path of a compiled property access or function call split in names
+class JsFieldPath : public RefObject
+{
+public:
+    inline JsFieldPath()
+	: m_last(0)
+	{ }
+    static JsFieldPath* build(const String& path);
+    inline const ObjList* names() const
+	{ return m_names.skipNull(); }
+    inline const JsFieldName* field(const String& name) const
+	{ return (m_last && *m_last == name) ? m_last : 0; }
+private:
+    ObjList m_names;
+    const JsFieldName* m_last;
+};
+
+// Compiled property access or function call, all its clones share the
+//  path names and their lookup caches
+class JsFieldRef : public ExpOperation
+{
+public:
+    inline JsFieldRef(const ExpOperation& original, JsFieldPath* path)
+	: ExpOperation(original),
+	  m_path(path), m_field(path->field(original.name()))
+	{ }
+    inline JsFieldRef(const JsFieldRef& original, const char* name)
+	: ExpOperation(original,name),
+	  m_path(original.m_path), m_field(original.m_path->field(this->name()))
+	{ }
+    virtual void* getObject(const String& name) const;
+    virtual ExpOperation* clone(const char* name) const;
+    inline const JsFieldPath* path() const
+	{ return m_path; }
+private:
+    inline JsFieldRef(const JsFieldRef& original)
+	: ExpOperation(original),
+	  m_path(original.m_path), m_field(original.m_field)
+	{ }
+    RefPointer<JsFieldPath> m_path;
+    const JsFieldName* m_field;
+};
+
 class JsCode : public ScriptCode, public ExpEvaluator
 {
     friend class TelEngine::JsFunction;
@@ -592,6 +637,42 @@ static const ExpNull s_null;
 static const String s_noFile = "[no file]";
 static const NativeFields s_nativeFields;
 
+JsFieldPath* JsFieldPath::build(const String& path)
+{
+    JsFieldPath* fp = new JsFieldPath;
+    ObjList* list = path.split('.',true);
+    ObjList* add = &fp->m_names;
+    for (ObjList* l = list->skipNull(); l; l = l->skipNext()) {
+	const String* s = static_cast<const String*>(l->get());
+	if (s->null()) {
+	    // consecutive dots, leave it to be reported at run time
+	    TelEngine::destruct(fp);
+	    break;
+	}
+	fp->m_last = new JsFieldName(*s);
+	add = add->append(const_cast<JsFieldName*>(fp->m_last));
+    }
+    TelEngine::destruct(list);
+    return fp;
+}
+
+void* JsFieldRef::getObject(const String& name) const
+{
+    if (name == YATOM("JsFieldRef"))
+	return const_cast<JsFieldRef*>(this);
+    if (name == YATOM("JsFieldName"))
+	return const_cast<JsFieldName*>(m_field);
+    return ExpOperation::getObject(name);
+}
+
+ExpOperation* JsFieldRef::clone(const char* name) const
+{
+    if (name == this->name().c_str() || this->name() == name)
+	return new JsFieldRef(*this);
+    return ExpOperation::clone(name);
+}
+
+
 void JsContext::destroyed()
 {
     params().clearParams();
@@ -600,41 +681,53 @@ void JsContext::destroyed()
     JsObject::destroyed();
 }
 
-GenObject* JsContext::resolveTop(ObjList& stack, const String& name, GenObject* context)
+GenObject* JsContext::resolveTop(ObjList& stack, const String& name, GenObject* context,
+    const JsFieldName* field)
 {
     XDebug(DebugAll,"JsContext::resolveTop '%s'",name.c_str());
     for (ObjList* l = stack.skipNull(); l; l = l->skipNext()) {
+	// scopes are pushed wrapped under their own name, skip anything else
+	if (static_cast<const ExpOperation*>(l->get())->name() != YSTRING("()"))
+	    continue;
 	JsObject* jso = YOBJECT(JsObject,l->get());
-	if (jso && jso->toString() == YSTRING("()") && jso->hasField(stack,name,context))
+	if (!(jso && jso->toString() == YSTRING("()")))
+	    continue;
+	if (field ? (0 != jso->getField(stack,*field,context)) : jso->hasField(stack,name,context))
 	    return jso;
     }
     return this;
 }
 
-GenObject* JsContext::resolve(ObjList& stack, String& name, GenObject* context)
+GenObject* JsContext::resolve(ObjList& stack, String& name, GenObject* context, const JsFieldRef* ref)
 {
     GenObject* obj = 0;
-    if (name.find('.') < 0)
+    if (!ref && name.find('.') < 0)
 	obj = resolveTop(stack,name,context);
     else {
-	ObjList* list = name.split('.',true);
+	// compiled code provides the path already split in cached names
+	ObjList* list = ref ? 0 : name.split('.',true);
+	const ObjList* l = ref ? ref->path()->names() : list->skipNull();
 	name.clear();
-	for (ObjList* l = list->skipNull(); l; ) {
+	while (l) {
 	    const String* s = static_cast<const String*>(l->get());
-	    ObjList* l2 = l->skipNext();
+	    const JsFieldName* field = list ? 0 : static_cast<const JsFieldName*>(s);
+	    const ObjList* l2 = l->skipNext();
 	    if (TelEngine::null(s)) {
 		// consecutive dots - not good
 		obj = 0;
 		break;
 	    }
 	    if (!obj)
-		obj = resolveTop(stack,*s,context);
+		obj = resolveTop(stack,*s,context,field);
+	    else if (name)
+		field = 0;
 	    name.append(*s,".");
 	    if (!l2)
 		break;
-	    ExpExtender* ext = YOBJECT(ExpExtender,obj);
+	    JsObject* jso = field ? YOBJECT(JsObject,obj) : 0;
+	    ExpExtender* ext = jso ? jso : YOBJECT(ExpExtender,obj);
 	    if (ext) {
-		GenObject* adv = ext->getField(stack,name,context);
+		GenObject* adv = jso ? jso->getField(stack,*field,context) : ext->getField(stack,name,context);
 		XDebug(DebugAll,"JsContext::resolve advanced to '%s' of %p for '%s'",
 		    (adv ? adv->toString().c_str() : 0),ext,s->c_str());
 		if (adv) {
@@ -642,7 +735,7 @@ GenObject* JsContext::resolve(ObjList& stack, String& name, GenObject* context)
 			obj = adv;
 			name.clear();
 		    }
-		    else if (l->count() == 2) { // there is only one other field after this one
+		    else if (!l2->skipNext()) { // there is only one other field after this one
 			s = static_cast<const String*>(l2->get());
 			if (!TelEngine::null(s) && s_nativeFields.find(*s)) {
 			    obj = adv;
@@ -664,10 +757,15 @@ bool JsContext::runFunction(ObjList& stack, const ExpOperation& oper, GenObject*
 {
     XDebug(DebugAll,"JsContext::runFunction '%s' line=0x%08x [%p]",oper.name().c_str(),oper.lineNumber(),this);
     String name = oper.name();
-    GenObject* o = resolve(stack,name,context);
+    const JsFieldRef* ref = YOBJECT(JsFieldRef,&oper);
+    GenObject* o = resolve(stack,name,context,ref);
     if (o && o != this) {
 	ExpExtender* ext = YOBJECT(ExpExtender,o);
 	if (ext) {
+	    if (ref) {
+		JsFieldRef op(*ref,name);
+		return ext->runFunction(stack,op,context);
+	    }
 	    ExpOperation op(oper,name);
 	    return ext->runFunction(stack,op,context);
 	}
@@ -708,10 +806,15 @@ bool JsContext::runField(ObjList& stack, const ExpOperation& oper, GenObject* co
 {
     XDebug(DebugAll,"JsContext::runField '%s' [%p]",oper.name().c_str(),this);
     String name = oper.name();
-    GenObject* o = resolve(stack,name,context);
+    const JsFieldRef* ref = YOBJECT(JsFieldRef,&oper);
+    GenObject* o = resolve(stack,name,context,ref);
     if (o && o != this) {
 	ExpExtender* ext = YOBJECT(ExpExtender,o);
 	if (ext) {
+	    if (ref) {
+		JsFieldRef op(*ref,name);
+		return ext->runField(stack,op,context);
+	    }
 	    ExpOperation op(oper,name);
 	    return ext->runField(stack,op,context);
 	}
@@ -1135,6 +1238,19 @@ bool JsCode::link()
 	    m_linked.set(newJump,j);
 	}
     }
+    // give property accesses and calls their own lookup caches
+    for (unsigned int i = 0; i < n; i++) {
+	const ExpOperation* op = static_cast<const ExpOperation*>(m_linked[i]);
+	if (!op || op->name().null())
+	    continue;
+	if (op->opcode() != OpcField && op->opcode() != OpcFunc)
+	    continue;
+	JsFieldPath* path = JsFieldPath::build(op->name());
+	if (!path)
+	    continue;
+	m_linked.set(new JsFieldRef(*op,path),i);
+	TelEngine::destruct(path);
+    }
     if (entries) {
 	m_entries = new JsEntry[entries+1];
 	unsigned int e = 0;
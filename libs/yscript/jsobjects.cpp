@@ -470,6 +470,58 @@ static void dumpRecursiveObj(const GenObject* obj, String& buf, unsigned int dep
 }
 
 
+// Number of lists where a compiled property access remembers finding the name
+#define FIELD_HITS (sizeof(m_hits) / sizeof(m_hits[0]))
+
+JsFieldName::JsFieldName(const String& name)
+    : String(name), m_next(0)
+{
+    ::memset(m_hits,0,sizeof(m_hits));
+    hash();
+}
+
+// Hits are updated under a sequence counter so readers in other threads
+//  never mix the list of a hit with the node of another one
+// A hit without node remembers the name is not present in list
+NamedString* JsFieldName::getParam(const NamedList& list) const
+{
+#if defined(ATOMIC_OPS) && !defined(_WINDOWS)
+    unsigned int i = 0;
+    for (; i < FIELD_HITS; i++) {
+	const Hit& h = m_hits[i];
+	if (h.list != &list)
+	    continue;
+	unsigned int seq = __atomic_load_n(&h.seq,__ATOMIC_ACQUIRE);
+	const NamedList* hList = h.list;
+	u_int64_t shape = h.shape;
+	const ObjList* node = h.node;
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (!(seq & 1) && seq == h.seq && hList == &list && shape == list.shape())
+	    return node ? static_cast<NamedString*>(node->get()) : 0;
+	// stale hit of this list, replace it
+	break;
+    }
+    const ObjList* node = list.getParamNode(*this);
+    if (i >= FIELD_HITS)
+	i = __sync_fetch_and_add(&m_next,1) % FIELD_HITS;
+    Hit& h = m_hits[i];
+    unsigned int seq = h.seq;
+    // leave the hit alone if another thread is updating it
+    if (!(seq & 1) && __sync_bool_compare_and_swap(&h.seq,seq,seq + 1)) {
+	h.list = &list;
+	h.shape = list.shape();
+	h.node = node;
+	__atomic_store_n(&h.seq,seq + 2,__ATOMIC_RELEASE);
+    }
+    return node ? static_cast<NamedString*>(node->get()) : 0;
+#else
+    return list.getParam(*this);
+#endif
+}
+
+#undef FIELD_HITS
+
+
 const String JsObject::s_protoName("__proto__");
 
 JsObject::JsObject(const char* name, ScriptMutex* mtx, bool frozen)
@@ -990,6 +1042,31 @@ NamedString* JsObject::getField(ObjList& stack, const String& name, GenObject* c
     return 0;
 }
 
+// Same walk as the virtual getField() with cached lookups of the name
+NamedString* JsObject::getField(ObjList& stack, const JsFieldName& name, GenObject* context) const
+{
+    NamedString* fld = name.getParam(params());
+    if (fld)
+	return fld;
+    NamedString* p = params().getParam(protoName());
+    if (p) {
+	const JsObject* jso = YOBJECT(JsObject,p);
+	if (jso)
+	    fld = jso->getField(stack,name,context);
+	else {
+	    const ScriptContext* proto = YOBJECT(ScriptContext,p);
+	    if (proto)
+		fld = proto->getField(stack,name,context);
+	}
+	if (fld)
+	    return fld;
+    }
+    NamedList* np = nativeParams();
+    if (np)
+	return name.getParam(*np);
+    return 0;
+}
+
 JsObject* JsObject::runConstructor(ObjList& stack, const ExpOperation& oper, GenObject* context)
 {
     if (!ref())
@@ -1003,7 +1080,8 @@ bool JsObject::runFunction(ObjList& stack, const ExpOperation& oper, GenObject*
 {
     XDebug(DebugInfo,"JsObject::runFunction() '%s' in '%s' [%p]",
 	oper.name().c_str(),toString().c_str(),this);
-    NamedString* param = getField(stack,oper.name(),context);
+    const JsFieldName* name = YOBJECT(JsFieldName,&oper);
+    NamedString* param = name ? getField(stack,*name,context) : getField(stack,oper.name(),context);
     if (!param)
 	return false;
     ExpFunction* ef = YOBJECT(ExpFunction,param);
@@ -1023,7 +1101,8 @@ bool JsObject::runField(ObjList& stack, const ExpOperation& oper, GenObject* con
 {
     XDebug(DebugAll,"JsObject::runField() '%s' in '%s' [%p]",
 	oper.name().c_str(),toString().c_str(),this);
-    const String* param = getField(stack,oper.name(),context);
+    const JsFieldName* name = YOBJECT(JsFieldName,&oper);
+    const String* param = name ? getField(stack,*name,context) : getField(stack,oper.name(),context);
     if (param) {
 	ExpFunction* ef = YOBJECT(ExpFunction,param);
 	if (ef)
@@ -1660,8 +1739,39 @@ JsObject* JsObject::copy(int& res, JsObject* src, unsigned int flags, GenObject*
 }
 
 
+// Arrays longer than this keep a table of item nodes only if a quarter filled
+#define JSARRAY_SPARSE_LEN 65536
+
+static inline bool jsArraySparse(int32_t len, int32_t items)
+{
+    return (len > JSARRAY_SPARSE_LEN) && (items < len / 4);
+}
+
+// Turn a removed item parameter into an operation that can be pushed on stack
+static ExpOperation* jsArrayOper(NamedString* ns)
+{
+    if (!ns)
+	return 0;
+    ExpOperation* op = YOBJECT(ExpOperation,ns);
+    if (!op) {
+	op = new ExpOperation(*ns,0,true);
+	TelEngine::destruct(ns);
+    }
+    return op;
+}
+
+// Copy an item parameter to be added to another array
+static NamedString* jsArrayClone(const NamedString* ns)
+{
+    if (!ns)
+	return 0;
+    const ExpOperation* op = YOBJECT(ExpOperation,ns);
+    return op ? op->clone() : new ExpOperation(*ns,0,true);
+}
+
 JsArray::JsArray(ScriptMutex* mtx)
-    : JsObject("Array",mtx), m_length(0)
+    : JsObject("Array",mtx), m_length(0),
+      m_nodes(0), m_alloc(0), m_holes(0), m_shape(0), m_sparse(false)
 {
     params().addParam(new ExpFunction("push"));
     params().addParam(new ExpFunction("pop"));
@@ -1680,29 +1790,162 @@ JsArray::JsArray(ScriptMutex* mtx)
 }
 
 JsArray::JsArray(GenObject* context, unsigned int line, ScriptMutex* mtx)
-    : JsObject(mtx,"[object Array]",line), m_length(0)
+    : JsObject(mtx,"[object Array]",line), m_length(0),
+      m_nodes(0), m_alloc(0), m_holes(0), m_shape(0), m_sparse(false)
 {
     setPrototype(context,YSTRING("Array"));
 }
 
+JsArray::~JsArray()
+{
+    delete[] m_nodes;
+}
+
 JsObject* JsArray::copy(ScriptMutex* mtx, const ExpOperation& oper) const
 {
     JsArray* jsa = new JsArray(mtx,toString(),oper.lineNumber(),frozen());
     deepCopyParams(jsa->params(),params(),mtx);
     jsa->setLength(length());
+    jsa->buildItems();
     return jsa;
 }
 
+// Get the index of an item from its parameter name, -1 if not an index
+int32_t JsArray::itemIndex(const String& name)
+{
+    const char* s = name.c_str();
+    if (!s || name.length() > 10 || (s[0] == '0' && s[1]))
+	return -1;
+    int64_t idx = 0;
+    for (; *s; s++) {
+	if (*s < '0' || *s > '9')
+	    return -1;
+	idx = idx * 10 + (*s - '0');
+    }
+    return (idx <= 0x7fffffff) ? (int32_t)idx : -1;
+}
+
+// Rebuild the table of item nodes if parameters changed structure since it was built
+// Return true if the table is valid, false if items must be looked up by name
+bool JsArray::buildItems(bool force)
+{
+    if (m_shape && m_shape == params().shape())
+	return !m_sparse;
+    if (m_sparse && !force)
+	return false;
+    m_shape = 0;
+    m_sparse = false;
+    m_holes = m_length;
+    if (m_alloc)
+	::memset(m_nodes,0,m_alloc * sizeof(const ObjList*));
+    if (jsArraySparse(m_length,params().count())) {
+	sparseItems();
+	return false;
+    }
+    growItems(m_length);
+    const NamedList& lst = params();
+    for (const ObjList* o = lst.paramList()->skipNull(); o; o = o->skipNext()) {
+	int32_t idx = itemIndex(static_cast<const NamedString*>(o->get())->name());
+	if (idx >= 0 && idx < m_length && !m_nodes[idx]) {
+	    m_nodes[idx] = o;
+	    m_holes--;
+	}
+    }
+    if (jsArraySparse(m_length,m_length - m_holes)) {
+	sparseItems();
+	return false;
+    }
+    itemsChanged();
+    return true;
+}
+
+// Make room in the table for a new length, added slots are holes
+void JsArray::growItems(int32_t len)
+{
+    if (len <= m_alloc)
+	return;
+    int32_t alloc = m_alloc ? m_alloc : 16;
+    while (alloc < len)
+	alloc = (alloc < 0x40000000) ? (alloc << 1) : len;
+    const ObjList** nodes = new const ObjList*[alloc];
+    if (m_alloc)
+	::memcpy(nodes,m_nodes,m_alloc * sizeof(const ObjList*));
+    ::memset(nodes + m_alloc,0,(alloc - m_alloc) * sizeof(const ObjList*));
+    delete[] m_nodes;
+    m_nodes = nodes;
+    m_alloc = alloc;
+}
+
+// Release the table, items are looked up by name until a forced rebuild
+void JsArray::sparseItems()
+{
+    delete[] m_nodes;
+    m_nodes = 0;
+    m_alloc = 0;
+    m_holes = 0;
+    m_sparse = true;
+    itemsChanged();
+}
+
+// Move an item to another index, caller must reset the parameters index
+void JsArray::moveItem(int32_t from, int32_t to)
+{
+    const ObjList* node = m_nodes[from];
+    m_nodes[to] = node;
+    if (node)
+	const_cast<String&>(static_cast<NamedString*>(node->get())->name()) = to;
+}
+
+// Remove an item from parameters and leave a hole in its place
+NamedString* JsArray::takeItem(int32_t index)
+{
+    const ObjList* node = m_nodes[index];
+    if (!node)
+	return 0;
+    m_nodes[index] = 0;
+    m_holes++;
+    const ObjList* next = node->next();
+    NamedString* ns = params().clearParamNode(node,false);
+    // the parameter that followed in list moved into the node
+    const NamedString* moved = static_cast<const NamedString*>(node->get());
+    if (moved) {
+	int32_t idx = itemIndex(moved->name());
+	if (idx >= 0 && idx < m_length && m_nodes[idx] == next)
+	    m_nodes[idx] = node;
+    }
+    return ns;
+}
+
+// Add an item or a hole after the last one, the table must be valid
+void JsArray::appendItem(NamedString* item)
+{
+    growItems(m_length + 1);
+    if (!item) {
+	m_length++;
+	m_holes++;
+	return;
+    }
+    const_cast<String&>(item->name()) = m_length;
+    // new items are usually appended after the last one, search list end from there
+    const ObjList* last = m_length ? m_nodes[m_length - 1] : 0;
+    m_nodes[m_length++] = params().addParamNode(item,last);
+    itemsChanged();
+}
+
 void JsArray::push(ExpOperation* item)
 {
     if (!item)
 	return;
+    if (buildItems()) {
+	appendItem(item);
+	return;
+    }
     unsigned int pos = m_length;
     while (params().getParam(String(pos)))
 	pos++;
     const_cast<String&>(item->name()) = pos;
     params().addParam(item);
-    setLength(pos + 1);
+    m_length = pos + 1;
 }
 
 bool JsArray::runAssign(ObjList& stack, const ExpOperation& oper, GenObject* context)
@@ -1713,16 +1956,57 @@ bool JsArray::runAssign(ObjList& stack, const ExpOperation& oper, GenObject* con
 	int newLen = oper.toInteger(-1);
 	if (newLen < 0)
 	    return false;
+	if (buildItems(true)) {
+	    for (int32_t i = newLen; i < m_length; i++) {
+		NamedString* ns = takeItem(i);
+		TelEngine::destruct(ns);
+	    }
+	    // check before growing so a huge length does not allocate the table
+	    if (newLen > m_length && jsArraySparse(newLen,m_length - m_holes)) {
+		m_length = newLen;
+		sparseItems();
+		return true;
+	    }
+	    growItems(newLen);
+	    m_holes += newLen - m_length;
+	    m_length = newLen;
+	    if (jsArraySparse(m_length,m_length - m_holes))
+		sparseItems();
+	    else
+		itemsChanged();
+	    return true;
+	}
 	for (int i = newLen; i < length(); i++)
 	    params().clearParam(String(i));
 	setLength(newLen);
 	return true;
     }
-    else if (!JsObject::runAssign(stack,oper,context))
+    bool items = buildItems();
+    if (!JsObject::runAssign(stack,oper,context))
 	return false;
-    int idx = oper.toString().toInteger(-1) + 1;
-    if (idx && idx > m_length)
-	setLength(idx);
+    int32_t len = oper.toString().toInteger(-1) + 1;
+    if (!items) {
+	if (len && len > m_length)
+	    m_length = len;
+	return true;
+    }
+    if (len && len > m_length) {
+	if (jsArraySparse(len,m_length - m_holes + 1)) {
+	    m_length = len;
+	    sparseItems();
+	    return true;
+	}
+	growItems(len);
+	m_holes += len - m_length;
+	m_length = len;
+    }
+    int32_t idx = itemIndex(oper.name());
+    if (idx >= 0 && idx < m_length && !m_nodes[idx]) {
+	m_nodes[idx] = params().getParamNode(oper.name());
+	if (m_nodes[idx])
+	    m_holes--;
+    }
+    itemsChanged();
     return true;
 }
 
@@ -1738,6 +2022,55 @@ bool JsArray::runField(ObjList& stack, const ExpOperation& oper, GenObject* cont
     return JsObject::runField(stack,oper,context);
 }
 
+NamedString* JsArray::getField(ObjList& stack, const String& name, GenObject* context) const
+{
+    if (validItems()) {
+	NamedString* ns = itemAt(itemIndex(name));
+	if (ns)
+	    return ns;
+    }
+    return JsObject::getField(stack,name,context);
+}
+
+void JsArray::fillFieldNames(ObjList& names)
+{
+    if (!buildItems(true)) {
+	JsObject::fillFieldNames(names);
+	return;
+    }
+    // items first in index order, they may be anywhere in parameters list
+    ObjList* tail = &names;
+    for (int32_t i = 0; i < m_length; i++) {
+	if (m_nodes[i])
+	    tail = tail->append(new String(itemAt(i)->name()));
+    }
+    const NamedList& lst = params();
+    for (const ObjList* o = lst.paramList()->skipNull(); o; o = o->skipNext()) {
+	const String& name = static_cast<const NamedString*>(o->get())->name();
+	if (name.null() || name.startsWith("__"))
+	    continue;
+	int32_t idx = itemIndex(name);
+	if (idx >= 0 && idx < m_length && m_nodes[idx] == o)
+	    continue;
+	tail = tail->append(new String(name));
+    }
+    const NamedList* native = nativeParams();
+    if (native)
+	ScriptContext::fillFieldNames(names,*native);
+}
+
+void JsArray::clearField(const String& name)
+{
+    int32_t idx = itemIndex(name);
+    if (idx >= 0 && idx < m_length && buildItems()) {
+	NamedString* ns = takeItem(idx);
+	TelEngine::destruct(ns);
+	itemsChanged();
+	return;
+    }
+    JsObject::clearField(name);
+}
+
 void JsArray::initConstructor(JsFunction* construct)
 {
     construct->params().addParam(new ExpFunction("isArray"));
@@ -1780,8 +2113,12 @@ bool JsArray::runNative(ObjList& stack, const ExpOperation& oper, GenObject* con
 	if (!extractArgs(this,stack,oper,context,args))
 	    return false;
 	while (ExpOperation* op = static_cast<ExpOperation*>(args.remove(false))) {
-	    const_cast<String&>(op->name()) = (unsigned int)m_length++;
-	    params().addParam(op);
+	    if (buildItems())
+		appendItem(op);
+	    else {
+		const_cast<String&>(op->name()) = (unsigned int)m_length++;
+		params().addParam(op);
+	    }
 	}
 	ExpEvaluator::pushOne(stack,new ExpOperation((int64_t)length()));
     }
@@ -1790,19 +2127,23 @@ bool JsArray::runNative(ObjList& stack, const ExpOperation& oper, GenObject* con
 	if (oper.number())
 	    return false;
 	NamedString* last = 0;
-	while ((m_length > 0) && !last)
-	    last = params().getParam(String(--m_length));
-	if (!last)
-	    ExpEvaluator::pushOne(stack,new ExpWrapper(0,0));
-	else {
-	    params().paramList()->remove(last,false);
-	    ExpOperation* op = YOBJECT(ExpOperation,last);
-	    if (!op) {
-		op = new ExpOperation(*last,0,true);
-		TelEngine::destruct(last);
+	if (buildItems()) {
+	    while ((m_length > 0) && !last) {
+		last = takeItem(--m_length);
+		m_holes--;
 	    }
-	    ExpEvaluator::pushOne(stack,op);
+	    itemsChanged();
+	}
+	else {
+	    while ((m_length > 0) && !last)
+		last = params().getParam(String(--m_length));
+	    if (last)
+		params().paramList()->remove(last,false);
 	}
+	if (!last)
+	    ExpEvaluator::pushOne(stack,new ExpWrapper(0,0));
+	else
+	    ExpEvaluator::pushOne(stack,jsArrayOper(last));
     }
     else if (oper.name() == YSTRING("concat")) {
 	// Returns a new array comprised of this array joined with other array(s) and/or value(s).
@@ -1821,56 +2162,48 @@ bool JsArray::runNative(ObjList& stack, const ExpOperation& oper, GenObject* con
 	extractArgs(this,stack,oper,context,args);
 
 	JsArray* array = new JsArray(context,oper.lineNumber(),mutex());
+	array->buildItems();
 	// copy this array - only numerically indexed elements!
-	for (int i = 0; i < m_length; i++) {
-	    NamedString* ns = params().getParam(String(i));
-	    if (!ns)
-		continue;
-	    ExpOperation* op = YOBJECT(ExpOperation,ns);
-	    op = op ? op->clone() : new ExpOperation(*ns,ns->name(),true);
-	    array->params().addParam(op);
-	}
-	array->setLength(length());
+	bool items = buildItems(true);
+	for (int32_t i = 0; i < m_length; i++)
+	    array->appendItem(jsArrayClone(getItem(i,items)));
 	// add parameters - either basic types or elements of Array
 	while (ExpOperation* op = static_cast<ExpOperation*>(args.remove(false))) {
 	    JsArray* ja = YOBJECT(JsArray,op);
 	    if (ja) {
-		int len = ja->length();
-		for (int i = 0; i < len; i++) {
-		    NamedString* ns = ja->params().getParam(String(i));
-		    if (ns) {
-			ExpOperation* arg = YOBJECT(ExpOperation,ns);
-			arg = arg ? arg->clone() : new ExpOperation(*ns,0,true);
-			const_cast<String&>(arg->name()) = (unsigned int)array->m_length++;
-			array->params().addParam(arg);
-		    }
-		    else
-			array->m_length++;
-		}
+		bool jaItems = ja->buildItems(true);
+		int32_t len = ja->length();
+		for (int32_t i = 0; i < len; i++)
+		    array->appendItem(jsArrayClone(ja->getItem(i,jaItems)));
 		TelEngine::destruct(op);
 	    }
-	    else {
-		const_cast<String&>(op->name()) = (unsigned int)array->m_length++;
-		array->params().addParam(op);
-	    }
+	    else
+		array->appendItem(op);
 	}
 	ExpEvaluator::pushOne(stack,new ExpWrapper(array));
     }
-    else if (oper.name() == YSTRING("join")) {
+    else if (oper.name() == YSTRING("join") || oper.name() == YSTRING("toString")) {
 	// Joins all elements of an array into a string
 	// var a = new Array("Wind","Rain","Fire");
 	// var myVar1 = a.join();      // assigns "Wind,Rain,Fire" to myVar1
 	// var myVar2 = a.join(", ");  // assigns "Wind, Rain, Fire" to myVar2
 	// var myVar3 = a.join(" + "); // assigns "Wind + Rain + Fire" to myVar3
+	// toString overrides the JsObject method and joins with default separator
+	// var monthNames = ['Jan', 'Feb', 'Mar', 'Apr'];
+	// var myVar = monthNames.toString(); // assigns "Jan,Feb,Mar,Apr" to myVar.
 	String separator = ",";
-	if (oper.number()) {
+	if (oper.number() && oper.name() == YSTRING("join")) {
 	    ExpOperation* op = popValue(stack,context);
 	    separator = *op;
 	    TelEngine::destruct(op);
 	}
 	String result;
-	for (int32_t i = 0; i < length(); i++)
-	    result.append(params()[String(i)],separator);
+	bool items = buildItems(true);
+	for (int32_t i = 0; i < length(); i++) {
+	    const NamedString* ns = getItem(i,items);
+	    if (ns)
+		result.append(*ns,separator);
+	}
 	ExpEvaluator::pushOne(stack,new ExpOperation(result));
     }
     else if (oper.name() == YSTRING("reverse")) {
@@ -1879,17 +2212,29 @@ bool JsArray::runNative(ObjList& stack, const ExpOperation& oper, GenObject* con
 	// myArray.reverse(); => three, two, one
 	if (oper.number())
 	    return false;
-	int i1 = 0;
-	int i2 = length() - 1;
-	for (; i1 < i2; i1++, i2--) {
-	    String s1(i1);
-	    String s2(i2);
-	    NamedString* n1 = params().getParam(s1);
-	    NamedString* n2 = params().getParam(s2);
-	    if (n1)
-		const_cast<String&>(n1->name()) = s2;
-	    if (n2)
-		const_cast<String&>(n2->name()) = s1;
+	int len = length();
+	if (buildItems(true)) {
+	    for (int i = 0, j = len - 1; i < j; i++, j--) {
+		const ObjList* tmp = m_nodes[i];
+		m_nodes[i] = m_nodes[j];
+		m_nodes[j] = tmp;
+	    }
+	    for (int i = 0; i < len; i++)
+		moveItem(i,i);
+	    params().resetIndex();
+	    itemsChanged();
+	}
+	else {
+	    // find all elements before renaming them so the lookups stay valid
+	    NamedString** items = len ? new NamedString*[len] : 0;
+	    for (int i = 0; i < len; i++)
+		items[i] = params().getParam(String(i));
+	    for (int i = 0; i < len; i++) {
+		if (items[i])
+		    const_cast<String&>(items[i]->name()) = len - 1 - i;
+	    }
+	    delete[] items;
+	    params().resetIndex();
 	}
 	ref();
 	ExpEvaluator::pushOne(stack,new ExpWrapper(this));
@@ -1908,21 +2253,34 @@ bool JsArray::runNative(ObjList& stack, const ExpOperation& oper, GenObject* con
 	// Removed this element: angel
 	if (oper.number())
 	    return false;
+	if (buildItems(true)) {
+	    NamedString* first = 0;
+	    if (m_length > 0) {
+		// shift : value n+1 becomes value n
+		first = takeItem(0);
+		for (int32_t i = 1; i < m_length; i++)
+		    moveItem(i,i - 1);
+		m_nodes[--m_length] = 0;
+		m_holes--;
+		params().resetIndex();
+		itemsChanged();
+	    }
+	    if (first)
+		ExpEvaluator::pushOne(stack,jsArrayOper(first));
+	    else
+		ExpEvaluator::pushOne(stack,new ExpWrapper(0,0));
+	    return true;
+	}
 	ObjList* l = params().paramList()->find("0");
 	if (l) {
 	    NamedString* ns = static_cast<NamedString*>(l->get());
 	    params().paramList()->remove(ns,false);
-	    ExpOperation* op = YOBJECT(ExpOperation,ns);
-	    if (!op) {
-		op = new ExpOperation(*ns,0,true);
-		TelEngine::destruct(ns);
-	    }
-	    ExpEvaluator::pushOne(stack,op);
+	    ExpEvaluator::pushOne(stack,jsArrayOper(ns));
 	    // shift : value n+1 becomes value n
 	    for (int32_t i = 0; ; i++) {
 		ns = static_cast<NamedString*>((*params().paramList())[String(i + 1)]);
 		if (!ns) {
-		    setLength(i);
+		    m_length = i;
 		    break;
 		}
 		const_cast<String&>(ns->name()) = i;
@@ -1944,7 +2302,27 @@ bool JsArray::runNative(ObjList& stack, const ExpOperation& oper, GenObject* con
 	// New length: 4
 	// shift array
 	int32_t shift = (int32_t)oper.number();
-	if (shift >= 1) {
+	if (shift >= 1 && buildItems(true)) {
+	    growItems(length() + shift);
+	    for (int32_t i = length() - 1; i >= 0; i--)
+		moveItem(i,i + shift);
+	    for (int32_t i = 0; i < shift; i++)
+		m_nodes[i] = 0;
+	    m_length += shift;
+	    m_holes += shift;
+	    params().resetIndex();
+	    const ObjList* tail = m_nodes[m_length - 1];
+	    for (int32_t i = shift - 1; i >= 0; i--) {
+		ExpOperation* op = popValue(stack,context);
+		if (!op)
+		    continue;
+		const_cast<String&>(op->name()) = i;
+		m_nodes[i] = tail = params().addParamNode(op,tail);
+		m_holes--;
+	    }
+	    itemsChanged();
+	}
+	else if (shift >= 1) {
 	    for (int32_t i = length() + shift - 1; i >= shift; i--) {
 		NamedString* ns = static_cast<NamedString*>((*params().paramList())[String(i - shift)]);
 		if (ns) {
@@ -1960,7 +2338,7 @@ bool JsArray::runNative(ObjList& stack, const ExpOperation& oper, GenObject* con
 	        const_cast<String&>(op->name()) = i;
 		params().paramList()->insert(op);
 	    }
-	    setLength(length() + shift);
+	    m_length += shift;
 	}
 	ExpEvaluator::pushOne(stack,new ExpOperation((int64_t)length()));
     }
@@ -1971,16 +2349,7 @@ bool JsArray::runNative(ObjList& stack, const ExpOperation& oper, GenObject* con
     else if (oper.name() == YSTRING("sort")) {
 	return runNativeSort(stack,oper,context);
     }
-    else if (oper.name() == YSTRING("toString")) {
-	// Override the JsObject toString method
-	// var monthNames = ['Jan', 'Feb', 'Mar', 'Apr'];
-	// var myVar = monthNames.toString(); // assigns "Jan,Feb,Mar,Apr" to myVar.
-	String separator = ",";
-	String result;
-	for (int32_t i = 0; i < length(); i++)
-	    result.append(params()[String(i)],separator);
-	ExpEvaluator::pushOne(stack,new ExpOperation(result));
-    } else if (oper.name() == YSTRING("includes") || oper.name() == YSTRING("indexOf")
+    else if (oper.name() == YSTRING("includes") || oper.name() == YSTRING("indexOf")
 	    || oper.name() == YSTRING("lastIndexOf")) {
 	// arr.includes(searchElement[,startIndex = 0[,"fieldName"]])
 	// arr.indexOf(searchElement[,startIndex = 0[,"fieldName"]])
@@ -2018,6 +2387,7 @@ bool JsArray::runNative(ObjList& stack, const ExpOperation& oper, GenObject* con
 	    fld = static_cast<ExpOperation*>(args.remove(false));
 	}
 	int index = -1;
+	bool items = buildItems(true);
 	for (int i = pos; ; i += dir) {
 	    if (dir > 0) {
 		if (i >= length())
@@ -2025,7 +2395,7 @@ bool JsArray::runNative(ObjList& stack, const ExpOperation& oper, GenObject* con
 	    }
 	    else if (i < 0)
 		break;
-	    ExpOperation* op2 = static_cast<ExpOperation*>(params().getParam(String(i)));
+	    ExpOperation* op2 = static_cast<ExpOperation*>(getItem(i,items));
 	    if (op2 && !TelEngine::null(fld)) {
 		const ExpExtender* ext = YOBJECT(ExpExtender,op2);
 		if (!ext)
@@ -2061,11 +2431,13 @@ bool JsArray::runNative(ObjList& stack, const ExpOperation& oper, GenObject* con
 unsigned int JsArray::toStringList(ObjList& list, bool emptyOk)
 {
     unsigned int n = 0;
+    bool items = buildItems(true);
+    ObjList* tail = &list;
     for (int32_t i = 0; i < length(); ++i) {
-	NamedString* ns = params().getParam(String(i));
+	NamedString* ns = getItem(i,items);
 	if (!(ns && (emptyOk || *ns)))
 	    continue;
-	list.append(new String(*ns));
+	tail = tail->append(new String(*ns));
 	n++;
     }
     return n;
@@ -2108,20 +2480,15 @@ bool JsArray::runNativeSlice(ObjList& stack, const ExpOperation& oper, GenObject
     }
     if (end < 0)
 	end = length() + end;
+    else if (end > length())
+	end = length();
 
     JsArray* array = new JsArray(context,oper.lineNumber(),mutex());
-    for (int32_t i = begin; i < end; i++) {
-	NamedString* ns = params().getParam(String(i));
-	if (!ns) {
-	    // if missing, insert undefined element in array also
-	    array->m_length++;
-	    continue;
-	}
-	ExpOperation* arg = YOBJECT(ExpOperation,ns);
-	arg = arg ? arg->clone() : new ExpOperation(*ns,0,true);
-	const_cast<String&>(arg->name()) = (unsigned int)array->m_length++;
-	array->params().addParam(arg);
-    }
+    array->buildItems();
+    bool items = buildItems(true);
+    // missing elements are copied as holes
+    for (int32_t i = begin; i < end; i++)
+	array->appendItem(jsArrayClone(getItem(i,items)));
     ExpEvaluator::pushOne(stack,new ExpWrapper(array));
     return true;
 }
@@ -2158,8 +2525,46 @@ bool JsArray::runNativeSplice(ObjList& stack, const ExpOperation& oper, GenObjec
 	argc--;
     }
 
-    // remove elements
     JsArray* removed = new JsArray(context,oper.lineNumber(),mutex());
+    int32_t shiftIdx = argc - delCount;
+    if (buildItems(true)) {
+	// remove elements, missing ones are holes in removed array too
+	removed->buildItems();
+	for (int32_t i = begin; i < begin + delCount; i++)
+	    removed->appendItem(jsArrayOper(takeItem(i)));
+	// move the elements that remained after the deleted ones
+	if (shiftIdx > 0) {
+	    growItems(m_length + shiftIdx);
+	    for (int32_t i = m_length - 1; i >= begin + delCount; i--)
+		moveItem(i,i + shiftIdx);
+	}
+	else if (shiftIdx < 0) {
+	    for (int32_t i = begin + delCount; i < m_length; i++)
+		moveItem(i,i + shiftIdx);
+	    for (int32_t i = m_length + shiftIdx; i < m_length; i++)
+		m_nodes[i] = 0;
+	}
+	m_length += shiftIdx;
+	if (shiftIdx)
+	    params().resetIndex();
+	// insert the new elements in the slots left free
+	const ObjList* tail = 0;
+	for (int32_t i = begin; i < begin + argc; i++) {
+	    ExpOperation* arg = static_cast<ExpOperation*>(args.remove(false));
+	    const_cast<String&>(arg->name()) = i;
+	    m_nodes[i] = tail = params().addParamNode(arg,tail);
+	}
+	m_holes = 0;
+	for (int32_t i = 0; i < m_length; i++) {
+	    if (!m_nodes[i])
+		m_holes++;
+	}
+	itemsChanged();
+	ExpEvaluator::pushOne(stack,new ExpWrapper(removed));
+	return true;
+    }
+
+    // remove elements
     for (int32_t i = begin; i < begin + delCount; i++) {
 	NamedString* ns = params().getParam(String(i));
 	if (!ns) {
@@ -2168,16 +2573,11 @@ bool JsArray::runNativeSplice(ObjList& stack, const ExpOperation& oper, GenObjec
 	    continue;
 	}
 	params().paramList()->remove(ns,false);
-	ExpOperation* op = YOBJECT(ExpOperation,ns);
-	if (!op) {
-	    op = new ExpOperation(*ns,0,true);
-	    TelEngine::destruct(ns);
-	}
+	ExpOperation* op = jsArrayOper(ns);
 	const_cast<String&>(op->name()) = (unsigned int)removed->m_length++;
 	removed->params().addParam(op);
     }
 
-    int32_t shiftIdx = argc - delCount;
     // shift elements to make room for those that are to be inserted or move the ones that remained
     // after delete
     if (shiftIdx > 0) {
@@ -2194,7 +2594,7 @@ bool JsArray::runNativeSplice(ObjList& stack, const ExpOperation& oper, GenObjec
 		const_cast<String&>(ns->name()) = i + shiftIdx;
 	}
     }
-    setLength(length() + shiftIdx);
+    m_length += shiftIdx;
     // insert the new elements
     for (int i = 0; i < argc; i++) {
 	ExpOperation* arg = static_cast<ExpOperation*>(args.remove(false));
@@ -2209,10 +2609,13 @@ class JsComparator
 {
 public:
     JsComparator(const char* funcName, ScriptRun* runner)
-	: m_name(funcName), m_runner(runner), m_failed(false)
+	: m_name(funcName), m_runner(runner), m_call(0), m_failed(false)
 	{ }
+    ~JsComparator()
+	{ TelEngine::destruct(m_call); }
     const char* m_name;
     ScriptRun* m_runner;
+    ScriptRun* m_call;
     bool m_failed;
 };
 
@@ -2222,8 +2625,11 @@ int compare(GenObject* op1, GenObject* op2, void* data)
     if (cmp && cmp->m_failed)
 	return 0;
     if (!(cmp && cmp->m_runner))
-	return ::strcmp(*(static_cast<String*>(op1)),*(static_cast<String*>(op2)));
-    ScriptRun* runner = cmp->m_runner->code()->createRunner(cmp->m_runner->context());
+	return ::strcmp(static_cast<String*>(op1)->safe(),static_cast<String*>(op2)->safe());
+    // one runner makes all the calls of a sort
+    if (!cmp->m_call)
+	cmp->m_call = cmp->m_runner->code()->createRunner(cmp->m_runner->context());
+    ScriptRun* runner = cmp->m_call;
     if (!runner)
 	return 0;
     ObjList stack;
@@ -2242,10 +2648,27 @@ int compare(GenObject* op1, GenObject* op2, void* data)
     }
     else
 	cmp->m_failed = true;
-    TelEngine::destruct(runner);
     return ret;
 }
 
+// Stable merge sort of array items, tmp must hold half of them
+static void sortItems(NamedString** items, NamedString** tmp, int32_t n, JsComparator* cmp)
+{
+    if (n < 2)
+	return;
+    int32_t h = n / 2;
+    sortItems(items,tmp,h,cmp);
+    sortItems(items + h,tmp,n - h,cmp);
+    if (compare(items[h - 1],items[h],cmp) <= 0)
+	return;
+    ::memcpy(tmp,items,h * sizeof(NamedString*));
+    int32_t i = 0, j = h, k = 0;
+    while (i < h && j < n)
+	items[k++] = (compare(tmp[i],items[j],cmp) > 0) ? items[j++] : tmp[i++];
+    while (i < h)
+	items[k++] = tmp[i++];
+}
+
 bool JsArray::runNativeSort(ObjList& stack, const ExpOperation& oper, GenObject* context)
 {
     ObjList arguments;
@@ -2255,6 +2678,48 @@ bool JsArray::runNativeSort(ObjList& stack, const ExpOperation& oper, GenObject*
     ScriptRun* runner = YOBJECT(ScriptRun,context);
     if (op && !runner)
 	return false;
+    JsComparator* comp = op ? new JsComparator(op->name() ,runner) : 0;
+    bool ok = true;
+    if (buildItems(true)) {
+	// take item nodes in list order so the list keeps items ordered by index
+	int32_t n = m_length - m_holes;
+	const ObjList** nodes = n ? new const ObjList*[n] : 0;
+	NamedString** items = n ? new NamedString*[n + n / 2] : 0;
+	int32_t k = 0;
+	const NamedList& lst = params();
+	for (const ObjList* o = lst.paramList()->skipNull(); o && k < n; o = o->skipNext()) {
+	    int32_t idx = itemIndex(static_cast<const NamedString*>(o->get())->name());
+	    if (idx >= 0 && idx < m_length && m_nodes[idx] == o) {
+		nodes[k] = o;
+		items[k++] = static_cast<NamedString*>(o->get());
+	    }
+	}
+	u_int64_t shape = m_shape;
+	sortItems(items,items + n,n,comp);
+	ok = comp ? !comp->m_failed : true;
+	if (ok && shape != params().shape()) {
+	    Debug(DebugWarn,"Array '%s' changed while sorting it",toString().c_str());
+	    ok = false;
+	}
+	if (ok) {
+	    // sorted items take the nodes in list order, holes go to the end
+	    for (int32_t i = 0; i < m_length; i++) {
+		if (i < n) {
+		    const_cast<ObjList*>(nodes[i])->set(items[i],false);
+		    const_cast<String&>(items[i]->name()) = i;
+		    m_nodes[i] = nodes[i];
+		}
+		else
+		    m_nodes[i] = 0;
+	    }
+	    params().resetIndex();
+	    itemsChanged();
+	}
+	delete[] nodes;
+	delete[] items;
+	delete comp;
+	return ok;
+    }
     ObjList sorted;
     ObjList* last = &sorted;
     // Copy the arguments in a ObjList for sorting
@@ -2263,9 +2728,8 @@ bool JsArray::runNativeSort(ObjList& stack, const ExpOperation& oper, GenObject*
 	if (str->name().toInteger(-1) > -1)
 	    (last = last->append(str))->setDelete(false);
     }
-    JsComparator* comp = op ? new JsComparator(op->name() ,runner) : 0;
     sorted.sort(&compare,comp);
-    bool ok = comp ? !comp->m_failed : true;
+    ok = comp ? !comp->m_failed : true;
     delete comp;
     if (ok) {
 	for (ObjList* o = params().paramList()->skipNull(); o;) {
@@ -2286,7 +2750,6 @@ bool JsArray::runNativeSort(ObjList& stack, const ExpOperation& oper, GenObject*
     return ok;
 }
 
-
 static inline void initRegexp(JsRegExp& rex)
 {
     rex.params().addParam("ignoreCase",String::boolText(rex.regexp().isCaseInsensitive()));
@@ -2455,6 +2455,42 @@ private:
 
 class JsFunction;
 
+/**
+ * Name of a property accessed from compiled code. It remembers the parameter
+ *  lists and list nodes where the property was last found and reuses them
+ *  while the list keeps its structure stamp (NamedList::shape())
+ * @short Property name with an inline lookup cache
+ */
+class YSCRIPT_API JsFieldName : public String
+{
+    YCLASS(JsFieldName,String)
+    YNOCOPY(JsFieldName);
+public:
+    /**
+     * Constructor
+     * @param name Name of the property
+     */
+    explicit JsFieldName(const String& name);
+
+    /**
+     * Locate the property in a parameter list, the list may be shared with
+     *  other threads looking up the same name
+     * @param list Parameter list to search
+     * @return Pointer to the property, NULL if not present in list
+     */
+    NamedString* getParam(const NamedList& list) const;
+
+private:
+    struct Hit {
+	volatile unsigned int seq;
+	const NamedList* list;
+	u_int64_t shape;
+	const ObjList* node;
+    };
+    mutable Hit m_hits[4];
+    mutable unsigned int m_next;
+};
+
 /**
  * Javascript Object class, base for all JS objects
  * @short Javascript Object
@@ -2609,6 +2645,16 @@ public:
      */
     virtual NamedString* getField(ObjList& stack, const String& name, GenObject* context) const;
 
+    /**
+     * Get a pointer to a field in the object or its prototype using the
+     *  lookup cache of a compiled property access
+     * @param stack Evaluation stack in use
+     * @param name Name of the field to retrieve
+     * @param context Pointer to arbitrary object passed from evaluation methods
+     * @return Pointer to field, NULL if not present
+     */
+    NamedString* getField(ObjList& stack, const JsFieldName& name, GenObject* context) const;
+
     /**
      * Native constructor initialization, called by addConstructor on the prototype
      * @param construct Function that has this object as prototype
@@ -3144,7 +3190,11 @@ private:
 };
 
 /**
- * Javascript Array class, implements arrays of items
+ * Javascript Array class, implements arrays of items.
+ * Items are kept as parameters named by their index. A table of the list nodes
+ *  holding them, valid while the parameters keep their structure stamp, lets
+ *  the array methods work by index. Arrays with few items spread over a large
+ *  length don't build the table and look up items by name
  * @short Javascript Array
  */
 class YSCRIPT_API JsArray : public JsObject
@@ -3169,9 +3219,15 @@ public:
      * @param frozen True if the object is to be frozen from creation
      */
     inline JsArray(ScriptMutex* mtx, const char* name, unsigned int line, bool frozen = false)
-	: JsObject(mtx,name,line,frozen), m_length(0)
+	: JsObject(mtx,name,line,frozen), m_length(0),
+	  m_nodes(0), m_alloc(0), m_holes(0), m_shape(0), m_sparse(false)
 	{ }
 
+    /**
+     * Destructor
+     */
+    virtual ~JsArray();
+
     /**
      * Retrieve the length of the array
      * @return Number of numerically indexed objects in array
@@ -3180,11 +3236,12 @@ public:
 	{ return m_length; }
 
     /**
-     * Set the internal length to a specific value
+     * Set the internal length to a specific value.
+     * Items are not added or removed, call after changing them in parameters
      * @param len Length of array to set
      */
     inline void setLength(int32_t len)
-	{ m_length = len; }
+	{ m_length = len; dropItems(); }
 
     /**
      * Add an item at the end of the array
@@ -3228,6 +3285,27 @@ public:
      */
     virtual bool runField(ObjList& stack, const ExpOperation& oper, GenObject* context);
 
+    /**
+     * Get a pointer to a field in the array, items are located by index
+     * @param stack Evaluation stack in use
+     * @param name Name of the field to retrieve
+     * @param context Pointer to arbitrary object passed from evaluation methods
+     * @return Pointer to field, NULL if not present
+     */
+    virtual NamedString* getField(ObjList& stack, const String& name, GenObject* context) const;
+
+    /**
+     * Fill a list with the names of all fields, items come first in index order
+     * @param names List to which key names must be added
+     */
+    virtual void fillFieldNames(ObjList& names);
+
+    /**
+     * Delete a field of the array, an item leaves a hole
+     * @param name Name of field to remove
+     */
+    virtual void clearField(const String& name);
+
     /**
      * Array constructor initialization
      * @param construct The Array function
@@ -3294,7 +3372,30 @@ private:
     bool runNativeSlice(ObjList& stack, const ExpOperation& oper, GenObject* context);
     bool runNativeSplice(ObjList& stack, const ExpOperation& oper, GenObject* context);
     bool runNativeSort(ObjList& stack, const ExpOperation& oper, GenObject* context);
+    static int32_t itemIndex(const String& name);
+    inline bool validItems() const
+	{ return m_shape && !m_sparse && m_shape == params().shape(); }
+    inline void dropItems()
+	{ m_shape = 0; m_sparse = false; }
+    inline void itemsChanged()
+	{ m_shape = params().shape(); }
+    inline NamedString* itemAt(int32_t index) const
+	{ return (index >= 0 && index < m_length && m_nodes[index]) ?
+	    static_cast<NamedString*>(m_nodes[index]->get()) : 0; }
+    inline NamedString* getItem(int32_t index, bool items) const
+	{ return items ? itemAt(index) : params().getParam(String(index)); }
+    bool buildItems(bool force = false);
+    void growItems(int32_t len);
+    void sparseItems();
+    void moveItem(int32_t from, int32_t to);
+    NamedString* takeItem(int32_t index);
+    void appendItem(NamedString* item);
     int32_t m_length;
+    const ObjList** m_nodes;
+    int32_t m_alloc;
+    int32_t m_holes;
+    u_int64_t m_shape;
+    bool m_sparse;
 };
 
 /**
@@ -102,7 +102,7 @@ void SDPSession::putMedia(NamedList& msg, ObjList* mList, bool putPort, const Na
 {
     if (sessParams) {
 	const char* prefix = sessParams->safe("ssdp_");
-	for (ObjList* o = sessParams->paramList()->skipNull(); o; o = o->skipNext()) {
+	for (const ObjList* o = sessParams->paramList()->skipNull(); o; o = o->skipNext()) {
 	    const NamedString* ns = static_cast<const NamedString*>(o->get());
 	    msg.addParam(prefix + ns->name(),*ns);
 	}
@@ -1146,7 +1146,7 @@ void SDPSession::updateSessionParams(const NamedList& nl)
     pref << "_";
     m_createSdpParams.clearParams();
     int pLen = pref.length();
-    for (ObjList* o = nl.paramList()->skipNull(); o; o = o->skipNext()) {
+    for (const ObjList* o = nl.paramList()->skipNull(); o; o = o->skipNext()) {
 	const NamedString* p = static_cast<const NamedString*>(o->get());
 	if (p->name().startsWith(pref) && p->name().rfind('_') < pLen) {
 	    NamedString* ns = new NamedString(p->name().substr(pLen),*p);
@@ -1165,6 +1165,7 @@ void SDPSession::addFmtpAmrExtra(String& buf, const String* fmtp)
 	return;
     }
     // Remove from 'fmtp' parameters we are setting from extra
+    const NamedList& extra = m_amrExtra;
     ObjList* l = fmtp->split(';',false);
     for (ObjList* f = l->skipNull(); f;) {
 	String& s = *static_cast<String*>(f->get());
@@ -1173,7 +1174,7 @@ void SDPSession::addFmtpAmrExtra(String& buf, const String* fmtp)
 	if (s) {
 	    int pos = s.find('=');
 	    if (pos >= 0) {
-		for (ObjList* o = m_amrExtra.paramList()->skipNull(); o; o = o->skipNext()) {
+		for (const ObjList* o = extra.paramList()->skipNull(); o; o = o->skipNext()) {
 		    NamedString* ns = static_cast<NamedString*>(o->get());
 		    if (s.startsWith(ns->name())) {
 			found = ns;
@@ -1182,7 +1183,7 @@ void SDPSession::addFmtpAmrExtra(String& buf, const String* fmtp)
 		}
 	    }
 	    else
-		found = m_amrExtra.getParam(s);
+		found = extra.getParam(s);
 	}
 	if (found) {
 	    f->remove();
@@ -1199,7 +1200,7 @@ void SDPSession::addFmtpAmrExtra(String& buf, const String* fmtp)
 // Add session or media parameters
 void SDPSession::addSdpParams(MimeSdpBody* sdp, const NamedList& params, bool* enc, bool* dir)
 {
-    for (ObjList* o = params.paramList()->skipNull(); o; o = o->skipNext()) {
+    for (const ObjList* o = params.paramList()->skipNull(); o; o = o->skipNext()) {
 	const NamedString* p = static_cast<const NamedString*>(o->get());
 	if (p->name().find(':') >= 0)
 	    continue;
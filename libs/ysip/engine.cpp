@@ -167,8 +167,274 @@ SIPEvent::~SIPEvent()
 }
 
 
+namespace TelEngine {
+
+// Transactions that may produce events and a heap of their pending timers
+// The queue lock is always taken after the engine lock, never before it
+class SIPEventQueue : public Mutex
+{
+public:
+    inline SIPEventQueue()
+	: Mutex(false,"SIPEngine::events"),
+	  m_first(0), m_last(0), m_heap(0), m_count(0), m_alloc(0), m_wake(1,"SIPEngine::wake"),
+	  m_trans(true,"SIPEngine::shard")
+	{ }
+    inline ~SIPEventQueue()
+	{ delete[] m_heap; }
+    void add(SIPTransaction* trans, bool first);
+    void remove(SIPTransaction* trans);
+    void changed(SIPTransaction* trans);
+    void polled(SIPTransaction* trans, bool again);
+    SIPTransaction* next(u_int64_t time);
+    u_int64_t nextTimer();
+    bool wait(u_int64_t maxwait);
+    void clear();
+    inline Mutex* transMutex()
+	{ return &m_trans; }
+private:
+    void push(SIPTransaction* trans, bool first);
+    void unlink(SIPTransaction* trans);
+    void setTimer(SIPTransaction* trans);
+    void timerUp(unsigned int pos);
+    void timerDown(unsigned int pos);
+    void timerRemove(SIPTransaction* trans);
+    inline void timerPlace(SIPTransaction* trans, unsigned int pos)
+	{ m_heap[pos] = trans; trans->m_timerIndex = pos; }
+    SIPTransaction* m_first;
+    SIPTransaction* m_last;
+    SIPTransaction** m_heap;
+    unsigned int m_count;
+    unsigned int m_alloc;
+    Semaphore m_wake;
+    // Serializes the transactions of the shard while polled or fed messages
+    Mutex m_trans;
+};
+
+}
+
+// Put a transaction in the ready queue, wake up any waiter if queue was empty
+void SIPEventQueue::push(SIPTransaction* trans, bool first)
+{
+    if (trans->m_ready)
+	return;
+    trans->m_ready = true;
+    if (!m_first) {
+	trans->m_readyNext = 0;
+	m_first = m_last = trans;
+	m_wake.unlock();
+    }
+    else if (first) {
+	trans->m_readyNext = m_first;
+	m_first = trans;
+    }
+    else {
+	trans->m_readyNext = 0;
+	m_last->m_readyNext = trans;
+	m_last = trans;
+    }
+}
+
+// Take a transaction out of the ready queue
+void SIPEventQueue::unlink(SIPTransaction* trans)
+{
+    if (!trans->m_ready)
+	return;
+    trans->m_ready = false;
+    SIPTransaction* prev = 0;
+    for (SIPTransaction* t = m_first; t; t = t->m_readyNext) {
+	if (t != trans) {
+	    prev = t;
+	    continue;
+	}
+	if (prev)
+	    prev->m_readyNext = t->m_readyNext;
+	else
+	    m_first = t->m_readyNext;
+	if (m_last == t)
+	    m_last = prev;
+	break;
+    }
+    trans->m_readyNext = 0;
+}
+
+void SIPEventQueue::timerUp(unsigned int pos)
+{
+    SIPTransaction* trans = m_heap[pos];
+    while (pos) {
+	unsigned int parent = (pos - 1) / 2;
+	if (m_heap[parent]->m_timeout <= trans->m_timeout)
+	    break;
+	timerPlace(m_heap[parent],pos);
+	pos = parent;
+    }
+    timerPlace(trans,pos);
+}
+
+void SIPEventQueue::timerDown(unsigned int pos)
+{
+    SIPTransaction* trans = m_heap[pos];
+    for (;;) {
+	unsigned int child = 2 * pos + 1;
+	if (child >= m_count)
+	    break;
+	if ((child + 1 < m_count) && (m_heap[child + 1]->m_timeout < m_heap[child]->m_timeout))
+	    child++;
+	if (trans->m_timeout <= m_heap[child]->m_timeout)
+	    break;
+	timerPlace(m_heap[child],pos);
+	pos = child;
+    }
+    timerPlace(trans,pos);
+}
+
+void SIPEventQueue::timerRemove(SIPTransaction* trans)
+{
+    int pos = trans->m_timerIndex;
+    if (pos < 0)
+	return;
+    trans->m_timerIndex = -1;
+    SIPTransaction* last = m_heap[--m_count];
+    m_heap[m_count] = 0;
+    if ((unsigned int)pos == m_count)
+	return;
+    timerPlace(last,pos);
+    timerUp(pos);
+    timerDown(last->m_timerIndex);
+}
+
+// Bring the heap entry of a transaction in sync with its timeout
+void SIPEventQueue::setTimer(SIPTransaction* trans)
+{
+    if (!trans->m_timeout) {
+	timerRemove(trans);
+	return;
+    }
+    int pos = trans->m_timerIndex;
+    if (pos >= 0) {
+	timerUp(pos);
+	timerDown(trans->m_timerIndex);
+	return;
+    }
+    if (m_count >= m_alloc) {
+	unsigned int alloc = m_alloc ? 2 * m_alloc : 256;
+	SIPTransaction** heap = new SIPTransaction*[alloc];
+	for (unsigned int i = 0; i < m_count; i++)
+	    heap[i] = m_heap[i];
+	delete[] m_heap;
+	m_heap = heap;
+	m_alloc = alloc;
+    }
+    timerPlace(trans,m_count++);
+    timerUp(trans->m_timerIndex);
+}
+
+void SIPEventQueue::add(SIPTransaction* trans, bool first)
+{
+    Lock lock(this);
+    trans->m_queued = true;
+    push(trans,first);
+    setTimer(trans);
+}
+
+void SIPEventQueue::remove(SIPTransaction* trans)
+{
+    Lock lock(this);
+    trans->m_queued = false;
+    unlink(trans);
+    timerRemove(trans);
+}
+
+void SIPEventQueue::changed(SIPTransaction* trans)
+{
+    Lock lock(this);
+    if (!trans->m_queued)
+	return;
+    push(trans,false);
+    setTimer(trans);
+}
+
+// Requeue a transaction after it was polled, at the start if it returned an event
+void SIPEventQueue::polled(SIPTransaction* trans, bool again)
+{
+    Lock lock(this);
+    if (!trans->m_queued)
+	return;
+    if (again)
+	push(trans,true);
+    setTimer(trans);
+}
+
+// Move transactions with expired timers to the ready queue then pop the first
+SIPTransaction* SIPEventQueue::next(u_int64_t time)
+{
+    Lock lock(this);
+    while (m_count && (m_heap[0]->m_timeout <= time)) {
+	SIPTransaction* t = m_heap[0];
+	timerRemove(t);
+	push(t,false);
+    }
+    SIPTransaction* t = m_first;
+    if (t) {
+	m_first = t->m_readyNext;
+	if (!m_first)
+	    m_last = 0;
+	t->m_readyNext = 0;
+	t->m_ready = false;
+    }
+    return t;
+}
+
+u_int64_t SIPEventQueue::nextTimer()
+{
+    Lock lock(this);
+    return m_count ? m_heap[0]->m_timeout : 0;
+}
+
+bool SIPEventQueue::wait(u_int64_t maxwait)
+{
+    Lock lock(this);
+    if (m_first)
+	return true;
+    u_int64_t now = Time::now();
+    u_int64_t when = now + maxwait;
+    if (m_count && (m_heap[0]->m_timeout < when))
+	when = m_heap[0]->m_timeout;
+    lock.drop();
+    if (when <= now)
+	return true;
+    maxwait = when - now;
+    if (Semaphore::efficientTimedLock())
+	return m_wake.lock((long)maxwait) || (Time::now() >= when);
+    // timed semaphore waits would busy loop, just sleep a bit
+    if (maxwait > Thread::idleUsec())
+	maxwait = Thread::idleUsec();
+    Thread::usleep(maxwait);
+    return Time::now() >= when;
+}
+
+void SIPEventQueue::clear()
+{
+    Lock lock(this);
+    while (m_first) {
+	SIPTransaction* t = m_first;
+	m_first = t->m_readyNext;
+	t->m_readyNext = 0;
+	t->m_ready = false;
+	t->m_queued = false;
+    }
+    m_last = 0;
+    while (m_count) {
+	SIPTransaction* t = m_heap[--m_count];
+	m_heap[m_count] = 0;
+	t->m_timerIndex = -1;
+	t->m_queued = false;
+    }
+}
+
+
 SIPEngine::SIPEngine(const char* userAgent)
     : Mutex(true,"SIPEngine"),
+      m_transByBranch(1024), m_transByCallID(1024), m_events(new SIPEventQueue[1]), m_shards(1),
       m_t1(500000), m_t4(5000000), m_reqTransCount(5), m_rspTransCount(6),
       m_maxForwards(70),
       m_flags(0), m_lazyTrying(false),
@@ -191,6 +457,41 @@ SIPEngine::SIPEngine(const char* userAgent)
 SIPEngine::~SIPEngine()
 {
     DDebug(this,DebugInfo,"SIPEngine::~SIPEngine() [%p]",this);
+    clearTransactions();
+    SIPEventQueue* events = m_events;
+    m_events = 0;
+    delete[] events;
+}
+
+// Try to match a message with the transactions in an index bucket
+// Transactions already tried by branch are skipped when searching by Call-ID
+// Only transactions of the locked shard can be processed
+static SIPTransaction* matchBucket(ObjList* l, SIPMessage* message, const String& branch,
+    SIPTransaction*& forked, bool byCallID, const SIPEngine* engine, unsigned int shard)
+{
+    const String& callid = byCallID ? message->getHeaderValue("Call-ID") : String::empty();
+    for (l = l ? l->skipNull() : 0; l; l = l->skipNext()) {
+	SIPTransaction* t = static_cast<SIPTransaction*>(l->get());
+	if (engine->shard(t) != shard)
+	    continue;
+	if (byCallID) {
+	    if ((t->getCallID() != callid) || (branch && (t->getBranch() == branch)))
+		continue;
+	}
+	else if (t->getBranch() != branch)
+	    continue;
+	switch (t->processMessage(message,branch)) {
+	    case SIPTransaction::Matched:
+		return t;
+	    case SIPTransaction::NoDialog:
+		forked = t;
+		break;
+	    case SIPTransaction::NoMatch:
+	    default:
+		break;
+	}
+    }
+    return 0;
 }
 
 SIPTransaction* SIPEngine::addMessage(SIPParty* ep, const char* buf, int len)
@@ -227,24 +528,21 @@ SIPTransaction* SIPEngine::addMessage(SIPMessage* message, bool* autoChangeParty
     String branch;
     if (br && br->startsWith("z9hG4bK"))
 	branch = *br;
+    const String& callid = message->getHeaderValue("Call-ID");
+    unsigned int sh = shard(callid);
+    // the shard lock serializes the transactions, the engine lock the indexes
+    Lock lckShard(shardMutex(sh));
     Lock lock(this);
     SIPTransaction* forked = 0;
-    ObjList* l = &m_transList;
-    for (; l; l = l->next()) {
-	SIPTransaction* t = static_cast<SIPTransaction*>(l->get());
-	if (!t)
-	    continue;
-	switch (t->processMessage(message,branch)) {
-	    case SIPTransaction::Matched:
-		return t;
-	    case SIPTransaction::NoDialog:
-		forked = t;
-		break;
-	    case SIPTransaction::NoMatch:
-	    default:
-		break;
-	}
-    }
+    SIPTransaction* t = 0;
+    // RFC 3261 requests and answers can match only the transaction with same branch
+    if (branch)
+	t = matchBucket(m_transByBranch.getHashList(branch),message,branch,forked,false,this,sh);
+    // RFC 2543 messages and ACK to 2xx are matched by Call-ID, CSeq and tags
+    if (!t && (branch.null() || message->isACK()))
+	t = matchBucket(m_transByCallID.getHashList(callid),message,branch,forked,true,this,sh);
+    if (t)
+	return t;
     if (forked)
 	return forkInvite(message,forked);
 
@@ -267,6 +565,113 @@ SIPTransaction* SIPEngine::forkInvite(SIPMessage* answer, SIPTransaction* trans)
     return 0;
 }
 
+// Put a transaction in a hash index, at the start of its bucket if requested
+static void indexTrans(HashList& index, SIPTransaction* trans, const String& key, bool first)
+{
+    ObjList* l = first ? index.getHashList(key) : 0;
+    if (l)
+	l = l->insert(trans);
+    else
+	l = index.append(trans,key.hash());
+    l->setDelete(false);
+}
+
+void SIPEngine::remove(SIPTransaction* transaction)
+{
+    Lock lock(this);
+    m_transList.remove(transaction,false);
+    m_transByBranch.remove(transaction,transaction->getBranch().hash(),false);
+    m_transByCallID.remove(transaction,transaction->getCallID().hash(),false);
+    if (m_events)
+	m_events[shard(transaction)].remove(transaction);
+}
+
+void SIPEngine::append(SIPTransaction* transaction)
+{
+    Lock lock(this);
+    m_transList.append(transaction);
+    indexTrans(m_transByBranch,transaction,transaction->getBranch(),false);
+    indexTrans(m_transByCallID,transaction,transaction->getCallID(),false);
+    m_events[shard(transaction)].add(transaction,false);
+}
+
+void SIPEngine::insert(SIPTransaction* transaction)
+{
+    Lock lock(this);
+    m_transList.insert(transaction);
+    indexTrans(m_transByBranch,transaction,transaction->getBranch(),true);
+    indexTrans(m_transByCallID,transaction,transaction->getCallID(),true);
+    m_events[shard(transaction)].add(transaction,true);
+}
+
+void SIPEngine::branchChanged(SIPTransaction* transaction, const String& oldBranch)
+{
+    Lock lock(this);
+    if (m_transByBranch.remove(transaction,oldBranch.hash(),false))
+	indexTrans(m_transByBranch,transaction,transaction->getBranch(),false);
+}
+
+void SIPEngine::transactionChanged(SIPTransaction* transaction)
+{
+    if (transaction && m_events)
+	m_events[shard(transaction)].changed(transaction);
+}
+
+void SIPEngine::clearTransactions()
+{
+    Lock lock(this);
+    if (m_events)
+	for (unsigned int i = 0; i < m_shards; i++)
+	    m_events[i].clear();
+    m_transByBranch.clear();
+    m_transByCallID.clear();
+    m_transList.clear();
+}
+
+u_int64_t SIPEngine::nextTimer()
+{
+    u_int64_t next = 0;
+    for (unsigned int i = 0; m_events && (i < m_shards); i++) {
+	u_int64_t t = m_events[i].nextTimer();
+	if (t && (!next || (t < next)))
+	    next = t;
+    }
+    return next;
+}
+
+bool SIPEngine::waitEvent(u_int64_t maxwait, unsigned int shard)
+{
+    return m_events && (shard < m_shards) && m_events[shard].wait(maxwait);
+}
+
+Mutex* SIPEngine::shardMutex(unsigned int shard)
+{
+    if ((m_shards < 2) || !m_events || (shard >= m_shards))
+	return this;
+    return m_events[shard].transMutex();
+}
+
+bool SIPEngine::setShards(unsigned int count)
+{
+    if (count < 1)
+	count = 1;
+    else if (count > SIP_MAX_SHARDS)
+	count = SIP_MAX_SHARDS;
+    Lock lock(this);
+    if (count == m_shards)
+	return true;
+    if (m_transList.skipNull()) {
+	Debug(this,DebugWarn,"Can't change shards count to %u while having transactions [%p]",
+	    count,this);
+	return false;
+    }
+    delete[] m_events;
+    m_events = new SIPEventQueue[count];
+    m_shards = count;
+    DDebug(this,DebugInfo,"Transaction events partitioned into %u shards [%p]",count,this);
+    return true;
+}
+
 bool SIPEngine::process()
 {
     SIPEvent* e = getEvent();
@@ -279,33 +684,37 @@ bool SIPEngine::process()
 
 SIPEvent* SIPEngine::getEvent()
 {
-    Lock lock(this);
-    ObjList* l = m_transList.skipNull();
-    if (!l)
-	return 0;
-    u_int64_t time = Time::now();
-    for (; l; l = l->skipNext()) {
-	SIPTransaction* t = static_cast<SIPTransaction*>(l->get());
-	SIPEvent* e = t->getEvent(true,time);
-	if (e) {
-	    DDebug(this,DebugInfo,"Got pending event %p (state %s) from transaction %p [%p]",
-		e,SIPTransaction::stateName(e->getState()),t,this);
-	    if (t->getState() == SIPTransaction::Invalid)
-		m_transList.remove(t);
+    for (unsigned int i = 0; i < m_shards; i++) {
+	SIPEvent* e = getEvent(i);
+	if (e)
 	    return e;
-	}
     }
-    time = Time::now();
-    for (l = m_transList.skipNull(); l; l = l->skipNext()) {
-	SIPTransaction* t = static_cast<SIPTransaction*>(l->get());
+    return 0;
+}
+
+SIPEvent* SIPEngine::getEvent(unsigned int shard)
+{
+    if (!m_events || (shard >= m_shards))
+	return 0;
+    SIPEventQueue& events = m_events[shard];
+    // other shards are polled in parallel, the engine is locked only to remove
+    Lock lock(shardMutex(shard));
+    u_int64_t time = Time::now();
+    // only transactions that were changed or whose timer expired are polled
+    while (SIPTransaction* t = events.next(time)) {
 	SIPEvent* e = t->getEvent(false,time);
 	if (e) {
 	    DDebug(this,DebugInfo,"Got event %p (state %s) from transaction %p [%p]",
 		e,SIPTransaction::stateName(e->getState()),t,this);
-	    if (t->getState() == SIPTransaction::Invalid)
-		m_transList.remove(t);
+	    if (t->getState() == SIPTransaction::Invalid) {
+		remove(t);
+		t->deref();
+	    }
+	    else
+		events.polled(t,true);
 	    return e;
 	}
+	events.polled(t,false);
     }
     return 0;
 }
@@ -29,6 +29,117 @@ using namespace TelEngine;
 
 static Regexp s_angled("<\\([^>]\\+\\)>");
 
+// Well known header names, the indexed ones match SIPMessage::KnownHeader
+static const struct {
+    const char* name;
+    unsigned int len;
+    int index;
+} s_knownHeaders[] = {
+    { "Via", 3, 0 },
+    { "From", 4, 1 },
+    { "To", 2, 2 },
+    { "Call-ID", 7, 3 },
+    { "CSeq", 4, 4 },
+    { "Contact", 7, 5 },
+    { "Route", 5, 6 },
+    { "Content-Length", 14, 7 },
+    { "WWW-Authenticate", 16, -2 },
+    { "Proxy-Authenticate", 18, -2 },
+    { "Authorization", 13, -2 },
+    { "Proxy-Authorization", 19, -2 },
+    { 0, 0, -1 }
+};
+
+// Identify a header name, returns its index, -2 for authentication lines
+//  or -1 for others. Compact forms are expanded if requested
+static int knownHeader(const char*& name, unsigned int& len, bool compact = false)
+{
+    if (compact && (len == 1)) {
+	char tmp[2] = { name[0], 0 };
+	const char* full = uncompactForm(tmp);
+	if (full != tmp) {
+	    name = full;
+	    len = ::strlen(full);
+	}
+    }
+    for (int i = 0; s_knownHeaders[i].name; i++) {
+	if ((s_knownHeaders[i].len == len) && !::strncasecmp(s_knownHeaders[i].name,name,len)) {
+	    if (compact)
+		name = s_knownHeaders[i].name;
+	    return s_knownHeaders[i].index;
+	}
+    }
+    return -1;
+}
+
+// Index of a header name used in lookups, compact forms are not accepted
+static inline int headerIndex(const char* name)
+{
+    unsigned int len = ::strlen(name);
+    int idx = knownHeader(name,len);
+    return (idx >= 0) ? idx : -1;
+}
+
+static inline bool isBlank(char c)
+{
+    return (c == ' ') || (c == '\t');
+}
+
+// Get the next line from buffer without copying it unless it is folded
+// Line continuations are appended without the leading blanks
+// Returns the line start, its length is stored in lineLen
+static const char* getLine(const char*& buf, int& len, int& lineLen, String& folded)
+{
+    folded.clear();
+    const char* start = buf;
+    int n = 0;
+    while (len > 0) {
+	char c = *buf;
+	if ((c == '\r') || (c == '\n')) {
+	    ++buf;
+	    --len;
+	    // CR is optional but skip over it if exists
+	    if ((c == '\r') && (len > 0) && (*buf == '\n')) {
+		++buf;
+		--len;
+	    }
+	    if ((n || folded) && (len > 0) && isBlank(*buf)) {
+		folded.append(start,n);
+		while ((len > 0) && isBlank(*buf)) {
+		    ++buf;
+		    --len;
+		}
+		start = buf;
+		n = 0;
+		continue;
+	    }
+	    break;
+	}
+	if (!c) {
+	    // Should not happen - but let's accept what we got and stop
+	    for (int i = 0; i < len; i++) {
+		if (buf[i]) {
+		    Debug(DebugMild,"Unexpected NUL character while unfolding lines");
+		    break;
+		}
+	    }
+	    buf += len;
+	    len = 0;
+	    break;
+	}
+	++buf;
+	--len;
+	++n;
+    }
+    if (folded) {
+	folded.append(start,n);
+	start = folded.c_str();
+	n = folded.length();
+    }
+    lineLen = n;
+    return start;
+}
+
 SIPMessage::SIPMessage(const SIPMessage& original)
     : RefObject(),
       version(original.version), method(original.method), uri(original.uri),
@@ -36,7 +147,8 @@ SIPMessage::SIPMessage(const SIPMessage& original)
       body(0), msgTraceId(original.msgTraceId), msgPrint(true), m_ep(0),
       m_valid(original.isValid()), m_answer(original.isAnswer()),
       m_outgoing(original.isOutgoing()), m_ack(original.isACK()),
-      m_cseq(-1), m_flags(original.getFlags()), m_dontSend(original.m_dontSend)
+      m_cseq(-1), m_flags(original.getFlags()), m_dontSend(original.m_dontSend),
+      m_first(), m_last(), m_count()
 {
     DDebug(DebugAll,"SIPMessage::SIPMessage(&%p) [%p]",
 	&original,this);
@@ -67,7 +179,7 @@ SIPMessage::SIPMessage(const char* _method, const char* _uri, const char* _versi
     : version(_version), method(_method), uri(_uri), code(0),
       body(0), msgPrint(true), m_ep(0), m_valid(true),
       m_answer(false), m_outgoing(true), m_ack(false), m_cseq(-1), m_flags(-1),
-      m_dontSend(false)
+      m_dontSend(false), m_first(), m_last(), m_count()
 {
     DDebug(DebugAll,"SIPMessage::SIPMessage('%s','%s','%s') [%p]",
 	_method,_uri,_version,this);
@@ -76,7 +188,7 @@ SIPMessage::SIPMessage(const char* _method, const char* _uri, const char* _versi
 SIPMessage::SIPMessage(SIPParty* ep, const char* buf, int len, unsigned int* bodyLen)
     : code(0), body(0), msgPrint(true), m_ep(ep), m_valid(false),
       m_answer(false), m_outgoing(false), m_ack(false), m_cseq(-1), m_flags(-1),
-      m_dontSend(false)
+      m_dontSend(false), m_first(), m_last(), m_count()
 {
     DDebug(DebugInfo,"SIPMessage::SIPMessage(%p,%d) [%p]\r\n------\r\n%s------",
 	buf,len,this,buf);
@@ -95,7 +207,7 @@ SIPMessage::SIPMessage(const SIPMessage* message, int _code, const char* _reason
     : code(_code), body(0), msgPrint(true),
       m_ep(0), m_valid(false),
       m_answer(true), m_outgoing(true), m_ack(false), m_cseq(-1), m_flags(-1),
-      m_dontSend(false)
+      m_dontSend(false), m_first(), m_last(), m_count()
 {
     DDebug(DebugAll,"SIPMessage::SIPMessage(%p,%d,'%s') [%p]",
 	message,_code,_reason,this);
@@ -126,7 +238,7 @@ SIPMessage::SIPMessage(const SIPMessage* original, const SIPMessage* answer)
     : method("ACK"), code(0),
       body(0), msgPrint(true), m_ep(0), m_valid(false),
       m_answer(false), m_outgoing(true), m_ack(true), m_cseq(-1), m_flags(-1),
-      m_dontSend(false)
+      m_dontSend(false), m_first(), m_last(), m_count()
 {
     DDebug(DebugAll,"SIPMessage::SIPMessage(%p,%p) [%p]",original,answer,this);
     if (!(original && original->isValid()))
@@ -148,7 +260,7 @@ SIPMessage::SIPMessage(const SIPMessage* original, const SIPMessage* answer)
 	    getParty()->appendAddr(tmp,true);
 	}
 	hl = new MimeHeaderLine("Via",tmp);
-	header.append(hl);
+	addHeader(hl);
     }
     if (answer && ((answer->code / 100) == 2) && (original->method &= "INVITE")) {
 	String tmp("z9hG4bK");
@@ -251,7 +363,7 @@ void SIPMessage::complete(SIPEngine* engine, const char* user, const char* domai
 	    hl->setParam("alias");
 	if (!((flags & (NotReqRport|RportAfterBranch)) || isAnswer() || isACK()))
 	    hl->setParam("rport");
-	header.append(hl);
+	addHeader(hl);
     }
     if (!(isAnswer() || hl->getParam("branch"))) {
 	String tmp("z9hG4bK");
@@ -278,7 +390,7 @@ void SIPMessage::complete(SIPEngine* engine, const char* user, const char* domai
 		tmp << String::uriEscape(user,'@',"+?&") << "@";
 	    tmp << domain << ">";
 	    hl = new MimeHeaderLine("From",tmp);
-	    header.append(hl);
+	    addHeader(hl);
 	}
 	if (!hl->getParam("tag"))
 	    hl->setParam("tag",String((unsigned int)Random::random()));
@@ -289,7 +401,7 @@ void SIPMessage::complete(SIPEngine* engine, const char* user, const char* domai
 	String tmp;
 	tmp << "<" << uri << ">";
 	hl = new MimeHeaderLine("To",tmp);
-	header.append(hl);
+	addHeader(hl);
     }
     if (hl && dlgTag && !hl->getParam("tag"))
 	hl->setParam("tag",dlgTag);
@@ -364,7 +476,7 @@ bool SIPMessage::copyHeader(const SIPMessage* message, const char* name, const c
 {
     const MimeHeaderLine* hl = message ? message->getHeader(name) : 0;
     if (hl) {
-	header.append(hl->clone(newName));
+	addHeader(hl->clone(newName));
 	return true;
     }
     return false;
@@ -380,7 +492,7 @@ int SIPMessage::copyAllHeaders(const SIPMessage* message, const char* name, cons
 	const MimeHeaderLine* hl = static_cast<const MimeHeaderLine*>(l->get());
 	if (hl && (hl->name() &= name)) {
 	    ++c;
-	    header.append(hl->clone(newName));
+	    addHeader(hl->clone(newName));
 	}
     }
     return c;
@@ -425,67 +537,88 @@ bool SIPMessage::parseFirst(String& line)
 bool SIPMessage::parse(const char* buf, int len, unsigned int* bodyLen)
 {
     DDebug(DebugAll,"SIPMessage::parse(%p,%d) [%p]",buf,len,this);
-    String* line = 0;
+    String folded;
+    const char* ptr = 0;
+    int n = 0;
     while (len > 0) {
-	line = MimeBody::getUnfoldedLine(buf,len);
-	if (!line->null())
-	    break;
+	ptr = getLine(buf,len,n,folded);
 	// Skip any initial empty lines
-	TelEngine::destruct(line);
+	if (n)
+	    break;
     }
-    if (!line)
+    if (!n)
 	return false;
-    if (!parseFirst(*line)) {
-	line->destruct();
+    String first(ptr,n);
+    if (!parseFirst(first))
 	return false;
+    for (int i = 0; i < HdrIndexed; i++) {
+	m_first[i] = m_last[i] = 0;
+	m_count[i] = 0;
     }
-    line->destruct();
     int clen = -1;
+    String value;
     while (len > 0) {
-	line = MimeBody::getUnfoldedLine(buf,len);
-	if (line->null()) {
+	ptr = getLine(buf,len,n,folded);
+	if (!n) {
 	    // Found end of headers
-	    line->destruct();
 	    break;
 	}
-	int col = line->find(':');
-	if (col <= 0) {
-	    line->destruct();
+	const char* col = (const char*)::memchr(ptr,':',n);
+	if (!col || (col == ptr))
 	    return false;
+	const char* name = ptr;
+	unsigned int nlen = col - ptr;
+	while (nlen && isBlank(*name)) {
+	    ++name;
+	    --nlen;
 	}
-	String name = line->substr(0,col);
-	name.trimBlanks();
-	if (name.null()) {
-	    line->destruct();
+	while (nlen && isBlank(name[nlen - 1]))
+	    --nlen;
+	if (!nlen)
 	    return false;
+	const char* val = col + 1;
+	int vlen = n - (val - ptr);
+	while (vlen && isBlank(*val)) {
+	    ++val;
+	    --vlen;
+	}
+	while (vlen && isBlank(val[vlen - 1]))
+	    --vlen;
+	value.assign(val,vlen);
+	int idx = knownHeader(name,nlen,true);
+	MimeHeaderLine* hl = 0;
+	// known names were replaced by their canonical form
+	if (idx == -1) {
+	    String tmp(name,nlen);
+	    hl = new MimeHeaderLine(tmp,value);
 	}
-	name = uncompactForm(name);
-	*line >> ":";
-	line->trimBlanks();
-	XDebug(DebugAll,"SIPMessage::parse header='%s' value='%s'",name.c_str(),line->c_str());
-
-	if ((name &= "WWW-Authenticate") ||
-	    (name &= "Proxy-Authenticate") ||
-	    (name &= "Authorization") ||
-	    (name &= "Proxy-Authorization"))
-	    header.append(new MimeAuthLine(name,*line));
+	else if (idx == -2)
+	    hl = new MimeAuthLine(name,value);
 	else
-	    header.append(new MimeHeaderLine(name,*line));
+	    hl = new MimeHeaderLine(name,value);
+	XDebug(DebugAll,"SIPMessage::parse header='%s' value='%s'",hl->name().c_str(),value.c_str());
+	header.append(hl);
+	if (idx < 0)
+	    continue;
+	if (!m_first[idx])
+	    m_first[idx] = hl;
+	m_last[idx] = hl;
+	m_count[idx]++;
 
-	if ((clen < 0) && (name &= "Content-Length"))
-	    clen = line->toInteger(-1,10);
-	else if ((m_cseq < 0) && (name &= "CSeq")) {
-	    int sep = line->find(' ');
+	if ((clen < 0) && (idx == HdrContentLength))
+	    clen = value.toInteger(-1,10);
+	else if ((m_cseq < 0) && (idx == HdrCSeq)) {
+	    int sep = value.find(' ');
 	    if (sep > 0) {
-		m_cseq = line->substr(0,sep).toInteger(-1,10);
+		m_cseq = value.substr(0,sep).toInteger(-1,10);
 		if (m_answer) {
-		    method = line->substr(sep + 1);
+		    method = value.substr(sep + 1);
 		    method.trimBlanks().toUpper();
 		}
 	    }
 	}
-	line->destruct();
     }
+    // Content- lines moved to body by buildBody() are never indexed
     if (!bodyLen) {
 	if (clen >= 0) {
 	    if (clen > len)
@@ -543,10 +676,39 @@ void SIPMessage::buildBody(const char* buf, int len)
 	header.count(),body);
 }
 
+// Build the index of well known headers
+void SIPMessage::indexHeaders()
+{
+    for (int i = 0; i < HdrIndexed; i++) {
+	m_first[i] = m_last[i] = 0;
+	m_count[i] = 0;
+    }
+    for (const ObjList* l = header.skipNull(); l; l = l->skipNext())
+	indexHeader(static_cast<const MimeHeaderLine*>(l->get()));
+}
+
+// Add a header line appended to the list to the index
+void SIPMessage::indexHeader(const MimeHeaderLine* line)
+{
+    if (!line)
+	return;
+    int idx = headerIndex(line->name());
+    if (idx < 0)
+	return;
+    if (!m_first[idx])
+	m_first[idx] = line;
+    m_last[idx] = line;
+    m_count[idx]++;
+}
+
 const MimeHeaderLine* SIPMessage::getHeader(const char* name) const
 {
     if (!(name && *name))
 	return 0;
+    int idx = headerIndex(name);
+    // an empty slot is scanned for lines appended without headersChanged()
+    if ((idx >= 0) && m_first[idx])
+	return m_first[idx];
     const ObjList* l = &header;
     for (; l; l = l->next()) {
 	const MimeHeaderLine* t = static_cast<const MimeHeaderLine*>(l->get());
@@ -560,6 +722,9 @@ const MimeHeaderLine* SIPMessage::getLastHeader(const char* name) const
 {
     if (!(name && *name))
 	return 0;
+    int idx = headerIndex(name);
+    if ((idx >= 0) && m_last[idx])
+	return m_last[idx];
     const MimeHeaderLine* res = 0;
     const ObjList* l = &header;
     for (; l; l = l->next()) {
@@ -574,20 +739,28 @@ void SIPMessage::clearHeaders(const char* name)
 {
     if (!(name && *name))
 	return;
+    bool removed = false;
     ObjList* l = &header;
     while (l) {
 	const MimeHeaderLine* t = static_cast<const MimeHeaderLine*>(l->get());
-	if (t && (t->name() &= name))
+	if (t && (t->name() &= name)) {
 	    l->remove();
+	    removed = true;
+	}
 	else
 	    l = l->next();
     }
+    if (removed && (headerIndex(name) >= 0))
+	indexHeaders();
 }
 
 int SIPMessage::countHeaders(const char* name) const
 {
     if (!(name && *name))
 	return 0;
+    int idx = headerIndex(name);
+    if ((idx >= 0) && m_last[idx])
+	return m_count[idx];
     int res = 0;
     const ObjList* l = &header;
     for (; l; l = l->next()) {
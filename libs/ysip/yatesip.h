@@ -40,6 +40,11 @@
 #define YSIP_API
 #endif
 
+/**
+ * Maximum number of shards a SIP engine can partition its transactions into
+ */
+#define SIP_MAX_SHARDS 32
+
 /**
  * Holds all Telephony Engine related classes.
  */
@@ -52,6 +57,7 @@ extern YSIP_API TokenDict* SIPResponses;
 
 class SIPEngine;
 class SIPEvent;
+class SIPEventQueue;
 
 class YSIP_API SIPParty : public RefObject
 {
@@ -380,14 +386,22 @@ public:
      * @param value Content of the new header line
      */
     inline void addHeader(const char* name, const char* value = 0)
-	{ header.append(new MimeHeaderLine(name,value)); }
+	{ addHeader(new MimeHeaderLine(name,value)); }
 
     /**
      * Append an already constructed header line
      * @param line Header line to add
      */
     inline void addHeader(MimeHeaderLine* line)
-	{ header.append(line); }
+	{ header.append(line); indexHeader(line); }
+
+    /**
+     * Rebuild the index of well known headers after lines were added to or
+     *  removed from the header list directly. It must be called before the
+     *  next lookup, the index is trusted and may keep removed lines
+     */
+    inline void headersChanged()
+	{ indexHeaders(); }
 
     /**
      * Clear all header lines that match a name
@@ -519,6 +533,9 @@ public:
 
     /**
      * All the headers should be in this list.
+     * Prefer addHeader() and clearHeaders() to change it. Call
+     *  headersChanged() after adding or removing lines directly, lookups of
+     *  well known headers are served from an index built from this list
      */
     ObjList header;
 
@@ -539,8 +556,25 @@ public:
     bool msgPrint;
 
 protected:
+    /**
+     * Well known headers indexed for fast lookup
+     */
+    enum KnownHeader {
+	HdrVia = 0,
+	HdrFrom,
+	HdrTo,
+	HdrCallId,
+	HdrCSeq,
+	HdrContact,
+	HdrRoute,
+	HdrContentLength,
+	HdrIndexed
+    };
+
     bool parse(const char* buf, int len, unsigned int* bodyLen);
     bool parseFirst(String& line);
+    void indexHeaders();
+    void indexHeader(const MimeHeaderLine* line);
     SIPParty* m_ep;
     RefPointer<SIPSequence> m_seq;
     bool m_valid;
@@ -554,6 +588,9 @@ protected:
     String m_authUser;
     String m_authPass;
     bool m_dontSend;
+    const MimeHeaderLine* m_first[HdrIndexed];
+    const MimeHeaderLine* m_last[HdrIndexed];
+    unsigned int m_count[HdrIndexed];
 private:
     SIPMessage(); // no, thanks
 };
@@ -948,8 +985,7 @@ public:
      * Set the (re)transmission flag that allows the latest outgoing message
      *  to be send over the wire
      */
-    inline void setTransmit()
-	{ m_transmit = true; }
+    void setTransmit();
 
     /**
      * Change transaction status to Cleared
@@ -1204,6 +1240,13 @@ protected:
     bool m_autoAck;
     bool m_silent;
     String m_traceId;
+
+private:
+    friend class SIPEventQueue;
+    SIPTransaction* m_readyNext;
+    int m_timerIndex;
+    bool m_ready;
+    bool m_queued;
 };
 
 /**
@@ -1394,13 +1437,23 @@ public:
 
     /**
      * Get a SIPEvent from the queue.
-     * This method mainly looks into the transaction list and get all kind of
-     * events, like an incoming request (INVITE, REGISTRATION), a timer, an
-     * outgoing message.
+     * This method polls the transactions that were changed or whose timer
+     * expired and get all kind of events, like an incoming request
+     * (INVITE, REGISTRATION), a timer, an outgoing message.
+     * All shards are checked in turn.
      * This method is thread safe
      */
     SIPEvent *getEvent();
 
+    /**
+     * Get a SIPEvent from the queue of a single shard.
+     * Only the shard's mutex is held while polling so each shard can be
+     *  polled by its own thread. This method is thread safe
+     * @param shard Index of the shard to poll
+     * @return Pointer to event or NULL if the shard has nothing to process
+     */
+    SIPEvent* getEvent(unsigned int shard);
+
     /**
      * This method should be called very often to get the events from the list and
      * to send them to processEvent method.
@@ -1579,22 +1632,101 @@ public:
      * Remove a transaction from the list without dereferencing it
      * @param transaction Pointer to transaction to remove
      */
-    inline void remove(SIPTransaction* transaction)
-	{ lock(); m_transList.remove(transaction,false); unlock(); }
+    void remove(SIPTransaction* transaction);
 
     /**
      * Append a transaction to the end of the list
      * @param transaction Pointer to transaction to append
      */
-    inline void append(SIPTransaction* transaction)
-	{ lock(); m_transList.append(transaction); unlock(); }
+    void append(SIPTransaction* transaction);
 
     /**
      * Insert a transaction at the start of the list
      * @param transaction Pointer to transaction to insert
      */
-    inline void insert(SIPTransaction* transaction)
-	{ lock(); m_transList.insert(transaction); unlock(); }
+    void insert(SIPTransaction* transaction);
+
+    /**
+     * Update the transaction index after the Via branch of a transaction changed
+     * @param transaction Pointer to transaction whose branch was changed
+     * @param oldBranch Branch the transaction was previously using
+     */
+    void branchChanged(SIPTransaction* transaction, const String& oldBranch);
+
+    /**
+     * Notify the engine that a transaction may have new events or its timer changed.
+     * The transaction is queued to be polled by the next @ref getEvent() call
+     * @param transaction Pointer to the changed transaction
+     */
+    void transactionChanged(SIPTransaction* transaction);
+
+    /**
+     * Remove all transactions from the list and the event queue
+     */
+    void clearTransactions();
+
+    /**
+     * Get the time when the earliest transaction timer will fire
+     * @return Time of the next timer in microseconds, zero if no timer is set
+     */
+    u_int64_t nextTimer();
+
+    /**
+     * Wait until a transaction is ready to produce events or a timer fires
+     * @param maxwait Maximum time to wait in microseconds
+     * @param shard Index of the shard to wait on
+     * @return True if some transaction is ready or a timer fired
+     */
+    bool waitEvent(u_int64_t maxwait, unsigned int shard = 0);
+
+    /**
+     * Set the number of shards the transaction events are partitioned into.
+     * Transactions are assigned to shards by their Call-ID so all transactions
+     *  of a dialog are always processed in order by the same thread.
+     * This can be changed only while the engine has no transactions
+     * @param count Desired number of shards, between 1 and SIP_MAX_SHARDS
+     * @return True if the number of shards was set
+     */
+    bool setShards(unsigned int count);
+
+    /**
+     * Get the number of shards the transaction events are partitioned into
+     * @return Number of shards, at least 1
+     */
+    inline unsigned int shards() const
+	{ return m_shards; }
+
+    /**
+     * Get the shard that processes the events of a transaction
+     * @param transaction Pointer to the transaction
+     * @return Index of the shard
+     */
+    inline unsigned int shard(const SIPTransaction* transaction) const
+	{ return shard(transaction->getCallID()); }
+
+    /**
+     * Get the shard that processes the transactions of a Call-ID
+     * @param callid Call-ID of the transactions
+     * @return Index of the shard
+     */
+    inline unsigned int shard(const String& callid) const
+	{ return (m_shards > 1) ? callid.hash() % m_shards : 0; }
+
+    /**
+     * Get the mutex serializing the transactions of a shard.
+     * With a single shard this is the engine itself
+     * @param shard Index of the shard
+     * @return Pointer to the mutex of the shard
+     */
+    Mutex* shardMutex(unsigned int shard);
+
+    /**
+     * Get the mutex serializing the transactions of the shard of a transaction
+     * @param transaction Pointer to the transaction
+     * @return Pointer to the mutex of the transaction's shard
+     */
+    inline Mutex* shardMutex(const SIPTransaction* transaction)
+	{ return shardMutex(shard(transaction)); }
 
     /**
      * Get the number of active SIP transactions
@@ -1609,6 +1741,26 @@ protected:
      */
     ObjList m_transList;
 
+    /**
+     * Index of the transactions by their Via branch, does not own them
+     */
+    HashList m_transByBranch;
+
+    /**
+     * Index of the transactions by their Call-ID, does not own them
+     */
+    HashList m_transByCallID;
+
+    /**
+     * Queues of transactions ready to be polled and their timers, one per shard
+     */
+    SIPEventQueue* m_events;
+
+    /**
+     * Number of event queues
+     */
+    unsigned int m_shards;
+
     u_int64_t m_t1;
     u_int64_t m_t4;
     int m_reqTransCount;
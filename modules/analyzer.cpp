@@ -649,8 +649,10 @@ void AnalyzerChan::checkTimers(Message& msg, const Time& tmr)
 {
     if (m_stopTime && (m_stopTime < tmr))
 	msgDrop(msg,"finished");
-    else
+    else {
+	armTimer(m_stopTime);
 	Channel::checkTimers(msg,tmr);
+    }
 }
 
 void AnalyzerChan::startChannel(NamedList& params)
@@ -680,6 +682,7 @@ void AnalyzerChan::setDuration(NamedList& params)
     int t = params.getIntValue("duration",120000);
     if (t > 0)
 	m_stopTime = Time::now() + 1000 * (uint64_t)t;
+    armTimer(m_stopTime);
 }
 
 void AnalyzerChan::addSource()
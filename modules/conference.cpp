@@ -22,6 +22,9 @@
  */
 
 #include <yatephone.h>
+#include "../engine/simd.h"
+
+#include <string.h>
 
 using namespace TelEngine;
 namespace { // anonymous
@@ -33,6 +36,9 @@ namespace { // anonymous
 #define MAX_SPEAKERS 8
 #define DEF_SPEAKERS 3
 
+// maximum number of smart channels mixed when a cap is set
+#define MAX_MIXED 32
+
 // Speaking detector energy square hysteresis
 #define SPEAK_HIST_MIN 16384
 #define SPEAK_HIST_MAX 32768
@@ -75,6 +81,144 @@ static Mutex s_srcMutex(false,"Conference");
 // Hold the number of the newest allocated dynamic room
 static int s_roomAlloc = 0;
 
+// Add samples to the mix accumulator
+typedef void (*MixAddFunc)(int* acc, const int16_t* src, unsigned int samples);
+// Saturate the accumulator to output, optionally substracting own samples
+typedef void (*MixOutFunc)(int16_t* dst, const int* acc, const int16_t* own,
+    unsigned int ownSamples, unsigned int samples);
+
+// Saturate symmetrically the result of additions and substraction
+static inline int16_t mixSaturate(int val)
+{
+    return (val < -32767) ? -32767 : ((val > 32767) ? 32767 : val);
+}
+
+static void mixAddScalar(int* acc, const int16_t* src, unsigned int samples)
+{
+    for (unsigned int i = 0; i < samples; i++)
+	acc[i] += src[i];
+}
+
+static void mixOutScalar(int16_t* dst, const int* acc, const int16_t* own,
+    unsigned int ownSamples, unsigned int samples)
+{
+    unsigned int i = 0;
+    for (; i < ownSamples; i++)
+	dst[i] = mixSaturate(acc[i] - own[i]);
+    for (; i < samples; i++)
+	dst[i] = mixSaturate(acc[i]);
+}
+
+#ifdef YSIMD_X86
+__attribute__((target("sse2")))
+static void mixAddSSE2(int* acc, const int16_t* src, unsigned int samples)
+{
+    unsigned int i = 0;
+    for (; i + 8 <= samples; i += 8) {
+	__m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+	// sign extend by placing the sample in the high half and shifting
+	__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s,s),16);
+	__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s,s),16);
+	__m128i* a = (__m128i*)(acc + i);
+	_mm_storeu_si128(a,_mm_add_epi32(_mm_loadu_si128(a),lo));
+	_mm_storeu_si128(a + 1,_mm_add_epi32(_mm_loadu_si128(a + 1),hi));
+    }
+    mixAddScalar(acc + i,src + i,samples - i);
+}
+
+__attribute__((target("sse2")))
+static void mixOutSSE2(int16_t* dst, const int* acc, const int16_t* own,
+    unsigned int ownSamples, unsigned int samples)
+{
+    const __m128i minVal = _mm_set1_epi16(-32767);
+    unsigned int i = 0;
+    for (; i + 8 <= samples; i += 8) {
+	__m128i lo = _mm_loadu_si128((const __m128i*)(acc + i));
+	__m128i hi = _mm_loadu_si128((const __m128i*)(acc + i + 4));
+	if (i + 8 <= ownSamples) {
+	    __m128i s = _mm_loadu_si128((const __m128i*)(own + i));
+	    lo = _mm_sub_epi32(lo,_mm_srai_epi32(_mm_unpacklo_epi16(s,s),16));
+	    hi = _mm_sub_epi32(hi,_mm_srai_epi32(_mm_unpackhi_epi16(s,s),16));
+	}
+	else if (i < ownSamples)
+	    break;
+	// packing saturates to -32768..32767, make it symmetric
+	_mm_storeu_si128((__m128i*)(dst + i),_mm_max_epi16(_mm_packs_epi32(lo,hi),minVal));
+    }
+    if (i < ownSamples)
+	mixOutScalar(dst + i,acc + i,own + i,ownSamples - i,samples - i);
+    else
+	mixOutScalar(dst + i,acc + i,0,0,samples - i);
+}
+
+__attribute__((target("avx2")))
+static void mixAddAVX2(int* acc, const int16_t* src, unsigned int samples)
+{
+    unsigned int i = 0;
+    for (; i + 16 <= samples; i += 16) {
+	__m128i s0 = _mm_loadu_si128((const __m128i*)(src + i));
+	__m128i s1 = _mm_loadu_si128((const __m128i*)(src + i + 8));
+	__m256i* a = (__m256i*)(acc + i);
+	_mm256_storeu_si256(a,_mm256_add_epi32(_mm256_loadu_si256(a),_mm256_cvtepi16_epi32(s0)));
+	_mm256_storeu_si256(a + 1,_mm256_add_epi32(_mm256_loadu_si256(a + 1),_mm256_cvtepi16_epi32(s1)));
+    }
+    mixAddScalar(acc + i,src + i,samples - i);
+}
+
+__attribute__((target("avx2")))
+static void mixOutAVX2(int16_t* dst, const int* acc, const int16_t* own,
+    unsigned int ownSamples, unsigned int samples)
+{
+    const __m256i minVal = _mm256_set1_epi16(-32767);
+    unsigned int i = 0;
+    for (; i + 16 <= samples; i += 16) {
+	__m256i lo = _mm256_loadu_si256((const __m256i*)(acc + i));
+	__m256i hi = _mm256_loadu_si256((const __m256i*)(acc + i + 8));
+	if (i + 16 <= ownSamples) {
+	    lo = _mm256_sub_epi32(lo,_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(own + i))));
+	    hi = _mm256_sub_epi32(hi,_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(own + i + 8))));
+	}
+	else if (i < ownSamples)
+	    break;
+	// packing works per 128 bit lane so restore the order of quadwords
+	__m256i p = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo,hi),0xd8);
+	_mm256_storeu_si256((__m256i*)(dst + i),_mm256_max_epi16(p,minVal));
+    }
+    if (i < ownSamples)
+	mixOutScalar(dst + i,acc + i,own + i,ownSamples - i,samples - i);
+    else
+	mixOutScalar(dst + i,acc + i,0,0,samples - i);
+}
+#endif
+
+static MixAddFunc s_mixAdd = mixAddScalar;
+static MixOutFunc s_mixOut = mixOutScalar;
+static const char* s_mixKernel = "scalar";
+
+// Pick the best mixing kernels the CPU supports
+static void selectMixKernel()
+{
+#ifdef YSIMD_X86
+    switch (simdLevel()) {
+	case SimdAVX2:
+	    s_mixAdd = mixAddAVX2;
+	    s_mixOut = mixOutAVX2;
+	    s_mixKernel = "avx2";
+	    return;
+	case SimdSSE2:
+	    s_mixAdd = mixAddSSE2;
+	    s_mixOut = mixOutSSE2;
+	    s_mixKernel = "sse2";
+	    return;
+	default:
+	    break;
+    }
+#endif
+    s_mixAdd = mixAddScalar;
+    s_mixOut = mixOutScalar;
+    s_mixKernel = "scalar";
+}
+
 // The conference room holds a list of connected channels and does the mixing.
 // It does also act as a data source for the sum of all channels
 class ConfRoom : public DataSource
@@ -141,11 +285,15 @@ private:
     ConfChan* m_speakers[MAX_SPEAKERS];
     int m_trackSpeakers;
     int m_trackInterval;
+    int m_maxMix;
     u_int64_t m_nextNotify;
     u_int64_t m_nextSpeakers;
     unsigned int m_minBuffer;
     unsigned int m_maxBuffer;
     unsigned int m_dataChunk;
+    DataBlock m_mixBuf;
+    DataBlock m_outBuf;
+    bool m_outBusy;
 };
 
 // A conference channel is just a dumb holder of its data channels
@@ -189,7 +337,8 @@ class ConfConsumer : public DataConsumer
 public:
     ConfConsumer(ConfRoom* room, bool smart = false)
 	: m_room(room), m_src(0), m_muted(false), m_smart(smart), m_speak(false),
-	  m_energy2(ENERGY_MIN), m_noise2(ENERGY_MIN), m_envelope2(ENERGY_MIN)
+	  m_energy2(ENERGY_MIN), m_noise2(ENERGY_MIN), m_envelope2(ENERGY_MIN),
+	  m_mixed(0)
 	{ DDebug(DebugAll,"ConfConsumer::ConfConsumer(%p,%s) [%p]",room,String::boolText(smart),this); m_format = room->getFormat(); }
     ~ConfConsumer()
 	{ DDebug(DebugAll,"ConfConsumer::~ConfConsumer() [%p]",this); }
@@ -215,8 +364,8 @@ public:
     inline bool shouldMix() const
 	{ return hasSignal() && (m_buffer.length() > 1); }
 private:
-    void consumed(const int* mixed, unsigned int samples);
-    void dataForward(const int* mixed, unsigned int samples);
+    void consumed(const int* mixed, unsigned int samples, const DataBlock& full);
+    void dataForward(const int* mixed, unsigned int samples, const DataBlock& full);
     RefPointer<ConfRoom> m_room;
     ConfSource* m_src;
     bool m_muted;
@@ -225,7 +374,10 @@ private:
     unsigned int m_energy2;
     unsigned int m_noise2;
     unsigned int m_envelope2;
+    // samples this consumer contributed to the current mix
+    unsigned int m_mixed;
     DataBlock m_buffer;
+    DataBlock m_outBuf;
 };
 
 // Per channel data source with that channel's data removed from the mix
@@ -329,7 +481,8 @@ ConfRoom* ConfRoom::get(const String& name, const NamedList* params)
 ConfRoom::ConfRoom(const String& name, const NamedList& params)
     : m_name(name), m_lonely(false), m_created(true), m_record(0),
       m_rate(8000), m_users(0), m_maxusers(10), m_maxLock(200),
-      m_expire(0), m_lonelyInterval(0), m_nextNotify(0), m_nextSpeakers(0)
+      m_expire(0), m_lonelyInterval(0), m_maxMix(0), m_nextNotify(0), m_nextSpeakers(0),
+      m_outBusy(false)
 {
     m_rate = params.getIntValue("rate",m_rate,8000,48000);
     m_maxusers = params.getIntValue("maxusers",m_maxusers);
@@ -344,6 +497,7 @@ ConfRoom::ConfRoom(const String& name, const NamedList& params)
 	m_trackSpeakers = MAX_SPEAKERS;
     else if ((m_trackSpeakers == 0) && params.getBoolValue("speakers"))
 	m_trackSpeakers = DEF_SPEAKERS;
+    m_maxMix = params.getIntValue("maxmix",0,0,MAX_MIXED);
     m_trackInterval = params.getIntValue("interval",3000);
     if (m_trackInterval <= 0)
 	m_trackInterval = 0;
@@ -554,6 +708,8 @@ void ConfRoom::msgStatus(Message& msg)
     msg.retValue() << ",users=" << m_users;
     msg.retValue() << ",chans=" << m_chans.count();
     msg.retValue() << ",owners=" << m_owners.count();
+    if (m_maxMix)
+	msg.retValue() << ",maxmix=" << m_maxMix;
     if (m_notify)
 	msg.retValue() << ",notify=" << m_notify;
     if (m_playerId)
@@ -658,20 +814,38 @@ void ConfRoom::mix(ConfConsumer* cons)
 {
     unsigned int len = m_maxBuffer;
     unsigned int mlen = 0;
+    ConfConsumer* loudest[MAX_MIXED];
+    int nLoud = 0;
     Lock mylock(this);
     // find out the minimum and maximum amount of data in buffers
+    //  and the loudest smart channels if the number of mixed ones is capped
     ObjList* l = m_chans.skipNull();
     for (; l; l = l->skipNext()) {
 	ConfChan* ch = static_cast<ConfChan*>(l->get());
 	ConfConsumer* co = static_cast<ConfConsumer*>(ch->getConsumer());
 	if (co) {
+	    co->m_mixed = 0;
 	    unsigned int buffered = co->m_buffer.length();
 	    if (len > buffered)
 		len = buffered;
 	    if (mlen < buffered)
 		mlen = buffered;
+	    if (!(m_maxMix && co->smart() && co->shouldMix()))
+		continue;
+	    unsigned int vol = co->envelope2();
+	    int i = nLoud;
+	    if (nLoud < m_maxMix)
+		nLoud++;
+	    else if (vol <= loudest[--i]->envelope2())
+		continue;
+	    for (; i > 0 && loudest[i-1]->envelope2() < vol; i--)
+		loudest[i] = loudest[i-1];
+	    loudest[i] = co;
 	}
     }
+    // mark the selected ones, non smart channels are never capped
+    for (int i = 0; i < nLoud; i++)
+	loudest[i]->m_mixed = 1;
     XDebug(&__plugin,DebugAll,"ConfRoom::mix() buffer %u - %u [%p]",len,mlen,this);
     // this many full chunks are in all buffers and we can safely mix
     len = len / m_dataChunk;
@@ -694,14 +868,20 @@ void ConfRoom::mix(ConfConsumer* cons)
 	speakChan[spk] = 0;
     }
     len = len * m_dataChunk / sizeof(int16_t);
-    DataBlock mixbuf(0,len*sizeof(int));
-    int* buf = (int*)mixbuf.data();
+    // the accumulator is reused, grow it only if needed
+    if (m_mixBuf.length() < len * sizeof(int))
+	m_mixBuf.assign(0,len * sizeof(int));
+    else
+	::memset(m_mixBuf.data(),0,len * sizeof(int));
+    int* buf = (int*)m_mixBuf.data();
     for (l = m_chans.skipNull(); l; l = l->skipNext()) {
 	ConfChan* ch = static_cast<ConfChan*>(l->get());
 	ConfConsumer* co = static_cast<ConfConsumer*>(ch->getConsumer());
 	if (co) {
+	    bool selected = co->m_mixed != 0;
+	    co->m_mixed = 0;
 	    // avoid mixing in noise
-	    if (co->shouldMix()) {
+	    if (co->shouldMix() && (selected || !(m_maxMix && co->smart()))) {
 		unsigned int n = co->m_buffer.length() / 2;
 #ifdef XDEBUG
 		if (ch->debugAt(DebugAll)) {
@@ -719,9 +899,8 @@ void ConfRoom::mix(ConfConsumer* cons)
 #endif
 		if (n > len)
 		    n = len;
-		const int16_t* p = (const int16_t*)co->m_buffer.data();
-		for (unsigned int i=0; i < n; i++)
-		    buf[i] += *p++;
+		s_mixAdd(buf,(const int16_t*)co->m_buffer.data(),n);
+		co->m_mixed = n;
 	    }
 	    if (m_trackSpeakers && m_notify && !ch->isUtility() && co->speaking()) {
 		int vol = co->envelope();
@@ -738,21 +917,24 @@ void ConfRoom::mix(ConfConsumer* cons)
 	    }
 	}
     }
+    // the output block is forwarded unlocked so use a temporary one
+    //  if another thread is still forwarding the previous mix
+    DataBlock tmp;
+    DataBlock* data = &tmp;
+    if (!m_outBusy) {
+	m_outBusy = true;
+	data = &m_outBuf;
+    }
+    if (data->length() != len * sizeof(int16_t))
+	data->assign(0,len * sizeof(int16_t));
+    s_mixOut((int16_t*)data->data(),buf,0,0,len);
     // we finished mixing - notify consumers about it
     for (l = m_chans.skipNull(); l; l = l->skipNext()) {
 	ConfChan* ch = static_cast<ConfChan*>(l->get());
 	ConfConsumer* co = static_cast<ConfConsumer*>(ch->getConsumer());
 	if (co)
-	    co->consumed(buf,len);
-    }
-    DataBlock data(0,len*sizeof(int16_t));
-    int16_t* p = (int16_t*)data.data();
-    for (unsigned int i=0; i < len; i++) {
-	int val = buf[i];
-	// saturate symmetrically the result of addition
-	*p++ = (val < -32767) ? -32767 : ((val > 32767) ? 32767 : val);
+	    co->consumed(buf,len,*data);
     }
-    mixbuf.clear();
     Message* m = 0;
     while (m_trackSpeakers && m_notify) {
 	u_int64_t now = Time::now();
@@ -824,7 +1006,12 @@ void ConfRoom::mix(ConfConsumer* cons)
 	break;
     }
     mylock.drop();
-    Forward(data);
+    Forward(*data);
+    if (data == &m_outBuf) {
+	mylock.acquire(this);
+	m_outBusy = false;
+	mylock.drop();
+    }
     if (m)
 	Engine::enqueue(m);
 }
@@ -956,11 +1143,11 @@ unsigned long ConfConsumer::Consume(const DataBlock& data, unsigned long tStamp,
 
 // Take out of the buffer the samples mixed in or skipped
 //  this method is called with the room locked
-void ConfConsumer::consumed(const int* mixed, unsigned int samples)
+void ConfConsumer::consumed(const int* mixed, unsigned int samples, const DataBlock& full)
 {
     if (!samples)
 	return;
-    dataForward(mixed,samples);
+    dataForward(mixed,samples,full);
     unsigned int n = m_buffer.length() / 2;
     if (samples > n) {
 	// buffer underflowed
@@ -980,7 +1167,8 @@ void ConfConsumer::consumed(const int* mixed, unsigned int samples)
 }
 
 // Substract our own data from the mix and send it on the no-echo source
-void ConfConsumer::dataForward(const int* mixed, unsigned int samples)
+//  channels that were not mixed in get the room's full mix as is
+void ConfConsumer::dataForward(const int* mixed, unsigned int samples, const DataBlock& full)
 {
     if (!(m_src && mixed))
 	return;
@@ -991,19 +1179,15 @@ void ConfConsumer::dataForward(const int* mixed, unsigned int samples)
     if (!src)
 	return;
 
-    int16_t* d = (int16_t*)m_buffer.data();
-    unsigned int n = m_buffer.length() / 2;
-    DataBlock data(0,samples*sizeof(int16_t));
-    int16_t* p = (int16_t*)data.data();
-    for (unsigned int i=0; i < samples; i++) {
-	int val = *mixed++;
-	// substract our own data if we contributed - only as much as we have
-	if ((i < n) && shouldMix())
-	    val -= d[i];
-	// saturate symmetrically the result of additions and substraction
-	*p++ = (val < -32767) ? -32767 : ((val > 32767) ? 32767 : val);
+    if (!m_mixed) {
+	src->Forward(full);
+	return;
     }
-    src->Forward(data);
+    // substract our own data - exactly as much as we contributed
+    if (m_outBuf.length() != samples * sizeof(int16_t))
+	m_outBuf.assign(0,samples * sizeof(int16_t));
+    s_mixOut((int16_t*)m_outBuf.data(),mixed,(const int16_t*)m_buffer.data(),m_mixed,samples);
+    src->Forward(m_outBuf);
 }
 
 unsigned int ConfConsumer::energy() const
@@ -1498,6 +1682,7 @@ void ConferenceDriver::statusParams(String& str)
 {
     Driver::statusParams(str);
     str.append("rooms=",",") << s_rooms.count();
+    str << ",mixer=" << s_mixKernel;
 }
 
 void ConferenceDriver::initialize()
@@ -1506,6 +1691,7 @@ void ConferenceDriver::initialize()
     // install intercept relays with a priority slightly higher than default
     installRelay(Tone,75);
     installRelay(Text,75);
+    selectMixKernel();
     setup();
     if (m_handler)
 	return;
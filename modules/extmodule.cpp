@@ -58,6 +58,16 @@ namespace { // anonymous
 // Default message timeout in milliseconds
 #define MSG_TIMEOUT 10000
 
+// Interval between checks for timed out asynchronous messages in microseconds
+#define EXPIRE_INTERVAL 100000
+
+// Binary frame types, each frame starts with the 32 bit length of what follows
+#define FRAME_TEXT    'T'
+#define FRAME_MESSAGE 'M'
+#define FRAME_ANSWER  'A'
+// Parameter value length that removes the parameter from an answered message
+#define FRAME_CLEAR   0xffffffff
+
 // Safety wait time after we flushed watchers, relays or messages (in ms)
 #define WAIT_FLUSH 5
 
@@ -69,6 +79,8 @@ static Mutex s_uses(false,"ExtModUse");
 static int s_waitFlush = WAIT_FLUSH;
 static int s_timeout = MSG_TIMEOUT;
 static int s_maxQueue = DEF_MAXQUEUE;
+static int s_concurrency = 0;
+static bool s_async = false;
 static bool s_settime = false;
 static bool s_timebomb = false;
 static bool s_pluginSafe = true;
@@ -159,6 +171,21 @@ private:
     bool m_waiting;
 };
 
+// Field reader for a received binary frame, works in place in the read buffer
+class FrameReader
+{
+public:
+    inline FrameReader(char* data, unsigned int len)
+	: m_data(data), m_len(len)
+	{ }
+    bool getInt(u_int32_t& val);
+    bool getString(String& str);
+    bool getParams(NamedList& list, bool answer);
+private:
+    char* m_data;
+    unsigned int m_len;
+};
+
 // Great idea - thanks, Maciek!
 class ExtMessage : public Message
 {
@@ -175,6 +202,7 @@ public:
 	{ return m_receiver == recv; }
     inline int decode(const char* str)
 	{ return Message::decode(str,m_id); }
+    bool decode(FrameReader& frame);
     inline const String& id() const
 	{ return m_id; }
 private:
@@ -186,13 +214,33 @@ private:
 class MsgHolder : public GenObject, public Semaphore
 {
 public:
-    MsgHolder(Message &msg);
+    MsgHolder(Message &msg, bool async = false);
     Message &m_msg;
     bool m_ret;
+    bool m_async;
+    u_int64_t m_timeout;
     String m_id;
     bool decode(const char *s);
+    bool decode(FrameReader& frame);
     inline const Message* msg() const
 	{ return &m_msg; }
+    virtual const String& toString() const
+	{ return m_id; }
+};
+
+// Asynchronous message encoded while locked, written to the script unlocked
+class MsgOutput : public GenObject
+{
+public:
+    inline MsgOutput(MsgHolder* holder)
+	: m_holder(holder), m_hash(holder->m_id.hash()), m_framed(false)
+	{ }
+    // only compared once unlocked, the holder may be gone already
+    MsgHolder* m_holder;
+    unsigned int m_hash;
+    bool m_framed;
+    String m_line;
+    DataBlock m_frame;
 };
 
 // Yet Another of Maciek's ideas
@@ -230,7 +278,9 @@ public:
     virtual void destruct();
     virtual bool received(Message& msg, int id);
     bool processLine(const char* line);
-    bool outputLine(const char* line);
+    bool processFrame(char* data, unsigned int len);
+    bool outputLine(const char* line, bool startFraming = false);
+    bool outputMessage(const Message& msg, const char* id, int accepted = -1);
     void reportError(const char* line);
     void returnMsg(const Message* msg, const char* id, bool accepted);
     bool addWatched(const String& name);
@@ -265,6 +315,17 @@ private:
     void closeOut();
     void closeAudio();
     bool outputLineInternal(const char* line, int len);
+    bool outputData(const char* data, int len);
+    bool beginWrite(int len);
+    bool processAnswer(const String& id, const char* line, FrameReader* frame);
+    bool enqueueMessage(ExtMessage* m);
+    MsgOutput* queueAsync(MsgHolder* h);
+    void takeBacklog(ObjList& output);
+    void encodeAsync(MsgOutput* out);
+    bool writeAsync(MsgOutput* out);
+    void sendAsync(ObjList& output, ObjList& failed);
+    void expire(u_int64_t now);
+    void resumeAll(ObjList& list, bool timedOut = false);
     int m_role;
     bool m_dead;
     bool m_quit;
@@ -282,14 +343,20 @@ private:
     bool m_setdata;
     bool m_settime;
     bool m_writing;
+    bool m_frameIn;
+    bool m_frameOut;
     int m_maxQueue;
+    int m_concurrency;
+    int m_inFlight;
+    bool m_async;
     int m_timeout;
     bool m_timebomb;
     bool m_restart;
     bool m_scripted;
     DataBlock m_buffer;
     String m_script, m_args;
-    ObjList m_waiting;
+    HashList m_waiting;
+    ObjList m_backlog;
     ObjList m_relays;
     String m_trackName;
     String m_reason;
@@ -616,8 +683,8 @@ void ExtModChan::disconnected(bool final, const char *reason)
 }
 
 
-MsgHolder::MsgHolder(Message &msg)
-    : m_msg(msg), m_ret(false)
+MsgHolder::MsgHolder(Message &msg, bool async)
+    : m_msg(msg), m_ret(false), m_async(async), m_timeout(0)
 {
     // the address of this object should be unique
     char buf[64];
@@ -630,6 +697,126 @@ bool MsgHolder::decode(const char *s)
     return (m_msg.decode(s,m_ret,m_id) == -2);
 }
 
+// Decode the rest of an answer frame, the identifier was already read
+bool MsgHolder::decode(FrameReader& frame)
+{
+    u_int32_t ret = 0;
+    String name;
+    if (!(frame.getInt(ret) && frame.getString(name) && frame.getString(m_msg.retValue())))
+	return false;
+    if (name)
+	m_msg = name;
+    m_ret = (ret != 0);
+    return frame.getParams(m_msg,true);
+}
+
+
+bool FrameReader::getInt(u_int32_t& val)
+{
+    if (m_len < 4)
+	return false;
+    const unsigned char* p = (const unsigned char*)m_data;
+    val = ((u_int32_t)p[0] << 24) | ((u_int32_t)p[1] << 16) | ((u_int32_t)p[2] << 8) | p[3];
+    m_data += 4;
+    m_len -= 4;
+    return true;
+}
+
+bool FrameReader::getString(String& str)
+{
+    u_int32_t len = 0;
+    if (!getInt(len) || (len > m_len))
+	return false;
+    str.assign(m_data,len);
+    m_data += len;
+    m_len -= len;
+    return true;
+}
+
+// Read parameters up to the end of the frame
+// Names are terminated in place over the already read value length
+bool FrameReader::getParams(NamedList& list, bool answer)
+{
+    while (m_len) {
+	if (m_len < 2)
+	    return false;
+	unsigned int nLen = ((unsigned char)m_data[0] << 8) | (unsigned char)m_data[1];
+	if (!nLen || (m_len < nLen + 6))
+	    return false;
+	char* name = m_data + 2;
+	m_data += nLen + 2;
+	m_len -= nLen + 2;
+	u_int32_t vLen = 0;
+	getInt(vLen);
+	name[nLen] = '\0';
+	if (vLen == FRAME_CLEAR) {
+	    if (answer)
+		list.clearParam(name);
+	    continue;
+	}
+	if (vLen > m_len)
+	    return false;
+	NamedString* ns = new NamedString(name);
+	ns->assign(m_data,vLen);
+	m_data += vLen;
+	m_len -= vLen;
+	if (answer)
+	    list.setParam(ns);
+	else
+	    list.addParam(ns);
+    }
+    return true;
+}
+
+
+static inline void putInt(unsigned char*& p, u_int32_t val)
+{
+    p[0] = (unsigned char)(val >> 24);
+    p[1] = (unsigned char)(val >> 16);
+    p[2] = (unsigned char)(val >> 8);
+    p[3] = (unsigned char)val;
+    p += 4;
+}
+
+static inline void putData(unsigned char*& p, const char* data, unsigned int len)
+{
+    putInt(p,len);
+    ::memcpy(p,data,len);
+    p += len;
+}
+
+// Build a message or answer frame, num holds the message time or processed flag
+static void encodeFrame(DataBlock& buf, char type, const Message& msg, const char* id, u_int32_t num)
+{
+    unsigned int idLen = TelEngine::null(id) ? 0 : ::strlen(id);
+    const String& name = msg;
+    unsigned int len = 17 + idLen + name.length() + msg.retValue().length();
+    for (const ObjList* o = msg.paramList()->skipNull(); o; o = o->skipNext()) {
+	const NamedString* s = static_cast<const NamedString*>(o->get());
+	if (s->name() && (s->name().length() <= 0xffff))
+	    len += 6 + s->name().length() + s->length();
+    }
+    buf.assign(0,len + 4);
+    unsigned char* p = (unsigned char*)buf.data();
+    putInt(p,len);
+    *p++ = type;
+    putData(p,id,idLen);
+    putInt(p,num);
+    putData(p,name.c_str(),name.length());
+    putData(p,msg.retValue().c_str(),msg.retValue().length());
+    for (const ObjList* o = msg.paramList()->skipNull(); o; o = o->skipNext()) {
+	const NamedString* s = static_cast<const NamedString*>(o->get());
+	unsigned int nLen = s->name().length();
+	if (!nLen || (nLen > 0xffff))
+	    continue;
+	*p++ = (unsigned char)(nLen >> 8);
+	*p++ = (unsigned char)nLen;
+	::memcpy(p,s->name().c_str(),nLen);
+	p += nLen;
+	putData(p,s->c_str(),s->length());
+    }
+}
+
 
 ExtMessage::~ExtMessage()
 {
@@ -646,6 +833,18 @@ void ExtMessage::startup(ExtModReceiver* recv)
     Engine::enqueue(this);
 }
 
+bool ExtMessage::decode(FrameReader& frame)
+{
+    u_int32_t tm = 0;
+    String name;
+    if (!(frame.getString(m_id) && frame.getInt(tm) && frame.getString(name)
+	    && name && frame.getString(retValue())))
+	return false;
+    assign(name);
+    msgTime() = tm ? ((u_int64_t)1000000) * tm : Time::now();
+    return frame.getParams(*this,false);
+}
+
 void ExtMessage::dispatched(bool accepted)
 {
     m_accepted = accepted;
@@ -801,8 +1000,11 @@ ExtModReceiver::ExtModReceiver(const char* script, const char* args, File* ain,
       m_in(0), m_out(0), m_ain(ain), m_aout(aout),
       m_chan(chan), m_watcher(0),
       m_selfWatch(false), m_reenter(false), m_setdata(true), m_settime(s_settime), m_writing(false),
-      m_maxQueue(s_maxQueue), m_timeout(s_timeout), m_timebomb(s_timebomb), m_restart(false), m_scripted(false),
-      m_buffer(0,DEF_INCOMING_LINE), m_script(script), m_args(args), m_trackName(s_trackName)
+      m_frameIn(false), m_frameOut(false), m_maxQueue(s_maxQueue),
+      m_concurrency(s_concurrency), m_inFlight(0), m_async(s_async),
+      m_timeout(s_timeout), m_timebomb(s_timebomb), m_restart(false), m_scripted(false),
+      m_buffer(0,DEF_INCOMING_LINE), m_script(script), m_args(args), m_waiting(61),
+      m_trackName(s_trackName)
 {
     debugChain(&__plugin);
     debugName(m_script);
@@ -821,8 +1023,11 @@ ExtModReceiver::ExtModReceiver(const char* name, Stream* io, ExtModChan* chan, i
       m_in(io), m_out(io), m_ain(0), m_aout(0),
       m_chan(chan), m_watcher(0),
       m_selfWatch(false), m_reenter(false), m_setdata(true), m_settime(s_settime), m_writing(false),
-      m_maxQueue(s_maxQueue), m_timeout(s_timeout), m_timebomb(s_timebomb), m_restart(false), m_scripted(false),
-      m_buffer(0,DEF_INCOMING_LINE), m_script(name), m_args(conn), m_trackName(s_trackName)
+      m_frameIn(false), m_frameOut(false), m_maxQueue(s_maxQueue),
+      m_concurrency(s_concurrency), m_inFlight(0), m_async(s_async),
+      m_timeout(s_timeout), m_timebomb(s_timebomb), m_restart(false), m_scripted(false),
+      m_buffer(0,DEF_INCOMING_LINE), m_script(name), m_args(conn), m_waiting(61),
+      m_trackName(s_trackName)
 {
     debugChain(&__plugin);
     debugName(m_script);
@@ -925,13 +1130,27 @@ bool ExtModReceiver::flush()
 	    p->setDelete(false);
     }
     bool flushed = false;
-    if (m_waiting.get()) {
+    ObjList async;
+    if (m_waiting.count() || m_backlog.skipNull()) {
 	Debug(DebugInfo,"ExtModReceiver releasing %u pending messages [%p]",m_qLength,this);
+	// asynchronous messages must be resumed, synchronous ones just released
+	for (unsigned int i = 0; i < m_waiting.length(); i++) {
+	    for (ObjList* l = m_waiting.getList(i); l; l = l->next()) {
+		MsgHolder* h = static_cast<MsgHolder*>(l->get());
+		if (h && h->m_async)
+		    async.append(h);
+	    }
+	}
 	m_waiting.clear();
+	for (ObjList* l = m_backlog.skipNull(); l; l = l->skipNext())
+	    async.append(l->get());
+	m_backlog.clear();
 	m_qLength = 0;
+	m_inFlight = 0;
 	needWait = flushed = true;
     }
     unlock();
+    resumeAll(async);
     if (needWait && s_pluginSafe) {
 	int ms = s_waitFlush;
 	// During shutdown longer delays are not acceptable
@@ -1028,32 +1247,60 @@ bool ExtModReceiver::received(Message &msg, int id)
 	return false;
     }
 
-    use();
-    bool fail = false;
     u_int64_t tout = (m_timeout > 0) ? Time::now() + 1000 * m_timeout : 0;
-    MsgHolder h(msg);
-    if (outputLine(msg.encode(h.m_id))) {
+    // messages from the engine queue received through relays are not waited
+    //  for, their dispatching continues when the answer arrives
+    if (m_async && !id && msg.defer()) {
+	MsgHolder* h = new MsgHolder(msg,true);
+	h->m_timeout = tout;
 	m_qLength++;
-	m_waiting.append(&h)->setDelete(false);
-	DDebug(DebugAll,"ExtMod queued message #%u %p '%s' [%p]",m_qLength,&msg,msg.c_str(),this);
+	if (m_concurrency && (m_inFlight >= m_concurrency)) {
+	    DDebug(DebugAll,"ExtMod delaying message %p '%s', %d in progress [%p]",
+		&msg,msg.c_str(),m_inFlight,this);
+	    m_backlog.append(h)->setDelete(false);
+	    unlock();
+	    return false;
+	}
+	ObjList output;
+	output.append(queueAsync(h));
+	unlock();
+	// the message is no longer ours to touch, it may get answered right away
+	ObjList failed;
+	sendAsync(output,failed);
+	resumeAll(failed);
+	return false;
     }
+
+    use();
+    bool fail = false;
+    MsgHolder h(msg);
+    // register before writing so an early answer finds the message
+    m_qLength++;
+    m_waiting.append(&h)->setDelete(false);
+    unlock();
+    // never write while locked, the reader thread needs the lock to drain the script
+    if (outputMessage(msg,h.m_id))
+	DDebug(DebugAll,"ExtMod queued message %p '%s' [%p]",&msg,msg.c_str(),this);
     else {
 	Debug(DebugWarn,"ExtMod could not queue message %p '%s' [%p]",&msg,msg.c_str(),this);
+	lock();
+	if (m_waiting.remove(&h,false,true) && (m_qLength > 0))
+	    m_qLength--;
+	unlock();
 	ok = false;
 	fail = true;
     }
-    unlock();
     // would be nice to lock the MsgHolder and wait for it to unlock from some
     //  other thread - unfortunately this does not work with all mutexes
     // sorry, Maciek - have to do it work in Windows too :-(
     while (ok) {
 	h.lock(Thread::idleUsec());
 	lock();
-	ok = (m_waiting.find(&h) != 0);
+	ok = (m_waiting.find(&h,h.m_id.hash()) != 0);
 	if (ok && tout && (Time::now() > tout)) {
 	    Alarm("extmodule","performance",DebugWarn,"Message %p '%s' did not return in %d msec [%p]",
 		&msg,msg.c_str(),m_timeout,this);
-	    if (m_waiting.remove(&h,false) && (m_qLength > 0))
+	    if (m_waiting.remove(&h,false,true) && (m_qLength > 0))
 		m_qLength--;
 	    ok = false;
 	    fail = true;
@@ -1068,6 +1315,164 @@ bool ExtModReceiver::received(Message &msg, int id)
     return h.m_ret;
 }
 
+// Mark an asynchronous message in progress and encode it, must be called locked
+MsgOutput* ExtModReceiver::queueAsync(MsgHolder* h)
+{
+    m_inFlight++;
+    m_waiting.append(h)->setDelete(false);
+    DDebug(DebugAll,"ExtMod sending message %p '%s', %d in progress [%p]",
+	h->msg(),h->msg()->c_str(),m_inFlight,this);
+    MsgOutput* out = new MsgOutput(h);
+    encodeAsync(out);
+    return out;
+}
+
+// Queue delayed messages while below the concurrency limit, must be called locked
+// The returned output must be sent with sendAsync() after unlocking
+void ExtModReceiver::takeBacklog(ObjList& output)
+{
+    while (!m_dead && !(m_concurrency && (m_inFlight >= m_concurrency))) {
+	MsgHolder* h = static_cast<MsgHolder*>(m_backlog.remove(false));
+	if (!h)
+	    break;
+	output.append(queueAsync(h));
+    }
+}
+
+// Encode an asynchronous message in the current encoding, must be called locked
+void ExtModReceiver::encodeAsync(MsgOutput* out)
+{
+    const Message& msg = out->m_holder->m_msg;
+    out->m_framed = m_frameOut;
+    if (out->m_framed)
+	encodeFrame(out->m_frame,FRAME_MESSAGE,msg,out->m_holder->m_id,
+	    (u_int32_t)msg.msgTime().sec());
+    else
+	out->m_line = msg.encode(out->m_holder->m_id);
+}
+
+// Write an encoded asynchronous message, must be called unlocked
+bool ExtModReceiver::writeAsync(MsgOutput* out)
+{
+    if (m_dead || !m_out || !m_out->valid() || !use())
+	return false;
+    for (;;) {
+	if (!beginWrite(out->m_framed ? out->m_frame.length() : out->m_line.length())) {
+	    unuse();
+	    return false;
+	}
+	if (out->m_framed == m_frameOut)
+	    break;
+	// encoding was switched, the message can be read only while still waiting
+	lock();
+	bool ok = (0 != m_waiting.find(out->m_holder,out->m_hash));
+	if (ok)
+	    encodeAsync(out);
+	m_writing = false;
+	unlock();
+	if (!ok) {
+	    unuse();
+	    return false;
+	}
+    }
+    bool ok = out->m_framed ? outputData((const char*)out->m_frame.data(),out->m_frame.length())
+	: outputLineInternal(out->m_line,out->m_line.length());
+    m_writing = false;
+    unuse();
+    return ok;
+}
+
+// Write queued asynchronous messages, must be called unlocked
+// Messages that could not be sent are moved to the failed list
+void ExtModReceiver::sendAsync(ObjList& output, ObjList& failed)
+{
+    bool fail = false;
+    MsgOutput* out;
+    while ((out = static_cast<MsgOutput*>(output.remove(false)))) {
+	if (!writeAsync(out)) {
+	    // unless flushed or expired meanwhile the message is still ours
+	    lock();
+	    ObjList* l = m_waiting.find(out->m_holder,out->m_hash);
+	    if (l) {
+		MsgHolder* h = static_cast<MsgHolder*>(l->remove(false));
+		m_inFlight--;
+		if (m_qLength > 0)
+		    m_qLength--;
+		Debug(DebugWarn,"ExtMod could not send message %p '%s' [%p]",
+		    h->msg(),h->msg()->c_str(),this);
+		failed.append(h);
+		fail = true;
+		// a slot was freed, let delayed messages use it
+		takeBacklog(output);
+	    }
+	    unlock();
+	}
+	TelEngine::destruct(out);
+    }
+    if (fail && m_timebomb)
+	die();
+}
+
+// Give up on asynchronous messages not answered in time
+void ExtModReceiver::expire(u_int64_t now)
+{
+    ObjList expired;
+    Lock mylock(this);
+    if (!(m_inFlight || m_backlog.skipNull()))
+	return;
+    for (unsigned int i = 0; i < m_waiting.length(); i++) {
+	ObjList* l = m_waiting.getList(i);
+	while (l) {
+	    MsgHolder* h = static_cast<MsgHolder*>(l->get());
+	    if (!(h && h->m_async && h->m_timeout && (now > h->m_timeout))) {
+		l = l->next();
+		continue;
+	    }
+	    l->remove(false);
+	    m_inFlight--;
+	    if (m_qLength > 0)
+		m_qLength--;
+	    expired.append(h);
+	}
+    }
+    ObjList* l = &m_backlog;
+    while (l) {
+	MsgHolder* h = static_cast<MsgHolder*>(l->get());
+	if (!(h && h->m_timeout && (now > h->m_timeout))) {
+	    l = l->next();
+	    continue;
+	}
+	l->remove(false);
+	if (m_qLength > 0)
+	    m_qLength--;
+	expired.append(h);
+    }
+    if (!expired.skipNull())
+	return;
+    ObjList output;
+    takeBacklog(output);
+    mylock.drop();
+    resumeAll(expired,true);
+    if (m_timebomb)
+	die();
+    ObjList failed;
+    sendAsync(output,failed);
+    resumeAll(failed);
+}
+
+// Continue dispatching asynchronous messages that will get no answer
+void ExtModReceiver::resumeAll(ObjList& list, bool timedOut)
+{
+    for (ObjList* l = list.skipNull(); l; l = l->skipNext()) {
+	MsgHolder* h = static_cast<MsgHolder*>(l->get());
+	if (timedOut)
+	    Alarm("extmodule","performance",DebugWarn,"Message %p '%s' did not return in %d msec [%p]",
+		h->msg(),h->msg()->c_str(),m_timeout,this);
+	Engine::resume(&h->m_msg,false);
+    }
+    list.clear();
+}
+
 bool ExtModReceiver::create(const char *script, const char *args)
 {
 #ifdef _WINDOWS
@@ -1191,8 +1596,14 @@ void ExtModReceiver::run()
 	Debug("ExtModule",DebugWarn,"Failed to set nonblocking mode, expect trouble [%p]",this);
     int posinbuf = 0;
     bool invalid = true;
+    u_int64_t nextExpire = 0;
     DDebug(DebugAll,"ExtModReceiver::run() entering loop [%p]",this);
     for (;;) {
+	u_int64_t now = Time::now();
+	if (now >= nextExpire) {
+	    nextExpire = now + EXPIRE_INTERVAL;
+	    expire(now);
+	}
 	use();
 	lock();
 	char* buffer = static_cast<char*>(m_buffer.data());
@@ -1238,6 +1649,36 @@ void ExtModReceiver::run()
 	}
 	buffer[totalsize] = 0;
 	for (;;) {
+	    if (m_frameIn) {
+		// binary frames, the length does not include itself
+		if (totalsize < 4)
+		    break;
+		const unsigned char* p = (const unsigned char*)buffer;
+		u_int32_t len = ((u_int32_t)p[0] << 24) | ((u_int32_t)p[1] << 16) |
+		    ((u_int32_t)p[2] << 8) | p[3];
+		if (len >= m_buffer.length() - 4) {
+		    Debug("ExtModule",DebugWarn,"Frame of length %u exceeds buffer of length %u, closing [%p]",
+			len,m_buffer.length(),this);
+		    return;
+		}
+		if ((int)len + 4 > totalsize)
+		    break;
+		readsize = len + 4;
+		invalid = false;
+		use();
+		bool goOut = processFrame(buffer + 4,len);
+		if (unuse() || goOut)
+		    return;
+		if (totalsize >= (int)m_buffer.length()) {
+		    Debug("ExtModule",DebugWarn,"Lost data shrinking read buffer to %u, closing [%p]",
+			m_buffer.length(),this);
+		    return;
+		}
+		totalsize -= readsize;
+		buffer = static_cast<char*>(m_buffer.data());
+		::memmove(buffer,buffer+readsize,totalsize+1);
+		continue;
+	    }
 	    char *eoline = ::strchr(buffer,'\n');
 	    if (!eoline && ((int)::strlen(buffer) < totalsize))
 		eoline=buffer+::strlen(buffer);
@@ -1267,57 +1708,116 @@ void ExtModReceiver::run()
     }
 }
 
-bool ExtModReceiver::outputLine(const char* line)
+bool ExtModReceiver::outputLine(const char* line, bool startFraming)
 {
     if (TelEngine::null(line))
 	return true;
     int len = ::strlen(line);
     if (m_dead || !m_out || !m_out->valid() || !use())
 	return false;
-    uint64_t tout = (m_timeout > 0) ? (Time::now() + 1000 * (uint64_t)m_timeout) : 0;
+    if (!beginWrite(len)) {
+	unuse();
+	return false;
+    }
+    bool ok = false;
+    if (m_frameOut) {
+	DataBlock frame(0,len + 5);
+	unsigned char* p = (unsigned char*)frame.data();
+	putInt(p,len + 1);
+	*p++ = FRAME_TEXT;
+	::memcpy(p,line,len);
+	ok = outputData((const char*)frame.data(),frame.length());
+    }
+    else
+	ok = outputLineInternal(line,len);
+    if (ok && startFraming)
+	m_frameOut = true;
+    m_writing = false;
+    unuse();
+    return ok;
+}
+
+// Send a message (accepted < 0) or the answer to one in the current encoding
+bool ExtModReceiver::outputMessage(const Message& msg, const char* id, int accepted)
+{
+    if (m_dead || !m_out || !m_out->valid() || !use())
+	return false;
+    bool framed = m_frameOut;
+    String line;
+    DataBlock frame;
     for (;;) {
-	Lock mylock(this);
-	if (m_dead || !m_out || !m_out->valid()) {
+	if (framed) {
+	    if (accepted < 0)
+		encodeFrame(frame,FRAME_MESSAGE,msg,id,(u_int32_t)msg.msgTime().sec());
+	    else
+		encodeFrame(frame,FRAME_ANSWER,msg,id,accepted ? 1 : 0);
+	}
+	else
+	    line = (accepted < 0) ? msg.encode(id) : msg.encode(accepted > 0,id);
+	if (!beginWrite(framed ? frame.length() : line.length())) {
 	    unuse();
 	    return false;
 	}
+	// encoding may have been switched while we were not writing
+	if (framed == m_frameOut)
+	    break;
+	m_writing = false;
+	framed = m_frameOut;
+    }
+    bool ok = framed ? outputData((const char*)frame.data(),frame.length())
+	: outputLineInternal(line,line.length());
+    m_writing = false;
+    unuse();
+    return ok;
+}
+
+// Wait for exclusive write access, must be called while in use
+bool ExtModReceiver::beginWrite(int len)
+{
+    uint64_t tout = (m_timeout > 0) ? (Time::now() + 1000 * (uint64_t)m_timeout) : 0;
+    for (;;) {
+	Lock mylock(this);
+	if (m_dead || !m_out || !m_out->valid())
+	    return false;
 	if (!m_writing) {
 	    m_writing = true;
-	    break;
+	    return true;
 	}
 	if (tout && tout < Time::now()) {
 	    if (!m_quit)
 		Alarm("extmodule","performance",DebugWarn,"Timeout %d msec for %d characters [%p]",
 		    m_timeout,len,this);
-	    unuse();
 	    return false;
 	}
 	mylock.drop();
 	Thread::idle();
     }
-    bool ok = outputLineInternal(line,len);
-    m_writing = false;
-    unuse();
-    return ok;
 }
 
-bool ExtModReceiver::outputLineInternal(const char* line, int len)
+bool ExtModReceiver::outputData(const char* data, int len)
 {
-    DDebug("ExtModReceiver",DebugAll,"outputLine len=%d '%s' [%p]",len,line,this);
     // since m_out can be non-blocking (the socket) we have to loop
     while (m_out && m_out->valid() && (len > 0) && !m_dead) {
-	int w = m_out->writeData(line,len);
+	int w = m_out->writeData(data,len);
 	if (w < 0) {
 	    if (m_dead || !m_out || !m_out->canRetry())
 		return false;
 	}
 	else {
-	    line += w;
+	    data += w;
 	    len -= w;
 	}
 	if (len > 0)
 	    Thread::idle();
     }
+    return (len <= 0);
+}
+
+bool ExtModReceiver::outputLineInternal(const char* line, int len)
+{
+    DDebug("ExtModReceiver",DebugAll,"outputLine len=%d '%s' [%p]",len,line,this);
+    if (!outputData(line,len))
+	return false;
     char nl = '\n';
     for (;;) {
 	if (m_dead || !m_out)
@@ -1341,8 +1841,7 @@ void ExtModReceiver::reportError(const char* line)
 
 void ExtModReceiver::returnMsg(const Message* msg, const char* id, bool accepted)
 {
-    String ret(msg->encode(accepted,id));
-    if (!outputLine(ret) && m_timebomb)
+    if (!outputMessage(*msg,id,accepted ? 1 : 0) && m_timebomb)
 	die();
 }
 
@@ -1409,27 +1908,12 @@ bool ExtModReceiver::processLine(const char* line)
 	    Debug(DebugWarn,"Expecting %%%%>connect, received '%s' [%p]",id.c_str(),this);
 	return true;
     }
-    else if (id.startsWith("%%<message:")) {
-	Lock mylock(this);
-	ObjList *p = &m_waiting;
-	for (; p; p=p->next()) {
-	    MsgHolder *msg = static_cast<MsgHolder *>(p->get());
-	    if (msg && msg->decode(line)) {
-		DDebug("ExtModReceiver",DebugInfo,"Matched message %p [%p]",msg->msg(),this);
-		if (m_chan && (m_chan->waitMsg() == msg->msg())) {
-		    DDebug("ExtModReceiver",DebugNote,"Entering wait mode on channel %p [%p]",m_chan,this);
-		    m_chan->waitMsg(0);
-		    m_chan->waiting(true);
-		}
-		msg->unlock();
-		if (p->remove(false) && (m_qLength > 0))
-		    m_qLength--;
-		return false;
-	    }
-	}
-	Debug("ExtModReceiver",(m_dead ? DebugInfo : DebugWarn),
-	    "Unmatched%s message: %s [%p]",(m_dead ? " dead" : ""),line,this);
-	return false;
+    else if (id.startSkip("%%<message:",false)) {
+	// the identifier is followed by the other fields
+	int sep = id.find(':');
+	if (sep >= 0)
+	    id = String::msgUnescape(id.substr(0,sep));
+	return processAnswer(id,line,0);
     }
     else if (id.startSkip("%%>install:",false)) {
 	int prio = 100;
@@ -1524,6 +2008,7 @@ bool ExtModReceiver::processLine(const char* line)
 	    val.trimBlanks();
 	    id = id.substr(0,col);
 	    bool ok = false;
+	    bool startFraming = false;
 	    Lock mylock(this);
 	    if (m_dead)
 		return false;
@@ -1565,6 +2050,34 @@ bool ExtModReceiver::processLine(const char* line)
 		val = m_maxQueue;
 		ok = true;
 	    }
+	    else if (id == "concurrency") {
+		Lock mylock(this);
+		m_concurrency = val.toInteger(m_concurrency,0,0,MAX_MAXQUEUE);
+		val = m_concurrency;
+		ObjList output;
+		takeBacklog(output);
+		mylock.drop();
+		ObjList failed;
+		sendAsync(output,failed);
+		resumeAll(failed);
+		ok = true;
+	    }
+	    else if (id == "async") {
+		m_async = val.toBoolean(m_async);
+		val = m_async;
+		ok = true;
+	    }
+	    else if (id == "framing") {
+		// switching is one way, the answer is the last text line we send
+		if (val == YSTRING("binary") && !m_frameIn) {
+		    m_frameIn = true;
+		    startFraming = true;
+		    ok = true;
+		}
+		else
+		    ok = val.null() || (val == (m_frameIn ? "binary" : "text"));
+		val = m_frameIn ? "binary" : "text";
+	    }
 	    else if (id == "bufsize") {
 		unsigned int len = val.toInteger(m_buffer.length(),0,
 		    MIN_INCOMING_LINE,MAX_INCOMING_LINE);
@@ -1654,7 +2167,7 @@ bool ExtModReceiver::processLine(const char* line)
 		id.c_str(),val.c_str(),ok ? "ok" : "failed");
 	    String out("%%<setlocal:");
 	    out << id << ":" << val << ":" << ok;
-	    outputLine(out);
+	    outputLine(out,startFraming);
 	    return false;
 	}
     }
@@ -1665,60 +2178,141 @@ bool ExtModReceiver::processLine(const char* line)
     }
     else {
 	ExtMessage* m = new ExtMessage;
-	if (m->decode(line) == -2) {
-	    DDebug("ExtModReceiver",DebugAll,"Created message %p '%s' [%p]",m,m->c_str(),this);
-	    lock();
-	    bool note = true;
-	    while (!m_dead && m_chan && m_chan->waiting()) {
-		if (note) {
-		    note = false;
-		    Debug("ExtModReceiver",DebugNote,"Waiting before enqueueing new message %p '%s' [%p]",
-			m,m->c_str(),this);
-		}
-		unlock();
-		Thread::yield();
-		if (m_dead) {
-		    m->destruct();
-		    return false;
-		}
-		lock();
-	    }
-	    ExtModChan* chan = 0;
-	    if ((m_role == RoleChannel) && !m_chan && m_setdata && (*m == "call.execute")) {
-		// we delayed channel creation as there was nothing to ref() it
-		chan = new ExtModChan(this);
-		m_chan = chan;
-		m->setParam("id",chan->id());
+	if (m->decode(line) == -2)
+	    return enqueueMessage(m);
+	m->destruct();
+    }
+    reportError(line);
+    return false;
+}
+
+// Process a binary frame received from the external module
+bool ExtModReceiver::processFrame(char* data, unsigned int len)
+{
+    if (m_dead)
+	return false;
+    if (m_quit)
+	return true;
+    XDebug("ExtModReceiver",DebugAll,"processFrame len=%u type '%c'",len,len ? data[0] : ' ');
+    if (!len) {
+	Debug("ExtModReceiver",DebugWarn,"Received empty frame [%p]",this);
+	return false;
+    }
+    FrameReader frame(data + 1,len - 1);
+    switch (data[0]) {
+	case FRAME_TEXT:
+	    return processLine(String(data + 1,len - 1));
+	case FRAME_MESSAGE:
+	    {
+		ExtMessage* m = new ExtMessage;
+		if (m->decode(frame))
+		    return enqueueMessage(m);
+		m->destruct();
 	    }
-	    if (m_setdata)
-		m->userData(m_chan);
-	    // now the newly created channel is referenced by the message
-	    if (chan)
-		chan->deref();
-	    id = m->id();
-	    if (id && !chan) {
-		// Copy the user data pointer from waiting message with same id
-		ObjList *p = &m_waiting;
-		for (; p; p=p->next()) {
-		    MsgHolder *h = static_cast<MsgHolder *>(p->get());
-		    if (h && (h->m_id == id)) {
-			RefObject* ud = h->m_msg.userData();
-			Debug("ExtModReceiver",DebugAll,"Copying data pointer %p from %p '%s' [%p]",
-			    ud,h->msg(),h->msg()->c_str(),this);
-			m->userData(ud);
-			break;
-		    }
-		}
+	    break;
+	case FRAME_ANSWER:
+	    {
+		String id;
+		if (frame.getString(id))
+		    return processAnswer(id,0,&frame);
 	    }
-	    if (m_settime || !m->msgTime())
-		m->msgTime() = Time::now();
-	    m->startup(this);
-	    unlock();
+	    break;
+	default:
+	    Debug("ExtModReceiver",DebugWarn,"Received unknown frame type 0x%02x [%p]",
+		(unsigned char)data[0],this);
+	    return false;
+    }
+    Debug("ExtModReceiver",DebugWarn,"Received invalid frame '%c' of length %u [%p]",
+	data[0],len,this);
+    return false;
+}
+
+// Match the answer to a message we sent, decode from either line or frame
+bool ExtModReceiver::processAnswer(const String& id, const char* line, FrameReader* frame)
+{
+    Lock mylock(this);
+    MsgHolder *msg = static_cast<MsgHolder *>(m_waiting[id]);
+    if (msg && (frame ? msg->decode(*frame) : msg->decode(line))) {
+	DDebug("ExtModReceiver",DebugInfo,"Matched message %p [%p]",msg->msg(),this);
+	m_waiting.remove(msg,false,true);
+	if (m_qLength > 0)
+	    m_qLength--;
+	if (msg->m_async) {
+	    ObjList output;
+	    m_inFlight--;
+	    takeBacklog(output);
+	    mylock.drop();
+	    Engine::resume(&msg->m_msg,msg->m_ret);
+	    TelEngine::destruct(msg);
+	    ObjList failed;
+	    sendAsync(output,failed);
+	    resumeAll(failed);
 	    return false;
 	}
-	m->destruct();
+	if (m_chan && (m_chan->waitMsg() == msg->msg())) {
+	    DDebug("ExtModReceiver",DebugNote,"Entering wait mode on channel %p [%p]",m_chan,this);
+	    m_chan->waitMsg(0);
+	    m_chan->waiting(true);
+	}
+	msg->unlock();
+	return false;
     }
-    reportError(line);
+    if (line)
+	Debug("ExtModReceiver",(m_dead ? DebugInfo : DebugWarn),
+	    "Unmatched%s message: %s [%p]",(m_dead ? " dead" : ""),line,this);
+    else
+	Debug("ExtModReceiver",(m_dead ? DebugInfo : DebugWarn),
+	    "Unmatched%s message frame '%s' [%p]",(m_dead ? " dead" : ""),id.c_str(),this);
+    return false;
+}
+
+// Enqueue a message decoded from the external module
+bool ExtModReceiver::enqueueMessage(ExtMessage* m)
+{
+    DDebug("ExtModReceiver",DebugAll,"Created message %p '%s' [%p]",m,m->c_str(),this);
+    lock();
+    bool note = true;
+    while (!m_dead && m_chan && m_chan->waiting()) {
+	if (note) {
+	    note = false;
+	    Debug("ExtModReceiver",DebugNote,"Waiting before enqueueing new message %p '%s' [%p]",
+		m,m->c_str(),this);
+	}
+	unlock();
+	Thread::yield();
+	if (m_dead) {
+	    m->destruct();
+	    return false;
+	}
+	lock();
+    }
+    ExtModChan* chan = 0;
+    if ((m_role == RoleChannel) && !m_chan && m_setdata && (*m == "call.execute")) {
+	// we delayed channel creation as there was nothing to ref() it
+	chan = new ExtModChan(this);
+	m_chan = chan;
+	m->setParam("id",chan->id());
+    }
+    if (m_setdata)
+	m->userData(m_chan);
+    // now the newly created channel is referenced by the message
+    if (chan)
+	chan->deref();
+    const String& id = m->id();
+    if (id && !chan) {
+	// Copy the user data pointer from waiting message with same id
+	MsgHolder *h = static_cast<MsgHolder *>(m_waiting[id]);
+	if (h) {
+	    RefObject* ud = h->m_msg.userData();
+	    Debug("ExtModReceiver",DebugAll,"Copying data pointer %p from %p '%s' [%p]",
+		ud,h->msg(),h->msg()->c_str(),this);
+	    m->userData(ud);
+	}
+    }
+    if (m_settime || !m->msgTime())
+	m->msgTime() = Time::now();
+    m->startup(this);
+    unlock();
     return false;
 }
 
@@ -2096,6 +2690,8 @@ void ExtModulePlugin::initialize()
     s_cfg = Engine::configFile("extmodule");
     s_cfg.load();
     s_maxQueue = s_cfg.getIntValue("general","maxqueue",DEF_MAXQUEUE,0,MAX_MAXQUEUE);
+    s_concurrency = s_cfg.getIntValue("general","concurrency",0,0,MAX_MAXQUEUE);
+    s_async = s_cfg.getBoolValue("general","async",false);
     s_timeout = s_cfg.getIntValue("general","timeout",MSG_TIMEOUT);
     s_timebomb = s_cfg.getBoolValue("general","timebomb",false);
     s_settime = s_cfg.getBoolValue("general","settime",false);
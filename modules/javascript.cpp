@@ -2273,7 +2273,7 @@ static void dumpTable(const ExpOperation& oper, String& str, const char* eol,
 	    }
 	    // Array of objects
 	    row++;
-	    for (ObjList* l = jso->params().paramList()->skipNull(); l; l = l->skipNext()) {
+	    for (const ObjList* l = jso->params().paramList()->skipNull(); l; l = l->skipNext()) {
 		const NamedString* ns = static_cast<const NamedString*>(l->get());
 		if (ns->name() == JsObject::protoName())
 		    continue;
@@ -2290,7 +2290,7 @@ static void dumpTable(const ExpOperation& oper, String& str, const char* eol,
 	// Object containing Arrays
 	// Each propery is a column in table
 	// { name1: [ "val11", "val21" ], name2: [ "val12" ], name3: [ undefined, "val23" ] }
-	for (ObjList* l = jso->params().paramList()->skipNull(); l; l = l->skipNext()) {
+	for (const ObjList* l = jso->params().paramList()->skipNull(); l; l = l->skipNext()) {
 	    const NamedString* ns = static_cast<const NamedString*>(l->get());
 	    jsa = YOBJECT(JsArray,ns);
 	    if (!jsa)
@@ -6815,8 +6815,10 @@ void JsJSON::replaceParams(GenObject* obj, const NamedList& params, bool sqlEsc,
 	}
     }
     else if (jso) {
-	NamedString* proto = jso->params().getParam(protoName());
-	for (ObjList* o = jso->params().paramList()->skipNull(); o; o = o->skipNext()) {
+	// values are replaced in place, read the list without dropping its index
+	const NamedList& props = jso->params();
+	NamedString* proto = props.getParam(protoName());
+	for (const ObjList* o = props.paramList()->skipNull(); o; o = o->skipNext()) {
 	    NamedString* p = static_cast<NamedString*>(o->get());
 	    if (p != proto)
 		replaceParams(p,params,sqlEsc,extraEsc);
@@ -349,7 +349,7 @@ void MsgSniff::handleMsg(const Message& msg, bool* handled)
 	age = Time::now();
 
     String par;
-    for (ObjList* o = msg.paramList()->skipNull(); o; o = o->skipNext()) {
+    for (const ObjList* o = msg.paramList()->skipNull(); o; o = o->skipNext()) {
 	const NamedString* s = static_cast<NamedString*>(o->get());
 	String tmp;
 	tmp << "\r\n  param['" << s->name() << "'] = ";
@@ -171,7 +171,7 @@ bool AuthHandler::received(Message &msg)
     Debug(&__plugin,DebugAll,"Authenticating user %s with password length %u",
 	username.c_str(),pass->length());
 
-    for (ObjList* o = usr->paramList()->skipNull(); o; o = o->skipNext()) {
+    for (const ObjList* o = usr->paramList()->skipNull(); o; o = o->skipNext()) {
 	const NamedString* s = static_cast<NamedString*>(o->get());
 	if (s && !s_skipParams.find(s->name())) {
 	    String value = *s;
@@ -0,0 +1,119 @@
+/**
+ * benchrun.h
+ * This file is part of the YATE Project http://YATE.null.ro
+ *
+ * Common runner for the benchmark test modules
+ *
+ * Yet Another Telephony Engine - a fully featured software PBX and IVR
+ * Copyright (C) 2026 Null Team
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef __BENCHRUN_H
+#define __BENCHRUN_H
+
+#include <yatengine.h>
+
+using namespace TelEngine;
+// keep the runner local to each module including it
+namespace { // anonymous
+
+/**
+ * A plugin that runs its benchmark once when the engine starts.
+ * Settings are read from the section named like the plugin in the main config
+ * @short Benchmark test module
+ */
+class BenchPlugin : public Plugin
+{
+    class StartHandler : public MessageHandler
+    {
+    public:
+	inline StartHandler(BenchPlugin* bench)
+	    : MessageHandler("engine.start",100,bench->name()), m_bench(bench)
+	    { }
+	virtual bool received(Message& msg)
+	    { m_bench->run(); return false; }
+    private:
+	BenchPlugin* m_bench;
+    };
+
+public:
+    /**
+     * Constructor
+     * @param name Name of the plugin and of its config section
+     * @param title Name of the benchmark used in output
+     */
+    inline BenchPlugin(const char* name, const char* title)
+	: Plugin(name,"misc"), m_title(title), m_first(true)
+	{ Output("Loaded module %s",m_title.c_str()); }
+
+    /**
+     * Destructor
+     */
+    virtual ~BenchPlugin()
+	{ Output("Unloading module %s",m_title.c_str()); }
+
+    /**
+     * Install the engine start handler on first initialization
+     */
+    virtual void initialize()
+	{
+	    if (!m_first)
+		return;
+	    m_first = false;
+	    Output("Initializing module %s",m_title.c_str());
+	    Engine::install(new StartHandler(this));
+	}
+
+    /**
+     * Run the benchmark, called from the engine start handler
+     */
+    virtual void run() = 0;
+
+    /**
+     * Get how many iterations to run from the plugin's config section
+     * @param param Name of the parameter holding the count
+     * @return Configured count, at least 1000, default 200000
+     */
+    inline unsigned int iterations(const char* param) const
+	{
+	    int n = Engine::config().getIntValue(name(),param,200000);
+	    return (n < 1000) ? 1000 : n;
+	}
+
+    /**
+     * Compute a rate per second
+     * @param count How many operations were performed
+     * @param usec Time they took in microseconds
+     * @return Operations per second
+     */
+    static inline unsigned int rate(unsigned int count, u_int64_t usec)
+	{ return (unsigned int)((u_int64_t)count * 1000000 / (usec ? usec : 1)); }
+
+    /**
+     * Get the name of the benchmark used in output
+     * @return Benchmark title
+     */
+    inline const String& title() const
+	{ return m_title; }
+
+private:
+    String m_title;
+    bool m_first;
+};
+
+}; // anonymous namespace
+
+#endif /* __BENCHRUN_H */
+
+/* vi: set ts=8 sw=4 sts=4 noet: */
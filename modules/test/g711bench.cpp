@@ -0,0 +1,140 @@
+/**
+ * g711bench.cpp
+ * This file is part of the YATE Project http://YATE.null.ro
+ *
+ * G.711 conversion benchmark
+ *
+ * Yet Another Telephony Engine - a fully featured software PBX and IVR
+ * Copyright (C) 2026 Null Team
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include "benchrun.h"
+
+#include <string.h>
+
+using namespace TelEngine;
+namespace { // anonymous
+
+// 20ms of narrowband audio
+#define BENCH_SAMPLES 160
+
+class G711Bench : public BenchPlugin
+{
+public:
+    inline G711Bench()
+	: BenchPlugin("g711bench","G711Bench")
+	{ }
+    virtual void run();
+private:
+    void runPair(const char* sFormat, const char* dFormat, unsigned int packets);
+};
+
+INIT_PLUGIN(G711Bench);
+
+static unsigned int sampleSize(const String& format)
+{
+    return (format == YSTRING("slin")) ? 2 : 1;
+}
+
+void G711Bench::run()
+{
+    unsigned int packets = iterations("packets");
+    runPair("slin","alaw",packets);
+    runPair("slin","mulaw",packets);
+    runPair("alaw","slin",packets);
+    runPair("mulaw","slin",packets);
+    runPair("alaw","mulaw",packets);
+    runPair("mulaw","alaw",packets);
+}
+
+// Compare per sample lookups against batch conversion of whole packets
+void G711Bench::runPair(const char* sFormat, const char* dFormat, unsigned int packets)
+{
+    String sFmt(sFormat);
+    String dFmt(dFormat);
+    unsigned int sl = sampleSize(sFmt);
+    unsigned int dl = sampleSize(dFmt);
+    unsigned int codes = (sl == 2) ? 65536 : 256;
+    // build a reference table converting one sample at a time
+    DataBlock table(0,codes * dl);
+    DataBlock one;
+    DataBlock in(0,sl);
+    for (unsigned int i = 0; i < codes; i++) {
+	if (sl == 2)
+	    *(u_int16_t*)in.data() = i;
+	else
+	    *(u_int8_t*)in.data() = i;
+	one.convert(in,sFmt,dFmt);
+	::memcpy((u_int8_t*)table.data() + i * dl,one.data(),dl);
+    }
+    DataBlock src(0,BENCH_SAMPLES * sl);
+    for (unsigned int i = 0; i < BENCH_SAMPLES * sl; i++)
+	((u_int8_t*)src.data())[i] = (u_int8_t)(i * 37 + 11);
+    DataBlock dst(0,BENCH_SAMPLES * dl);
+
+    unsigned int bad = 0;
+    DataBlock out;
+    for (unsigned int p = 0; p < 256; p++) {
+	for (unsigned int i = 0; i < BENCH_SAMPLES * sl; i++)
+	    ((u_int8_t*)src.data())[i] = (u_int8_t)(i * 37 + p * 101 + 11);
+	out.convert(src,sFmt,dFmt);
+	for (unsigned int i = 0; i < BENCH_SAMPLES; i++) {
+	    unsigned int idx = (sl == 2) ? ((u_int16_t*)src.data())[i] : ((u_int8_t*)src.data())[i];
+	    if (::memcmp((u_int8_t*)out.data() + i * dl,(u_int8_t*)table.data() + idx * dl,dl))
+		bad++;
+	}
+    }
+    if (bad)
+	Output("G711Bench %s->%s: %u samples differ from reference!",sFormat,dFormat,bad);
+
+    u_int64_t t = Time::now();
+    for (unsigned int p = 0; p < packets; p++) {
+	((u_int8_t*)src.data())[0] = (u_int8_t)p;
+	if (sl == 2) {
+	    const u_int16_t* s = (const u_int16_t*)src.data();
+	    u_int8_t* d = (u_int8_t*)dst.data();
+	    const u_int8_t* c = (const u_int8_t*)table.data();
+	    for (unsigned int i = 0; i < BENCH_SAMPLES; i++)
+		*d++ = c[*s++];
+	}
+	else if (dl == 2) {
+	    const u_int8_t* s = (const u_int8_t*)src.data();
+	    u_int16_t* d = (u_int16_t*)dst.data();
+	    const u_int16_t* c = (const u_int16_t*)table.data();
+	    for (unsigned int i = 0; i < BENCH_SAMPLES; i++)
+		*d++ = c[*s++];
+	}
+	else {
+	    const u_int8_t* s = (const u_int8_t*)src.data();
+	    u_int8_t* d = (u_int8_t*)dst.data();
+	    const u_int8_t* c = (const u_int8_t*)table.data();
+	    for (unsigned int i = 0; i < BENCH_SAMPLES; i++)
+		*d++ = c[*s++];
+	}
+    }
+    u_int64_t tTable = Time::now() - t;
+    t = Time::now();
+    for (unsigned int p = 0; p < packets; p++) {
+	((u_int8_t*)src.data())[0] = (u_int8_t)p;
+	out.convert(src,sFmt,dFmt);
+    }
+    u_int64_t tConv = Time::now() - t;
+    Output("G711Bench %s->%s: per sample table %u ksamples/s, DataBlock::convert %u ksamples/s",
+	sFormat,dFormat,rate(packets,tTable) / 1000 * BENCH_SAMPLES,
+	rate(packets,tConv) / 1000 * BENCH_SAMPLES);
+}
+
+}; // anonymous namespace
+
+/* vi: set ts=8 sw=4 sts=4 noet: */
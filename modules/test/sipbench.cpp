@@ -0,0 +1,234 @@
+/**
+ * sipbench.cpp
+ * This file is part of the YATE Project http://YATE.null.ro
+ *
+ * SIP message parser benchmark
+ *
+ * Yet Another Telephony Engine - a fully featured software PBX and IVR
+ * Copyright (C) 2026 Null Team
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <yatesip.h>
+
+#include "benchrun.h"
+
+#include <string.h>
+
+using namespace TelEngine;
+namespace { // anonymous
+
+class SipBench : public BenchPlugin
+{
+public:
+    inline SipBench()
+	: BenchPlugin("sipbench","SipBench")
+	{ }
+    virtual void run();
+private:
+    unsigned int check(const char* buf);
+};
+
+INIT_PLUGIN(SipBench);
+
+// Captured messages, addresses and tags changed
+static const char* s_corpus[] = {
+    "INVITE sip:1002@10.0.0.2 SIP/2.0\r\n"
+    "Via: SIP/2.0/UDP 10.0.0.1:5060;branch=z9hG4bK43a9f1c7;rport\r\n"
+    "Via: SIP/2.0/UDP 10.0.0.9:5060;branch=z9hG4bK0b7d3e21\r\n"
+    "Record-Route: <sip:10.0.0.9;lr>\r\n"
+    "From: \"Alice\" <sip:1001@10.0.0.1>;tag=1928301774\r\n"
+    "To: <sip:1002@10.0.0.2>\r\n"
+    "Call-ID: a84b4c76e66710@10.0.0.1\r\n"
+    "CSeq: 314159 INVITE\r\n"
+    "Contact: <sip:1001@10.0.0.1:5060>\r\n"
+    "Max-Forwards: 70\r\n"
+    "User-Agent: YATE/6.4.1\r\n"
+    "Allow: ACK, INVITE, OPTIONS, BYE, CANCEL, REGISTER, INFO,\r\n"
+    " REFER, NOTIFY, SUBSCRIBE\r\n"
+    "Supported: timer, replaces\r\n"
+    "Content-Type: application/sdp\r\n"
+    "Content-Length: 211\r\n"
+    "\r\n"
+    "v=0\r\n"
+    "o=yate 1700000000 1700000000 IN IP4 10.0.0.1\r\n"
+    "s=SIP Call\r\n"
+    "c=IN IP4 10.0.0.1\r\n"
+    "t=0 0\r\n"
+    "m=audio 20000 RTP/AVP 0 8 101\r\n"
+    "a=rtpmap:0 PCMU/8000\r\n"
+    "a=rtpmap:8 PCMA/8000\r\n"
+    "a=rtpmap:101 telephone-event/8000\r\n"
+    "a=ptime:20\r\n",
+
+    "REGISTER sip:10.0.0.2 SIP/2.0\r\n"
+    "v: SIP/2.0/UDP 10.0.0.5:5062;branch=z9hG4bK77ef4c23;rport\r\n"
+    "f: <sip:1005@10.0.0.2>;tag=65a35\r\n"
+    "t: <sip:1005@10.0.0.2>\r\n"
+    "i: 843817637684230@10.0.0.5\r\n"
+    "CSeq: 2 REGISTER\r\n"
+    "m: <sip:1005@10.0.0.5:5062>;expires=600\r\n"
+    "Authorization: Digest username=\"1005\", realm=\"Yate\", nonce=\"4f5d7ac1.0a1b\",\r\n"
+    "\turi=\"sip:10.0.0.2\", response=\"b8b2a4b1c1e3f2a6d3b4c5e6f7a8b9c0\", algorithm=MD5\r\n"
+    "Max-Forwards: 70\r\n"
+    "User-Agent: Softphone 3.2\r\n"
+    "l: 0\r\n"
+    "\r\n",
+
+    "OPTIONS sip:10.0.0.2 SIP/2.0\r\n"
+    "Via: SIP/2.0/TCP 10.0.0.7:5060;branch=z9hG4bKhjhs8ass877\r\n"
+    "Max-Forwards: 70\r\n"
+    "To: <sip:10.0.0.2>\r\n"
+    "From: <sip:monitor@10.0.0.7>;tag=1928301774\r\n"
+    "Call-ID: a84b4c76e66710\r\n"
+    "CSeq: 63104 OPTIONS\r\n"
+    "Contact: <sip:monitor@10.0.0.7>\r\n"
+    "Accept: application/sdp\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n",
+
+    "SIP/2.0 200 OK\r\n"
+    "Via: SIP/2.0/UDP 10.0.0.1:5060;branch=z9hG4bK43a9f1c7;rport=5060;received=10.0.0.1\r\n"
+    "Via: SIP/2.0/UDP 10.0.0.9:5060;branch=z9hG4bK0b7d3e21\r\n"
+    "Record-Route: <sip:10.0.0.9;lr>\r\n"
+    "From: \"Alice\" <sip:1001@10.0.0.1>;tag=1928301774\r\n"
+    "To: <sip:1002@10.0.0.2>;tag=a6c85cf\r\n"
+    "Call-ID: a84b4c76e66710@10.0.0.1\r\n"
+    "CSeq: 314159 INVITE\r\n"
+    "Contact: <sip:1002@10.0.0.2:5060>\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n",
+    0
+};
+
+// Compact forms used in the corpus
+static const TokenDict s_compact[] = {
+    { "Via", 'v' },
+    { "From", 'f' },
+    { "To", 't' },
+    { "Call-ID", 'i' },
+    { "Contact", 'm' },
+    { "Content-Length", 'l' },
+    { 0, 0 }
+};
+
+static const char* s_lookups[] = {
+    "Via", "From", "To", "Call-ID", "CSeq", "Contact", "Max-Forwards", 0
+};
+
+// Compare parsed headers with a line by line reference parse
+unsigned int SipBench::check(const char* buf)
+{
+    SIPMessage* msg = SIPMessage::fromParsing(0,buf,::strlen(buf));
+    if (!msg) {
+	Output("SipBench: failed to parse message");
+	return 1;
+    }
+    unsigned int bad = 0;
+    int len = ::strlen(buf);
+    // skip the first line
+    TelEngine::destruct(MimeBody::getUnfoldedLine(buf,len));
+    ObjList* l = msg->header.skipNull();
+    while (len > 0) {
+	String* line = MimeBody::getUnfoldedLine(buf,len);
+	if (line->null()) {
+	    TelEngine::destruct(line);
+	    break;
+	}
+	int col = line->find(':');
+	String name = line->substr(0,col);
+	name.trimBlanks();
+	if (name.length() == 1)
+	    name = lookup(name.at(0),s_compact,name);
+	String value = line->substr(col + 1);
+	value.trimBlanks();
+	TelEngine::destruct(line);
+	MimeHeaderLine* ref = (name.endsWith("Authorization") || name.endsWith("Authenticate")) ?
+	    new MimeAuthLine(name,value) : new MimeHeaderLine(name,value);
+	String expect;
+	ref->buildLine(expect);
+	TelEngine::destruct(ref);
+	const MimeHeaderLine* hl = l ? static_cast<const MimeHeaderLine*>(l->get()) : 0;
+	String tmp;
+	if (hl)
+	    hl->buildLine(tmp);
+	if (!hl || (hl->name() != name) || (tmp != expect)) {
+	    Output("SipBench: header mismatch '%s' parsed as '%s'",expect.c_str(),tmp.c_str());
+	    bad++;
+	}
+	if (l)
+	    l = l->skipNext();
+    }
+    for (int i = 0; s_lookups[i]; i++) {
+	const MimeHeaderLine* first = 0;
+	const MimeHeaderLine* last = 0;
+	int count = 0;
+	for (ObjList* o = msg->header.skipNull(); o; o = o->skipNext()) {
+	    const MimeHeaderLine* hl = static_cast<const MimeHeaderLine*>(o->get());
+	    if (hl->name() &= s_lookups[i]) {
+		if (!first)
+		    first = hl;
+		last = hl;
+		count++;
+	    }
+	}
+	if ((msg->getHeader(s_lookups[i]) != first) || (msg->getLastHeader(s_lookups[i]) != last)
+		|| (msg->countHeaders(s_lookups[i]) != count)) {
+	    Output("SipBench: lookup of '%s' differs from list scan",s_lookups[i]);
+	    bad++;
+	}
+    }
+    TelEngine::destruct(msg);
+    return bad;
+}
+
+void SipBench::run()
+{
+    unsigned int count = iterations("messages");
+    unsigned int bad = 0;
+    unsigned int n = 0;
+    while (s_corpus[n])
+	bad += check(s_corpus[n++]);
+    if (bad)
+	Output("SipBench: %u differences found!",bad);
+
+    u_int64_t t = Time::now();
+    for (unsigned int i = 0; i < count; i++) {
+	const char* buf = s_corpus[i % n];
+	SIPMessage* msg = SIPMessage::fromParsing(0,buf,::strlen(buf));
+	TelEngine::destruct(msg);
+    }
+    u_int64_t tParse = Time::now() - t;
+    unsigned int found = 0;
+    t = Time::now();
+    for (unsigned int i = 0; i < count; i++) {
+	const char* buf = s_corpus[i % n];
+	SIPMessage* msg = SIPMessage::fromParsing(0,buf,::strlen(buf));
+	if (msg) {
+	    for (int j = 0; s_lookups[j]; j++)
+		if (msg->getHeader(s_lookups[j]))
+		    found++;
+	    found += msg->countHeaders("Via");
+	    if (msg->getLastHeader("Via"))
+		found++;
+	}
+	TelEngine::destruct(msg);
+    }
+    u_int64_t tLookup = Time::now() - t;
+    Output("SipBench: parse %u msg/s, parse and lookups %u msg/s (%u found)",
+	rate(count,tParse),rate(count,tLookup),found);
+}
+
+}; // anonymous namespace
+
+/* vi: set ts=8 sw=4 sts=4 noet: */
@@ -0,0 +1,203 @@
+/**
+ * srtpbench.cpp
+ * This file is part of the YATE Project http://YATE.null.ro
+ *
+ * SRTP per packet processing benchmark
+ *
+ * Yet Another Telephony Engine - a fully featured software PBX and IVR
+ * Copyright (C) 2026 Null Team
+ *
+ * This software is distributed under multiple licenses;
+ * see the COPYING file in the main directory for licensing
+ * information for this specific distribution.
+ *
+ * This use of this software may be subject to additional restrictions.
+ * See the LEGAL file in the main directory for details.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <yatertp.h>
+
+#include "benchrun.h"
+
+#include <string.h>
+
+using namespace TelEngine;
+namespace { // anonymous
+
+// 20ms of G.711
+#define BENCH_PAYLOAD_LEN 160
+
+class SrtpBench : public BenchPlugin
+{
+public:
+    inline SrtpBench()
+	: BenchPlugin("srtpbench","SrtpBench")
+	{ }
+    virtual void run();
+private:
+    void runSuite(const char* suite, unsigned int count);
+};
+
+INIT_PLUGIN(SrtpBench);
+
+// Receives the cipher built by a handler of engine.cipher
+class CipherHolder : public RefObject
+{
+public:
+    inline CipherHolder()
+	: m_cipher(0)
+	{ }
+    virtual ~CipherHolder()
+	{ TelEngine::destruct(m_cipher); }
+    virtual void* getObject(const String& name) const
+	{ return (name == YATOM("Cipher*")) ? (void*)&m_cipher : RefObject::getObject(name); }
+    inline Cipher* cipher()
+	{ Cipher* tmp = m_cipher; m_cipher = 0; return tmp; }
+private:
+    Cipher* m_cipher;
+};
+
+// Session getting ciphers from the engine like the RTP channel does
+class BenchSession : public RTPSession
+{
+public:
+    inline BenchSession()
+	: m_payload(0), m_received(0), m_bad(0)
+	{ }
+    virtual Cipher* createCipher(const String& name, Cipher::Direction dir);
+    virtual bool checkCipher(const String& name);
+    virtual bool rtpRecvData(bool marker, unsigned int timestamp, const void* data, int len);
+    inline void expect(const unsigned char* payload)
+	{ m_payload = payload; }
+    inline unsigned int received() const
+	{ return m_received; }
+    inline unsigned int bad() const
+	{ return m_bad; }
+private:
+    const unsigned char* m_payload;
+    unsigned int m_received;
+    unsigned int m_bad;
+};
+
+// Transport handing sent packets directly to another session instead of a socket
+class LoopTransport : public RTPTransport
+{
+public:
+    inline LoopTransport(RTPSession* peer = 0)
+	: m_peer(peer)
+	{ }
+    virtual void rtpData(const void* data, int len)
+	{ if (m_peer) m_peer->rtpData(data,len); }
+    virtual void rtcpData(const void* data, int len)
+	{ }
+private:
+    RTPSession* m_peer;
+};
+
+
+// Check if a handler of engine.cipher can build a cipher
+static bool haveCipher(const String& name)
+{
+    Message msg("engine.cipher");
+    msg.addParam("cipher",name);
+    return Engine::dispatch(msg);
+}
+
+
+Cipher* BenchSession::createCipher(const String& name, Cipher::Direction dir)
+{
+    Message msg("engine.cipher");
+    msg.addParam("cipher",name);
+    msg.addParam("direction",lookup(dir,Cipher::directions(),"unknown"));
+    CipherHolder* cHold = new CipherHolder;
+    msg.userData(cHold);
+    cHold->deref();
+    return Engine::dispatch(msg) ? cHold->cipher() : 0;
+}
+
+bool BenchSession::checkCipher(const String& name)
+{
+    return haveCipher(name);
+}
+
+bool BenchSession::rtpRecvData(bool marker, unsigned int timestamp, const void* data, int len)
+{
+    m_received++;
+    if (!(m_payload && (len == BENCH_PAYLOAD_LEN) && !::memcmp(data,m_payload,len)))
+	m_bad++;
+    return true;
+}
+
+
+void SrtpBench::run()
+{
+    unsigned int count = iterations("packets");
+    runSuite("NULL",count);
+    if (!haveCipher("aes_ctr")) {
+	Output("SrtpBench: no aes_ctr cipher available, load the openssl module");
+	return;
+    }
+    runSuite("AES_CM_128_HMAC_SHA1_32",count);
+    runSuite("AES_CM_128_HMAC_SHA1_80",count);
+}
+
+// Send packets protected with a crypto suite to a session that unprotects them
+void SrtpBench::runSuite(const char* suite, unsigned int count)
+{
+    BenchSession* recv = new BenchSession;
+    BenchSession* send = new BenchSession;
+    recv->transport(new LoopTransport);
+    send->transport(new LoopTransport(recv));
+    recv->direction(RTPSession::RecvOnly);
+    send->direction(RTPSession::SendOnly);
+    recv->dataPayload(0);
+    send->dataPayload(0);
+    bool ok = true;
+    if (::strcmp(suite,"NULL")) {
+	RTPSecure* srtp = new RTPSecure(suite);
+	String cSuite;
+	String key;
+	ok = srtp->supported(send) && srtp->create(cSuite,key,true);
+	if (ok) {
+	    send->security(srtp);
+	    srtp = new RTPSecure;
+	    ok = srtp->setup(cSuite,key);
+	    if (ok)
+		recv->receiver()->security(srtp);
+	    else
+		TelEngine::destruct(srtp);
+	}
+	else
+	    TelEngine::destruct(srtp);
+    }
+    if (ok) {
+	unsigned char payload[BENCH_PAYLOAD_LEN];
+	for (unsigned int i = 0; i < BENCH_PAYLOAD_LEN; i++)
+	    payload[i] = (unsigned char)(i * 7 + 3);
+	recv->expect(payload);
+	unsigned int ts = 0;
+	u_int64_t t = Time::now();
+	for (unsigned int i = 0; i < count; i++) {
+	    payload[0] = (unsigned char)i;
+	    send->rtpSendData(false,ts,payload,BENCH_PAYLOAD_LEN);
+	    ts += BENCH_PAYLOAD_LEN;
+	}
+	t = Time::now() - t;
+	if (recv->bad() || (recv->received() != count))
+	    Output("SrtpBench %s: sent %u packets, received %u, %u bad!",
+		suite,count,recv->received(),recv->bad());
+	Output("SrtpBench %s: protect and unprotect %u pkt/s",suite,rate(count,t));
+    }
+    else
+	Output("SrtpBench %s: failed to set up SRTP",suite);
+    TelEngine::destruct(send);
+    TelEngine::destruct(recv);
+}
+
+}; // anonymous namespace
+
+/* vi: set ts=8 sw=4 sts=4 noet: */
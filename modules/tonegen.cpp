@@ -123,6 +123,7 @@ class ToneSource : public ThreadedSource
 public:
     virtual void destroyed();
     virtual void run();
+    virtual bool runFrame();
     inline const String& name()
 	{ return m_name; }
     bool startup();
@@ -136,6 +137,8 @@ protected:
 	{ return false; }
     virtual void cleanup();
     void advanceTone(const Tone*& tone);
+    void initFrames();
+    void fillFrame();
     static const ToneDesc* getBlock(String& tone, const ToneDesc* table);
     static const ToneDesc* findToneDesc(String& tone, const String& prefix);
     String m_name;
@@ -147,6 +150,10 @@ private:
     unsigned m_brate;
     unsigned m_total;
     u_int64_t m_time;
+    const Tone* m_cur;
+    int m_samp;
+    int m_dpos;
+    int m_nsam;
 };
 
 class TempSource : public ToneSource
@@ -202,6 +209,7 @@ public:
 static ObjList s_toneDesc;               // List of configured tones
 static ObjList s_defToneDesc;            // List of default tones
 static String s_defLang;                 // Default tone language
+static bool s_paced = false;             // Serve sources from shared pacing threads
 static const String s_default = "itu";
 
 // 421.052Hz (19 samples @ 8kHz) sine wave, pretty close to standard 425Hz
@@ -657,7 +665,8 @@ bool ToneData::decode(const String& desc, int& samples, const short*& data, bool
 
 ToneSource::ToneSource(const ToneDesc* tone)
     : m_tone(0), m_repeat(tone == 0), m_firstPass(true),
-      m_data(0,320), m_brate(16000), m_total(0), m_time(0)
+      m_data(0,320), m_brate(16000), m_total(0), m_time(0),
+      m_cur(0), m_samp(0), m_dpos(1), m_nsam(0)
 {
     if (tone) {
 	m_tone = tone->tones();
@@ -679,7 +688,11 @@ void ToneSource::destroyed()
 bool ToneSource::startup()
 {
     DDebug(&__plugin,DebugAll,"ToneSource::startup(\"%s\") tone=%p",m_name.c_str(),m_tone);
-    return m_tone && start("Tone Source");
+    if (!m_tone)
+	return false;
+    if (s_paced)
+	return startPaced(m_data.length() * (u_int64_t)1000000 / m_brate,noChan());
+    return start("Tone Source");
 }
 
 void ToneSource::cleanup()
@@ -846,43 +859,55 @@ ToneSource* ToneSource::getTone(String& tone, const String& prefix)
     return t;
 }
 
+// Reset the generator to the start of the tone
+void ToneSource::initFrames()
+{
+    m_samp = 0;
+    m_dpos = 1;
+    m_cur = m_tone;
+    m_nsam = m_cur ? m_cur->nsamples : 0;
+    if (m_nsam < 0)
+	m_nsam = -m_nsam;
+}
+
+// Generate the next frame of samples in the data buffer
+void ToneSource::fillFrame()
+{
+    short *d = (short *) m_data.data();
+    for (unsigned int i = m_data.length()/2; i--; m_samp++,m_dpos++) {
+	if (m_samp >= m_nsam) {
+	    // go to the start of the next tone
+	    m_samp = 0;
+	    const Tone *otone = m_cur;
+	    advanceTone(m_cur);
+	    m_nsam = m_cur ? m_cur->nsamples : 32000;
+	    if (m_nsam < 0) {
+		m_nsam = -m_nsam;
+		// reset repeat point here
+		m_tone = m_cur;
+	    }
+	    if (m_cur != otone)
+		m_dpos = 1;
+	}
+	if (m_cur && m_cur->data) {
+	    if (m_dpos > m_cur->data[0])
+		m_dpos = 1;
+	    *d++ = m_cur->data[m_dpos];
+	}
+	else
+	    *d++ = 0;
+    }
+}
+
 void ToneSource::run()
 {
     Debug(&__plugin,DebugAll,"ToneSource::run() [%p]",this);
     u_int64_t tpos = Time::now();
     m_time = tpos;
-    int samp = 0; // sample number
-    int dpos = 1; // position in data
-    const Tone* tone = m_tone;
-    int nsam = tone->nsamples;
-    if (nsam < 0)
-	nsam = -nsam;
+    initFrames();
     while (m_tone && looping(noChan())) {
 	Thread::check();
-	short *d = (short *) m_data.data();
-	for (unsigned int i = m_data.length()/2; i--; samp++,dpos++) {
-	    if (samp >= nsam) {
-		// go to the start of the next tone
-		samp = 0;
-		const Tone *otone = tone;
-		advanceTone(tone);
-		nsam = tone ? tone->nsamples : 32000;
-		if (nsam < 0) {
-		    nsam = -nsam;
-		    // reset repeat point here
-		    m_tone = tone;
-		}
-		if (tone != otone)
-		    dpos = 1;
-	    }
-	    if (tone && tone->data) {
-		if (dpos > tone->data[0])
-		    dpos = 1;
-		*d++ = tone->data[dpos];
-	    }
-	    else
-		*d++ = 0;
-	}
+	fillFrame();
 	int64_t dly = tpos - Time::now();
 	if (dly > 0) {
 	    XDebug(&__plugin,DebugAll,"ToneSource sleeping for " FMT64 " usec",dly);
@@ -899,6 +924,21 @@ void ToneSource::run()
     m_time = 0;
 }
 
+bool ToneSource::runFrame()
+{
+    if (!m_time) {
+	Debug(&__plugin,DebugAll,"ToneSource paced start [%p]",this);
+	m_time = Time::now();
+	initFrames();
+    }
+    if (!m_tone)
+	return false;
+    fillFrame();
+    Forward(m_data,m_total/2);
+    m_total += m_data.length();
+    return true;
+}
+
 
 TempSource::TempSource(String& desc, const String& prefix, DataBlock* rawdata)
     : m_single(0), m_rawdata(rawdata)
@@ -1238,6 +1278,7 @@ void ToneGenDriver::initialize()
     // Init tones from config
     Configuration cfg(Engine::configFile("tonegen"));
     s_defLang = cfg.getValue("general","lang");
+    s_paced = cfg.getBoolValue("general","paced");
     if (s_defLang == s_default)
 	s_defLang.clear();
     unsigned int n = cfg.sections();
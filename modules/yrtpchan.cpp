@@ -87,6 +87,8 @@ static TokenDict dict_yrtp_dir[] = {
 static bool s_ipv6 = false;              // IPv6 support enabled
 static int s_minport = MIN_PORT;
 static int s_maxport = MAX_PORT;
+static int s_sharedPort = 0;
+static int s_sharedSockets = 1;
 static int s_bufsize = BUF_SIZE;
 static int s_padding = 0;
 static String s_localip;
@@ -484,8 +486,11 @@ YRTPWrapper::~YRTPWrapper()
 
 void* YRTPWrapper::getObject(const String& name) const
 {
-    if (name == YATOM("Socket"))
-	return m_rtp ? m_rtp->rtpSock() : 0;
+    if (name == YATOM("Socket")) {
+	// don't expose a socket shared with other sessions
+	RTPTransport* trans = m_rtp ? m_rtp->UDPSession::transport() : 0;
+	return (trans && !trans->shared()) ? trans->rtpSock() : 0;
+    }
     if (name == YATOM("DataSource"))
 	return m_source;
     if (name == YATOM("DataConsumer"))
@@ -577,6 +582,18 @@ bool YRTPWrapper::bindLocal(const char* localip, bool rtcp)
 	    m_id.c_str(),localip,this);
 	return false;
     }
+    if (m_rtp && s_sharedPort) {
+	addr.port(s_sharedPort);
+	if (m_rtp->sharedAddr(addr,rtcp,s_sharedSockets)) {
+	    m_host = addr.host();
+	    m_port = s_sharedPort;
+	    TraceDebug(m_traceId,&splugin,DebugInfo,"Session '%s' %p attached to shared %s%s [%p]",
+		m_id.c_str(),session(),addr.addr().c_str(),(rtcp ? " +RTCP" : ""),this);
+	    return true;
+	}
+	TraceDebug(m_traceId,&splugin,DebugMild,"YRTPWrapper '%s' could not use shared port %s [%p]",
+	    m_id.c_str(),addr.addr().c_str(),this);
+    }
     for (; attempt; attempt--) {
 	int lport = (minport + (Random::random() % (maxport - minport))) & 0xfffe;
 	addr.port(lport);
@@ -1903,6 +1920,8 @@ void YRTPPlugin::initialize()
 	cfg.getBoolValue("general","ipv6_support",false);
     s_minport = cfg.getIntValue("general","minport",MIN_PORT);
     s_maxport = cfg.getIntValue("general","maxport",MAX_PORT);
+    s_sharedPort = cfg.getIntValue("general","sharedport",0,0,65534) & 0xfffe;
+    s_sharedSockets = cfg.getIntValue("general","sharedsockets",1,1,16);
     s_bufsize = cfg.getIntValue("general","buffer",BUF_SIZE);
     s_minJitter = cfg.getIntValue("general","minjitter",50);
     s_maxJitter = cfg.getIntValue("general","maxjitter",Engine::clientMode() ? 120 : 0);
@@ -1918,6 +1937,11 @@ void YRTPPlugin::initialize()
     s_monitor = cfg.getBoolValue("general","monitoring",false);
     s_sleep = cfg.getIntValue("general","defsleep",5);
     RTPGroup::setMinSleep(cfg.getIntValue("general","minsleep"));
+    bool eventPoll = cfg.getBoolValue("general","eventpoll");
+    if (eventPoll && !RTPGroup::canEventPoll())
+	Debug(this,DebugConf,"Socket event polling is not supported on this platform");
+    RTPGroup::setEventPolling(eventPoll);
+    RTPGroup::setBatchSend(cfg.getBoolValue("general","batchsend"));
     s_priority = Thread::priority(cfg.getValue("general","thread"));
     s_affinity = cfg.getValue("general","affinity");
     s_rtpWarnSeq = cfg.getBoolValue("general","rtp_warn_seq",true);
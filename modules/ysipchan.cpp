@@ -41,6 +41,7 @@ class YateTCPParty;                      // A SIP TCP/TLS party
 class YateSIPEngine;                     // The SIP engine
 class YateSIPLine;                       // A line
 class YateSIPEndPoint;                   // Endpoint processor
+class YateSIPEngineWorker;               // Engine shard processor
 class SIPDriver;
 
 #define EXPIRES_MIN 60
@@ -647,6 +648,19 @@ private:
     YateSIPTransport* m_transport;
 };
 
+// A thread processing the events of one SIP engine shard
+class YateSIPEngineWorker : public Thread
+{
+    friend class YateSIPEndPoint;
+public:
+    YateSIPEngineWorker(YateSIPEndPoint* ep, unsigned int shard, Thread::Priority prio);
+    ~YateSIPEngineWorker();
+    virtual void run();
+private:
+    YateSIPEndPoint* m_ep;
+    unsigned int m_shard;
+};
+
 class YateSIPTCPListener : public Thread, public GenObject, public ProtocolHolder, public YateSIPListener
 {
     friend class SIPDriver;
@@ -749,11 +763,6 @@ public:
     bool hasActiveTransaction(YateSIPTransport* trans);
     // Check if the engine has pending transactions
     bool hasInitialTransaction();
-    // Clear transactions
-    inline void clearTransactions() {
-	    Lock lck(this);
-	    m_transList.clear();
-	}
     inline bool update() const
 	{ return m_update; }
     inline bool prack() const
@@ -858,12 +867,17 @@ class YateSIPEndPoint : public Thread
 {
     friend class SIPDriver;
     friend class YateSIPTCPListener;
+    friend class YateSIPEngineWorker;
 public:
     YateSIPEndPoint(Thread::Priority prio = Thread::Normal,
-	unsigned int partyMutexCount = 5);
+	unsigned int partyMutexCount = 5, unsigned int threads = 1);
     ~YateSIPEndPoint();
     bool Init(void);
     void run(void);
+    // Start the threads processing engine shards other than the first one
+    bool startWorkers(Thread::Priority prio = Thread::Normal);
+    // Process the events of an engine shard until cancelled
+    void processEvents(unsigned int shard);
     bool incoming(SIPEvent* e, SIPTransaction* t);
     void invite(SIPEvent* e, SIPTransaction* t);
     void regReq(SIPEvent* e, SIPTransaction* t);
@@ -918,39 +932,41 @@ public:
     inline YateSIPEngine* engine() const
 	{ return m_engine; }
     inline void incFailedAuths()
-	{ m_failedAuths++; }
+	{ m_failedAuths.inc(); }
     inline unsigned int failedAuths()
-    {
-	unsigned int tmp = m_failedAuths;
-	m_failedAuths = 0;
-	return tmp;
-    }
+	{ return takeCount(m_failedAuths); }
     inline unsigned int timedOutTrs()
-    {
-	unsigned int tmp = m_timedOutTrs;
-	m_timedOutTrs = 0;
-	return tmp;
-    }
+	{ return takeCount(m_timedOutTrs); }
     inline unsigned int timedOutByes()
-    {
-	unsigned int tmp = m_timedOutByes;
-	m_timedOutByes = 0;
-	return tmp;
-    }
+	{ return takeCount(m_timedOutByes); }
     MutexPool m_partyMutexPool;          // SIPParty mutex pool
     // Check if data is allowed to be read from socket(s) and processed
-    static bool canRead();
+    static bool canRead(int evCount = s_evCount);
     static int s_evCount;
 private:
+    // Cancel worker threads and wait for them to terminate
+    void stopWorkers();
+    // Update the flood counter seen by the transports
+    void setEvCount(unsigned int shard, int evCount);
+    // Retrieve and reset a statistics counter updated by all shards
+    static inline unsigned int takeCount(AtomicUInt& counter)
+    {
+	unsigned int tmp = counter.valueAtomic();
+	counter.sub(tmp);
+	return tmp;
+    }
     YateSIPEngine *m_engine;
+    unsigned int m_threads;              // Number of threads processing engine shards
+    YateSIPEngineWorker** m_workers;     // Workers of shards 1 .. m_threads - 1
+    int* m_evCounts;                     // Events handled in a row by each shard
     Mutex m_mutex;                       // Protect transports and listeners
     ObjList m_transports;                // All transports (non UDP are not owned)
     YateSIPUDPTransport* m_defTransport; // Default transport (pointer to object in m_transports)
     ObjList m_listeners;                 // Listeners list
 
-    unsigned int m_failedAuths;
-    unsigned int m_timedOutTrs;
-    unsigned int m_timedOutByes;
+    AtomicUInt m_failedAuths;
+    AtomicUInt m_timedOutTrs;
+    AtomicUInt m_timedOutByes;
 };
 
 // Handle transfer requests
@@ -5359,19 +5375,34 @@ bool YateSIPEngine::checkUser(String& username, const String& realm, const Strin
 }
 
 
-YateSIPEndPoint::YateSIPEndPoint(Thread::Priority prio, unsigned int partyMutexCount)
+YateSIPEndPoint::YateSIPEndPoint(Thread::Priority prio, unsigned int partyMutexCount,
+    unsigned int threads)
     : Thread("YSIP EndPoint",prio),
       m_partyMutexPool(partyMutexCount,true,"SIPParty"),
-      m_engine(0), m_mutex(true,"YateSIPEndPoint"), m_defTransport(0),
+      m_engine(0), m_threads(threads ? threads : 1), m_workers(0), m_evCounts(0),
+      m_mutex(true,"YateSIPEndPoint"), m_defTransport(0),
       m_failedAuths(0),m_timedOutTrs(0), m_timedOutByes(0)
 {
-    Debug(&plugin,DebugAll,"YateSIPEndPoint::YateSIPEndPoint(%s) [%p]",
-	Thread::priority(prio),this);
+    Debug(&plugin,DebugAll,"YateSIPEndPoint::YateSIPEndPoint(%s,%u) [%p]",
+	Thread::priority(prio),m_threads,this);
+    if (m_threads > 1) {
+	m_workers = new YateSIPEngineWorker*[m_threads];
+	m_evCounts = new int[m_threads];
+	for (unsigned int i = 0; i < m_threads; i++) {
+	    m_workers[i] = 0;
+	    m_evCounts[i] = 0;
+	}
+    }
 }
 
 YateSIPEndPoint::~YateSIPEndPoint()
 {
     Debug(&plugin,DebugAll,"YateSIPEndPoint::~YateSIPEndPoint() [%p]",this);
+    stopWorkers();
+    delete[] m_workers;
+    m_workers = 0;
+    delete[] m_evCounts;
+    m_evCounts = 0;
     plugin.channels().clear();
     s_lines.clear();
     if (m_engine) {
@@ -5811,30 +5842,99 @@ bool YateSIPEndPoint::Init()
 {
     m_engine = new YateSIPEngine(this);
     m_engine->debugChain(&plugin);
+    if (!m_engine->setShards(m_threads))
+	m_threads = m_engine->shards();
     return true;
 }
 
+// Start the threads processing engine shards other than the first one
+bool YateSIPEndPoint::startWorkers(Thread::Priority prio)
+{
+    Lock lck(m_mutex);
+    bool ok = true;
+    for (unsigned int i = 1; i < m_threads; i++) {
+	if (m_workers[i])
+	    continue;
+	m_workers[i] = new YateSIPEngineWorker(this,i,prio);
+	if (m_workers[i]->startup())
+	    continue;
+	Debug(&plugin,DebugWarn,"Failed to start worker thread for engine shard %u",i);
+	m_workers[i] = 0;
+	ok = false;
+    }
+    return ok;
+}
+
+// Cancel worker threads and wait for them to terminate
+void YateSIPEndPoint::stopWorkers()
+{
+    if (!m_workers)
+	return;
+    Lock lck(m_mutex);
+    for (unsigned int i = 1; i < m_threads; i++)
+	if (m_workers[i])
+	    m_workers[i]->cancel();
+    // workers use the endpoint until they are gone, never give up waiting
+    for (unsigned int n = 1; ; n++) {
+	unsigned int running = 0;
+	for (unsigned int i = 1; i < m_threads; i++)
+	    if (m_workers[i])
+		running++;
+	if (!running)
+	    return;
+	if (!(n % 500))
+	    Debug(&plugin,DebugWarn,"Still waiting for %u engine workers to stop",running);
+	lck.drop();
+	Thread::idle();
+	lck.acquire(m_mutex);
+    }
+}
+
+// Update the flood counter seen by the transports, the most loaded shard counts
+void YateSIPEndPoint::setEvCount(unsigned int shard, int evCount)
+{
+    if (!m_evCounts) {
+	s_evCount = evCount;
+	return;
+    }
+    m_evCounts[shard] = evCount;
+    int count = 0;
+    for (unsigned int i = 0; i < m_threads; i++)
+	if (count < m_evCounts[i])
+	    count = m_evCounts[i];
+    s_evCount = count;
+}
+
 // Check if data is allowed to be read from socket(s) and processed
-bool YateSIPEndPoint::canRead()
+bool YateSIPEndPoint::canRead(int evCount)
 {
-    return s_floodEvents <= 1 || (s_evCount < s_floodEvents) || Engine::exiting();
+    return s_floodEvents <= 1 || (evCount < s_floodEvents) || Engine::exiting();
 }
 
 void YateSIPEndPoint::run()
 {
+    processEvents(0);
+    plugin.epTerminated(this);
+}
+
+// Process the events of an engine shard until cancelled
+void YateSIPEndPoint::processEvents(unsigned int shard)
+{
+    int evCount = 0;
     for (;;)
     {
-	if (!canRead()) {
-	    if (s_evCount == s_floodEvents)
-	        Debug(&plugin,DebugMild,"Flood detected: %d handled events",s_evCount);
-	    else if ((s_evCount % s_floodEvents) == 0)
-	        Debug(&plugin,DebugWarn,"Severe flood detected: %d events",s_evCount);
+	if (!canRead(evCount)) {
+	    if (evCount == s_floodEvents)
+	        Debug(&plugin,DebugMild,"Flood detected: %d handled events",evCount);
+	    else if ((evCount % s_floodEvents) == 0)
+	        Debug(&plugin,DebugWarn,"Severe flood detected: %d events",evCount);
 	}
-	SIPEvent* e = m_engine->getEvent();
+	SIPEvent* e = m_engine->getEvent(shard);
 	if (e)
-	    s_evCount++;
+	    evCount++;
 	else
-	    s_evCount = 0;
+	    evCount = 0;
+	setEvCount(shard,evCount);
 	// hack: use a loop so we can use break and continue
 	for (; e; m_engine->processEvent(e),e = 0) {
 	    SIPTransaction* t = e->getTransaction();
@@ -5845,12 +5945,12 @@ void YateSIPEndPoint::run()
 	    if (t->isOutgoing() && t->getResponseCode() == 408) {
 	    	if (t->getMethod() == YSTRING("BYE")) {
 		    DDebug(&plugin,DebugInfo,"BYE for transaction %p has timed out",t);
-		    m_timedOutByes++;
+		    m_timedOutByes.inc();
 		    plugin.changed();
 		}
 		if (e->getState() == SIPTransaction::Cleared && e->getUserData()) {
 		    DDebug(&plugin,DebugInfo,"Transaction %p has timed out",t);
-		    m_timedOutTrs++;
+		    m_timedOutTrs.inc();
 		    plugin.changed();
 		}
 	    }
@@ -5890,14 +5990,35 @@ void YateSIPEndPoint::run()
 		break;
 	    }
 	}
-	if (s_evCount || s_engineHalt) {
+	if (evCount || s_engineHalt) {
 	    if (Thread::check(false))
 		break;
 	}
 	else
-	    Thread::usleep(Thread::idleUsec());
+	    // sleep until a transaction has events or its timer is due
+	    m_engine->waitEvent(100000,shard);
     }
-    plugin.epTerminated(this);
+}
+
+YateSIPEngineWorker::YateSIPEngineWorker(YateSIPEndPoint* ep, unsigned int shard,
+    Thread::Priority prio)
+    : Thread("YSIP Engine",prio), m_ep(ep), m_shard(shard)
+{
+    XDebug(&plugin,DebugAll,"YateSIPEngineWorker(%p,%u) [%p]",ep,shard,this);
+}
+
+YateSIPEngineWorker::~YateSIPEngineWorker()
+{
+    XDebug(&plugin,DebugAll,"~YateSIPEngineWorker() shard=%u [%p]",m_shard,this);
+    Lock lck(m_ep->m_mutex);
+    if (m_ep->m_workers[m_shard] == this)
+	m_ep->m_workers[m_shard] = 0;
+}
+
+void YateSIPEngineWorker::run()
+{
+    DDebug(&plugin,DebugAll,"YateSIPEngineWorker processing shard %u [%p]",m_shard,this);
+    m_ep->processEvents(m_shard);
 }
 
 bool YateSIPEndPoint::incoming(SIPEvent* e, SIPTransaction* t)
@@ -8298,6 +8419,7 @@ void YateSIPConnection::doPrack(SIPTransaction* t)
     if (msg) {
 	m_prackTimer = Time::now() + PRACK_TIMER;
 	m_prackCount = PRACK_TRIES;
+	armTimer(m_prackTimer);
 	msg->addHeader("Require","100rel");
 	msg->addHeader("RSeq",String(++m_lastRseq));
 	RefPointer<SIPTransaction> tr = m_tr;
@@ -8873,6 +8995,7 @@ void YateSIPConnection::sendProvisional(SIPMessage* msg)
 	    }
 	    m_prackTimer = Time::now() + PRACK_TIMER;
 	    m_prackCount = PRACK_TRIES;
+	    armTimer(m_prackTimer);
 	    msg->addHeader("Require","100rel");
 	    msg->addHeader("RSeq",String(++m_lastRseq));
 	}
@@ -8889,6 +9012,7 @@ void YateSIPConnection::checkTimers(Message& msg, const Time& tmr)
 	if (m_prackTimer && (m_prackTimer < tmr)) {
 	    if (--m_prackCount > 0) {
 		m_prackTimer += PRACK_TIMER;
+		armTimer(m_prackTimer);
 		RefPointer<SIPTransaction> tr = m_tr;
 		lock.drop();
 		if (tr)
@@ -8907,6 +9031,8 @@ void YateSIPConnection::checkTimers(Message& msg, const Time& tmr)
 		return;
 	    }
 	}
+	else if (m_prackTimer != (uint64_t)-1)
+	    armTimer(m_prackTimer);
     }
 }
 
@@ -10295,13 +10421,15 @@ void SIPDriver::initialize()
     if (!m_endpoint) {
 	Thread::Priority prio = Thread::priority(s_cfg.getValue("general","thread"));
 	unsigned int partyMutexCount = s_cfg.getIntValue("general","party_mutexcount",47,13,101);
-	m_endpoint = new YateSIPEndPoint(prio,partyMutexCount);
+	unsigned int threads = s_cfg.getIntValue("general","engine_threads",1,1,SIP_MAX_SHARDS);
+	m_endpoint = new YateSIPEndPoint(prio,partyMutexCount,threads);
 	if (!(m_endpoint->Init())) {
 	    delete m_endpoint;
 	    m_endpoint = 0;
 	    return;
 	}
 	m_endpoint->startup();
+	m_endpoint->startWorkers(prio);
 	setup();
 	installRelay(Halt);
 	installRelay(Progress);
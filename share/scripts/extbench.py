@@ -0,0 +1,261 @@
+#!/usr/bin/env python3
+"""
+ extbench.py
+ This file is part of the YATE Project http://YATE.null.ro
+
+ External module protocol benchmark
+
+ Yet Another Telephony Engine - a fully featured software PBX and IVR
+ Copyright (C) 2026 Null Team
+
+ This software is distributed under multiple licenses;
+ see the COPYING file in the main directory for licensing
+ information for this specific distribution.
+
+ This use of this software may be subject to additional restrictions.
+ See the LEGAL file in the main directory for details.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+ Compares the text and binary framed encodings of the external module
+ protocol. The script installs a handler for the messages it emits so each
+ round trip crosses the pipe four times: the message, its relay back to the
+ script, the answer to the relay and the final answer.
+
+ To use add in extmodule.conf:
+
+ [scripts]
+ extbench.py=20000
+
+ The optional parameter is the number of messages sent with each encoding.
+"""
+
+import os
+import struct
+import sys
+import time
+
+COUNT = int(sys.argv[1]) if len(sys.argv) > 1 and sys.argv[1] else 20000
+WINDOW = 100
+
+# Parameters of a typical call.route, some need escaping in text mode
+PARAMS = [
+    ("id", "sip/1234"),
+    ("module", "sip"),
+    ("status", "incoming"),
+    ("address", "10.0.0.1:5060"),
+    ("billid", "1700000000-1234"),
+    ("caller", "1001"),
+    ("called", "1002"),
+    ("callername", "Alice"),
+    ("sip_uri", "sip:1002@10.0.0.2"),
+    ("sip_from", "\"Alice\" <sip:1001@10.0.0.1>;tag=1928301774"),
+    ("sip_to", "<sip:1002@10.0.0.2>"),
+    ("sip_callid", "a84b4c76e66710@10.0.0.1"),
+    ("sip_contact", "<sip:1001@10.0.0.1:5060>"),
+    ("sip_user-agent", "Softphone 3.2"),
+    ("formats", "alaw,mulaw,gsm"),
+    ("rtp_addr", "10.0.0.1"),
+    ("rtp_port", "20000"),
+    ("sdp_raw", "v=0\r\no=- 1 1 IN IP4 10.0.0.1\r\ns=SIP Call\r\n"),
+]
+
+
+def escape(s, extra=""):
+    out = []
+    for c in s:
+        if c == "%":
+            out.append("%%")
+        elif c < " " or c == ":" or c == extra:
+            out.append("%" + chr(ord(c) + 64))
+        else:
+            out.append(c)
+    return "".join(out)
+
+
+def unescape(s):
+    if "%" not in s:
+        return s
+    out = []
+    i = 0
+    while i < len(s):
+        c = s[i]
+        if c == "%" and i + 1 < len(s):
+            i += 1
+            c = s[i]
+            if c != "%":
+                c = chr(ord(c) - 64)
+        out.append(c)
+        i += 1
+    return "".join(out)
+
+
+class Channel:
+    def __init__(self):
+        self.inp = sys.stdin.fileno()
+        self.outp = sys.stdout.fileno()
+        self.rbuf = b""
+        self.wbuf = []
+        self.framed_out = False
+        self.framed_in = False
+        self.params = None
+
+    def flush(self):
+        if self.wbuf:
+            data = b"".join(self.wbuf)
+            self.wbuf = []
+            while data:
+                data = data[os.write(self.outp, data):]
+
+    def line(self, text):
+        data = text.encode("utf-8")
+        if self.framed_out:
+            self.wbuf.append(struct.pack(">Ic", len(data) + 1, b"T") + data)
+        else:
+            self.wbuf.append(data + b"\n")
+
+    def message(self, mid, name, params, answer=None):
+        if self.framed_out:
+            def s(v):
+                v = v.encode("utf-8")
+                return struct.pack(">I", len(v)) + v
+            parts = [b"A" if answer is not None else b"M", s(mid),
+                     struct.pack(">I", int(answer) if answer is not None else 0),
+                     s(name), s("")]
+            for n, v in params:
+                n = n.encode("utf-8")
+                parts.append(struct.pack(">H", len(n)) + n + s(v))
+            body = b"".join(parts)
+            self.wbuf.append(struct.pack(">I", len(body)) + body)
+        else:
+            if answer is None:
+                head = "%%>message:" + escape(mid) + ":0:"
+            else:
+                head = "%%<message:" + escape(mid) + ":" + ("true" if answer else "false") + ":"
+            self.line(head + escape(name) + "::" + ":".join(
+                escape(n, "=") + "=" + escape(v) for n, v in params))
+
+    def read(self):
+        """Block until at least one item is available, return the list.
+        Items are (kind, id, name) where kind is 'M', 'A' or a text line"""
+        items = []
+        while not items:
+            data = os.read(self.inp, 65536)
+            if not data:
+                raise EOFError()
+            self.rbuf += data
+            while True:
+                if self.framed_in:
+                    if len(self.rbuf) < 4:
+                        break
+                    flen = struct.unpack_from(">I", self.rbuf)[0]
+                    if len(self.rbuf) < flen + 4:
+                        break
+                    frame = self.rbuf[4:flen + 4]
+                    self.rbuf = self.rbuf[flen + 4:]
+                    if frame[:1] == b"T":
+                        items.append(self.text(frame[1:].decode("utf-8")))
+                    else:
+                        ilen = struct.unpack_from(">I", frame, 1)[0]
+                        mid = frame[5:5 + ilen].decode("utf-8")
+                        nlen = struct.unpack_from(">I", frame, 9 + ilen)[0]
+                        name = frame[13 + ilen:13 + ilen + nlen].decode("utf-8")
+                        items.append((chr(frame[0]), mid, name))
+                        if frame[:1] == b"A" and self.params is None:
+                            self.params = self.frameParams(frame, 13 + ilen + nlen)
+                else:
+                    pos = self.rbuf.find(b"\n")
+                    if pos < 0:
+                        break
+                    text = self.rbuf[:pos].decode("utf-8")
+                    self.rbuf = self.rbuf[pos + 1:]
+                    items.append(self.text(text))
+                    if text.startswith("%%<setlocal:framing:binary:true"):
+                        self.framed_in = True
+        return items
+
+    def text(self, text):
+        if text.startswith("%%>message:") or text.startswith("%%<message:"):
+            f = text.split(":")
+            if text[2] == "<" and self.params is None:
+                self.params = [tuple(unescape(p).split("=", 1)) for p in f[5:]]
+            return ("A" if text[2] == "<" else "M", unescape(f[1]), unescape(f[3]))
+        return (text, None, None)
+
+    def frameParams(self, frame, pos):
+        params = []
+        pos += 4 + struct.unpack_from(">I", frame, pos)[0]
+        while pos < len(frame):
+            nlen = struct.unpack_from(">H", frame, pos)[0]
+            name = frame[pos + 2:pos + 2 + nlen].decode("utf-8")
+            pos += 2 + nlen
+            vlen = struct.unpack_from(">I", frame, pos)[0]
+            params.append((name, frame[pos + 4:pos + 4 + vlen].decode("utf-8")))
+            pos += 4 + vlen
+        return params
+
+
+def run(chan, label):
+    sent = 0
+    done = 0
+    bad = 0
+    chan.params = None
+    start = time.time()
+    while done < COUNT:
+        while sent < COUNT and sent - done < WINDOW:
+            chan.message("%s%d" % (label, sent), "extbench", PARAMS)
+            sent += 1
+        chan.flush()
+        for kind, mid, name in chan.read():
+            if kind == "M":
+                chan.message(mid, "", [("handled", "extbench")], True)
+            elif kind == "A":
+                done += 1
+                # the first answer must carry what we sent and what the handler set
+                if done == 1 and (name != "extbench" or chan.params is None or
+                                  any(p not in chan.params for p in PARAMS + [("handled", "extbench")])):
+                    bad += 1
+        chan.flush()
+    if bad:
+        chan.line("%%>output:extbench: " + label + " answer differs from the sent message!")
+    return COUNT / (time.time() - start)
+
+
+def wait_for(chan, prefix):
+    while True:
+        for kind, mid, name in chan.read():
+            if kind.startswith(prefix):
+                return kind
+
+
+def main():
+    chan = Channel()
+    chan.line("%%>setlocal:reenter:true")
+    chan.line("%%>setlocal:bufsize:65536")
+    chan.line("%%>install:100:extbench")
+    chan.flush()
+    wait_for(chan, "%%<install:")
+    text = run(chan, "t")
+    chan.line("%%>setlocal:framing:binary")
+    chan.flush()
+    chan.framed_out = True
+    if not wait_for(chan, "%%<setlocal:framing:").endswith(":true"):
+        chan.line("%%>output:extbench: binary framing not supported")
+        chan.flush()
+        return
+    binary = run(chan, "b")
+    chan.line("%%>uninstall:extbench")
+    chan.line("%%%%>output:extbench: %d messages, text %d msg/s, binary %d msg/s" %
+              (COUNT, text, binary))
+    chan.flush()
+    try:
+        while True:
+            chan.read()
+    except EOFError:
+        pass
+
+
+if __name__ == "__main__":
+    main()
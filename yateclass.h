@@ -5768,7 +5768,9 @@ public:
 	{ append(value); return *this; }
 
     /**
-     * Convert data from a different format
+     * Convert data from a different format.
+     * The memory already held by this block is reused if large enough so a
+     *  block kept between calls converts without allocating
      * @param src Source data block
      * @param sFormat Name of the source format
      * @param dFormat Name of the destination format
@@ -6292,6 +6294,22 @@ public:
      */
     static bool fips186prf(DataBlock& out, const DataBlock& seed, unsigned int len);
 
+    /**
+     * Compute a HMAC from two digests already updated with the key XORed
+     *  with the inner and outer pads. The pad digests are left unchanged and
+     *  no memory is allocated so this is suitable for per packet use
+     * @param out Buffer to receive the 20 octets of the HMAC
+     * @param ipad Digest updated with the inner pad, must not be finalized
+     * @param opad Digest updated with the outer pad, must not be finalized
+     * @param buf Pointer to the message
+     * @param len Length of the message
+     * @param extra Optional data to append to the message
+     * @param extraLen Length of the appended data
+     * @return True on success, false if a pad digest is not usable
+     */
+    static bool hmacPads(unsigned char* out, const SHA1& ipad, const SHA1& opad,
+	const void* buf, unsigned int len, const void* extra = 0, unsigned int extraLen = 0);
+
 protected:
     bool updateInternal(const void* buf, unsigned int len);
 
@@ -6455,9 +6473,16 @@ public:
 };
 
 class NamedIterator;
+class NamedListIndex;
 
 /**
- * This class holds a named list of named strings
+ * This class holds a named list of named strings.
+ * Lists with many parameters build on demand a hash index for looking up
+ *  parameters by name. The index is kept by the methods of this class, it is
+ *  dropped when the list is accessed through the non-const @ref paramList()
+ *  so callers only reading the list should use the const one
+ * A structure stamp obtained by @ref shape() lets callers cache the list
+ *  nodes holding parameters for as long as no parameter is added or removed
  * @short A named string container class
  */
 class YATE_API NamedList : public String
@@ -6491,6 +6516,11 @@ public:
      */
     NamedList& operator=(const NamedList& value);
 
+    /**
+     * Destructor
+     */
+    virtual ~NamedList();
+
     /**
      * Get a pointer to a derived class given that class name
      * @param name Name of the class we are asking for
@@ -6516,7 +6546,7 @@ public:
      * Clear all parameters
      */
     inline void clearParams()
-	{ m_params.clear(); }
+	{ resetIndex(); m_params.clear(); }
 
     /**
      * Add a named string to the parameter list.
@@ -6525,6 +6555,15 @@ public:
      */
     NamedList& addParam(NamedString* param);
 
+    /**
+     * Add a named string to the parameter list, the end of the list is searched
+     *  starting from a node known to be in the list
+     * @param param Parameter to add
+     * @param node Node of this list close to its end, NULL to search from start
+     * @return The list node holding the added parameter, NULL if param was NULL
+     */
+    const ObjList* addParamNode(NamedString* param, const ObjList* node = 0);
+
     /**
      * Add a named string to the parameter list.
      * @param name Name of the new string
@@ -6762,6 +6801,16 @@ public:
      */
     NamedList& clearParam(NamedString* param, bool delParam = true);
 
+    /**
+     * Remove the parameter held by a list node obtained from @ref getParamNode().
+     * The lookup index is kept. The parameter that followed in list moves into
+     *  the node so a node kept by caller for that parameter must be updated
+     * @param node List node holding the parameter to remove
+     * @param delParam True to destroy the parameter
+     * @return The removed parameter, NULL if destroyed or node was empty
+     */
+    NamedString* clearParamNode(const ObjList* node, bool delParam = true);
+
     /**
      * Copy a parameter from another NamedList, clears it if not present there
      * @param original NamedList to copy the parameter from
@@ -6845,6 +6894,24 @@ public:
      */
     NamedString* getParam(const String& name) const;
 
+    /**
+     * Locate the list node holding a named string.
+     * The node keeps holding the parameter while @ref shape() is unchanged,
+     *  even if the parameter is replaced by @ref setParam()
+     * @param name Name of parameter to locate
+     * @return A pointer to the list node or NULL.
+     */
+    const ObjList* getParamNode(const String& name) const;
+
+    /**
+     * Get the stamp of the current structure of the list.
+     * Stamps are never shared by two lists, a new one is handed out after
+     *  parameters are added, removed or renamed. Changing the value of a
+     *  parameter, in place or by @ref setParam(), keeps the stamp
+     * @return Nonzero structure stamp, stamps are 64 bit and never reused
+     */
+    u_int64_t shape() const;
+
     /**
      * Locate a named string in the parameter list.
      * @param index Index of the parameter to locate
@@ -6957,11 +7024,13 @@ public:
     static const NamedList& empty();
 
     /**
-     * Get the parameters list
+     * Get the parameters list.
+     * This drops the parameters index and structure stamp as the list may be
+     *  changed by caller
      * @return Pointer to the parameters list
      */
     inline ObjList* paramList()
-	{ return &m_params; }
+	{ resetIndex(); return &m_params; }
 
     /**
      * Get the parameters list
@@ -6970,9 +7039,21 @@ public:
     inline const ObjList* paramList() const
 	{ return &m_params; }
 
+    /**
+     * Drop the parameters lookup index and structure stamp, they will be
+     *  rebuilt when needed.
+     * Must be called after changing in place the name of parameters in list
+     */
+    inline void resetIndex()
+	{ m_shape = 0; if (m_index) dropIndex(); }
+
 private:
     NamedList(); // no default constructor please
+    void dropIndex();
+    void indexParam(const ObjList* node);
     ObjList m_params;
+    mutable NamedListIndex* m_index;
+    mutable u_int64_t m_shape;
 };
 
 /**
@@ -10521,6 +10602,30 @@ public:
      */
     int recvFrom(void* buffer, int length, SocketAddr& addr, int flags = 0);
 
+    /**
+     * Receive multiple datagrams from a connected or unconnected socket using as
+     *  few system calls as possible. Datagrams rejected by filters are dropped
+     * @param buffers Array of buffers for data transfer
+     * @param lengths Array of buffer lengths, set to the length of received data on return
+     * @param count Number of buffers in the arrays
+     * @param addrs Optional array to fill in with the address of each incoming datagram
+     * @param flags Operating system specific bit flags that change the behaviour
+     * @return Number of datagrams received, @ref socketError() if an error occurred
+     */
+    int recvFromBatch(void** buffers, int* lengths, int count, SocketAddr* addrs = 0, int flags = 0);
+
+    /**
+     * Send multiple datagrams to the same address using as few system calls as possible
+     * @param buffers Array of buffers holding the datagrams to send
+     * @param lengths Array of datagram lengths
+     * @param count Number of datagrams in the arrays
+     * @param addr Address to send the datagrams to
+     * @param flags Operating system specific bit flags that change the behaviour
+     * @return Number of datagrams sent, @ref socketError() if an error occurred
+     */
+    int sendToBatch(const void* const* buffers, const int* lengths, int count,
+	const SocketAddr& addr, int flags = 0);
+
     /**
      * Receive a message from a connected socket
      * @param buffer Buffer for data transfer
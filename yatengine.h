@@ -369,7 +369,9 @@ private:
 };
 
 class MessageDispatcher;
+class MessageHandler;
 class MessageRelay;
+class MessageRing;
 class Engine;
 
 /**
@@ -476,6 +478,21 @@ public:
      */
     void resetMsg(Time tm = Time::now());
 
+    /**
+     * Suspend dispatching of a message taken from the engine queue.
+     * Can be called only from a handler that then returns false, dispatching
+     *  is continued with the next handler by a call to @ref Engine::resume()
+     * @return True if dispatching was suspended, false if the message is
+     *  dispatched synchronously and the handler must process it in place
+     */
+    bool defer();
+
+    /**
+     * Check if the handler currently processing the message can suspend it
+     * @return True if a call to defer() will succeed
+     */
+    bool deferrable() const;
+
     /**
      * Retrieve a reference to the creation time of the message.
      * @return A reference to the @ref Time when the message was created
@@ -583,6 +600,12 @@ private:
     RefObject* m_data;
     bool m_notify;
     bool m_broadcast;
+    volatile int m_queued;
+    volatile int m_defer;
+    bool m_deferRetv;
+    bool m_deferHandled;
+    unsigned int m_deferPrio;
+    const MessageHandler* m_deferAfter;
     void commonEncode(String& str) const;
     int commonDecode(const char* str, int offs);
 };
@@ -846,6 +869,7 @@ class YATE_API MessagePostHook : public RefObject, public MessageNotifier
 class YATE_API MessageDispatcher : public GenObject
 {
     friend class Engine;
+    friend class EnginePrivate;
     YNOCOPY(MessageDispatcher); // no automatic copies please
 public:
     /**
@@ -945,7 +969,7 @@ public:
      * @return True if the queue holds at least one message
      */
     inline bool hasMessages() const
-	{ return m_messages.get() || m_messages.next(); }
+	{ return m_enqueueCount != m_dequeueCount; }
 
     /**
      * Check if there is at least one handler installed
@@ -1058,7 +1082,17 @@ protected:
 	{ m_trackParam = paramName; }
 
 private:
+    bool markQueued(Message* msg);
+    void pushQueued(Message* msg);
+    void dispatchQueued(Message* msg);
+    bool dispatchResumed(Message* msg);
+    void dispatchOwned(Message* msg);
+    bool dispatchInternal(Message& msg, bool& parked);
+    int resumeDeferred(Message* msg, bool handled);
     ObjList m_handlers;
+    HashList m_handlersByName;
+    ObjList m_handlersAny;
+    MessageRing* m_ring;
     ObjList m_messages;
     ObjList m_hooks;
     RWLock m_handlersLock;
@@ -1068,9 +1102,10 @@ private:
     ObjList* m_hookAppend;
     String m_trackParam;
     unsigned int m_changes;
+    volatile unsigned int m_overflow;
     u_int64_t m_warnTime;
-    u_int64_t m_enqueueCount;
-    u_int64_t m_dequeueCount;
+    volatile u_int64_t m_enqueueCount;
+    volatile u_int64_t m_dequeueCount;
     u_int64_t m_dispatchCount;
     u_int64_t m_queuedMax;
     u_int64_t m_msgAvgAge;
@@ -1645,6 +1680,15 @@ public:
      */
     static bool enqueue(Message* msg, bool skipHooks = false);
 
+    /**
+     * Continue dispatching a message suspended by @ref Message::defer()
+     * The remaining handlers are called from an engine worker thread
+     * @param msg The suspended message, it is destroyed after dispatching
+     * @param handled True if the handler that suspended the message handled it
+     * @return True if dispatching was resumed, false if the message was not suspended
+     */
+    static bool resume(Message* msg, bool handled);
+
     /**
      * Convenience function.
      * Enqueue a new parameterless message in the message queue
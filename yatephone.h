@@ -390,6 +390,8 @@ class DataSource;
 class DataTranslator;
 class TranslatorFactory;
 class ThreadedSourcePrivate;
+class DataConsumerSet;
+class MediaPump;
 
 /**
  * A data consumer
@@ -485,7 +487,8 @@ public:
      */
     inline explicit DataSource(const char* format = "slin")
 	: DataNode(format), Mutex(false,"DataSource"),
-	  m_nextStamp(invalidStamp()), m_translator(0) { }
+	  m_nextStamp(invalidStamp()), m_translator(0),
+	  m_snapshot(0), m_snapLock(0) { }
 
     /**
      * Source's destruct notification - detaches all consumers
@@ -513,7 +516,9 @@ public:
     virtual bool control(NamedList& params);
 
     /**
-     * Forwards the data to its consumers
+     * Forwards the data to its consumers.
+     * Works on a snapshot of the consumers so it never waits for
+     *  consumers being attached or detached from other threads
      * @param data The raw data block to forward
      * @param tStamp Timestamp of data - typically samples
      * @param flags Indicator flags associated with the data block
@@ -531,14 +536,16 @@ public:
     bool attach(DataConsumer* consumer, bool override = false);
 
     /**
-     * Detach a data consumer
+     * Detach a data consumer.
+     * Waits until other threads forwarding data finish consuming it
      * @param consumer Data consumer to detach
      * @return True on success, false on failure
      */
     bool detach(DataConsumer* consumer);
 
     /**
-     * Detach all data consumers
+     * Detach all data consumers.
+     * Waits until other threads forwarding data finish consuming them
      */
     void clear();
 
@@ -571,16 +578,23 @@ private:
 	    m_translator = translator;
 	}
     bool detachInternal(DataConsumer* consumer);
+    void publish();
+    bool retire();
+    void drain();
     DataTranslator* m_translator;
+    DataConsumerSet* m_snapshot;
+    ObjList m_retired;
+    volatile int m_snapLock;
 };
 
 /**
- * A data source with a thread of its own
+ * A data source with a thread of its own or served by a shared pacing thread
  * @short Data source with own thread
  */
 class YATE_API ThreadedSource : public DataSource
 {
     friend class ThreadedSourcePrivate;
+    friend class MediaPump;
 public:
     /**
      * The destruction notification, checks that the thread is gone
@@ -596,7 +610,16 @@ public:
     bool start(const char* name = "ThreadedSource", Thread::Priority prio = Thread::Normal);
 
     /**
-     * Stops and destroys the worker thread if running
+     * Starts serving the source from the shared pool of pacing threads
+     *  instead of a thread of its own. The source must implement runFrame()
+     * @param interval Interval between frames in microseconds
+     * @param runConsumers True to keep running as long consumers are attached
+     * @return True if started, false if an error occured
+     */
+    bool startPaced(unsigned int interval, bool runConsumers = false);
+
+    /**
+     * Stops and destroys the worker thread if running or stops being paced
      */
     void stop();
 
@@ -608,17 +631,26 @@ public:
 
     /**
      * Check if the data thread is running
-     * @return True if the data thread was started and is running
+     * @return True if the data thread was started and is running or the
+     *  source is served by a pacing thread
      */
     bool running() const;
 
+    /**
+     * Check if the source is served by a shared pacing thread
+     * @return True if the source was started paced and was not stopped
+     */
+    inline bool paced() const
+	{ return m_paced; }
+
 protected:
     /**
      * Threaded Source constructor
      * @param format Name of the data format, default "slin" (Signed Linear)
      */
     inline explicit ThreadedSource(const char* format = "slin")
-	: DataSource(format), m_thread(0)
+	: DataSource(format), m_thread(0),
+	  m_pump(0), m_paced(false), m_runConsumers(false)
 	{ }
 
     /**
@@ -626,6 +658,13 @@ protected:
      */
     virtual void run() = 0;
 
+    /**
+     * Produce and forward one frame, called from a pacing thread.
+     * Must not block as the pacing thread serves other sources too
+     * @return True to be called again after the frame interval, false to stop
+     */
+    virtual bool runFrame();
+
     /**
      * The cleanup after thread method, deletes the source if already
      *  dereferenced and set for asynchronous deletion
@@ -640,7 +679,11 @@ protected:
     bool looping(bool runConsumers = false) const;
 
 private:
+    bool pacing() const;
     ThreadedSourcePrivate* m_thread;
+    MediaPump* m_pump;
+    bool m_paced;
+    bool m_runConsumers;
 };
 
 /**
@@ -823,6 +866,7 @@ private:
     DataTranslator(); // No default constructor please
     static void compose();
     static void compose(TranslatorFactory* factory);
+    static void update();
     static bool canConvert(const FormatInfo* fmt1, const FormatInfo* fmt2);
     DataSource* m_tsource;
     static Mutex s_mutex;
@@ -1659,6 +1703,7 @@ class YATE_API Channel : public CallEndpoint, public DebugEnabler, public Messag
 {
     friend class Driver;
     friend class Router;
+    friend class ChannelTimers;
     YNOCOPY(Channel); // no automatic copies please
 private:
     NamedList m_parameters;
@@ -1668,6 +1713,9 @@ private:
     u_int64_t m_timeout;
     u_int64_t m_maxcall;
     u_int64_t m_maxPDD;          // Timeout while waiting for some progress on outgoing calls
+    u_int64_t m_timerWhen;       // Time the channel is armed in the timer wheel
+    Channel* m_timerNext;
+    Channel** m_timerPrev;
     u_int64_t m_dtmfTime;
     unsigned int m_toutAns;
     unsigned int m_dtmfSeq;
@@ -1821,12 +1869,21 @@ public:
     virtual bool msgControl(Message& msg);
 
     /**
-     * Timer check method, by default handles channel timeouts
+     * Timer check method, by default handles channel timeouts.
+     * It is called from the engine's timer wheel only when a time requested
+     *  by armTimer() is reached, not periodically for every channel
      * @param msg Timer message
      * @param tmr Current time against which timers are compared
      */
     virtual void checkTimers(Message& msg, const Time& tmr);
 
+    /**
+     * Make sure checkTimers() is called not later than a specific time.
+     * Derived classes that keep their own timers must call this when setting them
+     * @param when Time in microseconds to check timers at, zero to do nothing
+     */
+    void armTimer(u_int64_t when);
+
     /**
      * Notification on progress of prerouting incoming call
      * @param msg Notification call.preroute message just after being dispatched
@@ -1954,7 +2011,7 @@ public:
      * @param tout New timeout time or zero to disable
      */
     inline void timeout(u_int64_t tout)
-	{ m_timeout = tout; }
+	{ m_timeout = tout; armTimer(tout); }
 
     /**
      * Get the time this channel will time out on outgoing calls
@@ -1968,7 +2025,7 @@ public:
      * @param tout New timeout time or zero to disable
      */
     inline void maxcall(u_int64_t tout)
-	{ m_maxcall = tout; }
+	{ m_maxcall = tout; armTimer(tout); }
 
     /**
      * Set the time this channel will time out on outgoing calls
@@ -1999,7 +2056,7 @@ public:
      * @param tout New timeout time or zero to disable
      */
     inline void maxPDD(u_int64_t tout)
-	{ m_maxPDD = tout; }
+	{ m_maxPDD = tout; armTimer(tout); }
 
     /**
      * Set the time this channel will time out while waiting for some progress
@@ -2239,12 +2296,14 @@ class YATE_API Driver : public Module
 {
     friend class Router;
     friend class Channel;
+    friend class ChannelTimers;
 
 private:
     bool m_init;
     bool m_varchan;
     String m_prefix;
     ObjList m_chans;
+    HashList m_chanIndex;
     int m_routing;
     int m_routed;
     int m_total;